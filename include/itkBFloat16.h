@@ -0,0 +1,217 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkBFloat16_h
+#define itkBFloat16_h
+
+#include "itkFixedArray.h"
+#include "itkIntTypes.h"
+#include "itkMacro.h"
+#include "itkNumericTraits.h"
+
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace itk
+{
+/** \class BFloat16
+ *
+ * \brief Brain floating point (bfloat16) storage pixel type.
+ *
+ * BFloat16 is the upper half of an IEEE 754 float (1 sign, 8 exponent and
+ * 7 mantissa bits). Compared with Float16 it trades precision (~2 significant
+ * digits) for the full float range, so unnormalised intensities cannot
+ * overflow. As with Float16, it is a storage type only and all arithmetic
+ * is done in float.
+ *
+ * \sa Float16
+ * \ingroup ITKCSIROTomo
+ */
+    class BFloat16
+    {
+    public:
+        typedef uint16_t            StorageType;
+
+        BFloat16()
+            : m_Bits( 0 )
+        {
+        }
+
+        /** Conversion from any arithmetic type, rounding to nearest even */
+        template< typename T >
+        BFloat16( const T & value )
+            : m_Bits( FloatToBits( static_cast< float >( value ) ) )
+        {
+        }
+
+        operator float() const
+        {
+            return BitsToFloat( m_Bits );
+        }
+
+        BFloat16 & operator+=( float flt ) { return *this = BFloat16( BitsToFloat( m_Bits ) + flt ); }
+        BFloat16 & operator-=( float flt ) { return *this = BFloat16( BitsToFloat( m_Bits ) - flt ); }
+        BFloat16 & operator*=( float flt ) { return *this = BFloat16( BitsToFloat( m_Bits ) * flt ); }
+        BFloat16 & operator/=( float flt ) { return *this = BFloat16( BitsToFloat( m_Bits ) / flt ); }
+
+        BFloat16 operator-() const { return FromBits( m_Bits ^ 0x8000 ); }
+
+        StorageType GetBits() const { return m_Bits; }
+
+        static BFloat16 FromBits( StorageType uintBits )
+        {
+            BFloat16 value;
+            value.m_Bits = uintBits;
+            return value;
+        }
+
+        static StorageType FloatToBits( float flt )
+        {
+            uint32_t uintFloat;
+            std::memcpy( &uintFloat, &flt, sizeof( uintFloat ) );
+
+            // Keep NaNs quiet, truncation could otherwise turn them into infinity
+            if( ( uintFloat & 0x7fffffff ) > 0x7f800000 )
+                return static_cast< StorageType >( ( uintFloat >> 16 ) | 0x40 );
+
+            // Round to nearest even
+            uintFloat += 0x7fff + ( ( uintFloat >> 16 ) & 1 );
+
+            return static_cast< StorageType >( uintFloat >> 16 );
+        }
+
+        static float BitsToFloat( StorageType uintBits )
+        {
+            const uint32_t uintFloat( static_cast< uint32_t >( uintBits ) << 16 );
+
+            float flt;
+            std::memcpy( &flt, &uintFloat, sizeof( flt ) );
+            return flt;
+        }
+
+    private:
+        StorageType                 m_Bits;
+    };
+
+    inline std::ostream & operator<<( std::ostream & os, const BFloat16 & value )
+    {
+        return os << static_cast< float >( value );
+    }
+
+    inline std::istream & operator>>( std::istream & is, BFloat16 & value )
+    {
+        float flt;
+        if( is >> flt )
+            value = BFloat16( flt );
+        return is;
+    }
+}
+
+namespace std
+{
+    /** Limits of bfloat16, so that the type satisfies the floating
+     * point concept checks of ITK */
+    template<>
+    class numeric_limits< itk::BFloat16 >
+    {
+    public:
+        static const bool is_specialized = true;
+        static const bool is_signed = true;
+        static const bool is_integer = false;
+        static const bool is_exact = false;
+        static const bool has_infinity = true;
+        static const bool has_quiet_NaN = true;
+        static const bool has_signaling_NaN = false;
+        static const bool is_iec559 = true;
+        static const bool is_bounded = true;
+        static const bool is_modulo = false;
+        static const int digits = 8;
+        static const int digits10 = 2;
+        static const int max_digits10 = 4;
+        static const int radix = 2;
+        static const int min_exponent = -125;
+        static const int min_exponent10 = -37;
+        static const int max_exponent = 128;
+        static const int max_exponent10 = 38;
+        static const float_round_style round_style = round_to_nearest;
+
+        static itk::BFloat16 min() { return itk::BFloat16::FromBits( 0x0080 ); }
+        static itk::BFloat16 lowest() { return itk::BFloat16::FromBits( 0xff7f ); }
+        static itk::BFloat16 max() { return itk::BFloat16::FromBits( 0x7f7f ); }
+        static itk::BFloat16 epsilon() { return itk::BFloat16::FromBits( 0x3c00 ); }
+        static itk::BFloat16 round_error() { return itk::BFloat16::FromBits( 0x3f00 ); }
+        static itk::BFloat16 infinity() { return itk::BFloat16::FromBits( 0x7f80 ); }
+        static itk::BFloat16 quiet_NaN() { return itk::BFloat16::FromBits( 0x7fc0 ); }
+        static itk::BFloat16 signaling_NaN() { return itk::BFloat16::FromBits( 0x7fa0 ); }
+        static itk::BFloat16 denorm_min() { return itk::BFloat16::FromBits( 0x0001 ); }
+    };
+}
+
+namespace itk
+{
+    /** \class NumericTraits<BFloat16>
+     * \brief Traits of the bfloat16 storage type, accumulating and
+     * computing in float
+     * \ingroup ITKCSIROTomo
+     */
+    template<>
+    class NumericTraits< BFloat16 > : public std::numeric_limits< BFloat16 >
+    {
+    public:
+        typedef BFloat16                    ValueType;
+        typedef BFloat16                    AbsType;
+        typedef float                       PrintType;
+        typedef float                       AccumulateType;
+        typedef float                       FloatType;
+        typedef float                       RealType;
+        typedef float                       ScalarRealType;
+        typedef FixedArray< ValueType, 1 >  MeasurementVectorType;
+
+        static const bool IsSigned = true;
+        static const bool IsInteger = false;
+        static const bool IsComplex = false;
+
+        static ValueType min() { return ValueType::FromBits( 0x0080 ); }
+        static ValueType max() { return ValueType::FromBits( 0x7f7f ); }
+        static ValueType min( ValueType ) { return min(); }
+        static ValueType max( ValueType ) { return max(); }
+        static ValueType NonpositiveMin() { return ValueType::FromBits( 0xff7f ); }
+        static ValueType ZeroValue() { return ValueType(); }
+        static ValueType OneValue() { return ValueType::FromBits( 0x3f80 ); }
+        static ValueType ZeroValue( const ValueType & ) { return ZeroValue(); }
+        static ValueType OneValue( const ValueType & ) { return OneValue(); }
+
+        static bool IsPositive( ValueType val ) { return static_cast< float >( val ) > 0.0f; }
+        static bool IsNonpositive( ValueType val ) { return static_cast< float >( val ) <= 0.0f; }
+        static bool IsNegative( ValueType val ) { return static_cast< float >( val ) < 0.0f; }
+        static bool IsNonnegative( ValueType val ) { return static_cast< float >( val ) >= 0.0f; }
+
+        static unsigned int GetLength( const ValueType & ) { return 1; }
+        static unsigned int GetLength() { return 1; }
+        static void SetLength( ValueType &, const unsigned int s )
+        {
+            if( s != 1 )
+                itkGenericExceptionMacro( << "Cannot set the size of a scalar to " << s );
+        }
+        static ValueType ZeroValue( const ValueType &, unsigned int ) { return ZeroValue(); }
+        template< typename TArray >
+        static void AssignToArray( const ValueType & v, TArray & mv ) { mv = v; }
+    };
+}
+
+#endif // itkBFloat16_h
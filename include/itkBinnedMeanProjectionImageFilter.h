@@ -0,0 +1,149 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkBinnedMeanProjectionImageFilter_h
+#define itkBinnedMeanProjectionImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class BinnedMeanProjectionImageFilter
+ *
+ * \brief Averages a series of frames and bins the average in one pass.
+ *
+ * With an input of one dimension more than the output, the input is a series
+ * of frames along its last axis, e.g. darks or flats read by an
+ * ImageSeriesReader, and the output is their average. With an input of the
+ * output dimension the input is a single frame. Either way the output is
+ * binned by BinningFactor along every axis, each pixel the mean of a
+ * BinningFactor^N block of input pixels, trailing pixels that do not fill a
+ * block dropped. With a factor of 1 the filter is a MeanProjectionImageFilter
+ * along the last axis.
+ *
+ * The output spacing is the input spacing times the factor and its origin the
+ * physical centre of the first block, so that physical positions, such as the
+ * vertical shift and trim points of VerticalStitchingImageFilter, select the
+ * same part of the detector at any binning.
+ *
+ * The frames are requested from the input NumberOfFramesPerChunk at a time and
+ * accumulated as they arrive, so when the input streams, as an
+ * ImageSeriesReader does along the series, only a chunk of full resolution
+ * frames is held at once rather than the whole series.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TInputImage, typename TOutputImage >
+    class ITK_TEMPLATE_EXPORT BinnedMeanProjectionImageFilter : public ImageToImageFilter< TInputImage, TOutputImage >
+    {
+    public:
+        typedef BinnedMeanProjectionImageFilter                     Self;
+        typedef ImageToImageFilter< TInputImage, TOutputImage >     Superclass;
+        typedef SmartPointer< Self >                                Pointer;
+        typedef SmartPointer< const Self >                          ConstPointer;
+
+        itkStaticConstMacro( InputImageDimension, unsigned int, TInputImage::ImageDimension );
+        itkStaticConstMacro( OutputImageDimension, unsigned int, TOutputImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(BinnedMeanProjectionImageFilter, ImageToImageFilter)
+
+        /** Image related typedefs. */
+        typedef TInputImage                                         InputImageType;
+        typedef TOutputImage                                        OutputImageType;
+        typedef typename InputImageType::PixelType                  InputPixelType;
+        typedef typename OutputImageType::PixelType                 OutputPixelType;
+        typedef typename InputImageType::IndexType                  InputIndexType;
+        typedef typename InputImageType::RegionType                 InputImageRegionType;
+        typedef typename OutputImageType::IndexType                 OutputIndexType;
+        typedef typename OutputImageType::RegionType                OutputImageRegionType;
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( SameDimensionOrMinusOneCheck, ( Concept::SameDimensionOrMinusOne< InputImageDimension, OutputImageDimension > ) );
+        itkConceptMacro( DoubleConvertibleToOutputCheck, ( Concept::Convertible< double, OutputPixelType > ) );
+    #endif
+
+        /** Pixels binned along each axis of the output */
+        itkSetClampMacro( BinningFactor, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( BinningFactor, unsigned int )
+
+        /** Frames requested from the input at a time */
+        itkSetClampMacro( NumberOfFramesPerChunk, SizeValueType, 1, NumericTraits< SizeValueType >::max() )
+        itkGetConstMacro( NumberOfFramesPerChunk, SizeValueType )
+
+        /** Maximum number of progress events per chunk */
+        itkSetMacro( NumberOfProgressUpdates, unsigned int )
+        itkGetConstMacro( NumberOfProgressUpdates, unsigned int )
+
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+    protected:
+        BinnedMeanProjectionImageFilter();
+        virtual ~BinnedMeanProjectionImageFilter() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        virtual void GenerateOutputInformation() ITK_OVERRIDE;
+
+        /** The blocks of the output requested region over the first chunk of
+         * frames, the following chunks being requested by GenerateData() */
+        virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+        virtual void GenerateData() ITK_OVERRIDE;
+
+        /** Accumulates the current chunk of frames over rows of the output */
+        void ThreadedAccumulate( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+        static ITK_THREAD_RETURN_TYPE AccumulateThreaderCallback( void * pArg );
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(BinnedMeanProjectionImageFilter);
+
+        /** Input blocks of an output region over a range of frames */
+        InputImageRegionType ComputeInputRegion( const OutputImageRegionType & regionOutput, IndexValueType intFirstFrame, SizeValueType uintNumFrames ) const;
+
+        /** Frames of the input series, along its last axis */
+        void GetFrameRange( IndexValueType & intFirstFrame, SizeValueType & uintNumFrames ) const;
+
+        unsigned int                                m_BinningFactor;
+        SizeValueType                               m_NumberOfFramesPerChunk;
+        unsigned int                                m_NumberOfProgressUpdates;
+
+        // Sums of the chunks accumulated so far over the output requested
+        // region, written out scaled with the last chunk
+        std::vector< double >                       m_Sums;
+        InputImageRegionType                        m_ChunkRegion;
+        double                                      m_Divisor;
+        bool                                        m_LastChunk;
+
+        ChunkedProgressCounter                      m_ProgressCounter;
+        float                                       m_InitialProgress;
+        float                                       m_ProgressWeight;
+        FilterInstrumentation::Pointer              m_Instrumentation;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkBinnedMeanProjectionImageFilter.hxx"
+#endif
+
+#endif // itkBinnedMeanProjectionImageFilter_h
@@ -0,0 +1,316 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkBinnedMeanProjectionImageFilter_hxx
+#define itkBinnedMeanProjectionImageFilter_hxx
+
+#include "itkBinnedMeanProjectionImageFilter.h"
+
+#include "itkImageScanlineConstIterator.h"
+#include "itkImageRegionSplitterSlowDimension.h"
+#include "itkContinuousIndex.h"
+#include "itkMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+    template< typename TInputImage, typename TOutputImage >
+    BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::BinnedMeanProjectionImageFilter()
+        : m_BinningFactor( 1 )
+        , m_NumberOfFramesPerChunk( 16 )
+        , m_NumberOfProgressUpdates( 100 )
+        , m_Divisor( 1.0 )
+        , m_LastChunk( true )
+        , m_InitialProgress( 0.0f )
+        , m_ProgressWeight( 1.0f )
+        , m_Instrumentation( FilterInstrumentation::New() )
+    {
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "BinningFactor: " << m_BinningFactor << std::endl;
+        os << indent << "NumberOfFramesPerChunk: " << m_NumberOfFramesPerChunk << std::endl;
+        os << indent << "NumberOfProgressUpdates: " << m_NumberOfProgressUpdates << std::endl;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::GetFrameRange( IndexValueType & intFirstFrame, SizeValueType & uintNumFrames ) const
+    {
+        if( InputImageDimension > OutputImageDimension )
+        {
+            const InputImageRegionType & regionInput( this->GetInput()->GetLargestPossibleRegion() );
+            intFirstFrame = regionInput.GetIndex( InputImageDimension - 1 );
+            uintNumFrames = regionInput.GetSize( InputImageDimension - 1 );
+        }
+        else
+        {
+            intFirstFrame = 0;
+            uintNumFrames = 1;
+        }
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    typename BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::InputImageRegionType
+    BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::ComputeInputRegion( const OutputImageRegionType & regionOutput, IndexValueType intFirstFrame, SizeValueType uintNumFrames ) const
+    {
+        InputImageRegionType regionInput;
+
+        for( unsigned int j = 0; j < OutputImageDimension; j++ )
+        {
+            regionInput.SetIndex( j, regionOutput.GetIndex( j ) * static_cast< IndexValueType >( m_BinningFactor ) );
+            regionInput.SetSize( j, regionOutput.GetSize( j ) * m_BinningFactor );
+        }
+
+        if( InputImageDimension > OutputImageDimension )
+        {
+            regionInput.SetIndex( InputImageDimension - 1, intFirstFrame );
+            regionInput.SetSize( InputImageDimension - 1, uintNumFrames );
+        }
+
+        return regionInput;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::GenerateOutputInformation()
+    {
+        const InputImageType * pInput( this->GetInput() );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        if( !pInput || !pOutput )
+            return;
+
+        const InputImageRegionType & regionInput( pInput->GetLargestPossibleRegion() );
+        const typename InputImageType::SpacingType & spacingInput( pInput->GetSpacing() );
+        const typename InputImageType::DirectionType & directionInput( pInput->GetDirection() );
+
+        const double dblFactor( static_cast< double >( m_BinningFactor ) );
+
+        OutputImageRegionType regionOutput;
+        typename OutputImageType::SpacingType spacingOutput;
+        typename OutputImageType::DirectionType directionOutput;
+        ContinuousIndex< double, InputImageDimension > indexOrigin;
+        indexOrigin.Fill( 0.0 );
+
+        for( unsigned int j = 0; j < OutputImageDimension; j++ )
+        {
+            // Blocks aligned to multiples of the factor in index space, those
+            // only partly within the input dropped
+            const IndexValueType intFirstBlock( Math::Ceil< IndexValueType >( regionInput.GetIndex( j ) / dblFactor ) );
+            const IndexValueType intEndBlock( Math::Floor< IndexValueType >( ( regionInput.GetIndex( j ) + static_cast< double >( regionInput.GetSize( j ) ) ) / dblFactor ) );
+
+            if( intEndBlock <= intFirstBlock )
+                itkExceptionMacro( "Binning factor " << m_BinningFactor << " exceeds the input size " << regionInput.GetSize() );
+
+            regionOutput.SetIndex( j, intFirstBlock );
+            regionOutput.SetSize( j, static_cast< SizeValueType >( intEndBlock - intFirstBlock ) );
+
+            spacingOutput[j] = spacingInput[j] * dblFactor;
+
+            for( unsigned int i = 0; i < OutputImageDimension; i++ )
+                directionOutput[i][j] = directionInput[i][j];
+
+            // Output index 0 at the centre of the block of input index 0
+            indexOrigin[j] = 0.5 * ( dblFactor - 1.0 );
+        }
+
+        typename InputImageType::PointType pointOrigin;
+        pInput->TransformContinuousIndexToPhysicalPoint( indexOrigin, pointOrigin );
+
+        typename OutputImageType::PointType originOutput;
+        for( unsigned int i = 0; i < OutputImageDimension; i++ )
+            originOutput[i] = pointOrigin[i];
+
+        pOutput->SetLargestPossibleRegion( regionOutput );
+        pOutput->SetSpacing( spacingOutput );
+        pOutput->SetOrigin( originOutput );
+        pOutput->SetDirection( directionOutput );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::GenerateInputRequestedRegion()
+    {
+        Superclass::GenerateInputRequestedRegion();
+
+        InputImageType * pInput( const_cast< InputImageType * >( this->GetInput() ) );
+
+        if( !pInput )
+            return;
+
+        IndexValueType intFirstFrame;
+        SizeValueType uintNumFrames;
+        GetFrameRange( intFirstFrame, uintNumFrames );
+
+        pInput->SetRequestedRegion( ComputeInputRegion( this->GetOutput()->GetRequestedRegion(), intFirstFrame, std::min( uintNumFrames, m_NumberOfFramesPerChunk ) ) );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::GenerateData()
+    {
+        InputImageType * pInput( const_cast< InputImageType * >( this->GetInput() ) );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        this->AllocateOutputs();
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        const OutputImageRegionType regionOutput( pOutput->GetRequestedRegion() );
+
+        IndexValueType intFirstFrame;
+        SizeValueType uintNumFrames;
+        GetFrameRange( intFirstFrame, uintNumFrames );
+
+        const SizeValueType uintNumChunks( ( uintNumFrames + m_NumberOfFramesPerChunk - 1 ) / m_NumberOfFramesPerChunk );
+
+        m_Sums.assign( regionOutput.GetNumberOfPixels(), 0.0 );
+        m_Divisor = uintNumFrames * std::pow( static_cast< double >( m_BinningFactor ), static_cast< double >( OutputImageDimension ) );
+
+        this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+        this->GetMultiThreader()->SetSingleMethod( this->AccumulateThreaderCallback, this );
+
+        for( SizeValueType c = 0; c < uintNumChunks; c++ )
+        {
+            const SizeValueType uintChunkStart( c * m_NumberOfFramesPerChunk );
+            m_ChunkRegion = ComputeInputRegion( regionOutput, intFirstFrame + static_cast< IndexValueType >( uintChunkStart ),
+                                                std::min( m_NumberOfFramesPerChunk, uintNumFrames - uintChunkStart ) );
+
+            // The first chunk was brought up to date by the pipeline, the
+            // following ones are requested in turn
+            if( c > 0 )
+            {
+                pInput->SetRequestedRegion( m_ChunkRegion );
+                pInput->PropagateRequestedRegion();
+                pInput->UpdateOutputData();
+            }
+
+            m_LastChunk = ( c + 1 == uintNumChunks );
+            m_InitialProgress = static_cast< float >( c ) / uintNumChunks;
+            m_ProgressWeight = 1.0f / uintNumChunks;
+            m_ProgressCounter.Initialize( regionOutput.GetNumberOfPixels(), m_NumberOfProgressUpdates );
+
+            this->GetMultiThreader()->SingleMethodExecute();
+        }
+
+        std::vector< double >().swap( m_Sums );
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::ThreadedAccumulate( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const InputImageType * pInput( this->GetInput() );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        // The output requested region split by rows
+        ImageRegionSplitterSlowDimension::Pointer pSplitter( ImageRegionSplitterSlowDimension::New() );
+
+        OutputImageRegionType regionThread( pOutput->GetRequestedRegion() );
+        if( threadId >= pSplitter->GetNumberOfSplits( regionThread, numberOfThreads ) )
+            return;
+        pSplitter->GetSplit( threadId, numberOfThreads, regionThread );
+
+        // support progress methods/callbacks, accounted once per scanline
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter, m_InitialProgress, m_ProgressWeight );
+
+        itkCSIROTomoScopedPhase( m_Instrumentation, threadId, Filtering );
+
+        const SizeValueType uintFactor( m_BinningFactor );
+        const SizeValueType uintLineLength( regionThread.GetSize( 0 ) );
+
+        // Input rows of a block, along every output axis but the first
+        SizeValueType uintBlockRows( 1 );
+        for( unsigned int j = 1; j < OutputImageDimension; j++ )
+            uintBlockRows *= uintFactor;
+
+        IndexValueType intFirstFrame( 0 );
+        SizeValueType uintNumFrames( 1 );
+        if( InputImageDimension > OutputImageDimension )
+        {
+            intFirstFrame = m_ChunkRegion.GetIndex( InputImageDimension - 1 );
+            uintNumFrames = m_ChunkRegion.GetSize( InputImageDimension - 1 );
+        }
+
+        ImageScanlineConstIterator< OutputImageType > itOutput( pOutput, regionThread );
+
+        for( itOutput.GoToBegin(); !itOutput.IsAtEnd(); itOutput.NextLine() )
+        {
+            const OutputIndexType indexOutput( itOutput.GetIndex() );
+            double * pSums( &m_Sums[pOutput->ComputeOffset( indexOutput )] );
+
+            InputIndexType indexBlock;
+            for( unsigned int j = 0; j < OutputImageDimension; j++ )
+                indexBlock[j] = indexOutput[j] * static_cast< IndexValueType >( uintFactor );
+
+            for( SizeValueType f = 0; f < uintNumFrames; f++ )
+            {
+                if( InputImageDimension > OutputImageDimension )
+                    indexBlock[InputImageDimension - 1] = intFirstFrame + static_cast< IndexValueType >( f );
+
+                for( SizeValueType b = 0; b < uintBlockRows; b++ )
+                {
+                    InputIndexType indexRow( indexBlock );
+                    SizeValueType uintRow( b );
+                    for( unsigned int j = 1; j < OutputImageDimension; j++ )
+                    {
+                        indexRow[j] += static_cast< IndexValueType >( uintRow % uintFactor );
+                        uintRow /= uintFactor;
+                    }
+
+                    const InputPixelType * pRow( pInput->GetBufferPointer() + pInput->ComputeOffset( indexRow ) );
+
+                    for( SizeValueType x = 0; x < uintLineLength; ++x )
+                    {
+                        double dblSum( 0.0 );
+                        for( SizeValueType k = 0; k < uintFactor; ++k )
+                            dblSum += static_cast< double >( pRow[x * uintFactor + k] );
+                        pSums[x] += dblSum;
+                    }
+                }
+            }
+
+            if( m_LastChunk )
+            {
+                OutputPixelType * pOutputLine( pOutput->GetBufferPointer() + pOutput->ComputeOffset( indexOutput ) );
+                for( SizeValueType x = 0; x < uintLineLength; ++x )
+                    pOutputLine[x] = static_cast< OutputPixelType >( pSums[x] / m_Divisor );
+            }
+
+            progress.CompletedPixels( uintLineLength );
+        }
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, regionThread.GetNumberOfPixels() * uintBlockRows * uintFactor * uintNumFrames );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    ITK_THREAD_RETURN_TYPE BinnedMeanProjectionImageFilter< TInputImage, TOutputImage >::AccumulateThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedAccumulate( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+}
+
+#endif // itkBinnedMeanProjectionImageFilter_hxx
@@ -0,0 +1,260 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkCSIROTomoInstrumentation_h
+#define itkCSIROTomoInstrumentation_h
+
+#include "itkEventObject.h"
+#include "itkIntTypes.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace itk
+{
+/** \class FilterInstrumentation
+ *
+ * \brief Per-thread timing and allocation statistics of a CSIROTomo filter.
+ *
+ * Every filter in this module owns a FilterInstrumentation object, returned by
+ * GetInstrumentation(). When the module is configured with
+ * ITKCSIROTomo_USE_INSTRUMENTATION the filters record, per thread, the time
+ * spent in each internal phase, the number of pixels processed, the number of
+ * medians computed and the bytes allocated for intermediate images, and
+ * invoke an InstrumentationEvent once an update has completed. Without the
+ * definition the recording macros expand to nothing and the statistics
+ * remain zero.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class FilterInstrumentation : public Object
+    {
+    public:
+        typedef FilterInstrumentation                       Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(FilterInstrumentation, Object)
+
+        /** Internal phases of the filters in this module. Phases are timed
+         * over a scanline or larger, the median filters gathering the
+         * neighborhoods of a line in one pass and selecting in another */
+        typedef enum
+        {
+            NeighborhoodGather = 0,
+            MedianSelection,
+            Weighting,
+            RegionCopy,
+            Blending,
+            Functor,
+            Filtering,
+            BackProjection,
+            NumberOfPhases
+        } PhaseType;
+
+        /** Statistics of a single thread, padded to avoid false sharing */
+        struct ThreadStatistics
+        {
+            ThreadStatistics()
+                : PixelsProcessed( 0 )
+                , MediansComputed( 0 )
+                , BytesAllocated( 0 )
+            {
+                for( unsigned int i = 0; i < NumberOfPhases; i++ )
+                    PhaseSeconds[i] = 0.0;
+            }
+
+            double          PhaseSeconds[NumberOfPhases];
+            SizeValueType   PixelsProcessed;
+            SizeValueType   MediansComputed;
+            SizeValueType   BytesAllocated;
+            char            Padding[64];
+        };
+
+        /** Clears all statistics and prepares slots for the passed number of threads */
+        void Initialize( ThreadIdType numberOfThreads )
+        {
+            m_ThreadStatistics.assign( std::max( numberOfThreads, static_cast< ThreadIdType >( 1 ) ), ThreadStatistics() );
+        }
+
+        ThreadIdType GetNumberOfThreads() const
+        {
+            return static_cast< ThreadIdType >( m_ThreadStatistics.size() );
+        }
+
+        ThreadStatistics & GetThreadStatistics( ThreadIdType threadId )
+        {
+            return m_ThreadStatistics[threadId];
+        }
+
+        const ThreadStatistics & GetThreadStatistics( ThreadIdType threadId ) const
+        {
+            return m_ThreadStatistics[threadId];
+        }
+
+        /** Adds the statistics of another object (e.g. an internal mini-pipeline
+         * filter) thread by thread */
+        void Merge( const FilterInstrumentation * pOther )
+        {
+            if( !pOther )
+                return;
+
+            if( m_ThreadStatistics.size() < pOther->m_ThreadStatistics.size() )
+                m_ThreadStatistics.resize( pOther->m_ThreadStatistics.size() );
+
+            for( size_t t = 0; t < pOther->m_ThreadStatistics.size(); t++ )
+            {
+                const ThreadStatistics & other( pOther->m_ThreadStatistics[t] );
+                ThreadStatistics & stats( m_ThreadStatistics[t] );
+
+                for( unsigned int i = 0; i < NumberOfPhases; i++ )
+                    stats.PhaseSeconds[i] += other.PhaseSeconds[i];
+
+                stats.PixelsProcessed += other.PixelsProcessed;
+                stats.MediansComputed += other.MediansComputed;
+                stats.BytesAllocated += other.BytesAllocated;
+            }
+        }
+
+        /** Totals over all threads */
+        double GetPhaseSeconds( PhaseType phase ) const
+        {
+            double dblSeconds( 0.0 );
+            for( size_t t = 0; t < m_ThreadStatistics.size(); t++ )
+                dblSeconds += m_ThreadStatistics[t].PhaseSeconds[phase];
+
+            return dblSeconds;
+        }
+
+        SizeValueType GetPixelsProcessed() const
+        {
+            SizeValueType uintTotal( 0 );
+            for( size_t t = 0; t < m_ThreadStatistics.size(); t++ )
+                uintTotal += m_ThreadStatistics[t].PixelsProcessed;
+
+            return uintTotal;
+        }
+
+        SizeValueType GetMediansComputed() const
+        {
+            SizeValueType uintTotal( 0 );
+            for( size_t t = 0; t < m_ThreadStatistics.size(); t++ )
+                uintTotal += m_ThreadStatistics[t].MediansComputed;
+
+            return uintTotal;
+        }
+
+        SizeValueType GetBytesAllocated() const
+        {
+            SizeValueType uintTotal( 0 );
+            for( size_t t = 0; t < m_ThreadStatistics.size(); t++ )
+                uintTotal += m_ThreadStatistics[t].BytesAllocated;
+
+            return uintTotal;
+        }
+
+        static const char * GetPhaseName( PhaseType phase )
+        {
+            static const char * const arrNames[NumberOfPhases] =
+                { "NeighborhoodGather", "MedianSelection", "Weighting", "RegionCopy", "Blending", "Functor",
+                  "Filtering", "BackProjection" };
+
+            return phase < NumberOfPhases ? arrNames[phase] : "Unknown";
+        }
+
+        /** Adds the wall time of its scope to a phase of one thread */
+        class ScopedPhase
+        {
+        public:
+            ScopedPhase( FilterInstrumentation * pInstrumentation, ThreadIdType threadId, PhaseType phase )
+                : m_Seconds( pInstrumentation->GetThreadStatistics( threadId ).PhaseSeconds[phase] )
+                , m_Start( std::chrono::steady_clock::now() )
+            {
+            }
+
+            ~ScopedPhase()
+            {
+                m_Seconds += std::chrono::duration< double >( std::chrono::steady_clock::now() - m_Start ).count();
+            }
+
+        private:
+            ScopedPhase( const ScopedPhase & );
+            void operator=( const ScopedPhase & );
+
+            double &                                    m_Seconds;
+            std::chrono::steady_clock::time_point       m_Start;
+        };
+
+    protected:
+        FilterInstrumentation()
+        {
+            Initialize( 1 );
+        }
+
+        virtual ~FilterInstrumentation() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "NumberOfThreads: " << GetNumberOfThreads() << std::endl;
+            os << indent << "PixelsProcessed: " << GetPixelsProcessed() << std::endl;
+            os << indent << "MediansComputed: " << GetMediansComputed() << std::endl;
+            os << indent << "BytesAllocated: " << GetBytesAllocated() << std::endl;
+
+            for( unsigned int i = 0; i < NumberOfPhases; i++ )
+                os << indent << GetPhaseName( static_cast< PhaseType >( i ) ) << ": " << GetPhaseSeconds( static_cast< PhaseType >( i ) ) << " s" << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(FilterInstrumentation);
+
+        std::vector< ThreadStatistics >             m_ThreadStatistics;
+    };
+
+    /** Invoked by the CSIROTomo filters when an update has completed and the
+     * statistics returned by GetInstrumentation() are up to date */
+    itkEventMacro( InstrumentationEvent, AnyEvent )
+}
+
+// Recording macros used by the filters. They compile to nothing unless
+// ITKCSIROTomo_USE_INSTRUMENTATION is defined.
+#ifdef ITKCSIROTomo_USE_INSTRUMENTATION
+#define itkCSIROTomoInstrumentationInitialize( instrumentation, threads ) \
+    ( instrumentation )->Initialize( threads )
+#define itkCSIROTomoScopedPhase( instrumentation, threadId, phase ) \
+    ::itk::FilterInstrumentation::ScopedPhase itkCSIROTomoScopedPhase##phase( instrumentation, threadId, ::itk::FilterInstrumentation::phase )
+#define itkCSIROTomoInstrumentationCount( instrumentation, threadId, counter, value ) \
+    ( instrumentation )->GetThreadStatistics( threadId ).counter += ( value )
+#define itkCSIROTomoInstrumentationMerge( instrumentation, other ) \
+    ( instrumentation )->Merge( other )
+#define itkCSIROTomoInstrumentationReport( filter ) \
+    ( filter )->InvokeEvent( ::itk::InstrumentationEvent() )
+#else
+#define itkCSIROTomoInstrumentationInitialize( instrumentation, threads ) ( (void)0 )
+#define itkCSIROTomoScopedPhase( instrumentation, threadId, phase ) ( (void)0 )
+#define itkCSIROTomoInstrumentationCount( instrumentation, threadId, counter, value ) ( (void)0 )
+#define itkCSIROTomoInstrumentationMerge( instrumentation, other ) ( (void)0 )
+#define itkCSIROTomoInstrumentationReport( filter ) ( (void)0 )
+#endif
+
+#endif // itkCSIROTomoInstrumentation_h
@@ -0,0 +1,185 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkCenterOfRotationCalculator_h
+#define itkCenterOfRotationCalculator_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+
+#include "vnl/algo/vnl_fft_1d.h"
+
+#include <complex>
+#include <vector>
+
+namespace itk
+{
+/** \class CenterOfRotationCalculator
+ *
+ * \brief Estimates the rotation axis of a parallel beam scan.
+ *
+ * The estimate is made from a pair of preprocessed projections 180 degrees
+ * apart, or from a sinogram (detector column along axis 0, projection along
+ * axis 1) in which case every pair of rows 180 degrees apart is used, or the
+ * first and last rows if the scan covers only 180 degrees. Opposing rows are
+ * mirrors of each other about the rotation axis, so the axis follows from the
+ * shift between a row and the mirrored opposing row.
+ *
+ * A coarse integer shift is found by phase correlation of the row pairs,
+ * then refined by evaluating the mean squared difference of the pairs at
+ * subpixel candidate shifts around it, the candidates being distributed over
+ * the threads, and fitting a parabola to the best candidates.
+ *
+ * Columns outside the trim region, given as for VerticalStitchingImageFilter
+ * in physical coordinates, are ignored, as are the rows outside it when a
+ * projection pair is used. The result is returned as an offset from the
+ * detector centre in columns, as expected by
+ * ParallelBeamFilteredBackProjectionImageFilter::SetCenterOfRotationOffset().
+ *
+ * \sa ParallelBeamFilteredBackProjectionImageFilter
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    class ITK_TEMPLATE_EXPORT CenterOfRotationCalculator : public Object
+    {
+    public:
+        typedef CenterOfRotationCalculator                  Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(CenterOfRotationCalculator, Object)
+
+        /** Image related typedefs. */
+        typedef TImage                                      ImageType;
+        typedef typename ImageType::PixelType               PixelType;
+        typedef typename ImageType::RegionType              RegionType;
+        typedef typename ImageType::IndexType               IndexType;
+        typedef typename ImageType::PointType               PointType;
+
+        typedef vnl_fft_1d< double >                        FFTType;
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( ImageIsTwoDimensional, ( Concept::SameDimension< ImageDimension, 2 > ) );
+    #endif
+
+        /** Projection at some angle */
+        itkSetConstObjectMacro( Projection, ImageType )
+        itkGetConstObjectMacro( Projection, ImageType )
+
+        /** Projection 180 degrees from the first */
+        itkSetConstObjectMacro( OpposingProjection, ImageType )
+        itkGetConstObjectMacro( OpposingProjection, ImageType )
+
+        /** Sinogram, used when no projection pair is set */
+        itkSetConstObjectMacro( Sinogram, ImageType )
+        itkGetConstObjectMacro( Sinogram, ImageType )
+
+        /** Angle between the rows of the sinogram in radians, 0 spreads the rows
+         * over 180 degrees, the last row opposing the first */
+        itkSetMacro( AngleStep, double )
+        itkGetConstMacro( AngleStep, double )
+
+        // Trim amounts in physical coordinates
+        itkSetMacro( TrimPointMin, PointType )
+        itkGetConstMacro( TrimPointMin, PointType )
+        itkSetMacro( TrimPointMax, PointType )
+        itkGetConstMacro( TrimPointMax, PointType )
+
+        /** Largest offset searched, in columns, 0 searches a quarter of the trimmed width */
+        itkSetMacro( MaximumOffset, double )
+        itkGetConstMacro( MaximumOffset, double )
+
+        /** Number of candidate shifts per column evaluated within two columns of the coarse shift */
+        itkSetClampMacro( SubpixelSteps, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( SubpixelSteps, unsigned int )
+
+        itkSetClampMacro( NumberOfThreads, ThreadIdType, 1, ITK_MAX_THREADS )
+        itkGetConstMacro( NumberOfThreads, ThreadIdType )
+
+        /** Estimates the rotation axis */
+        void Compute();
+
+        /** Rotation axis relative to the detector centre, in columns */
+        itkGetConstMacro( CenterOfRotationOffset, double )
+
+        /** Offset found by the phase correlation, before refinement */
+        itkGetConstMacro( CoarseOffset, double )
+
+    protected:
+        CenterOfRotationCalculator();
+        virtual ~CenterOfRotationCalculator() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** Region between the trim points over the first uintTrimmedDimensions
+         * axes, throwing if the points do not bound a region of the image */
+        RegionType ComputeTrimRegion( const ImageType * pImage, unsigned int uintTrimmedDimensions ) const;
+
+        /** Copies a row and the mirrored opposing row of each pair to the profile buffers */
+        void AddProfilePair( const ImageType * pImage, IndexValueType intRow, const ImageType * pOpposingImage, IndexValueType intOpposingRow );
+
+        void ThreadedCrossSpectrum( ThreadIdType threadId, ThreadIdType numberOfThreads );
+        void ThreadedEvaluateCandidates( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+        static ITK_THREAD_RETURN_TYPE CrossSpectrumThreaderCallback( void * pArg );
+        static ITK_THREAD_RETURN_TYPE EvaluateCandidatesThreaderCallback( void * pArg );
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(CenterOfRotationCalculator);
+
+        typename ImageType::ConstPointer                    m_Projection;
+        typename ImageType::ConstPointer                    m_OpposingProjection;
+        typename ImageType::ConstPointer                    m_Sinogram;
+
+        double                                              m_AngleStep;
+        PointType                                           m_TrimPointMin;
+        PointType                                           m_TrimPointMax;
+        double                                              m_MaximumOffset;
+        unsigned int                                        m_SubpixelSteps;
+        ThreadIdType                                        m_NumberOfThreads;
+
+        double                                              m_CenterOfRotationOffset;
+        double                                              m_CoarseOffset;
+
+        // Row pairs of the trimmed columns, the opposing rows mirrored
+        IndexValueType                                      m_ProfileStart;
+        SizeValueType                                       m_ProfileLength;
+        std::vector< double >                               m_Profiles;
+        std::vector< double >                               m_MirroredProfiles;
+
+        // Per thread cross power spectra of the coarse search
+        unsigned int                                        m_FFTLength;
+        std::vector< std::vector< std::complex< double > > > m_CrossSpectra;
+
+        // Candidate shifts of the refinement and their mean squared differences
+        std::vector< double >                               m_CandidateShifts;
+        std::vector< double >                               m_CandidateErrors;
+
+        MultiThreader::Pointer                              m_Threader;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkCenterOfRotationCalculator.hxx"
+#endif
+
+#endif // itkCenterOfRotationCalculator_h
@@ -0,0 +1,373 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkCenterOfRotationCalculator_hxx
+#define itkCenterOfRotationCalculator_hxx
+
+#include "itkCenterOfRotationCalculator.h"
+
+#include "itkMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+    template< typename TImage >
+    CenterOfRotationCalculator< TImage >::CenterOfRotationCalculator()
+        : m_AngleStep( 0.0 )
+        , m_MaximumOffset( 0.0 )
+        , m_SubpixelSteps( 8 )
+        , m_NumberOfThreads( MultiThreader::GetGlobalDefaultNumberOfThreads() )
+        , m_CenterOfRotationOffset( 0.0 )
+        , m_CoarseOffset( 0.0 )
+        , m_ProfileStart( 0 )
+        , m_ProfileLength( 0 )
+        , m_FFTLength( 0 )
+        , m_Threader( MultiThreader::New() )
+    {
+        m_TrimPointMin.Fill( 0.0 );
+        m_TrimPointMax.Fill( 0.0 );
+    }
+
+    template< typename TImage >
+    void CenterOfRotationCalculator< TImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "Projection: " << m_Projection.GetPointer() << std::endl;
+        os << indent << "OpposingProjection: " << m_OpposingProjection.GetPointer() << std::endl;
+        os << indent << "Sinogram: " << m_Sinogram.GetPointer() << std::endl;
+        os << indent << "AngleStep: " << m_AngleStep << std::endl;
+        os << indent << "TrimPointMin: " << m_TrimPointMin << std::endl;
+        os << indent << "TrimPointMax: " << m_TrimPointMax << std::endl;
+        os << indent << "MaximumOffset: " << m_MaximumOffset << std::endl;
+        os << indent << "SubpixelSteps: " << m_SubpixelSteps << std::endl;
+        os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+        os << indent << "CenterOfRotationOffset: " << m_CenterOfRotationOffset << std::endl;
+        os << indent << "CoarseOffset: " << m_CoarseOffset << std::endl;
+    }
+
+    template< typename TImage >
+    typename CenterOfRotationCalculator< TImage >::RegionType CenterOfRotationCalculator< TImage >::ComputeTrimRegion( const ImageType * pImage, unsigned int uintTrimmedDimensions ) const
+    {
+        // Special case, no trim points set (zero)
+        if( m_TrimPointMax.EuclideanDistanceTo( m_TrimPointMin ) == 0.0 )
+            return pImage->GetLargestPossibleRegion();
+
+        const RegionType & regionImage( pImage->GetLargestPossibleRegion() );
+        RegionType regionTrim( regionImage );
+        IndexType indexBoundMin;
+        IndexType indexBoundMax;
+
+        // The max bound is exclusive and may lie one pixel past the image, so
+        // rather than the return values of the transforms the bounds of the
+        // trimmed dimensions are checked against the image
+        pImage->TransformPhysicalPointToIndex( m_TrimPointMin, indexBoundMin );
+        pImage->TransformPhysicalPointToIndex( m_TrimPointMax, indexBoundMax );
+
+        for( unsigned int j = 0; j < uintTrimmedDimensions; j++ )
+        {
+            const IndexValueType intEnd( regionImage.GetIndex( j ) + static_cast< IndexValueType >( regionImage.GetSize( j ) ) );
+
+            if( indexBoundMin[j] < regionImage.GetIndex( j ) || indexBoundMax[j] <= indexBoundMin[j] || indexBoundMax[j] > intEnd )
+                itkExceptionMacro( "ComputeTrimRegion failed, the trim points " << m_TrimPointMin << " and " << m_TrimPointMax << " do not bound a region of the image " << regionImage );
+
+            regionTrim.SetIndex( j, indexBoundMin[j] );
+            regionTrim.SetSize( j, indexBoundMax[j] - indexBoundMin[j] );
+        }
+
+        return regionTrim;
+    }
+
+    template< typename TImage >
+    void CenterOfRotationCalculator< TImage >::AddProfilePair( const ImageType * pImage, IndexValueType intRow, const ImageType * pOpposingImage, IndexValueType intOpposingRow )
+    {
+        IndexType indexRow;
+        indexRow[0] = m_ProfileStart;
+        indexRow[1] = intRow;
+
+        IndexType indexOpposingRow;
+        indexOpposingRow[0] = m_ProfileStart;
+        indexOpposingRow[1] = intOpposingRow;
+
+        const PixelType * pRow( pImage->GetBufferPointer() + pImage->ComputeOffset( indexRow ) );
+        const PixelType * pOpposingRow( pOpposingImage->GetBufferPointer() + pOpposingImage->ComputeOffset( indexOpposingRow ) );
+
+        for( SizeValueType i = 0; i < m_ProfileLength; i++ )
+        {
+            m_Profiles.push_back( static_cast< double >( pRow[i] ) );
+            m_MirroredProfiles.push_back( static_cast< double >( pOpposingRow[m_ProfileLength - 1 - i] ) );
+        }
+    }
+
+    template< typename TImage >
+    void CenterOfRotationCalculator< TImage >::Compute()
+    {
+        m_Profiles.clear();
+        m_MirroredProfiles.clear();
+
+        RegionType regionDetector;
+
+        if( m_Projection && m_OpposingProjection )
+        {
+            regionDetector = m_Projection->GetLargestPossibleRegion();
+
+            if( regionDetector != m_OpposingProjection->GetLargestPossibleRegion() )
+                itkExceptionMacro( "Projection and opposing projection regions differ" );
+
+            const RegionType regionTrim( ComputeTrimRegion( m_Projection, ImageDimension ) );
+            m_ProfileStart = regionTrim.GetIndex( 0 );
+            m_ProfileLength = regionTrim.GetSize( 0 );
+
+            for( IndexValueType y = regionTrim.GetIndex( 1 ); y < regionTrim.GetIndex( 1 ) + static_cast< IndexValueType >( regionTrim.GetSize( 1 ) ); y++ )
+                AddProfilePair( m_Projection, y, m_OpposingProjection, y );
+        }
+        else if( m_Sinogram )
+        {
+            regionDetector = m_Sinogram->GetLargestPossibleRegion();
+
+            // Every projection of the sinogram is used, only the columns are trimmed
+            const RegionType regionTrim( ComputeTrimRegion( m_Sinogram, 1 ) );
+            m_ProfileStart = regionTrim.GetIndex( 0 );
+            m_ProfileLength = regionTrim.GetSize( 0 );
+
+            const IndexValueType intFirst( regionDetector.GetIndex( 1 ) );
+            const SizeValueType uintNumProjections( regionDetector.GetSize( 1 ) );
+            // Without an angle step the first and last rows are 180 degrees apart
+            if( m_AngleStep == 0.0 && uintNumProjections < 2 )
+                itkExceptionMacro( "A sinogram of a single row needs an AngleStep" );
+
+            const double dblAngleStep( m_AngleStep != 0.0 ? std::fabs( m_AngleStep ) : Math::pi / ( uintNumProjections - 1 ) );
+            const SizeValueType uintHalfTurn( static_cast< SizeValueType >( Math::Round< IndexValueType >( Math::pi / dblAngleStep ) ) );
+
+            if( uintHalfTurn < uintNumProjections )
+            {
+                for( SizeValueType p = 0; p + uintHalfTurn < uintNumProjections; p++ )
+                    AddProfilePair( m_Sinogram, intFirst + p, m_Sinogram, intFirst + p + uintHalfTurn );
+            }
+            else
+                AddProfilePair( m_Sinogram, intFirst, m_Sinogram, intFirst + uintNumProjections - 1 );
+        }
+        else
+            itkExceptionMacro( "A projection pair or a sinogram is required" );
+
+        if( m_ProfileLength < 4 || m_Profiles.empty() )
+            itkExceptionMacro( "The trim region leaves too few pixels to estimate the rotation axis" );
+
+        const IndexValueType intMaximumShift( std::min( static_cast< IndexValueType >( std::ceil( 2.0 * ( m_MaximumOffset > 0.0 ? m_MaximumOffset : 0.25 * m_ProfileLength ) ) ),
+                                                        static_cast< IndexValueType >( m_ProfileLength ) - 2 ) );
+
+        // Coarse search, correlation of the accumulated cross power spectrum
+        // whitened by the square root of its magnitude. Full phase correlation
+        // proved less robust for profiles trimmed off-centre.
+        m_FFTLength = 2;
+        while( m_FFTLength < 2 * m_ProfileLength )
+            m_FFTLength *= 2;
+
+        m_Threader->SetNumberOfThreads( m_NumberOfThreads );
+        m_CrossSpectra.assign( m_Threader->GetNumberOfThreads(), std::vector< std::complex< double > >( m_FFTLength, std::complex< double >( 0.0, 0.0 ) ) );
+
+        m_Threader->SetSingleMethod( this->CrossSpectrumThreaderCallback, this );
+        m_Threader->SingleMethodExecute();
+
+        vnl_vector< std::complex< double > > vecCorrelation( m_FFTLength, std::complex< double >( 0.0, 0.0 ) );
+        for( size_t t = 0; t < m_CrossSpectra.size(); t++ )
+            for( unsigned int k = 0; k < m_FFTLength; k++ )
+                vecCorrelation[k] += m_CrossSpectra[t][k];
+
+        double dblPeakMagnitude( 0.0 );
+        for( unsigned int k = 0; k < m_FFTLength; k++ )
+            dblPeakMagnitude = std::max( dblPeakMagnitude, std::abs( vecCorrelation[k] ) );
+
+        for( unsigned int k = 0; k < m_FFTLength; k++ )
+        {
+            const double dblMagnitude( std::abs( vecCorrelation[k] ) );
+            vecCorrelation[k] = dblMagnitude > 1.0e-6 * dblPeakMagnitude ? vecCorrelation[k] / std::sqrt( dblMagnitude ) : std::complex< double >( 0.0, 0.0 );
+        }
+
+        FFTType fft( m_FFTLength );
+        fft.bwd_transform( vecCorrelation );
+
+        IndexValueType intCoarseShift( 0 );
+        double dblPeak( -NumericTraits< double >::max() );
+        for( IndexValueType n = -intMaximumShift; n <= intMaximumShift; n++ )
+        {
+            const double dblValue( vecCorrelation[( n + m_FFTLength ) % m_FFTLength].real() );
+            if( dblValue > dblPeak )
+            {
+                dblPeak = dblValue;
+                intCoarseShift = n;
+            }
+        }
+
+        // The shift between a row and the mirrored opposing row is twice the
+        // distance of the rotation axis from the centre of the trimmed columns
+        const double dblTrimCentre( m_ProfileStart - regionDetector.GetIndex( 0 ) + 0.5 * ( m_ProfileLength - 1.0 ) );
+        const double dblDetectorCentre( 0.5 * ( regionDetector.GetSize( 0 ) - 1.0 ) );
+
+        m_CoarseOffset = dblTrimCentre + 0.5 * intCoarseShift - dblDetectorCentre;
+
+        // Refinement, candidate shifts within two columns of the coarse shift
+        m_CandidateShifts.clear();
+        for( int j = -2 * static_cast< int >( m_SubpixelSteps ); j <= 2 * static_cast< int >( m_SubpixelSteps ); j++ )
+            m_CandidateShifts.push_back( intCoarseShift + static_cast< double >( j ) / m_SubpixelSteps );
+
+        m_CandidateErrors.assign( m_CandidateShifts.size(), NumericTraits< double >::max() );
+
+        m_Threader->SetSingleMethod( this->EvaluateCandidatesThreaderCallback, this );
+        m_Threader->SingleMethodExecute();
+
+        const size_t uintBest( std::min_element( m_CandidateErrors.begin(), m_CandidateErrors.end() ) - m_CandidateErrors.begin() );
+        double dblShift( m_CandidateShifts[uintBest] );
+
+        if( uintBest > 0 && uintBest + 1 < m_CandidateErrors.size() )
+        {
+            const double dblLower( m_CandidateErrors[uintBest - 1] );
+            const double dblUpper( m_CandidateErrors[uintBest + 1] );
+            const double dblCurvature( dblLower - 2.0 * m_CandidateErrors[uintBest] + dblUpper );
+
+            if( dblCurvature > 0.0 )
+                dblShift += 0.5 * ( dblLower - dblUpper ) / dblCurvature / m_SubpixelSteps;
+        }
+
+        m_CenterOfRotationOffset = dblTrimCentre + 0.5 * dblShift - dblDetectorCentre;
+    }
+
+    template< typename TImage >
+    void CenterOfRotationCalculator< TImage >::ThreadedCrossSpectrum( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const SizeValueType uintNumPairs( m_Profiles.size() / m_ProfileLength );
+        const SizeValueType uintTaperLength( std::max( m_ProfileLength / 10, static_cast< SizeValueType >( 1 ) ) );
+
+        FFTType fft( m_FFTLength );
+        vnl_vector< std::complex< double > > vecProfile( m_FFTLength );
+        vnl_vector< std::complex< double > > vecMirrored( m_FFTLength );
+
+        std::vector< std::complex< double > > & vecCrossSpectrum( m_CrossSpectra[threadId] );
+
+        for( SizeValueType r = threadId; r < uintNumPairs; r += numberOfThreads )
+        {
+            const double * pProfile( &m_Profiles[r * m_ProfileLength] );
+            const double * pMirrored( &m_MirroredProfiles[r * m_ProfileLength] );
+
+            double dblMean( 0.0 );
+            double dblMirroredMean( 0.0 );
+            for( SizeValueType i = 0; i < m_ProfileLength; i++ )
+            {
+                dblMean += pProfile[i];
+                dblMirroredMean += pMirrored[i];
+            }
+            dblMean /= m_ProfileLength;
+            dblMirroredMean /= m_ProfileLength;
+
+            // Tukey taper over a tenth of the profile either side, suppressing the
+            // correlation of the profile edges while weighting the interior alike
+            for( SizeValueType i = 0; i < m_ProfileLength; i++ )
+            {
+                double dblTaper( 1.0 );
+                if( i < uintTaperLength )
+                    dblTaper = 0.5 - 0.5 * std::cos( Math::pi * ( i + 0.5 ) / uintTaperLength );
+                else if( i + uintTaperLength >= m_ProfileLength )
+                    dblTaper = 0.5 - 0.5 * std::cos( Math::pi * ( m_ProfileLength - i - 0.5 ) / uintTaperLength );
+
+                vecProfile[i] = std::complex< double >( ( pProfile[i] - dblMean ) * dblTaper, 0.0 );
+                vecMirrored[i] = std::complex< double >( ( pMirrored[i] - dblMirroredMean ) * dblTaper, 0.0 );
+            }
+            for( SizeValueType i = m_ProfileLength; i < m_FFTLength; i++ )
+            {
+                vecProfile[i] = std::complex< double >( 0.0, 0.0 );
+                vecMirrored[i] = std::complex< double >( 0.0, 0.0 );
+            }
+
+            fft.fwd_transform( vecProfile );
+            fft.fwd_transform( vecMirrored );
+
+            for( unsigned int k = 0; k < m_FFTLength; k++ )
+                vecCrossSpectrum[k] += vecProfile[k] * std::conj( vecMirrored[k] );
+        }
+    }
+
+    template< typename TImage >
+    void CenterOfRotationCalculator< TImage >::ThreadedEvaluateCandidates( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const SizeValueType uintNumPairs( m_Profiles.size() / m_ProfileLength );
+        const double dblLast( m_ProfileLength - 1.0 );
+
+        for( size_t c = threadId; c < m_CandidateShifts.size(); c += numberOfThreads )
+        {
+            // Both profiles are moved by half the shift, so that they are
+            // interpolated alike and the error is not biased to whole columns
+            const double dblHalfShift( 0.5 * m_CandidateShifts[c] );
+            const SizeValueType uintStart( static_cast< SizeValueType >( std::ceil( std::fabs( dblHalfShift ) ) ) );
+
+            if( 2 * uintStart + 1 >= m_ProfileLength )
+                continue;
+
+            double dblSum( 0.0 );
+            SizeValueType uintCount( 0 );
+
+            for( SizeValueType r = 0; r < uintNumPairs; r++ )
+            {
+                const double * pProfile( &m_Profiles[r * m_ProfileLength] );
+                const double * pMirrored( &m_MirroredProfiles[r * m_ProfileLength] );
+
+                for( SizeValueType i = uintStart; i + uintStart < m_ProfileLength; i++ )
+                {
+                    const double dblPosition( std::min( i + dblHalfShift, dblLast ) );
+                    const double dblMirroredPosition( std::min( i - dblHalfShift, dblLast ) );
+
+                    const SizeValueType uintIndex( std::min( static_cast< SizeValueType >( dblPosition ), m_ProfileLength - 2 ) );
+                    const SizeValueType uintMirroredIndex( std::min( static_cast< SizeValueType >( dblMirroredPosition ), m_ProfileLength - 2 ) );
+
+                    const double dblValue( pProfile[uintIndex] + ( dblPosition - uintIndex ) * ( pProfile[uintIndex + 1] - pProfile[uintIndex] ) );
+                    const double dblMirroredValue( pMirrored[uintMirroredIndex]
+                                                   + ( dblMirroredPosition - uintMirroredIndex ) * ( pMirrored[uintMirroredIndex + 1] - pMirrored[uintMirroredIndex] ) );
+
+                    dblSum += ( dblValue - dblMirroredValue ) * ( dblValue - dblMirroredValue );
+                    uintCount++;
+                }
+            }
+
+            m_CandidateErrors[c] = dblSum / uintCount;
+        }
+    }
+
+    template< typename TImage >
+    ITK_THREAD_RETURN_TYPE CenterOfRotationCalculator< TImage >::CrossSpectrumThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedCrossSpectrum( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+
+    template< typename TImage >
+    ITK_THREAD_RETURN_TYPE CenterOfRotationCalculator< TImage >::EvaluateCandidatesThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedEvaluateCandidates( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+}
+
+#endif // itkCenterOfRotationCalculator_hxx
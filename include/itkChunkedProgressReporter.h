@@ -0,0 +1,140 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkChunkedProgressReporter_h
+#define itkChunkedProgressReporter_h
+
+#include "itkIntTypes.h"
+#include "itkProcessObject.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+namespace itk
+{
+/** \class ChunkedProgressCounter
+ *
+ * \brief Progress state shared by all threads of a single filter update.
+ *
+ * Threads add completed work to a lock-free counter, so the progress seen by
+ * observers is that of the whole output rather than an extrapolation of the
+ * first thread. The counter is owned by the filter and initialised before the
+ * threads are started, typically in BeforeThreadedGenerateData().
+ *
+ * \sa ChunkedProgressReporter
+ * \ingroup ITKCSIROTomo
+ */
+    class ChunkedProgressCounter
+    {
+    public:
+        ChunkedProgressCounter()
+            : m_Completed( 0 )
+            , m_Total( 1 )
+            , m_Interval( 1 )
+        {
+        }
+
+        /** Resets the counter for an update processing uintTotal pixels, reporting
+         * at most uintNumberOfUpdates progress events */
+        void Initialize( SizeValueType uintTotal, unsigned int uintNumberOfUpdates )
+        {
+            m_Completed.store( 0, std::memory_order_relaxed );
+            m_Total = std::max( uintTotal, static_cast< SizeValueType >( 1 ) );
+            m_Interval = std::max( m_Total / std::max( uintNumberOfUpdates, 1u ), static_cast< SizeValueType >( 1 ) );
+        }
+
+        /** Adds completed pixels, returning the new total */
+        SizeValueType Add( SizeValueType uintPixels )
+        {
+            return m_Completed.fetch_add( uintPixels, std::memory_order_relaxed ) + uintPixels;
+        }
+
+        SizeValueType GetTotal() const { return m_Total; }
+        SizeValueType GetInterval() const { return m_Interval; }
+
+    private:
+        ChunkedProgressCounter( const ChunkedProgressCounter & );
+        void operator=( const ChunkedProgressCounter & );
+
+        std::atomic< SizeValueType >        m_Completed;
+        SizeValueType                       m_Total;
+        SizeValueType                       m_Interval;
+    };
+
+/** \class ChunkedProgressReporter
+ *
+ * \brief Per-thread progress reporting in chunks of pixels.
+ *
+ * A replacement for ProgressReporter that is called once per chunk of work
+ * (a scanline or tile) instead of once per pixel, keeping the counter update
+ * out of the innermost loops. As with ProgressReporter, progress events are
+ * only invoked and aborts only checked from thread 0.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class ChunkedProgressReporter
+    {
+    public:
+        ChunkedProgressReporter( ProcessObject * pFilter, ThreadIdType threadId, ChunkedProgressCounter & counter,
+                                 float fltInitialProgress = 0.0f, float fltProgressWeight = 1.0f )
+            : m_Filter( pFilter )
+            , m_ThreadId( threadId )
+            , m_Counter( counter )
+            , m_InitialProgress( fltInitialProgress )
+            , m_ProgressWeight( fltProgressWeight )
+            , m_NextUpdate( counter.GetInterval() )
+        {
+            if( m_ThreadId == 0 )
+                m_Filter->UpdateProgress( m_InitialProgress );
+        }
+
+        /** Records a completed chunk of pixels */
+        void CompletedPixels( SizeValueType uintPixels )
+        {
+            const SizeValueType uintCompleted( m_Counter.Add( uintPixels ) );
+
+            if( m_ThreadId != 0 || uintCompleted < m_NextUpdate )
+                return;
+
+            m_NextUpdate = ( uintCompleted / m_Counter.GetInterval() + 1 ) * m_Counter.GetInterval();
+
+            const float fltFraction( std::min( 1.0f, static_cast< float >( uintCompleted ) / static_cast< float >( m_Counter.GetTotal() ) ) );
+            m_Filter->UpdateProgress( m_InitialProgress + m_ProgressWeight * fltFraction );
+
+            if( m_Filter->GetAbortGenerateData() )
+            {
+                ProcessAborted e( __FILE__, __LINE__ );
+                e.SetDescription( std::string( "Object " ) + m_Filter->GetNameOfClass() + ": AbortGenerateDataOn" );
+                throw e;
+            }
+        }
+
+    private:
+        ChunkedProgressReporter( const ChunkedProgressReporter & );
+        void operator=( const ChunkedProgressReporter & );
+
+        ProcessObject *                     m_Filter;
+        ThreadIdType                        m_ThreadId;
+        ChunkedProgressCounter &            m_Counter;
+        float                               m_InitialProgress;
+        float                               m_ProgressWeight;
+        SizeValueType                       m_NextUpdate;
+    };
+}
+
+#endif // itkChunkedProgressReporter_h
@@ -0,0 +1,384 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkChunkedStackFormat_h
+#define itkChunkedStackFormat_h
+
+#include "itkByteSwapper.h"
+#include "itkImageRegion.h"
+#include "itkMacro.h"
+#include "itk_zlib.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class ChunkedStackHeader
+ *
+ * \brief Geometry and chunk index of a chunked stack file.
+ *
+ * A chunked stack file holds an image cut into chunks of ChunkSize pixels,
+ * each compressed on its own, so that a reader can decompress only the chunks
+ * overlapping the region it needs, e.g. a few projections of a projection
+ * stack or a slab of rows of every projection for a sinogram. The file starts
+ * with a text header, ended by a HeaderEnd line, followed by the chunk index,
+ * a little endian offset and compressed size for each chunk, and then the
+ * chunks in index order. Chunks are numbered with the first axis varying
+ * fastest.
+ *
+ * Each chunk is byte shuffled, the first byte of every pixel followed by the
+ * second byte of every pixel and so on, and then deflated. Shuffling groups the
+ * slowly varying exponent and high order bytes of neighbouring pixels, which
+ * compresses much better than the interleaved pixels.
+ *
+ * \sa ChunkedStackImageFileWriter, ChunkedStackImageFileReader
+ * \ingroup ITKCSIROTomo
+ */
+    template< unsigned int VImageDimension >
+    class ChunkedStackHeader
+    {
+    public:
+        typedef ImageRegion< VImageDimension >              RegionType;
+        typedef typename RegionType::IndexType              IndexType;
+        typedef typename RegionType::SizeType               SizeType;
+
+        ChunkedStackHeader()
+            : PixelSize( 0 )
+            , IndexOffset( 0 )
+        {
+            Size.Fill( 0 );
+            ChunkSize.Fill( 1 );
+            Spacing.assign( VImageDimension, 1.0 );
+            Origin.assign( VImageDimension, 0.0 );
+            Direction.assign( VImageDimension * VImageDimension, 0.0 );
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+                Direction[j * VImageDimension + j] = 1.0;
+        }
+
+        /** Pixel type, as named by the writer, and its size in bytes */
+        std::string                 PixelType;
+        unsigned int                PixelSize;
+
+        /** Geometry of the image, the direction row major */
+        SizeType                    Size;
+        SizeType                    ChunkSize;
+        std::vector< double >       Spacing;
+        std::vector< double >       Origin;
+        std::vector< double >       Direction;
+
+        /** Offset and compressed size of each chunk */
+        std::vector< std::uint64_t > ChunkOffsets;
+        std::vector< std::uint64_t > ChunkSizes;
+
+        /** Position of the chunk index in the file */
+        std::uint64_t               IndexOffset;
+
+        /** Chunks along each axis */
+        SizeType GetChunkGridSize() const
+        {
+            SizeType sizeGrid;
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+                sizeGrid[j] = ( Size[j] + ChunkSize[j] - 1 ) / ChunkSize[j];
+
+            return sizeGrid;
+        }
+
+        SizeValueType GetNumberOfChunks() const
+        {
+            const SizeType sizeGrid( GetChunkGridSize() );
+
+            SizeValueType uintNumChunks( 1 );
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+                uintNumChunks *= sizeGrid[j];
+
+            return uintNumChunks;
+        }
+
+        /** Pixels of a chunk, those of the last along an axis possibly fewer */
+        RegionType GetChunkRegion( SizeValueType uintChunk ) const
+        {
+            const SizeType sizeGrid( GetChunkGridSize() );
+
+            RegionType regionChunk;
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+            {
+                const SizeValueType uintPosition( uintChunk % sizeGrid[j] );
+                uintChunk /= sizeGrid[j];
+
+                regionChunk.SetIndex( j, static_cast< IndexValueType >( uintPosition * ChunkSize[j] ) );
+                regionChunk.SetSize( j, std::min( ChunkSize[j], Size[j] - uintPosition * ChunkSize[j] ) );
+            }
+
+            return regionChunk;
+        }
+
+        /** Chunks overlapping a region of the image, in index order */
+        std::vector< SizeValueType > GetChunksOverlapping( const RegionType & region ) const
+        {
+            const SizeType sizeGrid( GetChunkGridSize() );
+
+            // Range of chunk positions along each axis
+            IndexType indexFirst;
+            IndexType indexLast;
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+            {
+                indexFirst[j] = region.GetIndex( j ) / static_cast< IndexValueType >( ChunkSize[j] );
+                indexLast[j] = ( region.GetIndex( j ) + static_cast< IndexValueType >( region.GetSize( j ) ) - 1 ) / static_cast< IndexValueType >( ChunkSize[j] );
+            }
+
+            std::vector< SizeValueType > vecChunks;
+            if( region.GetNumberOfPixels() == 0 )
+                return vecChunks;
+
+            IndexType indexChunk( indexFirst );
+            for( ;; )
+            {
+                SizeValueType uintChunk( 0 );
+                for( unsigned int j = VImageDimension; j-- > 0; )
+                    uintChunk = uintChunk * sizeGrid[j] + static_cast< SizeValueType >( indexChunk[j] );
+                vecChunks.push_back( uintChunk );
+
+                unsigned int j( 0 );
+                for( ; j < VImageDimension; j++ )
+                {
+                    if( ++indexChunk[j] <= indexLast[j] )
+                        break;
+                    indexChunk[j] = indexFirst[j];
+                }
+
+                if( j == VImageDimension )
+                    break;
+            }
+
+            return vecChunks;
+        }
+
+        /** Writes the text header, followed by room for the chunk index */
+        void Write( std::ostream & os )
+        {
+            os << "CSIROTomoChunkedStack1\n";
+            os << "Dimension " << VImageDimension << "\n";
+            os << "PixelType " << PixelType << "\n";
+            os << "PixelSize " << PixelSize << "\n";
+            os << "ByteOrder " << ( ByteSwapper< int >::SystemIsBigEndian() ? "BigEndian" : "LittleEndian" ) << "\n";
+            os << "Codec shuffle-deflate\n";
+            WriteValues( os, "Size", &Size[0], VImageDimension );
+            WriteValues( os, "ChunkSize", &ChunkSize[0], VImageDimension );
+            os.precision( 17 );
+            WriteValues( os, "Spacing", &Spacing[0], Spacing.size() );
+            WriteValues( os, "Origin", &Origin[0], Origin.size() );
+            WriteValues( os, "Direction", &Direction[0], Direction.size() );
+            os << "HeaderEnd\n";
+
+            IndexOffset = static_cast< std::uint64_t >( os.tellp() );
+            ChunkOffsets.assign( GetNumberOfChunks(), 0 );
+            ChunkSizes.assign( GetNumberOfChunks(), 0 );
+            WriteIndex( os );
+        }
+
+        /** Writes the chunk index at its position */
+        void WriteIndex( std::ostream & os ) const
+        {
+            os.seekp( static_cast< std::streamoff >( IndexOffset ) );
+            for( size_t i = 0; i < ChunkOffsets.size(); i++ )
+            {
+                std::uint64_t arrEntry[2] = { ChunkOffsets[i], ChunkSizes[i] };
+                ByteSwapper< std::uint64_t >::SwapRangeFromSystemToLittleEndian( arrEntry, 2 );
+                os.write( reinterpret_cast< const char * >( arrEntry ), sizeof( arrEntry ) );
+            }
+        }
+
+        /** Reads the header and chunk index, returning a description of the
+         * first problem found or an empty string */
+        std::string Read( std::istream & is )
+        {
+            std::string strLine;
+            if( !std::getline( is, strLine ) || strLine != "CSIROTomoChunkedStack1" )
+                return "not a chunked stack file";
+
+            bool blnHeaderEnd( false );
+            while( !blnHeaderEnd && std::getline( is, strLine ) )
+            {
+                std::istringstream iss( strLine );
+                std::string strKey;
+                iss >> strKey;
+
+                bool blnValid( true );
+                if( strKey == "HeaderEnd" )
+                    blnHeaderEnd = true;
+                else if( strKey == "Dimension" )
+                {
+                    unsigned int uintDimension( 0 );
+                    if( !( iss >> uintDimension ) || uintDimension != VImageDimension )
+                        return "not of dimension " + std::to_string( VImageDimension );
+                }
+                else if( strKey == "PixelType" )
+                    blnValid = static_cast< bool >( iss >> PixelType );
+                else if( strKey == "PixelSize" )
+                    blnValid = static_cast< bool >( iss >> PixelSize );
+                else if( strKey == "ByteOrder" )
+                {
+                    std::string strByteOrder;
+                    iss >> strByteOrder;
+                    if( strByteOrder != ( ByteSwapper< int >::SystemIsBigEndian() ? "BigEndian" : "LittleEndian" ) )
+                        return "written with the byte order " + strByteOrder;
+                }
+                else if( strKey == "Codec" )
+                {
+                    std::string strCodec;
+                    iss >> strCodec;
+                    if( strCodec != "shuffle-deflate" )
+                        return "compressed with the unknown codec " + strCodec;
+                }
+                else if( strKey == "Size" )
+                    blnValid = ReadValues( iss, &Size[0], VImageDimension );
+                else if( strKey == "ChunkSize" )
+                    blnValid = ReadValues( iss, &ChunkSize[0], VImageDimension );
+                else if( strKey == "Spacing" )
+                    blnValid = ReadValues( iss, &Spacing[0], Spacing.size() );
+                else if( strKey == "Origin" )
+                    blnValid = ReadValues( iss, &Origin[0], Origin.size() );
+                else if( strKey == "Direction" )
+                    blnValid = ReadValues( iss, &Direction[0], Direction.size() );
+
+                if( !blnValid )
+                    return "invalid " + strKey;
+            }
+
+            if( !blnHeaderEnd )
+                return "truncated header";
+
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+            {
+                if( ChunkSize[j] == 0 )
+                    return "empty chunks";
+            }
+
+            IndexOffset = static_cast< std::uint64_t >( is.tellg() );
+
+            const SizeValueType uintNumChunks( GetNumberOfChunks() );
+            ChunkOffsets.resize( uintNumChunks );
+            ChunkSizes.resize( uintNumChunks );
+            for( SizeValueType i = 0; i < uintNumChunks; i++ )
+            {
+                std::uint64_t arrEntry[2];
+                if( !is.read( reinterpret_cast< char * >( arrEntry ), sizeof( arrEntry ) ) )
+                    return "truncated chunk index";
+                ByteSwapper< std::uint64_t >::SwapRangeFromSystemToLittleEndian( arrEntry, 2 );
+
+                ChunkOffsets[i] = arrEntry[0];
+                ChunkSizes[i] = arrEntry[1];
+            }
+
+            return std::string();
+        }
+
+    private:
+        template< typename TValue >
+        static void WriteValues( std::ostream & os, const char * pKey, const TValue * pValues, size_t uintCount )
+        {
+            os << pKey;
+            for( size_t i = 0; i < uintCount; i++ )
+                os << " " << pValues[i];
+            os << "\n";
+        }
+
+        template< typename TValue >
+        static bool ReadValues( std::istream & is, TValue * pValues, size_t uintCount )
+        {
+            for( size_t i = 0; i < uintCount; i++ )
+            {
+                if( !( is >> pValues[i] ) )
+                    return false;
+            }
+
+            return true;
+        }
+    };
+
+/** \class ChunkedStackCodec
+ *
+ * \brief Byte shuffle and deflate of the chunks of a chunked stack file.
+ *
+ * Stateless, so that chunks can be coded concurrently by the threads of a
+ * ChunkedStackImageFileWriter or ChunkedStackImageFileReader.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class ChunkedStackCodec
+    {
+    public:
+        /** Shuffles and deflates uintPixels pixels of uintPixelSize bytes into
+         * vecCompressed, vecShuffled being scratch space */
+        static bool Compress( const char * pPixels, SizeValueType uintPixels, unsigned int uintPixelSize, int intLevel,
+                              std::vector< char > & vecShuffled, std::vector< char > & vecCompressed )
+        {
+            const SizeValueType uintBytes( uintPixels * uintPixelSize );
+
+            vecShuffled.resize( uintBytes );
+            for( unsigned int b = 0; b < uintPixelSize; b++ )
+            {
+                char * pPlane( &vecShuffled[0] + b * uintPixels );
+                for( SizeValueType i = 0; i < uintPixels; i++ )
+                    pPlane[i] = pPixels[i * uintPixelSize + b];
+            }
+
+            uLongf uintCompressedSize( compressBound( static_cast< uLong >( uintBytes ) ) );
+            vecCompressed.resize( uintCompressedSize );
+
+            if( compress2( reinterpret_cast< Bytef * >( &vecCompressed[0] ), &uintCompressedSize,
+                           reinterpret_cast< const Bytef * >( &vecShuffled[0] ), static_cast< uLong >( uintBytes ), intLevel ) != Z_OK )
+                return false;
+
+            vecCompressed.resize( uintCompressedSize );
+            return true;
+        }
+
+        /** Inflates and unshuffles a chunk into uintPixels pixels of
+         * uintPixelSize bytes, vecShuffled being scratch space */
+        static bool Decompress( const char * pCompressed, SizeValueType uintCompressedSize, SizeValueType uintPixels, unsigned int uintPixelSize,
+                                std::vector< char > & vecShuffled, char * pPixels )
+        {
+            const SizeValueType uintBytes( uintPixels * uintPixelSize );
+
+            vecShuffled.resize( uintBytes );
+
+            uLongf uintInflatedSize( static_cast< uLongf >( uintBytes ) );
+            if( uncompress( reinterpret_cast< Bytef * >( &vecShuffled[0] ), &uintInflatedSize,
+                            reinterpret_cast< const Bytef * >( pCompressed ), static_cast< uLong >( uintCompressedSize ) ) != Z_OK
+                || uintInflatedSize != uintBytes )
+                return false;
+
+            for( unsigned int b = 0; b < uintPixelSize; b++ )
+            {
+                const char * pPlane( &vecShuffled[0] + b * uintPixels );
+                for( SizeValueType i = 0; i < uintPixels; i++ )
+                    pPixels[i * uintPixelSize + b] = pPlane[i];
+            }
+
+            return true;
+        }
+    };
+}
+
+#endif // itkChunkedStackFormat_h
@@ -0,0 +1,112 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkChunkedStackImageFileReader_h
+#define itkChunkedStackImageFileReader_h
+
+#include "itkImageSource.h"
+#include "itkChunkedStackFormat.h"
+
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class ChunkedStackImageFileReader
+ *
+ * \brief Reads a region of an image from a chunked stack file.
+ *
+ * Only the chunks overlapping the requested region of the output are read and
+ * decompressed, so requesting a few projections, or a few rows of every
+ * projection for a sinogram, reads that part of the file rather than the whole
+ * stack. The requested region is produced as is, never enlarged to the
+ * largest possible region.
+ *
+ * The compressed chunks are read in file order by one thread, and then
+ * decompressed and copied into the output by the threads of the reader. The
+ * pixel type of the file must have the size of the pixel type of the output.
+ *
+ * \sa ChunkedStackImageFileWriter
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TOutputImage >
+    class ITK_TEMPLATE_EXPORT ChunkedStackImageFileReader : public ImageSource< TOutputImage >
+    {
+    public:
+        typedef ChunkedStackImageFileReader                 Self;
+        typedef ImageSource< TOutputImage >                 Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, TOutputImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(ChunkedStackImageFileReader, ImageSource)
+
+        /** Image related typedefs. */
+        typedef TOutputImage                                OutputImageType;
+        typedef typename OutputImageType::PixelType         OutputPixelType;
+        typedef typename OutputImageType::RegionType        OutputImageRegionType;
+
+        typedef ChunkedStackHeader< TOutputImage::ImageDimension > HeaderType;
+
+        itkSetStringMacro( FileName )
+        itkGetStringMacro( FileName )
+
+        /** Header of the file, with its chunk index */
+        const HeaderType & GetHeader() const { return m_Header; }
+
+        /** Chunks decompressed by the last update */
+        itkGetConstMacro( NumberOfChunksRead, SizeValueType )
+
+    protected:
+        ChunkedStackImageFileReader();
+        virtual ~ChunkedStackImageFileReader() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        virtual void GenerateOutputInformation() ITK_OVERRIDE;
+
+        /** Leaves the requested region as is */
+        virtual void EnlargeOutputRequestedRegion( DataObject * pOutput ) ITK_OVERRIDE;
+
+        virtual void GenerateData() ITK_OVERRIDE;
+
+        /** Decompresses the chunks assigned to a thread into the output */
+        void ThreadedDecompress( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+        static ITK_THREAD_RETURN_TYPE DecompressThreaderCallback( void * pArg );
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(ChunkedStackImageFileReader);
+
+        std::string                                 m_FileName;
+        HeaderType                                  m_Header;
+        SizeValueType                               m_NumberOfChunksRead;
+
+        // Chunks overlapping the requested region, with their compressed bytes
+        std::vector< SizeValueType >                m_Chunks;
+        std::vector< std::vector< char > >          m_CompressedChunks;
+        std::vector< bool >                         m_ChunkFailed;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkChunkedStackImageFileReader.hxx"
+#endif
+
+#endif // itkChunkedStackImageFileReader_h
@@ -0,0 +1,198 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkChunkedStackImageFileReader_hxx
+#define itkChunkedStackImageFileReader_hxx
+
+#include "itkChunkedStackImageFileReader.h"
+
+#include "itkImageIOBase.h"
+#include "itkImageScanlineIterator.h"
+
+#include <fstream>
+
+namespace itk
+{
+    template< typename TOutputImage >
+    ChunkedStackImageFileReader< TOutputImage >::ChunkedStackImageFileReader()
+        : m_NumberOfChunksRead( 0 )
+    {
+    }
+
+    template< typename TOutputImage >
+    void ChunkedStackImageFileReader< TOutputImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "FileName: " << m_FileName << std::endl;
+        os << indent << "NumberOfChunksRead: " << m_NumberOfChunksRead << std::endl;
+    }
+
+    template< typename TOutputImage >
+    void ChunkedStackImageFileReader< TOutputImage >::GenerateOutputInformation()
+    {
+        OutputImageType * pOutput( this->GetOutput() );
+
+        if( m_FileName.empty() )
+            itkExceptionMacro( "No file name set" );
+
+        std::ifstream ifs( m_FileName.c_str(), std::ios::binary );
+        if( !ifs )
+            itkExceptionMacro( "Unable to open " << m_FileName );
+
+        m_Header = HeaderType();
+        const std::string strError( m_Header.Read( ifs ) );
+        if( !strError.empty() )
+            itkExceptionMacro( << m_FileName << " is " << strError );
+
+        if( m_Header.PixelSize != sizeof( OutputPixelType ) )
+            itkExceptionMacro( << m_FileName << " holds " << m_Header.PixelType << " pixels of " << m_Header.PixelSize << " bytes, not "
+                               << ImageIOBase::GetComponentTypeAsString( ImageIOBase::MapPixelType< OutputPixelType >::CType ) );
+
+        OutputImageRegionType regionLargest;
+        regionLargest.SetSize( m_Header.Size );
+
+        typename OutputImageType::SpacingType spacing;
+        typename OutputImageType::PointType origin;
+        typename OutputImageType::DirectionType direction;
+        for( unsigned int j = 0; j < ImageDimension; j++ )
+        {
+            spacing[j] = m_Header.Spacing[j];
+            origin[j] = m_Header.Origin[j];
+            for( unsigned int k = 0; k < ImageDimension; k++ )
+                direction[j][k] = m_Header.Direction[j * ImageDimension + k];
+        }
+
+        pOutput->SetLargestPossibleRegion( regionLargest );
+        pOutput->SetSpacing( spacing );
+        pOutput->SetOrigin( origin );
+        pOutput->SetDirection( direction );
+    }
+
+    template< typename TOutputImage >
+    void ChunkedStackImageFileReader< TOutputImage >::EnlargeOutputRequestedRegion( DataObject * )
+    {
+    }
+
+    template< typename TOutputImage >
+    void ChunkedStackImageFileReader< TOutputImage >::GenerateData()
+    {
+        OutputImageType * pOutput( this->GetOutput() );
+        const OutputImageRegionType regionRequested( pOutput->GetRequestedRegion() );
+
+        pOutput->SetBufferedRegion( regionRequested );
+        pOutput->Allocate();
+
+        m_Chunks = m_Header.GetChunksOverlapping( regionRequested );
+        m_CompressedChunks.resize( m_Chunks.size() );
+        m_ChunkFailed.assign( m_Chunks.size(), false );
+
+        // The chunks are read in file order by this thread, leaving the
+        // decompression to the threads
+        {
+            std::ifstream ifs( m_FileName.c_str(), std::ios::binary );
+            if( !ifs )
+                itkExceptionMacro( "Unable to open " << m_FileName );
+
+            for( size_t i = 0; i < m_Chunks.size(); i++ )
+            {
+                const std::uint64_t uintSize( m_Header.ChunkSizes[m_Chunks[i]] );
+                if( uintSize == 0 )
+                    itkExceptionMacro( "Chunk " << m_Chunks[i] << " of " << m_FileName << " was not written" );
+
+                m_CompressedChunks[i].resize( uintSize );
+                ifs.seekg( static_cast< std::streamoff >( m_Header.ChunkOffsets[m_Chunks[i]] ) );
+                if( !ifs.read( &m_CompressedChunks[i][0], static_cast< std::streamsize >( uintSize ) ) )
+                    itkExceptionMacro( "Unable to read chunk " << m_Chunks[i] << " of " << m_FileName );
+            }
+        }
+
+        this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+        this->GetMultiThreader()->SetSingleMethod( this->DecompressThreaderCallback, this );
+        this->GetMultiThreader()->SingleMethodExecute();
+
+        std::vector< std::vector< char > >().swap( m_CompressedChunks );
+
+        for( size_t i = 0; i < m_Chunks.size(); i++ )
+        {
+            if( m_ChunkFailed[i] )
+                itkExceptionMacro( "Unable to decompress chunk " << m_Chunks[i] << " of " << m_FileName );
+        }
+
+        m_NumberOfChunksRead = m_Chunks.size();
+    }
+
+    template< typename TOutputImage >
+    void ChunkedStackImageFileReader< TOutputImage >::ThreadedDecompress( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        OutputImageType * pOutput( this->GetOutput() );
+        const OutputImageRegionType regionRequested( pOutput->GetRequestedRegion() );
+
+        std::vector< OutputPixelType > vecPixels;
+        std::vector< char > vecShuffled;
+
+        for( size_t i = threadId; i < m_Chunks.size(); i += numberOfThreads )
+        {
+            const OutputImageRegionType regionChunk( m_Header.GetChunkRegion( m_Chunks[i] ) );
+            vecPixels.resize( regionChunk.GetNumberOfPixels() );
+
+            if( !ChunkedStackCodec::Decompress( &m_CompressedChunks[i][0], m_CompressedChunks[i].size(), vecPixels.size(), sizeof( OutputPixelType ),
+                                                vecShuffled, reinterpret_cast< char * >( &vecPixels[0] ) ) )
+            {
+                m_ChunkFailed[i] = true;
+                continue;
+            }
+
+            // Copy the part of the chunk within the requested region, the
+            // chunk pixels being stored first axis fastest
+            OutputImageRegionType regionCopy( regionChunk );
+            regionCopy.Crop( regionRequested );
+
+            ImageScanlineIterator< OutputImageType > itOutput( pOutput, regionCopy );
+            while( !itOutput.IsAtEnd() )
+            {
+                const typename OutputImageType::IndexType indexLine( itOutput.GetIndex() );
+
+                SizeValueType uintOffset( 0 );
+                for( unsigned int j = ImageDimension; j-- > 0; )
+                    uintOffset = uintOffset * regionChunk.GetSize( j ) + static_cast< SizeValueType >( indexLine[j] - regionChunk.GetIndex( j ) );
+
+                const OutputPixelType * pPixel( &vecPixels[uintOffset] );
+                while( !itOutput.IsAtEndOfLine() )
+                {
+                    itOutput.Set( *pPixel++ );
+                    ++itOutput;
+                }
+
+                itOutput.NextLine();
+            }
+        }
+    }
+
+    template< typename TOutputImage >
+    ITK_THREAD_RETURN_TYPE ChunkedStackImageFileReader< TOutputImage >::DecompressThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedDecompress( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+}
+
+#endif // itkChunkedStackImageFileReader_hxx
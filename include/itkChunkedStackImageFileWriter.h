@@ -0,0 +1,138 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkChunkedStackImageFileWriter_h
+#define itkChunkedStackImageFileWriter_h
+
+#include "itkProcessObject.h"
+#include "itkImage.h"
+#include "itkChunkedStackFormat.h"
+
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class ChunkedStackImageFileWriter
+ *
+ * \brief Writes an image, typically a projection stack, as a chunked stack file.
+ *
+ * The image is cut into chunks of ChunkSize pixels, a size of 0 along an axis
+ * taking the whole axis, which are byte shuffled and deflated independently,
+ * see ChunkedStackHeader. The default chunks hold whole rows, 16 rows of 16
+ * frames of a stack, so that a ChunkedStackImageFileReader reads a few
+ * projections or a sinogram slab without decompressing the rest of the file.
+ *
+ * The chunks are compressed by the threads of the writer a batch at a time
+ * and written in order as each batch completes, so only a batch of chunks is
+ * held compressed at once. The file is written under a temporary name and
+ * renamed when complete.
+ *
+ * \sa ChunkedStackImageFileReader
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TInputImage >
+    class ITK_TEMPLATE_EXPORT ChunkedStackImageFileWriter : public ProcessObject
+    {
+    public:
+        typedef ChunkedStackImageFileWriter                 Self;
+        typedef ProcessObject                               Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, TInputImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(ChunkedStackImageFileWriter, ProcessObject)
+
+        /** Image related typedefs. */
+        typedef TInputImage                                 InputImageType;
+        typedef typename InputImageType::PixelType          InputPixelType;
+        typedef typename InputImageType::RegionType         InputImageRegionType;
+        typedef typename InputImageType::SizeType           SizeType;
+
+        typedef ChunkedStackHeader< TInputImage::ImageDimension > HeaderType;
+
+        /** Image to write */
+        using Superclass::SetInput;
+        void SetInput( const InputImageType * pInput )
+        {
+            this->ProcessObject::SetNthInput( 0, const_cast< InputImageType * >( pInput ) );
+        }
+        const InputImageType * GetInput() const
+        {
+            return itkDynamicCastInDebugMode< const InputImageType * >( this->GetPrimaryInput() );
+        }
+
+        itkSetStringMacro( FileName )
+        itkGetStringMacro( FileName )
+
+        /** Pixels of a chunk along each axis, 0 for the whole axis */
+        itkSetMacro( ChunkSize, SizeType )
+        itkGetConstReferenceMacro( ChunkSize, SizeType )
+
+        /** Deflate level, from 1, the fastest, to 9, the smallest */
+        itkSetClampMacro( CompressionLevel, int, 1, 9 )
+        itkGetConstMacro( CompressionLevel, int )
+
+        /** Chunks compressed per thread before a batch is written */
+        itkSetClampMacro( NumberOfChunksPerThread, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( NumberOfChunksPerThread, unsigned int )
+
+        /** Header of the last file written, with its chunk index */
+        const HeaderType & GetHeader() const { return m_Header; }
+
+        /** Brings the input up to date and writes it */
+        virtual void Write();
+
+        virtual void Update() ITK_OVERRIDE { this->Write(); }
+
+    protected:
+        ChunkedStackImageFileWriter();
+        virtual ~ChunkedStackImageFileWriter() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        virtual void GenerateData() ITK_OVERRIDE;
+
+        /** Compresses the chunks of the current batch assigned to a thread */
+        void ThreadedCompress( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+        static ITK_THREAD_RETURN_TYPE CompressThreaderCallback( void * pArg );
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(ChunkedStackImageFileWriter);
+
+        std::string                                 m_FileName;
+        SizeType                                    m_ChunkSize;
+        int                                         m_CompressionLevel;
+        unsigned int                                m_NumberOfChunksPerThread;
+
+        HeaderType                                  m_Header;
+
+        // Chunks of the batch being compressed, with their compressed bytes
+        SizeValueType                               m_BatchFirst;
+        std::vector< std::vector< char > >          m_BatchChunks;
+        std::vector< bool >                         m_BatchFailed;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkChunkedStackImageFileWriter.hxx"
+#endif
+
+#endif // itkChunkedStackImageFileWriter_h
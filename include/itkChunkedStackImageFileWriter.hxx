@@ -0,0 +1,201 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkChunkedStackImageFileWriter_hxx
+#define itkChunkedStackImageFileWriter_hxx
+
+#include "itkChunkedStackImageFileWriter.h"
+
+#include "itkImageIOBase.h"
+#include "itkImageScanlineConstIterator.h"
+
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <fstream>
+
+namespace itk
+{
+    template< typename TInputImage >
+    ChunkedStackImageFileWriter< TInputImage >::ChunkedStackImageFileWriter()
+        : m_CompressionLevel( 1 )
+        , m_NumberOfChunksPerThread( 4 )
+        , m_BatchFirst( 0 )
+    {
+        this->SetNumberOfRequiredInputs( 1 );
+
+        // Whole rows, 16 rows of 16 frames
+        m_ChunkSize.Fill( 16 );
+        m_ChunkSize[0] = 0;
+    }
+
+    template< typename TInputImage >
+    void ChunkedStackImageFileWriter< TInputImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "FileName: " << m_FileName << std::endl;
+        os << indent << "ChunkSize: " << m_ChunkSize << std::endl;
+        os << indent << "CompressionLevel: " << m_CompressionLevel << std::endl;
+        os << indent << "NumberOfChunksPerThread: " << m_NumberOfChunksPerThread << std::endl;
+    }
+
+    template< typename TInputImage >
+    void ChunkedStackImageFileWriter< TInputImage >::Write()
+    {
+        InputImageType * pInput( const_cast< InputImageType * >( this->GetInput() ) );
+        if( !pInput )
+            itkExceptionMacro( "No input to write" );
+
+        if( m_FileName.empty() )
+            itkExceptionMacro( "No file name set" );
+
+        this->InvokeEvent( StartEvent() );
+
+        pInput->UpdateOutputInformation();
+        pInput->SetRequestedRegionToLargestPossibleRegion();
+        pInput->Update();
+
+        this->GenerateData();
+
+        this->InvokeEvent( EndEvent() );
+
+        // Release upstream data if requested
+        this->ReleaseInputs();
+    }
+
+    template< typename TInputImage >
+    void ChunkedStackImageFileWriter< TInputImage >::GenerateData()
+    {
+        const InputImageType * pInput( this->GetInput() );
+        const InputImageRegionType regionInput( pInput->GetLargestPossibleRegion() );
+
+        if( pInput->GetBufferedRegion() != regionInput )
+            itkExceptionMacro( "Input buffered over " << pInput->GetBufferedRegion() << " rather than " << regionInput );
+
+        m_Header = HeaderType();
+        m_Header.PixelType = ImageIOBase::GetComponentTypeAsString( ImageIOBase::MapPixelType< InputPixelType >::CType );
+        m_Header.PixelSize = sizeof( InputPixelType );
+        for( unsigned int j = 0; j < ImageDimension; j++ )
+        {
+            m_Header.Size[j] = regionInput.GetSize( j );
+            m_Header.ChunkSize[j] = m_ChunkSize[j] == 0 ? std::max( regionInput.GetSize( j ), static_cast< SizeValueType >( 1 ) ) : m_ChunkSize[j];
+            m_Header.Spacing[j] = pInput->GetSpacing()[j];
+            m_Header.Origin[j] = pInput->GetOrigin()[j];
+            for( unsigned int k = 0; k < ImageDimension; k++ )
+                m_Header.Direction[j * ImageDimension + k] = pInput->GetDirection()[j][k];
+        }
+
+        const std::string strTemporaryFileName( m_FileName + ".tmp" );
+
+        {
+            std::ofstream ofs( strTemporaryFileName.c_str(), std::ios::binary );
+            if( !ofs )
+                itkExceptionMacro( "Unable to open " << strTemporaryFileName );
+
+            m_Header.Write( ofs );
+
+            const SizeValueType uintNumChunks( m_Header.GetNumberOfChunks() );
+            const ThreadIdType uintNumThreads( this->GetNumberOfThreads() );
+            const SizeValueType uintBatchSize( static_cast< SizeValueType >( uintNumThreads ) * m_NumberOfChunksPerThread );
+
+            this->GetMultiThreader()->SetNumberOfThreads( uintNumThreads );
+            this->GetMultiThreader()->SetSingleMethod( this->CompressThreaderCallback, this );
+
+            for( m_BatchFirst = 0; m_BatchFirst < uintNumChunks; m_BatchFirst += uintBatchSize )
+            {
+                const SizeValueType uintBatchChunks( std::min( uintBatchSize, uintNumChunks - m_BatchFirst ) );
+                m_BatchChunks.resize( uintBatchChunks );
+                m_BatchFailed.assign( uintBatchChunks, false );
+
+                this->GetMultiThreader()->SingleMethodExecute();
+
+                for( SizeValueType i = 0; i < uintBatchChunks; i++ )
+                {
+                    if( m_BatchFailed[i] )
+                        itkExceptionMacro( "Unable to compress chunk " << m_BatchFirst + i << " of " << m_FileName );
+
+                    m_Header.ChunkOffsets[m_BatchFirst + i] = static_cast< std::uint64_t >( ofs.tellp() );
+                    m_Header.ChunkSizes[m_BatchFirst + i] = m_BatchChunks[i].size();
+                    ofs.write( &m_BatchChunks[i][0], static_cast< std::streamsize >( m_BatchChunks[i].size() ) );
+                }
+
+                this->UpdateProgress( static_cast< float >( m_BatchFirst + uintBatchChunks ) / uintNumChunks );
+            }
+
+            std::vector< std::vector< char > >().swap( m_BatchChunks );
+
+            m_Header.WriteIndex( ofs );
+
+            if( !ofs.flush() )
+                itkExceptionMacro( "Unable to write " << strTemporaryFileName );
+        }
+
+        if( !itksys::SystemTools::RenameFile( strTemporaryFileName.c_str(), m_FileName.c_str() ) )
+            itkExceptionMacro( "Unable to rename " << strTemporaryFileName << " to " << m_FileName );
+    }
+
+    template< typename TInputImage >
+    void ChunkedStackImageFileWriter< TInputImage >::ThreadedCompress( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const InputImageType * pInput( this->GetInput() );
+        const typename InputImageType::IndexType indexStart( pInput->GetLargestPossibleRegion().GetIndex() );
+
+        std::vector< InputPixelType > vecPixels;
+        std::vector< char > vecShuffled;
+
+        for( SizeValueType i = threadId; i < m_BatchChunks.size(); i += numberOfThreads )
+        {
+            // Chunks are numbered from the start of the largest possible region
+            InputImageRegionType regionChunk( m_Header.GetChunkRegion( m_BatchFirst + i ) );
+            for( unsigned int j = 0; j < ImageDimension; j++ )
+                regionChunk.SetIndex( j, regionChunk.GetIndex( j ) + indexStart[j] );
+
+            vecPixels.resize( regionChunk.GetNumberOfPixels() );
+
+            ImageScanlineConstIterator< InputImageType > itInput( pInput, regionChunk );
+            typename std::vector< InputPixelType >::iterator itPixels( vecPixels.begin() );
+            while( !itInput.IsAtEnd() )
+            {
+                while( !itInput.IsAtEndOfLine() )
+                {
+                    *itPixels++ = itInput.Get();
+                    ++itInput;
+                }
+
+                itInput.NextLine();
+            }
+
+            if( !ChunkedStackCodec::Compress( reinterpret_cast< const char * >( &vecPixels[0] ), vecPixels.size(), sizeof( InputPixelType ), m_CompressionLevel,
+                                              vecShuffled, m_BatchChunks[i] ) )
+                m_BatchFailed[i] = true;
+        }
+    }
+
+    template< typename TInputImage >
+    ITK_THREAD_RETURN_TYPE ChunkedStackImageFileWriter< TInputImage >::CompressThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedCompress( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+}
+
+#endif // itkChunkedStackImageFileWriter_hxx
@@ -0,0 +1,55 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkComputePixelTraits_h
+#define itkComputePixelTraits_h
+
+#include "itkFloat16.h"
+#include "itkBFloat16.h"
+
+namespace itk
+{
+/** \class ComputePixelTraits
+ *
+ * \brief Type in which the filters of this module compute on a stored pixel.
+ *
+ * Native pixel types are computed on as they are, while the reduced
+ * precision storage types (Float16, BFloat16) are widened to float when
+ * gathered from their buffers.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TPixel >
+    struct ComputePixelTraits
+    {
+        typedef TPixel              ComputeType;
+    };
+
+    template<>
+    struct ComputePixelTraits< Float16 >
+    {
+        typedef float               ComputeType;
+    };
+
+    template<>
+    struct ComputePixelTraits< BFloat16 >
+    {
+        typedef float               ComputeType;
+    };
+}
+
+#endif // itkComputePixelTraits_h
@@ -0,0 +1,124 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkDefectMapRepairImageFilter_h
+#define itkDefectMapRepairImageFilter_h
+
+#include "itkInPlaceImageFilter.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+#include "itkComputePixelTraits.h"
+#include "itkDetectorDefectMap.h"
+
+namespace itk
+{
+/** \class DefectMapRepairImageFilter
+ *
+ * \brief Repairs the defective pixels of a frame from a DetectorDefectMap.
+ *
+ * Each defect of the map is replaced by the median of its stencil, the
+ * pixels within the radius of the map that are neither defects nor off the
+ * detector, the upper of the two middle values for an even count. A defect
+ * whose stencil is empty is left unchanged. Only the stencils are gathered,
+ * so the cost of a frame is proportional to the number of defects rather than
+ * to its size, unlike a MaskedMedianImageFilter run with a mask of the frame.
+ *
+ * The whole frame is processed, its buffered region having to be the region
+ * of the map. The filter runs in place by default: the other pixels are then
+ * passed through untouched, and since no stencil reads a defect the repaired
+ * pixels never feed each other. Otherwise the input is copied to the output
+ * first. The defects are divided among the threads.
+ *
+ * \sa DetectorDefectMap, MaskedMedianImageFilter
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    class ITK_TEMPLATE_EXPORT DefectMapRepairImageFilter : public InPlaceImageFilter< TImage, TImage >
+    {
+    public:
+        typedef DefectMapRepairImageFilter                  Self;
+        typedef InPlaceImageFilter< TImage, TImage >        Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(DefectMapRepairImageFilter, InPlaceImageFilter)
+
+        /** Image related typedefs. */
+        typedef TImage                                      ImageType;
+        typedef typename ImageType::PixelType               PixelType;
+        typedef typename ImageType::RegionType              ImageRegionType;
+
+        /** Stencils are gathered and their median selected in this type,
+         * float for the reduced precision storage types */
+        typedef typename ComputePixelTraits< PixelType >::ComputeType ComputeType;
+
+        typedef DetectorDefectMap< TImage::ImageDimension > DefectMapType;
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( ComputeLessThanComparableCheck, ( Concept::LessThanComparable< ComputeType > ) );
+    #endif
+
+        /** Defects of the detector and their stencils */
+        itkSetConstObjectMacro( DefectMap, DefectMapType )
+        itkGetConstObjectMacro( DefectMap, DefectMapType )
+
+        /** Maximum number of progress events per update */
+        itkSetMacro( NumberOfProgressUpdates, unsigned int )
+        itkGetConstMacro( NumberOfProgressUpdates, unsigned int )
+
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+        /** Modified with the map as well as the filter */
+        virtual ModifiedTimeType GetMTime() const ITK_OVERRIDE;
+
+    protected:
+        DefectMapRepairImageFilter();
+        virtual ~DefectMapRepairImageFilter() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** The whole frame is requested and produced */
+        virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+        virtual void EnlargeOutputRequestedRegion( DataObject * pOutput ) ITK_OVERRIDE;
+
+        virtual void GenerateData() ITK_OVERRIDE;
+
+        /** Repairs a share of the defects */
+        void ThreadedRepair( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+        static ITK_THREAD_RETURN_TYPE RepairThreaderCallback( void * pArg );
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(DefectMapRepairImageFilter);
+
+        typename DefectMapType::ConstPointer        m_DefectMap;
+        unsigned int                                m_NumberOfProgressUpdates;
+
+        ChunkedProgressCounter                      m_ProgressCounter;
+        FilterInstrumentation::Pointer              m_Instrumentation;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkDefectMapRepairImageFilter.hxx"
+#endif
+
+#endif // itkDefectMapRepairImageFilter_h
@@ -0,0 +1,193 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkDefectMapRepairImageFilter_hxx
+#define itkDefectMapRepairImageFilter_hxx
+
+#include "itkDefectMapRepairImageFilter.h"
+
+#include "itkImageAlgorithm.h"
+
+#include <algorithm>
+#include <vector>
+
+#define DEFECT_REPAIR_BLOCK_SIZE 1024
+
+namespace itk
+{
+    template< typename TImage >
+    DefectMapRepairImageFilter< TImage >::DefectMapRepairImageFilter()
+        : m_NumberOfProgressUpdates( 100 )
+        , m_Instrumentation( FilterInstrumentation::New() )
+    {
+        this->InPlaceOn();
+    }
+
+    template< typename TImage >
+    void DefectMapRepairImageFilter< TImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "NumberOfDefects: " << ( m_DefectMap ? m_DefectMap->GetNumberOfDefects() : 0 ) << std::endl;
+        os << indent << "NumberOfProgressUpdates: " << m_NumberOfProgressUpdates << std::endl;
+    }
+
+    template< typename TImage >
+    ModifiedTimeType DefectMapRepairImageFilter< TImage >::GetMTime() const
+    {
+        const ModifiedTimeType uintMTime( Superclass::GetMTime() );
+
+        return m_DefectMap ? std::max( uintMTime, m_DefectMap->GetMTime() ) : uintMTime;
+    }
+
+    template< typename TImage >
+    void DefectMapRepairImageFilter< TImage >::GenerateInputRequestedRegion()
+    {
+        Superclass::GenerateInputRequestedRegion();
+
+        ImageType * pInput( const_cast< ImageType * >( this->GetInput() ) );
+        if( pInput )
+            pInput->SetRequestedRegionToLargestPossibleRegion();
+    }
+
+    template< typename TImage >
+    void DefectMapRepairImageFilter< TImage >::EnlargeOutputRequestedRegion( DataObject * pOutput )
+    {
+        Superclass::EnlargeOutputRequestedRegion( pOutput );
+
+        pOutput->SetRequestedRegionToLargestPossibleRegion();
+    }
+
+    template< typename TImage >
+    void DefectMapRepairImageFilter< TImage >::GenerateData()
+    {
+        if( !m_DefectMap )
+            itkExceptionMacro( "No defect map set" );
+
+        const ImageType * pInput( this->GetInput() );
+        if( pInput->GetBufferedRegion() != m_DefectMap->GetRegion() )
+            itkExceptionMacro( "Frame buffered over " << pInput->GetBufferedRegion() << " rather than the region of the defect map " << m_DefectMap->GetRegion() );
+
+        this->AllocateOutputs();
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        // Run in place the output is the input, the other pixels already in place
+        ImageType * pOutput( this->GetOutput() );
+        if( pOutput->GetBufferPointer() != pInput->GetBufferPointer() )
+        {
+            itkCSIROTomoScopedPhase( m_Instrumentation, 0, RegionCopy );
+            ImageAlgorithm::Copy( pInput, pOutput, pInput->GetBufferedRegion(), pOutput->GetRequestedRegion() );
+        }
+
+        m_ProgressCounter.Initialize( m_DefectMap->GetNumberOfDefects(), m_NumberOfProgressUpdates );
+
+        this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+        this->GetMultiThreader()->SetSingleMethod( this->RepairThreaderCallback, this );
+        this->GetMultiThreader()->SingleMethodExecute();
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
+    template< typename TImage >
+    void DefectMapRepairImageFilter< TImage >::ThreadedRepair( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const SizeValueType uintNumDefects( m_DefectMap->GetNumberOfDefects() );
+        const SizeValueType uintFirst( uintNumDefects * threadId / numberOfThreads );
+        const SizeValueType uintEnd( uintNumDefects * ( threadId + 1 ) / numberOfThreads );
+
+        // support progress methods/callbacks
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter );
+
+        // No stencil reads a defect, so reading the input while writing the
+        // output is safe in place
+        const PixelType * pInputBuffer( this->GetInput()->GetBufferPointer() );
+        PixelType * pOutputBuffer( this->GetOutput()->GetBufferPointer() );
+        const typename DefectMapType::OffsetsType & vecDefects( m_DefectMap->GetDefectOffsets() );
+
+        // The stencils of a block of defects are gathered one after another,
+        // pixels[vecStarts[i - uintBlock]] onwards for defect i, and then
+        // selected, each pass timed once per block, a single stencil being
+        // too small to time
+        std::vector< ComputeType > pixels;
+        std::vector< SizeValueType > vecStarts;
+        SizeValueType uintMediansComputed( 0 );
+
+        for( SizeValueType uintBlock = uintFirst; uintBlock < uintEnd; uintBlock += DEFECT_REPAIR_BLOCK_SIZE )
+        {
+            const SizeValueType uintBlockEnd( std::min( uintBlock + DEFECT_REPAIR_BLOCK_SIZE, uintEnd ) );
+
+            {
+                itkCSIROTomoScopedPhase( m_Instrumentation, threadId, NeighborhoodGather );
+
+                pixels.clear();
+                vecStarts.assign( 1, 0 );
+                for( SizeValueType i = uintBlock; i < uintBlockEnd; i++ )
+                {
+                    const SizeValueType uintStencilSize( m_DefectMap->GetStencilSize( i ) );
+                    const PixelType * pCenter( pInputBuffer + vecDefects[i] );
+                    const OffsetValueType * pStencil( m_DefectMap->GetStencil( i ) );
+
+                    const SizeValueType uintStart( pixels.size() );
+                    pixels.resize( uintStart + uintStencilSize );
+                    for( SizeValueType k = 0; k < uintStencilSize; ++k )
+                        pixels[uintStart + k] = pCenter[pStencil[k]];
+
+                    vecStarts.push_back( pixels.size() );
+                }
+            }
+
+            {
+                itkCSIROTomoScopedPhase( m_Instrumentation, threadId, MedianSelection );
+
+                for( SizeValueType i = uintBlock; i < uintBlockEnd; i++ )
+                {
+                    const typename std::vector< ComputeType >::iterator itBegin( pixels.begin() + vecStarts[i - uintBlock] );
+                    const typename std::vector< ComputeType >::iterator itEnd( pixels.begin() + vecStarts[i - uintBlock + 1] );
+                    if( itBegin == itEnd )
+                        continue;
+
+                    const typename std::vector< ComputeType >::iterator medianIterator( itBegin + ( itEnd - itBegin ) / 2 );
+                    std::nth_element( itBegin, medianIterator, itEnd );
+
+                    pOutputBuffer[vecDefects[i]] = static_cast< PixelType >( static_cast< double >( *medianIterator ) );
+
+                    ++uintMediansComputed;
+                }
+            }
+        }
+
+        progress.CompletedPixels( uintEnd - uintFirst );
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, uintEnd - uintFirst );
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, MediansComputed, uintMediansComputed );
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, BytesAllocated, pixels.capacity() * sizeof( ComputeType ) + vecStarts.capacity() * sizeof( SizeValueType ) );
+    }
+
+    template< typename TImage >
+    ITK_THREAD_RETURN_TYPE DefectMapRepairImageFilter< TImage >::RepairThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedRepair( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+}
+
+#endif // itkDefectMapRepairImageFilter_hxx
@@ -0,0 +1,335 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkDetectorDefectMap_h
+#define itkDetectorDefectMap_h
+
+#include "itkImageRegion.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkPackedBitMaskImage.h"
+
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class DetectorDefectMap
+ *
+ * \brief Dead and hot pixels of a detector with the stencils repairing them.
+ *
+ * Defective pixels are a property of the detector rather than of each frame,
+ * so they are found once, e.g. by a ThresholdedMedianMaskImageFilter run on
+ * the average flat, and added to the map with AddDefects(). Update() sorts
+ * them by buffer offset and computes the stencil of each: the buffer offsets,
+ * relative to the defect, of the pixels within Radius of it that lie on the
+ * detector and are not defects themselves. DefectMapRepairImageFilter then
+ * repairs a frame by the median of each stencil, at a cost proportional to
+ * the number of defects rather than the size of the frame.
+ *
+ * Offsets are those of a frame buffered over Region. The map is saved by
+ * Write() as a text list of the defects and the radius, the stencils being
+ * recomputed by Read().
+ *
+ * \sa DefectMapRepairImageFilter
+ * \ingroup ITKCSIROTomo
+ */
+    template< unsigned int VImageDimension = 2 >
+    class ITK_TEMPLATE_EXPORT DetectorDefectMap : public Object
+    {
+    public:
+        typedef DetectorDefectMap                           Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, VImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(DetectorDefectMap, Object)
+
+        typedef ImageRegion< VImageDimension >              RegionType;
+        typedef typename RegionType::IndexType              IndexType;
+        typedef typename RegionType::SizeType               SizeType;
+        typedef SizeType                                    RadiusType;
+        typedef std::vector< OffsetValueType >              OffsetsType;
+
+        /** Pixels of the detector, that of the frames repaired */
+        itkGetConstReferenceMacro( Region, RegionType )
+
+        /** Neighborhood radius of the stencils */
+        itkSetMacro( Radius, RadiusType )
+        itkGetConstReferenceMacro( Radius, RadiusType )
+
+        /** Clears the map for a detector of the given region */
+        void Initialize( const RegionType & region )
+        {
+            m_Region = region;
+            m_Defects.clear();
+            m_StencilStarts.assign( 1, 0 );
+            m_StencilOffsets.clear();
+            this->Modified();
+        }
+
+        /** Adds a defect, Update() to recompute the stencils */
+        void AddDefect( const IndexType & index )
+        {
+            if( !m_Region.IsInside( index ) )
+                itkExceptionMacro( "Defect " << index << " lies outside " << m_Region );
+
+            m_Defects.push_back( ComputeOffset( index ) );
+            this->Modified();
+        }
+
+        /** Adds the set pixels of a mask of the detector region, an Image or a
+         * PackedBitMaskImage */
+        template< typename TMaskImage >
+        void AddDefects( const TMaskImage * pMask )
+        {
+            if( pMask->GetBufferedRegion() != m_Region )
+                itkExceptionMacro( "Mask buffered over " << pMask->GetBufferedRegion() << " rather than the detector region " << m_Region );
+
+            const SizeValueType uintLineLength( m_Region.GetSize( 0 ) );
+
+            RegionType regionLines( m_Region );
+            regionLines.SetSize( 0, 1 );
+
+            for( OffsetValueType intLine = 0; intLine < static_cast< OffsetValueType >( regionLines.GetNumberOfPixels() ); intLine++ )
+            {
+                const IndexType index( ComputeIndex( intLine * static_cast< OffsetValueType >( uintLineLength ) ) );
+                const MaskScanlineConstIterator< TMaskImage > itMask( pMask, index, uintLineLength );
+
+                for( SizeValueType x = itMask.FindNextSet( 0 ); x < uintLineLength; x = itMask.FindNextSet( x + 1 ) )
+                    m_Defects.push_back( intLine * static_cast< OffsetValueType >( uintLineLength ) + static_cast< OffsetValueType >( x ) );
+            }
+
+            this->Modified();
+        }
+
+        /** Sorts the defects and computes their stencils */
+        void Update()
+        {
+            std::sort( m_Defects.begin(), m_Defects.end() );
+            m_Defects.erase( std::unique( m_Defects.begin(), m_Defects.end() ), m_Defects.end() );
+
+            // Offsets of the neighborhood relative to its centre
+            std::vector< IndexType > vecNeighbors;
+            {
+                RegionType regionNeighborhood;
+                for( unsigned int j = 0; j < VImageDimension; j++ )
+                {
+                    regionNeighborhood.SetIndex( j, -static_cast< IndexValueType >( m_Radius[j] ) );
+                    regionNeighborhood.SetSize( j, 2 * m_Radius[j] + 1 );
+                }
+
+                for( SizeValueType i = 0; i < regionNeighborhood.GetNumberOfPixels(); i++ )
+                {
+                    IndexType indexNeighbor;
+                    SizeValueType uintRemainder( i );
+                    for( unsigned int j = 0; j < VImageDimension; j++ )
+                    {
+                        indexNeighbor[j] = regionNeighborhood.GetIndex( j ) + static_cast< IndexValueType >( uintRemainder % regionNeighborhood.GetSize( j ) );
+                        uintRemainder /= regionNeighborhood.GetSize( j );
+                    }
+
+                    bool blnCentre( true );
+                    for( unsigned int j = 0; j < VImageDimension; j++ )
+                        blnCentre = blnCentre && indexNeighbor[j] == 0;
+
+                    if( !blnCentre )
+                        vecNeighbors.push_back( indexNeighbor );
+                }
+            }
+
+            m_StencilStarts.assign( 1, 0 );
+            m_StencilOffsets.clear();
+
+            for( size_t i = 0; i < m_Defects.size(); i++ )
+            {
+                const IndexType indexDefect( ComputeIndex( m_Defects[i] ) );
+
+                for( size_t n = 0; n < vecNeighbors.size(); n++ )
+                {
+                    IndexType indexNeighbor;
+                    for( unsigned int j = 0; j < VImageDimension; j++ )
+                        indexNeighbor[j] = indexDefect[j] + vecNeighbors[n][j];
+
+                    if( !m_Region.IsInside( indexNeighbor ) )
+                        continue;
+
+                    const OffsetValueType intNeighbor( ComputeOffset( indexNeighbor ) );
+                    if( !std::binary_search( m_Defects.begin(), m_Defects.end(), intNeighbor ) )
+                        m_StencilOffsets.push_back( intNeighbor - m_Defects[i] );
+                }
+
+                m_StencilStarts.push_back( static_cast< SizeValueType >( m_StencilOffsets.size() ) );
+            }
+
+            this->Modified();
+        }
+
+        SizeValueType GetNumberOfDefects() const
+        {
+            return static_cast< SizeValueType >( m_Defects.size() );
+        }
+
+        /** Buffer offsets of the defects in increasing order */
+        const OffsetsType & GetDefectOffsets() const
+        {
+            return m_Defects;
+        }
+
+        IndexType GetDefectIndex( SizeValueType i ) const
+        {
+            return ComputeIndex( m_Defects[i] );
+        }
+
+        /** Stencil of defect i, offsets relative to it */
+        const OffsetValueType * GetStencil( SizeValueType i ) const
+        {
+            return m_StencilOffsets.empty() ? ITK_NULLPTR : &m_StencilOffsets[0] + m_StencilStarts[i];
+        }
+
+        SizeValueType GetStencilSize( SizeValueType i ) const
+        {
+            return m_StencilStarts[i + 1] - m_StencilStarts[i];
+        }
+
+        /** Saves the region, radius and defects, through a temporary file */
+        void Write( const std::string & strFileName ) const
+        {
+            const std::string strTemporaryFileName( strFileName + ".tmp" );
+
+            {
+                std::ofstream ofs( strTemporaryFileName.c_str() );
+                ofs << "DetectorDefectMap1 " << VImageDimension << "\n";
+                for( unsigned int j = 0; j < VImageDimension; j++ )
+                    ofs << m_Region.GetIndex( j ) << " " << m_Region.GetSize( j ) << " " << m_Radius[j] << "\n";
+                ofs << m_Defects.size() << "\n";
+                for( size_t i = 0; i < m_Defects.size(); i++ )
+                    ofs << m_Defects[i] << "\n";
+
+                if( !ofs.flush() )
+                    itkExceptionMacro( "Unable to write " << strTemporaryFileName );
+            }
+
+            if( !itksys::SystemTools::RenameFile( strTemporaryFileName.c_str(), strFileName.c_str() ) )
+                itkExceptionMacro( "Unable to rename " << strTemporaryFileName << " to " << strFileName );
+        }
+
+        /** Loads a map saved by Write() and computes its stencils */
+        void Read( const std::string & strFileName )
+        {
+            std::ifstream ifs( strFileName.c_str() );
+
+            std::string strMagic;
+            unsigned int uintDimension( 0 );
+            if( !( ifs >> strMagic >> uintDimension ) || strMagic != "DetectorDefectMap1" || uintDimension != VImageDimension )
+                itkExceptionMacro( strFileName << " is not a " << VImageDimension << "D defect map" );
+
+            RegionType region;
+            RadiusType radius;
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+            {
+                IndexValueType intIndex( 0 );
+                SizeValueType uintSize( 0 );
+                if( !( ifs >> intIndex >> uintSize >> radius[j] ) )
+                    itkExceptionMacro( "Unable to read the geometry of " << strFileName );
+
+                region.SetIndex( j, intIndex );
+                region.SetSize( j, uintSize );
+            }
+
+            size_t uintNumDefects( 0 );
+            if( !( ifs >> uintNumDefects ) )
+                itkExceptionMacro( "Unable to read the defects of " << strFileName );
+
+            Initialize( region );
+            m_Radius = radius;
+            m_Defects.resize( uintNumDefects );
+            for( size_t i = 0; i < uintNumDefects; i++ )
+            {
+                if( !( ifs >> m_Defects[i] ) || m_Defects[i] < 0 || m_Defects[i] >= static_cast< OffsetValueType >( region.GetNumberOfPixels() ) )
+                    itkExceptionMacro( "Unable to read defect " << i << " of " << strFileName );
+            }
+
+            Update();
+        }
+
+    protected:
+        DetectorDefectMap()
+            : m_StencilStarts( 1, 0 )
+        {
+            m_Radius.Fill( 1 );
+        }
+
+        virtual ~DetectorDefectMap() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "Region: " << m_Region << std::endl;
+            os << indent << "Radius: " << m_Radius << std::endl;
+            os << indent << "NumberOfDefects: " << m_Defects.size() << std::endl;
+            os << indent << "NumberOfStencilOffsets: " << m_StencilOffsets.size() << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(DetectorDefectMap);
+
+        OffsetValueType ComputeOffset( const IndexType & index ) const
+        {
+            OffsetValueType intOffset( 0 );
+            OffsetValueType intStride( 1 );
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+            {
+                intOffset += ( index[j] - m_Region.GetIndex( j ) ) * intStride;
+                intStride *= static_cast< OffsetValueType >( m_Region.GetSize( j ) );
+            }
+
+            return intOffset;
+        }
+
+        IndexType ComputeIndex( OffsetValueType intOffset ) const
+        {
+            IndexType index;
+            for( unsigned int j = 0; j < VImageDimension; j++ )
+            {
+                index[j] = m_Region.GetIndex( j ) + static_cast< IndexValueType >( intOffset % static_cast< OffsetValueType >( m_Region.GetSize( j ) ) );
+                intOffset /= static_cast< OffsetValueType >( m_Region.GetSize( j ) );
+            }
+
+            return index;
+        }
+
+        RegionType                                          m_Region;
+        RadiusType                                          m_Radius;
+
+        // Stencil i holds m_StencilOffsets[m_StencilStarts[i]] up to, not
+        // including, m_StencilOffsets[m_StencilStarts[i + 1]]
+        OffsetsType                                         m_Defects;
+        std::vector< SizeValueType >                        m_StencilStarts;
+        OffsetsType                                         m_StencilOffsets;
+    };
+}
+
+#endif // itkDetectorDefectMap_h
@@ -0,0 +1,214 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkDynamicFlatFieldCorrectionImageFilter_h
+#define itkDynamicFlatFieldCorrectionImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+#include "itkNUMAPlacement.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class DynamicFlatFieldCorrectionImageFilter
+ *
+ * \brief Flat field correction of a projection by a flat field estimated for
+ * it from the eigenflats of the flat series.
+ *
+ * The input is a dark corrected projection. The flat field behind it is
+ * modelled as the dark corrected mean flat, SetMeanFlat(), plus a weighted
+ * sum of the eigenflats set by SetEigenFlat(), as computed by
+ * EigenFlatCalculator, so that drifts of the beam between the flats and the
+ * projection are followed rather than left as rings and bands in the
+ * reconstruction. The weights of each projection are fitted by least squares
+ * of the projection against the model over FitRegion, which should be a part
+ * of the field of view clear of the sample, the whole projection if left
+ * empty. The sums of the fit are accumulated in parallel over the rows of
+ * the fit region before the projection is divided by its flat field.
+ *
+ * The input may also be a stack of projections along its last axis, e.g. an
+ * (N, Y, X) array of N projections viewed as a 3D image, with the mean flat
+ * and eigenflats one frame thick along that axis. They are then applied to
+ * every frame and the weights fitted to each frame separately, over the
+ * other axes of FitRegion, so that a whole stack is corrected by one update
+ * threaded over all of its frames rather than one update per projection.
+ *
+ * Without eigenflats the filter divides by the mean flat, as a conventional
+ * flat field correction. Pixels with a zero flat field are set to the
+ * maximum of the output pixel type, as done by DivideImageFilter.
+ *
+ * \sa EigenFlatCalculator
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TInputImage, typename TOutputImage = TInputImage >
+    class ITK_TEMPLATE_EXPORT DynamicFlatFieldCorrectionImageFilter : public ImageToImageFilter< TInputImage, TOutputImage >
+    {
+    public:
+        typedef DynamicFlatFieldCorrectionImageFilter               Self;
+        typedef ImageToImageFilter< TInputImage, TOutputImage >     Superclass;
+        typedef SmartPointer< Self >                                Pointer;
+        typedef SmartPointer< const Self >                          ConstPointer;
+
+        itkStaticConstMacro( InputImageDimension, unsigned int, TInputImage::ImageDimension );
+        itkStaticConstMacro( OutputImageDimension, unsigned int, TOutputImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(DynamicFlatFieldCorrectionImageFilter, ImageToImageFilter)
+
+        /** Image related typedefs. */
+        typedef TInputImage                                         InputImageType;
+        typedef TOutputImage                                        OutputImageType;
+        typedef typename InputImageType::PixelType                  InputPixelType;
+        typedef typename OutputImageType::PixelType                 OutputPixelType;
+        typedef typename InputImageType::IndexType                  InputIndexType;
+        typedef typename InputImageType::RegionType                 InputImageRegionType;
+        typedef typename OutputImageType::RegionType                OutputImageRegionType;
+
+        typedef std::vector< double >                               WeightsType;
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( SameDimensionCheck, ( Concept::SameDimension< InputImageDimension, OutputImageDimension > ) );
+        itkConceptMacro( DoubleConvertibleToOutputCheck, ( Concept::Convertible< double, OutputPixelType > ) );
+    #endif
+
+        /** Dark corrected mean flat */
+        itkSetInputMacro( MeanFlat, InputImageType );
+        itkGetInputMacro( MeanFlat, InputImageType );
+
+        /** Eigenflat k of the flat series, of the geometry of the mean flat */
+        void SetEigenFlat( unsigned int k, const InputImageType * pEigenFlat )
+        {
+            this->SetInput( k + 1, pEigenFlat );
+        }
+
+        const InputImageType * GetEigenFlat( unsigned int k ) const
+        {
+            return this->GetInput( k + 1 );
+        }
+
+        unsigned int GetNumberOfEigenFlats() const
+        {
+            return this->GetNumberOfIndexedInputs() > 1 ? static_cast< unsigned int >( this->GetNumberOfIndexedInputs() - 1 ) : 0;
+        }
+
+        /** Region of the projection clear of the sample over which the weights
+         * are fitted, the whole projection if empty. The last axis of the
+         * region is ignored for a stack of projections. */
+        itkSetMacro( FitRegion, InputImageRegionType )
+        itkGetConstReferenceMacro( FitRegion, InputImageRegionType )
+
+        /** Eigenflat weights fitted to the last projection, for a stack those
+         * of each frame of the output requested region in turn */
+        itkGetConstReferenceMacro( Weights, WeightsType )
+
+        /** Maximum number of progress events per update */
+        itkSetMacro( NumberOfProgressUpdates, unsigned int )
+        itkGetConstMacro( NumberOfProgressUpdates, unsigned int )
+
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+        /** With a placement, threads run on their node and read the mean flat
+         * and eigenflats from copies on it. Null by default, see NUMAPlacement */
+        itkSetObjectMacro( NUMAPlacement, NUMAPlacement )
+        itkGetModifiableObjectMacro( NUMAPlacement, NUMAPlacement )
+
+    protected:
+        DynamicFlatFieldCorrectionImageFilter();
+        virtual ~DynamicFlatFieldCorrectionImageFilter() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** The fit region is requested of every input besides the output
+         * requested region */
+        virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+        /** Fits the weights */
+        virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
+        virtual void ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId ) ITK_OVERRIDE;
+        virtual void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+        /** Accumulates the normal equations of the fit over rows of the fit
+         * region */
+        void ThreadedFit( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+        static ITK_THREAD_RETURN_TYPE FitThreaderCallback( void * pArg );
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(DynamicFlatFieldCorrectionImageFilter);
+
+        /** Fit region cropped to the projection, over the frames of the output
+         * requested region for a stack */
+        InputImageRegionType ComputeFitRegion() const;
+
+        /** Whether the input is a stack of projections along its last axis,
+         * the mean flat being a single frame of it */
+        bool IsFrameStack() const;
+
+        /** Frame of the weights of a pixel, and the index of the mean flat and
+         * eigenflats applied to it */
+        SizeValueType GetFrame( const InputIndexType & index ) const
+        {
+            return m_FrameStack ? static_cast< SizeValueType >( index[InputImageDimension - 1] - m_FirstFrame ) : 0;
+        }
+
+        InputIndexType GetFlatIndex( const InputIndexType & index ) const
+        {
+            InputIndexType indexFlat( index );
+            if( m_FrameStack )
+                indexFlat[InputImageDimension - 1] = m_FlatFrame;
+            return indexFlat;
+        }
+
+        /** The flat, or with a placement its copy on the node of the thread */
+        const InputImageType * GetNodeFlat( const InputImageType * pFlat, ThreadIdType threadId, ThreadIdType numberOfThreads ) const
+        {
+            return m_NUMAPlacement ? m_NUMAPlacement->GetReplica( pFlat, m_NUMAPlacement->GetNodeOfThread( threadId, numberOfThreads ) ) : pFlat;
+        }
+
+        InputImageRegionType                        m_FitRegion;
+        WeightsType                                 m_Weights;
+        unsigned int                                m_NumberOfProgressUpdates;
+
+        // Normal equations of each thread, the upper triangle of the eigenflat
+        // products followed by their products with the projection, summed
+        // over the rows of the fit region
+        InputImageRegionType                        m_CroppedFitRegion;
+        std::vector< std::vector< double > >        m_PartialSums;
+
+        // Frames of the output requested region and of the mean flat of a stack
+        bool                                        m_FrameStack;
+        IndexValueType                              m_FirstFrame;
+        SizeValueType                               m_NumberOfFrames;
+        IndexValueType                              m_FlatFrame;
+
+        MultiThreader::Pointer                      m_Threader;
+        ChunkedProgressCounter                      m_ProgressCounter;
+        FilterInstrumentation::Pointer              m_Instrumentation;
+        NUMAPlacement::Pointer                      m_NUMAPlacement;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkDynamicFlatFieldCorrectionImageFilter.hxx"
+#endif
+
+#endif // itkDynamicFlatFieldCorrectionImageFilter_h
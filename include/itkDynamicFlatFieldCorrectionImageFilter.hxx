@@ -0,0 +1,362 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkDynamicFlatFieldCorrectionImageFilter_hxx
+#define itkDynamicFlatFieldCorrectionImageFilter_hxx
+
+#include "itkDynamicFlatFieldCorrectionImageFilter.h"
+
+#include "itkImageScanlineConstIterator.h"
+#include "itkImageRegionSplitterSlowDimension.h"
+
+#include "vnl/vnl_matrix.h"
+#include "vnl/vnl_vector.h"
+#include "vnl/algo/vnl_svd.h"
+
+#include <algorithm>
+
+namespace itk
+{
+    template< typename TInputImage, typename TOutputImage >
+    DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::DynamicFlatFieldCorrectionImageFilter()
+        : m_NumberOfProgressUpdates( 100 )
+        , m_FrameStack( false )
+        , m_FirstFrame( 0 )
+        , m_NumberOfFrames( 1 )
+        , m_FlatFrame( 0 )
+        , m_Threader( MultiThreader::New() )
+        , m_Instrumentation( FilterInstrumentation::New() )
+    {
+        this->AddRequiredInputName("MeanFlat");
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "NumberOfEigenFlats: " << GetNumberOfEigenFlats() << std::endl;
+        os << indent << "FitRegion: " << m_FitRegion << std::endl;
+        os << indent << "Weights:";
+        for( size_t k = 0; k < m_Weights.size(); k++ )
+            os << " " << m_Weights[k];
+        os << std::endl;
+        os << indent << "NumberOfProgressUpdates: " << m_NumberOfProgressUpdates << std::endl;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    bool DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::IsFrameStack() const
+    {
+        const InputImageRegionType & regionFlat( this->GetMeanFlat()->GetLargestPossibleRegion() );
+
+        return regionFlat.GetSize( InputImageDimension - 1 ) == 1 && regionFlat != this->GetInput()->GetLargestPossibleRegion();
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    typename DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::InputImageRegionType
+    DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::ComputeFitRegion() const
+    {
+        const InputImageRegionType & regionLargest( this->GetInput()->GetLargestPossibleRegion() );
+
+        InputImageRegionType regionFit( m_FitRegion.GetNumberOfPixels() == 0 ? regionLargest : m_FitRegion );
+
+        // Every frame requested of a stack is fitted over the same rows
+        if( IsFrameStack() )
+        {
+            const OutputImageRegionType & regionOutput( this->GetOutput()->GetRequestedRegion() );
+            regionFit.SetIndex( InputImageDimension - 1, regionOutput.GetIndex( InputImageDimension - 1 ) );
+            regionFit.SetSize( InputImageDimension - 1, regionOutput.GetSize( InputImageDimension - 1 ) );
+        }
+
+        if( !regionFit.Crop( regionLargest ) )
+            itkExceptionMacro( "Fit region " << m_FitRegion << " lies outside the projection" );
+
+        return regionFit;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::GenerateInputRequestedRegion()
+    {
+        Superclass::GenerateInputRequestedRegion();
+
+        if( !this->GetInput() || !this->GetMeanFlat() )
+            return;
+
+        // Bounding box of the output requested region and the fit region
+        const OutputImageRegionType & regionOutput( this->GetOutput()->GetRequestedRegion() );
+        const InputImageRegionType regionFit( GetNumberOfEigenFlats() > 0 ? ComputeFitRegion() : regionOutput );
+
+        InputImageRegionType regionRequested;
+        for( unsigned int j = 0; j < InputImageDimension; j++ )
+        {
+            const IndexValueType intStart( std::min( regionOutput.GetIndex( j ), regionFit.GetIndex( j ) ) );
+            const IndexValueType intEnd( std::max( regionOutput.GetIndex( j ) + static_cast< IndexValueType >( regionOutput.GetSize( j ) ),
+                                                   regionFit.GetIndex( j ) + static_cast< IndexValueType >( regionFit.GetSize( j ) ) ) );
+
+            regionRequested.SetIndex( j, intStart );
+            regionRequested.SetSize( j, static_cast< SizeValueType >( intEnd - intStart ) );
+        }
+
+        // The mean flat and eigenflats alike, their single frame for a stack
+        const bool blnFrameStack( IsFrameStack() );
+        ProcessObject::DataObjectPointerArray vecInputs( this->GetInputs() );
+
+        for( size_t i = 0; i < vecInputs.size(); i++ )
+        {
+            InputImageType * pInput( dynamic_cast< InputImageType * >( vecInputs[i].GetPointer() ) );
+
+            if( pInput )
+            {
+                InputImageRegionType regionInput( regionRequested );
+                if( blnFrameStack && pInput != this->GetInput() )
+                {
+                    regionInput.SetIndex( InputImageDimension - 1, pInput->GetLargestPossibleRegion().GetIndex( InputImageDimension - 1 ) );
+                    regionInput.SetSize( InputImageDimension - 1, 1 );
+                }
+                regionInput.Crop( pInput->GetLargestPossibleRegion() );
+                pInput->SetRequestedRegion( regionInput );
+            }
+        }
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::BeforeThreadedGenerateData()
+    {
+        Superclass::BeforeThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        const OutputImageRegionType & regionOutput( this->GetOutput()->GetRequestedRegion() );
+
+        m_FrameStack = IsFrameStack();
+        m_FirstFrame = m_FrameStack ? regionOutput.GetIndex( InputImageDimension - 1 ) : 0;
+        m_NumberOfFrames = m_FrameStack ? regionOutput.GetSize( InputImageDimension - 1 ) : 1;
+        m_FlatFrame = this->GetMeanFlat()->GetLargestPossibleRegion().GetIndex( InputImageDimension - 1 );
+
+        const unsigned int uintNumEigenFlats( GetNumberOfEigenFlats() );
+        const unsigned int uintNumSums( uintNumEigenFlats * ( uintNumEigenFlats + 3 ) / 2 );
+
+        // Copied to the nodes before the fit, whose threads read them too
+        if( m_NUMAPlacement )
+        {
+            m_NUMAPlacement->Replicate( this->GetMeanFlat() );
+            for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+                m_NUMAPlacement->Replicate( GetEigenFlat( k ) );
+        }
+
+        m_Weights.assign( m_NumberOfFrames * uintNumEigenFlats, 0.0 );
+
+        if( uintNumEigenFlats > 0 )
+        {
+            itkCSIROTomoScopedPhase( m_Instrumentation, 0, Weighting );
+
+            m_CroppedFitRegion = ComputeFitRegion();
+
+            m_Threader->SetNumberOfThreads( this->GetNumberOfThreads() );
+            m_PartialSums.assign( m_Threader->GetNumberOfThreads(), std::vector< double >( m_NumberOfFrames * uintNumSums, 0.0 ) );
+
+            m_Threader->SetSingleMethod( this->FitThreaderCallback, this );
+            m_Threader->SingleMethodExecute();
+
+            for( SizeValueType f = 0; f < m_NumberOfFrames; f++ )
+            {
+                vnl_matrix< double > matNormal( uintNumEigenFlats, uintNumEigenFlats, 0.0 );
+                vnl_vector< double > vecRight( uintNumEigenFlats, 0.0 );
+
+                for( size_t t = 0; t < m_PartialSums.size(); t++ )
+                {
+                    const double * pSums( &m_PartialSums[t][f * uintNumSums] );
+
+                    unsigned int i( 0 );
+                    for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+                    {
+                        for( unsigned int l = k; l < uintNumEigenFlats; l++, i++ )
+                        {
+                            matNormal( k, l ) += pSums[i];
+                            if( l != k )
+                                matNormal( l, k ) += pSums[i];
+                        }
+                    }
+                    for( unsigned int k = 0; k < uintNumEigenFlats; k++, i++ )
+                        vecRight[k] += pSums[i];
+                }
+
+                // Least squares by the pseudo-inverse, eigenflats that do not
+                // vary over the fit region left unweighted
+                vnl_svd< double > svd( matNormal );
+                svd.zero_out_relative( 1.0e-10 );
+                const vnl_vector< double > vecWeights( svd.solve( vecRight ) );
+
+                for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+                    m_Weights[f * uintNumEigenFlats + k] = vecWeights[k];
+            }
+
+            itkDebugMacro( "Eigenflat weights of " << m_NumberOfFrames << " frames fitted over " << m_CroppedFitRegion );
+        }
+
+        m_ProgressCounter.Initialize( this->GetOutput()->GetRequestedRegion().GetNumberOfPixels(), m_NumberOfProgressUpdates );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::AfterThreadedGenerateData()
+    {
+        Superclass::AfterThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::ThreadedFit( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        // The fit region split by rows alike for any number of threads
+        ImageRegionSplitterSlowDimension::Pointer pSplitter( ImageRegionSplitterSlowDimension::New() );
+
+        InputImageRegionType regionThread( m_CroppedFitRegion );
+        if( threadId >= pSplitter->GetNumberOfSplits( regionThread, numberOfThreads ) )
+            return;
+        pSplitter->GetSplit( threadId, numberOfThreads, regionThread );
+
+        NUMAPlacement::ScopedThreadPin pin( m_NUMAPlacement, threadId, numberOfThreads );
+
+        const InputImageType * pProjection( this->GetInput() );
+        const InputImageType * pMeanFlat( GetNodeFlat( this->GetMeanFlat(), threadId, numberOfThreads ) );
+        const unsigned int uintNumEigenFlats( GetNumberOfEigenFlats() );
+        const SizeValueType uintLineLength( regionThread.GetSize( 0 ) );
+
+        std::vector< const InputImageType * > vecEigenFlats( uintNumEigenFlats );
+        for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+            vecEigenFlats[k] = GetNodeFlat( GetEigenFlat( k ), threadId, numberOfThreads );
+
+        const unsigned int uintNumSums( uintNumEigenFlats * ( uintNumEigenFlats + 3 ) / 2 );
+        std::vector< double > vecResidual( uintLineLength );
+        std::vector< std::vector< double > > vecLines( uintNumEigenFlats, std::vector< double >( uintLineLength ) );
+
+        ImageScanlineConstIterator< InputImageType > itProjection( pProjection, regionThread );
+
+        for( itProjection.GoToBegin(); !itProjection.IsAtEnd(); itProjection.NextLine() )
+        {
+            const InputIndexType index( itProjection.GetIndex() );
+            const InputIndexType indexFlat( GetFlatIndex( index ) );
+            double * pSums( &m_PartialSums[threadId][GetFrame( index ) * uintNumSums] );
+
+            const InputPixelType * pProjectionLine( pProjection->GetBufferPointer() + pProjection->ComputeOffset( index ) );
+            const InputPixelType * pMeanLine( pMeanFlat->GetBufferPointer() + pMeanFlat->ComputeOffset( indexFlat ) );
+
+            for( SizeValueType x = 0; x < uintLineLength; ++x )
+                vecResidual[x] = static_cast< double >( pProjectionLine[x] ) - static_cast< double >( pMeanLine[x] );
+
+            for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+            {
+                const InputPixelType * pEigenLine( vecEigenFlats[k]->GetBufferPointer() + vecEigenFlats[k]->ComputeOffset( indexFlat ) );
+                for( SizeValueType x = 0; x < uintLineLength; ++x )
+                    vecLines[k][x] = static_cast< double >( pEigenLine[x] );
+            }
+
+            unsigned int i( 0 );
+            for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+            {
+                for( unsigned int l = k; l < uintNumEigenFlats; l++, i++ )
+                {
+                    double dblSum( 0.0 );
+                    for( SizeValueType x = 0; x < uintLineLength; ++x )
+                        dblSum += vecLines[k][x] * vecLines[l][x];
+                    pSums[i] += dblSum;
+                }
+            }
+            for( unsigned int k = 0; k < uintNumEigenFlats; k++, i++ )
+            {
+                double dblSum( 0.0 );
+                for( SizeValueType x = 0; x < uintLineLength; ++x )
+                    dblSum += vecLines[k][x] * vecResidual[x];
+                pSums[i] += dblSum;
+            }
+        }
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId )
+    {
+        const ThreadIdType numberOfThreads( this->GetNumberOfThreads() );
+        NUMAPlacement::ScopedThreadPin pin( m_NUMAPlacement, threadId, numberOfThreads );
+
+        const InputImageType * pProjection( this->GetInput() );
+        const InputImageType * pMeanFlat( GetNodeFlat( this->GetMeanFlat(), threadId, numberOfThreads ) );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        // support progress methods/callbacks, accounted once per scanline
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter );
+
+        const unsigned int uintNumEigenFlats( GetNumberOfEigenFlats() );
+        const SizeValueType uintLineLength( outputRegionForThread.GetSize( 0 ) );
+
+        std::vector< const InputImageType * > vecEigenFlats( uintNumEigenFlats );
+        for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+            vecEigenFlats[k] = GetNodeFlat( GetEigenFlat( k ), threadId, numberOfThreads );
+
+        std::vector< double > vecFlat( uintLineLength );
+
+        itkCSIROTomoScopedPhase( m_Instrumentation, threadId, Functor );
+
+        ImageScanlineConstIterator< InputImageType > itProjection( pProjection, outputRegionForThread );
+
+        for( itProjection.GoToBegin(); !itProjection.IsAtEnd(); itProjection.NextLine() )
+        {
+            const InputIndexType index( itProjection.GetIndex() );
+            const InputIndexType indexFlat( GetFlatIndex( index ) );
+            const double * pWeights( m_Weights.empty() ? ITK_NULLPTR : &m_Weights[GetFrame( index ) * uintNumEigenFlats] );
+
+            // Flat field of the projection along the line
+            const InputPixelType * pMeanLine( pMeanFlat->GetBufferPointer() + pMeanFlat->ComputeOffset( indexFlat ) );
+            for( SizeValueType x = 0; x < uintLineLength; ++x )
+                vecFlat[x] = static_cast< double >( pMeanLine[x] );
+
+            for( unsigned int k = 0; k < uintNumEigenFlats; k++ )
+            {
+                const InputPixelType * pEigenLine( vecEigenFlats[k]->GetBufferPointer() + vecEigenFlats[k]->ComputeOffset( indexFlat ) );
+                const double dblWeight( pWeights[k] );
+
+                for( SizeValueType x = 0; x < uintLineLength; ++x )
+                    vecFlat[x] += dblWeight * static_cast< double >( pEigenLine[x] );
+            }
+
+            const InputPixelType * pProjectionLine( pProjection->GetBufferPointer() + pProjection->ComputeOffset( index ) );
+            OutputPixelType * pOutputLine( pOutput->GetBufferPointer() + pOutput->ComputeOffset( index ) );
+
+            for( SizeValueType x = 0; x < uintLineLength; ++x )
+                pOutputLine[x] = vecFlat[x] != 0.0 ? static_cast< OutputPixelType >( static_cast< double >( pProjectionLine[x] ) / vecFlat[x] )
+                                                   : NumericTraits< OutputPixelType >::max();
+
+            progress.CompletedPixels( uintLineLength );
+        }
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, outputRegionForThread.GetNumberOfPixels() );
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, BytesAllocated, vecFlat.capacity() * sizeof( double ) );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    ITK_THREAD_RETURN_TYPE DynamicFlatFieldCorrectionImageFilter< TInputImage, TOutputImage >::FitThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedFit( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+}
+
+#endif // itkDynamicFlatFieldCorrectionImageFilter_hxx
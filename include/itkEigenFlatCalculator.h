@@ -0,0 +1,164 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkEigenFlatCalculator_h
+#define itkEigenFlatCalculator_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class EigenFlatCalculator
+ *
+ * \brief Principal components ("eigenflats") of a flat field series.
+ *
+ * Flats are added one at a time, after SetMeanFlat() has been given the
+ * average of the series, both dark corrected. Each flat updates a truncated
+ * SVD of the mean-centred series in place (Brand's incremental SVD), so only
+ * the NumberOfEigenFlats basis images are held, never the series itself, and
+ * flats can be read from disk one by one. Besides the mean flat and the flat
+ * being added, memory is that of NumberOfEigenFlats + 1 images whatever the
+ * number of flats. The basis is updated in parallel over the pixels, with
+ * the residual of each flat orthogonalised twice against it so that it stays
+ * orthonormal over long series.
+ *
+ * GetEigenFlat() returns the components in order of decreasing variance,
+ * scaled to the standard deviation of the series along them. They are used by
+ * DynamicFlatFieldCorrectionImageFilter to model the flat field behind each
+ * projection as the mean flat plus a weighted sum of eigenflats.
+ *
+ * Eigenflats are linear in the flats, so the eigenflats of each stack of a
+ * vertically stitched acquisition can be stitched by
+ * VerticalStitchingImageFilter with the alpha/beta weights computed from the
+ * average flats, each stitched with zero images in place of the other
+ * stacks.
+ *
+ * \sa DynamicFlatFieldCorrectionImageFilter
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    class ITK_TEMPLATE_EXPORT EigenFlatCalculator : public Object
+    {
+    public:
+        typedef EigenFlatCalculator                         Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(EigenFlatCalculator, Object)
+
+        /** Image related typedefs. */
+        typedef TImage                                      ImageType;
+        typedef typename ImageType::PixelType               PixelType;
+        typedef typename ImageType::RegionType              RegionType;
+
+        typedef std::vector< double >                       SingularValuesType;
+
+        /** Dark corrected average of the flat series */
+        itkSetConstObjectMacro( MeanFlat, ImageType )
+        itkGetConstObjectMacro( MeanFlat, ImageType )
+
+        /** Number of components kept */
+        itkSetClampMacro( NumberOfEigenFlats, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( NumberOfEigenFlats, unsigned int )
+
+        itkSetClampMacro( NumberOfThreads, ThreadIdType, 1, ITK_MAX_THREADS )
+        itkGetConstMacro( NumberOfThreads, ThreadIdType )
+
+        /** Discards the flats added so far */
+        void Initialize();
+
+        /** Updates the components with a dark corrected flat of the series */
+        void AddFlat( const ImageType * pFlat );
+
+        /** Number of flats added since Initialize() */
+        itkGetConstMacro( NumberOfFlats, SizeValueType )
+
+        /** Number of components available, the smaller of NumberOfEigenFlats and
+         * the number of flats added */
+        unsigned int GetNumberOfComputedEigenFlats() const
+        {
+            return static_cast< unsigned int >( m_SingularValues.size() );
+        }
+
+        /** Singular values of the centred series, decreasing */
+        const SingularValuesType & GetSingularValues() const
+        {
+            return m_SingularValues;
+        }
+
+        /** Component k as an image of the geometry of the mean flat */
+        typename ImageType::Pointer GetEigenFlat( unsigned int k ) const;
+
+    protected:
+        EigenFlatCalculator();
+        virtual ~EigenFlatCalculator() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** Centres the flat, the first time, and projects the residual onto
+         * the basis */
+        void ThreadedProject( ThreadIdType threadId, ThreadIdType numberOfThreads );
+        /** Removes the projection from the centred flat, leaving the residual */
+        void ThreadedResidual( ThreadIdType threadId, ThreadIdType numberOfThreads );
+        /** Rotates the basis and residual onto the updated components */
+        void ThreadedRotate( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+        static ITK_THREAD_RETURN_TYPE ProjectThreaderCallback( void * pArg );
+        static ITK_THREAD_RETURN_TYPE ResidualThreaderCallback( void * pArg );
+        static ITK_THREAD_RETURN_TYPE RotateThreaderCallback( void * pArg );
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(EigenFlatCalculator);
+
+        typename ImageType::ConstPointer                    m_MeanFlat;
+        unsigned int                                        m_NumberOfEigenFlats;
+        ThreadIdType                                        m_NumberOfThreads;
+
+        SizeValueType                                       m_NumberOfFlats;
+        SingularValuesType                                  m_SingularValues;
+
+        // Basis images one after the other, the residual of the flat being
+        // added following the current components
+        SizeValueType                                       m_NumberOfPixels;
+        std::vector< float >                                m_Basis;
+
+        // State of the update shared by the threads
+        const PixelType *                                   m_Flat;
+        std::vector< std::vector< double > >                m_PartialSums;
+        std::vector< double >                               m_Projection;
+        std::vector< double >                               m_Rotation;
+        double                                              m_ResidualScale;
+        unsigned int                                        m_Rank;
+        unsigned int                                        m_UpdatedRank;
+
+        MultiThreader::Pointer                              m_Threader;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkEigenFlatCalculator.hxx"
+#endif
+
+#endif // itkEigenFlatCalculator_h
@@ -0,0 +1,320 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkEigenFlatCalculator_hxx
+#define itkEigenFlatCalculator_hxx
+
+#include "itkEigenFlatCalculator.h"
+
+#include "vnl/vnl_matrix.h"
+#include "vnl/algo/vnl_svd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+    template< typename TImage >
+    EigenFlatCalculator< TImage >::EigenFlatCalculator()
+        : m_NumberOfEigenFlats( 8 )
+        , m_NumberOfThreads( MultiThreader::GetGlobalDefaultNumberOfThreads() )
+        , m_NumberOfFlats( 0 )
+        , m_NumberOfPixels( 0 )
+        , m_Flat( ITK_NULLPTR )
+        , m_ResidualScale( 0.0 )
+        , m_Rank( 0 )
+        , m_UpdatedRank( 0 )
+        , m_Threader( MultiThreader::New() )
+    {
+    }
+
+    template< typename TImage >
+    void EigenFlatCalculator< TImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "MeanFlat: " << m_MeanFlat.GetPointer() << std::endl;
+        os << indent << "NumberOfEigenFlats: " << m_NumberOfEigenFlats << std::endl;
+        os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+        os << indent << "NumberOfFlats: " << m_NumberOfFlats << std::endl;
+        os << indent << "NumberOfComputedEigenFlats: " << GetNumberOfComputedEigenFlats() << std::endl;
+    }
+
+    template< typename TImage >
+    void EigenFlatCalculator< TImage >::Initialize()
+    {
+        m_NumberOfFlats = 0;
+        m_NumberOfPixels = 0;
+        m_SingularValues.clear();
+
+        std::vector< float >().swap( m_Basis );
+    }
+
+    template< typename TImage >
+    void EigenFlatCalculator< TImage >::AddFlat( const ImageType * pFlat )
+    {
+        if( !m_MeanFlat )
+            itkExceptionMacro( "A mean flat is required" );
+
+        if( !pFlat || pFlat->GetBufferedRegion() != m_MeanFlat->GetBufferedRegion() )
+            itkExceptionMacro( "Flat and mean flat buffered regions differ" );
+
+        if( m_NumberOfFlats == 0 )
+            m_NumberOfPixels = m_MeanFlat->GetBufferedRegion().GetNumberOfPixels();
+        else if( m_NumberOfPixels != m_MeanFlat->GetBufferedRegion().GetNumberOfPixels() )
+            itkExceptionMacro( "Flats differ in size from those added before" );
+
+        m_Rank = GetNumberOfComputedEigenFlats();
+
+        // Room for the residual after the current components
+        if( m_Basis.size() < ( m_Rank + 1 ) * m_NumberOfPixels )
+            m_Basis.resize( ( m_Rank + 1 ) * m_NumberOfPixels );
+
+        m_Threader->SetNumberOfThreads( m_NumberOfThreads );
+        const ThreadIdType uintNumThreads( m_Threader->GetNumberOfThreads() );
+
+        // Residual of the centred flat, orthogonalised twice against the basis.
+        // The last partial sum holds the squared norm of what is projected.
+        m_Projection.assign( m_Rank, 0.0 );
+        m_Flat = pFlat->GetBufferPointer();
+        double dblCentredNorm( 0.0 );
+        double dblResidualNorm( 0.0 );
+
+        for( unsigned int uintPass = 0; uintPass < 2; uintPass++ )
+        {
+            m_PartialSums.assign( uintNumThreads, std::vector< double >( m_Rank + 1, 0.0 ) );
+
+            m_Threader->SetSingleMethod( this->ProjectThreaderCallback, this );
+            m_Threader->SingleMethodExecute();
+
+            std::vector< double > vecProjection( m_Rank, 0.0 );
+            for( ThreadIdType t = 0; t < uintNumThreads; t++ )
+                for( unsigned int k = 0; k < m_Rank; k++ )
+                    vecProjection[k] += m_PartialSums[t][k];
+
+            if( uintPass == 0 )
+            {
+                for( ThreadIdType t = 0; t < uintNumThreads; t++ )
+                    dblCentredNorm += m_PartialSums[t][m_Rank];
+                dblCentredNorm = std::sqrt( dblCentredNorm );
+            }
+
+            m_Flat = ITK_NULLPTR;
+            m_PartialSums.assign( uintNumThreads, std::vector< double >( m_Rank + 1, 0.0 ) );
+            std::swap( m_Projection, vecProjection );
+
+            m_Threader->SetSingleMethod( this->ResidualThreaderCallback, this );
+            m_Threader->SingleMethodExecute();
+
+            for( unsigned int k = 0; k < m_Rank; k++ )
+                m_Projection[k] += vecProjection[k];
+
+            dblResidualNorm = 0.0;
+            for( ThreadIdType t = 0; t < uintNumThreads; t++ )
+                dblResidualNorm += m_PartialSums[t][m_Rank];
+            dblResidualNorm = std::sqrt( dblResidualNorm );
+        }
+
+        // A residual at rounding level adds no direction to the basis
+        if( dblResidualNorm <= 1.0e-6 * dblCentredNorm )
+            dblResidualNorm = 0.0;
+
+        // SVD of the current components extended by the flat,
+        //   [ diag( S )  p   ]
+        //   [ 0          |r| ]
+        vnl_matrix< double > matUpdate( m_Rank + 1, m_Rank + 1, 0.0 );
+        for( unsigned int k = 0; k < m_Rank; k++ )
+        {
+            matUpdate( k, k ) = m_SingularValues[k];
+            matUpdate( k, m_Rank ) = m_Projection[k];
+        }
+        matUpdate( m_Rank, m_Rank ) = dblResidualNorm;
+
+        vnl_svd< double > svd( matUpdate );
+
+        m_UpdatedRank = std::min( m_NumberOfEigenFlats, dblResidualNorm > 0.0 ? m_Rank + 1 : m_Rank );
+        m_ResidualScale = dblResidualNorm > 0.0 ? 1.0 / dblResidualNorm : 0.0;
+
+        m_Rotation.resize( ( m_Rank + 1 ) * m_UpdatedRank );
+        for( unsigned int j = 0; j <= m_Rank; j++ )
+            for( unsigned int k = 0; k < m_UpdatedRank; k++ )
+                m_Rotation[j * m_UpdatedRank + k] = svd.U( j, k );
+
+        m_Threader->SetSingleMethod( this->RotateThreaderCallback, this );
+        m_Threader->SingleMethodExecute();
+
+        m_SingularValues.resize( m_UpdatedRank );
+        for( unsigned int k = 0; k < m_UpdatedRank; k++ )
+            m_SingularValues[k] = svd.W( k );
+
+        m_NumberOfFlats++;
+    }
+
+    template< typename TImage >
+    typename EigenFlatCalculator< TImage >::ImageType::Pointer EigenFlatCalculator< TImage >::GetEigenFlat( unsigned int k ) const
+    {
+        if( k >= GetNumberOfComputedEigenFlats() )
+            itkExceptionMacro( "Eigenflat " << k << " requested of " << GetNumberOfComputedEigenFlats() );
+
+        typename ImageType::Pointer pEigenFlat( ImageType::New() );
+        pEigenFlat->CopyInformation( m_MeanFlat );
+        pEigenFlat->SetBufferedRegion( m_MeanFlat->GetBufferedRegion() );
+        pEigenFlat->SetRequestedRegion( m_MeanFlat->GetBufferedRegion() );
+        pEigenFlat->Allocate();
+
+        // Scaled to the standard deviation of the series along the component
+        const double dblScale( m_SingularValues[k] / std::sqrt( static_cast< double >( m_NumberOfFlats ) ) );
+        const float * pComponent( &m_Basis[k * m_NumberOfPixels] );
+        PixelType * pPixels( pEigenFlat->GetBufferPointer() );
+
+        for( SizeValueType i = 0; i < m_NumberOfPixels; i++ )
+            pPixels[i] = static_cast< PixelType >( dblScale * pComponent[i] );
+
+        return pEigenFlat;
+    }
+
+    template< typename TImage >
+    void EigenFlatCalculator< TImage >::ThreadedProject( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const SizeValueType uintStart( m_NumberOfPixels * threadId / numberOfThreads );
+        const SizeValueType uintEnd( m_NumberOfPixels * ( threadId + 1 ) / numberOfThreads );
+
+        std::vector< double > & vecSums( m_PartialSums[threadId] );
+        float * pResidual( &m_Basis[m_Rank * m_NumberOfPixels] );
+
+        if( m_Flat )
+        {
+            const PixelType * pMean( m_MeanFlat->GetBufferPointer() );
+
+            for( SizeValueType i = uintStart; i < uintEnd; i++ )
+                pResidual[i] = static_cast< float >( static_cast< double >( m_Flat[i] ) - static_cast< double >( pMean[i] ) );
+        }
+
+        for( unsigned int k = 0; k < m_Rank; k++ )
+        {
+            const float * pComponent( &m_Basis[k * m_NumberOfPixels] );
+
+            double dblSum( 0.0 );
+            for( SizeValueType i = uintStart; i < uintEnd; i++ )
+                dblSum += static_cast< double >( pComponent[i] ) * pResidual[i];
+
+            vecSums[k] = dblSum;
+        }
+
+        double dblNorm( 0.0 );
+        for( SizeValueType i = uintStart; i < uintEnd; i++ )
+            dblNorm += static_cast< double >( pResidual[i] ) * pResidual[i];
+
+        vecSums[m_Rank] = dblNorm;
+    }
+
+    template< typename TImage >
+    void EigenFlatCalculator< TImage >::ThreadedResidual( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const SizeValueType uintStart( m_NumberOfPixels * threadId / numberOfThreads );
+        const SizeValueType uintEnd( m_NumberOfPixels * ( threadId + 1 ) / numberOfThreads );
+
+        float * pResidual( &m_Basis[m_Rank * m_NumberOfPixels] );
+
+        for( unsigned int k = 0; k < m_Rank; k++ )
+        {
+            const float * pComponent( &m_Basis[k * m_NumberOfPixels] );
+            const float fltProjection( static_cast< float >( m_Projection[k] ) );
+
+            for( SizeValueType i = uintStart; i < uintEnd; i++ )
+                pResidual[i] -= fltProjection * pComponent[i];
+        }
+
+        double dblNorm( 0.0 );
+        for( SizeValueType i = uintStart; i < uintEnd; i++ )
+            dblNorm += static_cast< double >( pResidual[i] ) * pResidual[i];
+
+        m_PartialSums[threadId][m_Rank] = dblNorm;
+    }
+
+    template< typename TImage >
+    void EigenFlatCalculator< TImage >::ThreadedRotate( ThreadIdType threadId, ThreadIdType numberOfThreads )
+    {
+        const SizeValueType uintStart( m_NumberOfPixels * threadId / numberOfThreads );
+        const SizeValueType uintEnd( m_NumberOfPixels * ( threadId + 1 ) / numberOfThreads );
+
+        // The pixels are rotated a block at a time, the rotated components
+        // gathered aside as the current ones are still read
+        const SizeValueType uintBlockLength( 1024 );
+        std::vector< float > vecRotated( m_UpdatedRank * uintBlockLength );
+
+        for( SizeValueType uintBlock = uintStart; uintBlock < uintEnd; uintBlock += uintBlockLength )
+        {
+            const SizeValueType uintLength( std::min( uintBlockLength, uintEnd - uintBlock ) );
+
+            std::fill( vecRotated.begin(), vecRotated.end(), 0.0f );
+
+            for( unsigned int j = 0; j <= m_Rank; j++ )
+            {
+                const float * pComponent( &m_Basis[j * m_NumberOfPixels + uintBlock] );
+                const double dblScale( j < m_Rank ? 1.0 : m_ResidualScale );
+
+                for( unsigned int k = 0; k < m_UpdatedRank; k++ )
+                {
+                    const float fltWeight( static_cast< float >( dblScale * m_Rotation[j * m_UpdatedRank + k] ) );
+                    float * pRotated( &vecRotated[k * uintBlockLength] );
+
+                    for( SizeValueType i = 0; i < uintLength; i++ )
+                        pRotated[i] += fltWeight * pComponent[i];
+                }
+            }
+
+            for( unsigned int k = 0; k < m_UpdatedRank; k++ )
+                std::copy( &vecRotated[k * uintBlockLength], &vecRotated[k * uintBlockLength] + uintLength, &m_Basis[k * m_NumberOfPixels + uintBlock] );
+        }
+    }
+
+    template< typename TImage >
+    ITK_THREAD_RETURN_TYPE EigenFlatCalculator< TImage >::ProjectThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedProject( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+
+    template< typename TImage >
+    ITK_THREAD_RETURN_TYPE EigenFlatCalculator< TImage >::ResidualThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedResidual( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+
+    template< typename TImage >
+    ITK_THREAD_RETURN_TYPE EigenFlatCalculator< TImage >::RotateThreaderCallback( void * pArg )
+    {
+        MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+        Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+        pSelf->ThreadedRotate( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+}
+
+#endif // itkEigenFlatCalculator_hxx
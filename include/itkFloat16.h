@@ -0,0 +1,275 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkFloat16_h
+#define itkFloat16_h
+
+#include "itkFixedArray.h"
+#include "itkIntTypes.h"
+#include "itkMacro.h"
+#include "itkNumericTraits.h"
+
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace itk
+{
+/** \class Float16
+ *
+ * \brief IEEE 754 half precision storage pixel type.
+ *
+ * Float16 halves the memory and bandwidth of intermediate float images
+ * (1 sign, 5 exponent and 10 mantissa bits, ~3 significant digits, range
+ * +/-65504). It is a storage type only: values convert implicitly to float
+ * for all arithmetic, and the filters of this module gather and compute in
+ * float (see ComputePixelTraits) before rounding the result back to half
+ * precision, to nearest even.
+ *
+ * \sa BFloat16
+ * \ingroup ITKCSIROTomo
+ */
+    class Float16
+    {
+    public:
+        typedef uint16_t            StorageType;
+
+        Float16()
+            : m_Bits( 0 )
+        {
+        }
+
+        /** Conversion from any arithmetic type, rounding to nearest even */
+        template< typename T >
+        Float16( const T & value )
+            : m_Bits( FloatToBits( static_cast< float >( value ) ) )
+        {
+        }
+
+        operator float() const
+        {
+            return BitsToFloat( m_Bits );
+        }
+
+        Float16 & operator+=( float flt ) { return *this = Float16( BitsToFloat( m_Bits ) + flt ); }
+        Float16 & operator-=( float flt ) { return *this = Float16( BitsToFloat( m_Bits ) - flt ); }
+        Float16 & operator*=( float flt ) { return *this = Float16( BitsToFloat( m_Bits ) * flt ); }
+        Float16 & operator/=( float flt ) { return *this = Float16( BitsToFloat( m_Bits ) / flt ); }
+
+        Float16 operator-() const { return FromBits( m_Bits ^ 0x8000 ); }
+
+        StorageType GetBits() const { return m_Bits; }
+
+        static Float16 FromBits( StorageType uintBits )
+        {
+            Float16 value;
+            value.m_Bits = uintBits;
+            return value;
+        }
+
+        static StorageType FloatToBits( float flt )
+        {
+            uint32_t uintFloat;
+            std::memcpy( &uintFloat, &flt, sizeof( uintFloat ) );
+
+            const uint32_t uintSign( ( uintFloat >> 16 ) & 0x8000 );
+            const uint32_t uintExponent( ( uintFloat >> 23 ) & 0xff );
+            uint32_t uintMantissa( uintFloat & 0x7fffff );
+
+            // Infinity and NaN, keeping NaNs quiet
+            if( uintExponent == 0xff )
+                return static_cast< StorageType >( uintSign | 0x7c00 | ( uintMantissa ? 0x200 | ( uintMantissa >> 13 ) : 0 ) );
+
+            const int intExponent( static_cast< int >( uintExponent ) - 127 + 15 );
+
+            // Overflow to infinity
+            if( intExponent >= 0x1f )
+                return static_cast< StorageType >( uintSign | 0x7c00 );
+
+            // Subnormal or underflow to signed zero
+            if( intExponent <= 0 )
+            {
+                if( intExponent < -10 )
+                    return static_cast< StorageType >( uintSign );
+
+                uintMantissa |= 0x800000;
+
+                const unsigned int uintShift( static_cast< unsigned int >( 14 - intExponent ) );
+                const uint32_t uintHalfway( 1u << ( uintShift - 1 ) );
+                const uint32_t uintRemainder( uintMantissa & ( ( 1u << uintShift ) - 1 ) );
+                uint32_t uintHalf( uintMantissa >> uintShift );
+
+                if( uintRemainder > uintHalfway || ( uintRemainder == uintHalfway && ( uintHalf & 1 ) ) )
+                    uintHalf++;
+
+                return static_cast< StorageType >( uintSign | uintHalf );
+            }
+
+            // Normal, a carry out of the mantissa correctly increments the exponent
+            uint32_t uintHalf( uintSign | ( static_cast< uint32_t >( intExponent ) << 10 ) | ( uintMantissa >> 13 ) );
+            const uint32_t uintRemainder( uintMantissa & 0x1fff );
+
+            if( uintRemainder > 0x1000 || ( uintRemainder == 0x1000 && ( uintHalf & 1 ) ) )
+                uintHalf++;
+
+            return static_cast< StorageType >( uintHalf );
+        }
+
+        static float BitsToFloat( StorageType uintBits )
+        {
+            const uint32_t uintSign( static_cast< uint32_t >( uintBits & 0x8000 ) << 16 );
+            int intExponent( ( uintBits >> 10 ) & 0x1f );
+            uint32_t uintMantissa( uintBits & 0x3ff );
+            uint32_t uintFloat;
+
+            if( intExponent == 0x1f )
+                uintFloat = uintSign | 0x7f800000 | ( uintMantissa << 13 );
+            else if( intExponent == 0 && uintMantissa == 0 )
+                uintFloat = uintSign;
+            else
+            {
+                // Normalise subnormals
+                if( intExponent == 0 )
+                {
+                    intExponent = 1;
+                    while( !( uintMantissa & 0x400 ) )
+                    {
+                        uintMantissa <<= 1;
+                        intExponent--;
+                    }
+                    uintMantissa &= 0x3ff;
+                }
+
+                uintFloat = uintSign | ( static_cast< uint32_t >( intExponent + 127 - 15 ) << 23 ) | ( uintMantissa << 13 );
+            }
+
+            float flt;
+            std::memcpy( &flt, &uintFloat, sizeof( flt ) );
+            return flt;
+        }
+
+    private:
+        StorageType                 m_Bits;
+    };
+
+    inline std::ostream & operator<<( std::ostream & os, const Float16 & value )
+    {
+        return os << static_cast< float >( value );
+    }
+
+    inline std::istream & operator>>( std::istream & is, Float16 & value )
+    {
+        float flt;
+        if( is >> flt )
+            value = Float16( flt );
+        return is;
+    }
+}
+
+namespace std
+{
+    /** Limits of half precision, so that the type satisfies the floating
+     * point concept checks of ITK */
+    template<>
+    class numeric_limits< itk::Float16 >
+    {
+    public:
+        static const bool is_specialized = true;
+        static const bool is_signed = true;
+        static const bool is_integer = false;
+        static const bool is_exact = false;
+        static const bool has_infinity = true;
+        static const bool has_quiet_NaN = true;
+        static const bool has_signaling_NaN = false;
+        static const bool is_iec559 = true;
+        static const bool is_bounded = true;
+        static const bool is_modulo = false;
+        static const int digits = 11;
+        static const int digits10 = 3;
+        static const int max_digits10 = 5;
+        static const int radix = 2;
+        static const int min_exponent = -13;
+        static const int min_exponent10 = -4;
+        static const int max_exponent = 16;
+        static const int max_exponent10 = 4;
+        static const float_round_style round_style = round_to_nearest;
+
+        static itk::Float16 min() { return itk::Float16::FromBits( 0x0400 ); }
+        static itk::Float16 lowest() { return itk::Float16::FromBits( 0xfbff ); }
+        static itk::Float16 max() { return itk::Float16::FromBits( 0x7bff ); }
+        static itk::Float16 epsilon() { return itk::Float16::FromBits( 0x1400 ); }
+        static itk::Float16 round_error() { return itk::Float16::FromBits( 0x3800 ); }
+        static itk::Float16 infinity() { return itk::Float16::FromBits( 0x7c00 ); }
+        static itk::Float16 quiet_NaN() { return itk::Float16::FromBits( 0x7e00 ); }
+        static itk::Float16 signaling_NaN() { return itk::Float16::FromBits( 0x7d00 ); }
+        static itk::Float16 denorm_min() { return itk::Float16::FromBits( 0x0001 ); }
+    };
+}
+
+namespace itk
+{
+    /** \class NumericTraits<Float16>
+     * \brief Traits of the half precision storage type, accumulating and
+     * computing in float
+     * \ingroup ITKCSIROTomo
+     */
+    template<>
+    class NumericTraits< Float16 > : public std::numeric_limits< Float16 >
+    {
+    public:
+        typedef Float16                     ValueType;
+        typedef Float16                     AbsType;
+        typedef float                       PrintType;
+        typedef float                       AccumulateType;
+        typedef float                       FloatType;
+        typedef float                       RealType;
+        typedef float                       ScalarRealType;
+        typedef FixedArray< ValueType, 1 >  MeasurementVectorType;
+
+        static const bool IsSigned = true;
+        static const bool IsInteger = false;
+        static const bool IsComplex = false;
+
+        static ValueType min() { return ValueType::FromBits( 0x0400 ); }
+        static ValueType max() { return ValueType::FromBits( 0x7bff ); }
+        static ValueType min( ValueType ) { return min(); }
+        static ValueType max( ValueType ) { return max(); }
+        static ValueType NonpositiveMin() { return ValueType::FromBits( 0xfbff ); }
+        static ValueType ZeroValue() { return ValueType(); }
+        static ValueType OneValue() { return ValueType::FromBits( 0x3c00 ); }
+        static ValueType ZeroValue( const ValueType & ) { return ZeroValue(); }
+        static ValueType OneValue( const ValueType & ) { return OneValue(); }
+
+        static bool IsPositive( ValueType val ) { return static_cast< float >( val ) > 0.0f; }
+        static bool IsNonpositive( ValueType val ) { return static_cast< float >( val ) <= 0.0f; }
+        static bool IsNegative( ValueType val ) { return static_cast< float >( val ) < 0.0f; }
+        static bool IsNonnegative( ValueType val ) { return static_cast< float >( val ) >= 0.0f; }
+
+        static unsigned int GetLength( const ValueType & ) { return 1; }
+        static unsigned int GetLength() { return 1; }
+        static void SetLength( ValueType &, const unsigned int s )
+        {
+            if( s != 1 )
+                itkGenericExceptionMacro( << "Cannot set the size of a scalar to " << s );
+        }
+        static ValueType ZeroValue( const ValueType &, unsigned int ) { return ZeroValue(); }
+        template< typename TArray >
+        static void AssignToArray( const ValueType & v, TArray & mv ) { mv = v; }
+    };
+}
+
+#endif // itkFloat16_h
@@ -0,0 +1,196 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkHDF5ProjectionStackSource_h
+#define itkHDF5ProjectionStackSource_h
+
+#include "itkImage.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include "itk_hdf5.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace itk
+{
+/** \class HDF5ProjectionStackSource
+ *
+ * \brief Reads the projections of an HDF5 or NeXus projection dataset.
+ *
+ * The dataset, DatasetName in FileName, is three dimensional with the
+ * projection slowest and the detector column fastest, as the data of a NeXus
+ * NXdetector. Its projections are read in slabs aligned to the chunk shape of
+ * the dataset, every row and column of as many projections as a chunk holds,
+ * so that each chunk is read and decompressed once, straight into the slab,
+ * rather than once per projection it holds through the HDF5 chunk cache. A
+ * contiguous dataset is read a projection at a time.
+ *
+ * The last NumberOfCachedSlabs slabs read are kept, and with ReadAhead on a
+ * background thread reads the slab following the one last requested, so that
+ * reading overlaps the processing of the projections already read.
+ * GetProjection() returns a new image per projection, to be handed to the
+ * per-projection filters, converted by HDF5 from the type of the dataset to
+ * the pixel type of the image.
+ *
+ * The HDF5 library of ITK is not built thread safe, so the reads of a source
+ * are serialised, and no other HDF5 file should be accessed while a source is
+ * open.
+ *
+ * \sa IMBLSeriesIndex
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TProjectionImage >
+    class ITK_TEMPLATE_EXPORT HDF5ProjectionStackSource : public Object
+    {
+    public:
+        typedef HDF5ProjectionStackSource                   Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(HDF5ProjectionStackSource, Object)
+
+        /** Image related typedefs. */
+        typedef TProjectionImage                            ProjectionImageType;
+        typedef typename ProjectionImageType::Pointer       ProjectionImagePointer;
+        typedef typename ProjectionImageType::PixelType     PixelType;
+        typedef typename ProjectionImageType::SizeType      SizeType;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, TProjectionImage::ImageDimension );
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( TwoDimensionalProjection, ( Concept::SameDimension< ImageDimension, 2 > ) );
+    #endif
+
+        itkSetStringMacro( FileName )
+        itkGetStringMacro( FileName )
+
+        /** Path of the projection dataset, by default that of NeXus detector data */
+        itkSetStringMacro( DatasetName )
+        itkGetStringMacro( DatasetName )
+
+        /** Slabs kept once read, at least two so that one can be read ahead */
+        itkSetClampMacro( NumberOfCachedSlabs, unsigned int, 2, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( NumberOfCachedSlabs, unsigned int )
+
+        /** Read the slab following the one last requested on a background thread */
+        itkSetMacro( ReadAhead, bool )
+        itkGetConstMacro( ReadAhead, bool )
+        itkBooleanMacro( ReadAhead )
+
+        /** Opens the dataset and starts the read ahead thread */
+        void Open();
+
+        /** Stops the read ahead thread and closes the file */
+        void Close();
+
+        bool IsOpen() const { return m_File >= 0; }
+
+        /** Projections in the dataset, and the width and height of each */
+        SizeValueType GetNumberOfProjections() const { return m_NumberOfProjections; }
+        const SizeType & GetProjectionSize() const { return m_ProjectionSize; }
+
+        /** Projections per slab, the chunk depth of the dataset along the projections */
+        SizeValueType GetSlabDepth() const { return m_SlabDepth; }
+
+        /** Returns a new image holding a projection */
+        ProjectionImagePointer GetProjection( SizeValueType uintProjection );
+
+        /** Slabs read from the file, by GetProjection() or ahead of it, and the
+         * projections found already read */
+        SizeValueType GetNumberOfSlabsRead() const;
+        SizeValueType GetNumberOfCacheHits() const;
+
+    protected:
+        HDF5ProjectionStackSource();
+        virtual ~HDF5ProjectionStackSource() ITK_OVERRIDE;
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(HDF5ProjectionStackSource);
+
+        /** Projections of one slab, all rows and columns */
+        struct Slab
+        {
+            Slab()
+                : Index( -1 )
+                , Ready( false )
+                , LastUse( 0 )
+            {
+            }
+
+            OffsetValueType         Index;
+            bool                    Ready;
+            SizeValueType           LastUse;
+            std::string             Error;
+            std::vector< PixelType > Pixels;
+        };
+
+        /** Reads a slab from the file, returning a description of a failure or
+         * an empty string */
+        std::string ReadSlab( SizeValueType uintSlab, std::vector< PixelType > & vecPixels );
+
+        /** Slab holding or about to hold uintSlab, ITK_NULLPTR if none. Must be
+         * called with m_Mutex held, as must SelectSlabToReplace */
+        Slab * FindSlab( SizeValueType uintSlab );
+        Slab * SelectSlabToReplace();
+
+        /** Reads the slabs requested by GetProjection() until closed */
+        void ReadAheadLoop();
+
+        /** Memory type of PixelType */
+        static hid_t GetNativeType();
+
+        std::string                                 m_FileName;
+        std::string                                 m_DatasetName;
+        unsigned int                                m_NumberOfCachedSlabs;
+        bool                                        m_ReadAhead;
+
+        hid_t                                       m_File;
+        hid_t                                       m_Dataset;
+        SizeValueType                               m_NumberOfProjections;
+        SizeType                                    m_ProjectionSize;
+        SizeValueType                               m_SlabDepth;
+
+        // The cache, the slab to read ahead and the statistics, guarded by
+        // m_Mutex, and the reads of the file, serialised by m_ReadMutex
+        std::vector< Slab >                         m_Slabs;
+        OffsetValueType                             m_ReadAheadSlab;
+        bool                                        m_Stop;
+        SizeValueType                               m_UseCount;
+        SizeValueType                               m_NumberOfSlabsRead;
+        SizeValueType                               m_NumberOfCacheHits;
+
+        mutable std::mutex                          m_Mutex;
+        std::mutex                                  m_ReadMutex;
+        std::condition_variable                     m_Condition;
+        std::thread                                 m_ReadAheadThread;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkHDF5ProjectionStackSource.hxx"
+#endif
+
+#endif // itkHDF5ProjectionStackSource_h
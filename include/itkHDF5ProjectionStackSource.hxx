@@ -0,0 +1,412 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkHDF5ProjectionStackSource_hxx
+#define itkHDF5ProjectionStackSource_hxx
+
+#include "itkHDF5ProjectionStackSource.h"
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
+#include <type_traits>
+
+namespace itk
+{
+    template< typename TProjectionImage >
+    HDF5ProjectionStackSource< TProjectionImage >::HDF5ProjectionStackSource()
+        : m_DatasetName( "/entry/data/data" )
+        , m_NumberOfCachedSlabs( 3 )
+        , m_ReadAhead( true )
+        , m_File( -1 )
+        , m_Dataset( -1 )
+        , m_NumberOfProjections( 0 )
+        , m_SlabDepth( 1 )
+        , m_ReadAheadSlab( -1 )
+        , m_Stop( false )
+        , m_UseCount( 0 )
+        , m_NumberOfSlabsRead( 0 )
+        , m_NumberOfCacheHits( 0 )
+    {
+        m_ProjectionSize.Fill( 0 );
+    }
+
+    template< typename TProjectionImage >
+    HDF5ProjectionStackSource< TProjectionImage >::~HDF5ProjectionStackSource()
+    {
+        this->Close();
+    }
+
+    template< typename TProjectionImage >
+    void HDF5ProjectionStackSource< TProjectionImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "FileName: " << m_FileName << std::endl;
+        os << indent << "DatasetName: " << m_DatasetName << std::endl;
+        os << indent << "NumberOfCachedSlabs: " << m_NumberOfCachedSlabs << std::endl;
+        os << indent << "ReadAhead: " << m_ReadAhead << std::endl;
+        os << indent << "NumberOfProjections: " << m_NumberOfProjections << std::endl;
+        os << indent << "ProjectionSize: " << m_ProjectionSize << std::endl;
+        os << indent << "SlabDepth: " << m_SlabDepth << std::endl;
+    }
+
+    template< typename TProjectionImage >
+    void HDF5ProjectionStackSource< TProjectionImage >::Open()
+    {
+        this->Close();
+
+        if( GetNativeType() < 0 )
+            itkExceptionMacro( "No HDF5 memory type for the pixel type" );
+
+        // Failures are reported by the exception, not printed by HDF5
+        struct ErrorPrintingSuspension
+        {
+            ErrorPrintingSuspension()
+            {
+                H5Eget_auto2( H5E_DEFAULT, &Function, &ClientData );
+                H5Eset_auto2( H5E_DEFAULT, ITK_NULLPTR, ITK_NULLPTR );
+            }
+            ~ErrorPrintingSuspension()
+            {
+                H5Eset_auto2( H5E_DEFAULT, Function, ClientData );
+            }
+
+            H5E_auto2_t         Function;
+            void *              ClientData;
+        };
+
+        std::string strError;
+        {
+            ErrorPrintingSuspension suspension;
+
+            m_File = H5Fopen( m_FileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT );
+            if( m_File < 0 )
+                strError = "Unable to open " + m_FileName;
+            else
+            {
+                // Whole chunks are read straight into the slabs, so the chunk
+                // cache of the dataset would only hold copies
+                const hid_t plistAccess( H5Pcreate( H5P_DATASET_ACCESS ) );
+                H5Pset_chunk_cache( plistAccess, H5D_CHUNK_CACHE_NSLOTS_DEFAULT, 0, H5D_CHUNK_CACHE_W0_DEFAULT );
+                m_Dataset = H5Dopen2( m_File, m_DatasetName.c_str(), plistAccess );
+                H5Pclose( plistAccess );
+
+                if( m_Dataset < 0 )
+                    strError = "No dataset " + m_DatasetName + " in " + m_FileName;
+            }
+
+            if( strError.empty() )
+            {
+                hsize_t arrDims[3] = { 0, 0, 0 };
+                const hid_t space( H5Dget_space( m_Dataset ) );
+                const int intRank( H5Sget_simple_extent_ndims( space ) );
+                if( intRank == 3 )
+                    H5Sget_simple_extent_dims( space, arrDims, ITK_NULLPTR );
+                H5Sclose( space );
+
+                hsize_t arrChunkDims[3] = { 1, 0, 0 };
+                const hid_t plistCreate( H5Dget_create_plist( m_Dataset ) );
+                if( intRank == 3 && H5Pget_layout( plistCreate ) == H5D_CHUNKED )
+                    H5Pget_chunk( plistCreate, 3, arrChunkDims );
+                H5Pclose( plistCreate );
+
+                if( intRank != 3 )
+                    strError = m_DatasetName + " in " + m_FileName + " is not three dimensional";
+                else
+                {
+                    m_NumberOfProjections = static_cast< SizeValueType >( arrDims[0] );
+                    m_ProjectionSize[0] = static_cast< SizeValueType >( arrDims[2] );
+                    m_ProjectionSize[1] = static_cast< SizeValueType >( arrDims[1] );
+                    m_SlabDepth = std::max( static_cast< SizeValueType >( arrChunkDims[0] ), static_cast< SizeValueType >( 1 ) );
+                }
+            }
+        }
+
+        if( !strError.empty() )
+        {
+            this->Close();
+            itkExceptionMacro( << strError );
+        }
+
+        m_Slabs.assign( m_NumberOfCachedSlabs, Slab() );
+        m_ReadAheadSlab = -1;
+        m_Stop = false;
+        m_UseCount = 0;
+        m_NumberOfSlabsRead = 0;
+        m_NumberOfCacheHits = 0;
+
+        if( m_ReadAhead )
+            m_ReadAheadThread = std::thread( &Self::ReadAheadLoop, this );
+    }
+
+    template< typename TProjectionImage >
+    void HDF5ProjectionStackSource< TProjectionImage >::Close()
+    {
+        if( m_ReadAheadThread.joinable() )
+        {
+            {
+                std::lock_guard< std::mutex > lock( m_Mutex );
+                m_Stop = true;
+            }
+            m_Condition.notify_all();
+            m_ReadAheadThread.join();
+        }
+
+        if( m_Dataset >= 0 )
+            H5Dclose( m_Dataset );
+        if( m_File >= 0 )
+            H5Fclose( m_File );
+
+        m_Dataset = -1;
+        m_File = -1;
+        m_Slabs.clear();
+    }
+
+    template< typename TProjectionImage >
+    typename HDF5ProjectionStackSource< TProjectionImage >::ProjectionImagePointer
+    HDF5ProjectionStackSource< TProjectionImage >::GetProjection( SizeValueType uintProjection )
+    {
+        if( !this->IsOpen() )
+            itkExceptionMacro( "Not open" );
+
+        if( uintProjection >= m_NumberOfProjections )
+            itkExceptionMacro( "Projection " << uintProjection << " requested of " << m_NumberOfProjections );
+
+        ProjectionImagePointer pProjection( ProjectionImageType::New() );
+        pProjection->SetRegions( m_ProjectionSize );
+        pProjection->Allocate();
+
+        const SizeValueType uintSlab( uintProjection / m_SlabDepth );
+        const SizeValueType uintPixels( m_ProjectionSize[0] * m_ProjectionSize[1] );
+
+        std::unique_lock< std::mutex > lock( m_Mutex );
+
+        bool blnReadHere( false );
+        for( ;; )
+        {
+            Slab * pSlab( FindSlab( uintSlab ) );
+            if( pSlab && pSlab->Ready )
+            {
+                if( !pSlab->Error.empty() )
+                {
+                    // Dropped, so that a later request reads it again
+                    const std::string strError( pSlab->Error );
+                    *pSlab = Slab();
+                    itkExceptionMacro( << strError );
+                }
+
+                if( !blnReadHere )
+                    m_NumberOfCacheHits++;
+
+                const PixelType * pPixels( &pSlab->Pixels[0] + ( uintProjection - uintSlab * m_SlabDepth ) * uintPixels );
+                std::copy( pPixels, pPixels + uintPixels, pProjection->GetBufferPointer() );
+                pSlab->LastUse = ++m_UseCount;
+                break;
+            }
+
+            // Wait for a slab being read ahead, or when every slab is being read
+            if( !pSlab )
+                pSlab = SelectSlabToReplace();
+            else
+                pSlab = ITK_NULLPTR;
+
+            if( !pSlab )
+            {
+                m_Condition.wait( lock );
+                continue;
+            }
+
+            pSlab->Index = static_cast< OffsetValueType >( uintSlab );
+            pSlab->Ready = false;
+
+            lock.unlock();
+            const std::string strError( ReadSlab( uintSlab, pSlab->Pixels ) );
+            lock.lock();
+
+            pSlab->Error = strError;
+            pSlab->Ready = true;
+            pSlab->LastUse = ++m_UseCount;
+            m_NumberOfSlabsRead++;
+            blnReadHere = true;
+            m_Condition.notify_all();
+        }
+
+        const SizeValueType uintNextSlab( uintSlab + 1 );
+        if( m_ReadAhead && uintNextSlab * m_SlabDepth < m_NumberOfProjections && !FindSlab( uintNextSlab ) )
+        {
+            m_ReadAheadSlab = static_cast< OffsetValueType >( uintNextSlab );
+            m_Condition.notify_all();
+        }
+
+        return pProjection;
+    }
+
+    template< typename TProjectionImage >
+    SizeValueType HDF5ProjectionStackSource< TProjectionImage >::GetNumberOfSlabsRead() const
+    {
+        std::lock_guard< std::mutex > lock( m_Mutex );
+        return m_NumberOfSlabsRead;
+    }
+
+    template< typename TProjectionImage >
+    SizeValueType HDF5ProjectionStackSource< TProjectionImage >::GetNumberOfCacheHits() const
+    {
+        std::lock_guard< std::mutex > lock( m_Mutex );
+        return m_NumberOfCacheHits;
+    }
+
+    template< typename TProjectionImage >
+    std::string HDF5ProjectionStackSource< TProjectionImage >::ReadSlab( SizeValueType uintSlab, std::vector< PixelType > & vecPixels )
+    {
+        std::lock_guard< std::mutex > lock( m_ReadMutex );
+
+        const SizeValueType uintFirst( uintSlab * m_SlabDepth );
+        const SizeValueType uintCount( std::min( m_SlabDepth, m_NumberOfProjections - uintFirst ) );
+
+        try
+        {
+            vecPixels.resize( uintCount * m_ProjectionSize[0] * m_ProjectionSize[1] );
+        }
+        catch( std::exception & error )
+        {
+            return error.what();
+        }
+
+        const hsize_t arrStart[3] = { uintFirst, 0, 0 };
+        const hsize_t arrCount[3] = { uintCount, m_ProjectionSize[1], m_ProjectionSize[0] };
+
+        const hid_t spaceFile( H5Dget_space( m_Dataset ) );
+        const hid_t spaceMemory( H5Screate_simple( 3, arrCount, ITK_NULLPTR ) );
+
+        herr_t status( H5Sselect_hyperslab( spaceFile, H5S_SELECT_SET, arrStart, ITK_NULLPTR, arrCount, ITK_NULLPTR ) );
+        if( status >= 0 )
+            status = H5Dread( m_Dataset, GetNativeType(), spaceMemory, spaceFile, H5P_DEFAULT, &vecPixels[0] );
+
+        H5Sclose( spaceMemory );
+        H5Sclose( spaceFile );
+
+        if( status < 0 )
+        {
+            std::ostringstream oss;
+            oss << "Unable to read projections " << uintFirst << " to " << uintFirst + uintCount - 1 << " of " << m_DatasetName << " in " << m_FileName;
+            return oss.str();
+        }
+
+        return std::string();
+    }
+
+    template< typename TProjectionImage >
+    typename HDF5ProjectionStackSource< TProjectionImage >::Slab *
+    HDF5ProjectionStackSource< TProjectionImage >::FindSlab( SizeValueType uintSlab )
+    {
+        for( size_t i = 0; i < m_Slabs.size(); i++ )
+        {
+            if( m_Slabs[i].Index == static_cast< OffsetValueType >( uintSlab ) )
+                return &m_Slabs[i];
+        }
+
+        return ITK_NULLPTR;
+    }
+
+    template< typename TProjectionImage >
+    typename HDF5ProjectionStackSource< TProjectionImage >::Slab *
+    HDF5ProjectionStackSource< TProjectionImage >::SelectSlabToReplace()
+    {
+        // An empty slab, or else the least recently used of those not being read
+        Slab * pSelected( ITK_NULLPTR );
+        for( size_t i = 0; i < m_Slabs.size(); i++ )
+        {
+            if( m_Slabs[i].Index < 0 )
+                return &m_Slabs[i];
+
+            if( m_Slabs[i].Ready && ( !pSelected || m_Slabs[i].LastUse < pSelected->LastUse ) )
+                pSelected = &m_Slabs[i];
+        }
+
+        return pSelected;
+    }
+
+    template< typename TProjectionImage >
+    void HDF5ProjectionStackSource< TProjectionImage >::ReadAheadLoop()
+    {
+        std::unique_lock< std::mutex > lock( m_Mutex );
+
+        for( ;; )
+        {
+            while( !m_Stop && m_ReadAheadSlab < 0 )
+                m_Condition.wait( lock );
+
+            if( m_Stop )
+                return;
+
+            const SizeValueType uintSlab( static_cast< SizeValueType >( m_ReadAheadSlab ) );
+            m_ReadAheadSlab = -1;
+
+            if( FindSlab( uintSlab ) )
+                continue;
+
+            Slab * pSlab( SelectSlabToReplace() );
+            if( !pSlab )
+                continue;
+
+            pSlab->Index = static_cast< OffsetValueType >( uintSlab );
+            pSlab->Ready = false;
+
+            lock.unlock();
+            const std::string strError( ReadSlab( uintSlab, pSlab->Pixels ) );
+            lock.lock();
+
+            pSlab->Error = strError;
+            pSlab->Ready = true;
+            pSlab->LastUse = ++m_UseCount;
+            m_NumberOfSlabsRead++;
+            m_Condition.notify_all();
+        }
+    }
+
+    template< typename TProjectionImage >
+    hid_t HDF5ProjectionStackSource< TProjectionImage >::GetNativeType()
+    {
+        if( std::is_same< PixelType, float >::value )
+            return H5T_NATIVE_FLOAT;
+        if( std::is_same< PixelType, double >::value )
+            return H5T_NATIVE_DOUBLE;
+        if( std::is_same< PixelType, char >::value )
+            return H5T_NATIVE_CHAR;
+        if( std::is_same< PixelType, signed char >::value )
+            return H5T_NATIVE_SCHAR;
+        if( std::is_same< PixelType, unsigned char >::value )
+            return H5T_NATIVE_UCHAR;
+        if( std::is_same< PixelType, short >::value )
+            return H5T_NATIVE_SHORT;
+        if( std::is_same< PixelType, unsigned short >::value )
+            return H5T_NATIVE_USHORT;
+        if( std::is_same< PixelType, int >::value )
+            return H5T_NATIVE_INT;
+        if( std::is_same< PixelType, unsigned int >::value )
+            return H5T_NATIVE_UINT;
+        if( std::is_same< PixelType, long >::value )
+            return H5T_NATIVE_LONG;
+        if( std::is_same< PixelType, unsigned long >::value )
+            return H5T_NATIVE_ULONG;
+
+        return -1;
+    }
+}
+
+#endif // itkHDF5ProjectionStackSource_hxx
@@ -0,0 +1,386 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkIMBLSeriesIndex_h
+#define itkIMBLSeriesIndex_h
+
+#include "itkImageIOFactory.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkSize.h"
+
+#include "itksys/Directory.hxx"
+#include "itksys/RegularExpression.hxx"
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class IMBLSeriesIndex
+ *
+ * \brief Index of the dark, flat and projection frames of an IMBL acquisition.
+ *
+ * An IMBL acquisition directory holds the frames of every stack as TIFF files
+ * named DF_Y<stack>_<tag>_<frame>.tif for darks, BG_Y<stack>_<tag>_<frame>.tif
+ * for flats and SAMPLE_Y<stack>_T<tag>_<frame>.tif for projections. Update()
+ * lists the directory once and classifies every file by one regular
+ * expression, rather than rescanning the directory per series as a
+ * RegularExpressionSeriesFileNames does, then reads the TIFF headers only, on
+ * NumberOfThreads threads, to check that every frame has the same size.
+ *
+ * The index is saved to IndexFileName, by default a hidden sidecar file in the
+ * acquisition directory. When the files of the directory listing match those
+ * recorded there the next Update() loads the index from it and reads no
+ * headers. A sidecar that cannot be written, e.g. in a read only directory,
+ * is skipped with a warning.
+ *
+ * GetFileNames() returns the frames of a series sorted by frame number, as
+ * taken by an ImageSeriesReader.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class IMBLSeriesIndex : public Object
+    {
+    public:
+        typedef IMBLSeriesIndex                             Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(IMBLSeriesIndex, Object)
+
+        typedef std::vector< std::string >                  FileNamesContainer;
+        typedef Size< 2 >                                   FrameSizeType;
+
+        /** Kind of frame, by file name prefix */
+        enum FrameType
+        {
+            Dark = 0,       // DF
+            Flat = 1,       // BG
+            Projection = 2  // SAMPLE
+        };
+
+        /** Acquisition directory */
+        itkSetStringMacro( Directory )
+        itkGetStringMacro( Directory )
+
+        /** Sidecar file of the index, empty for the default in Directory */
+        itkSetStringMacro( IndexFileName )
+        itkGetStringMacro( IndexFileName )
+
+        /** Threads reading the TIFF headers */
+        itkSetClampMacro( NumberOfThreads, ThreadIdType, 1, ITK_MAX_THREADS )
+        itkGetConstMacro( NumberOfThreads, ThreadIdType )
+
+        /** Whether the last Update() loaded the index from the sidecar file */
+        itkGetConstMacro( LoadedFromIndexFile, bool )
+
+        /** Width and height shared by every frame */
+        itkGetConstReferenceMacro( FrameSize, FrameSizeType )
+
+        /** Sidecar file used by Update() */
+        std::string GetActualIndexFileName() const
+        {
+            return m_IndexFileName.empty() ? m_Directory + "/.imbl_series_index" : m_IndexFileName;
+        }
+
+        /** Indexes the directory, from the sidecar file if it is up to date */
+        void Update()
+        {
+            if( m_Directory.empty() )
+                itkExceptionMacro( "No directory to index" );
+
+            itksys::Directory directory;
+            if( !directory.Load( m_Directory ) )
+                itkExceptionMacro( "Unable to list " << m_Directory );
+
+            std::vector< Entry > vecEntries;
+            itksys::RegularExpression regexFrame( "^(DF|BG|SAMPLE)_Y([0-9]+)_(T?)[A-Z]+_([0-9]+)\\.tif$" );
+
+            for( unsigned long i = 0; i < directory.GetNumberOfFiles(); i++ )
+            {
+                const std::string strFile( directory.GetFile( i ) );
+                if( !regexFrame.find( strFile ) )
+                    continue;
+
+                Entry entry;
+                entry.Type = regexFrame.match( 1 ) == "DF" ? Dark : regexFrame.match( 1 ) == "BG" ? Flat : Projection;
+
+                // Projection tags start with T, dark and flat tags need not
+                if( entry.Type == Projection && regexFrame.match( 3 ).empty() )
+                    continue;
+
+                entry.Stack = static_cast< unsigned int >( std::atol( regexFrame.match( 2 ).c_str() ) );
+                entry.Frame = static_cast< SizeValueType >( std::atol( regexFrame.match( 4 ).c_str() ) );
+                entry.File = strFile;
+                vecEntries.push_back( entry );
+            }
+
+            std::sort( vecEntries.begin(), vecEntries.end() );
+
+            m_LoadedFromIndexFile = ReadIndexFile( vecEntries );
+            if( !m_LoadedFromIndexFile )
+            {
+                ReadFrameSizes( vecEntries );
+                WriteIndexFile( vecEntries );
+            }
+
+            m_Entries.swap( vecEntries );
+            this->Modified();
+        }
+
+        /** Number of frames indexed */
+        SizeValueType GetNumberOfFrames() const
+        {
+            return static_cast< SizeValueType >( m_Entries.size() );
+        }
+
+        /** One more than the highest stack of a kind of frame, 0 if there are none */
+        unsigned int GetNumberOfStacks( FrameType type ) const
+        {
+            unsigned int uintNumStacks( 0 );
+            for( size_t i = 0; i < m_Entries.size(); i++ )
+            {
+                if( m_Entries[i].Type == type )
+                    uintNumStacks = std::max( uintNumStacks, m_Entries[i].Stack + 1 );
+            }
+
+            return uintNumStacks;
+        }
+
+        /** Full paths of the frames of a series, in frame order */
+        FileNamesContainer GetFileNames( FrameType type, unsigned int uintStack ) const
+        {
+            FileNamesContainer vecFileNames;
+            for( size_t i = 0; i < m_Entries.size(); i++ )
+            {
+                if( m_Entries[i].Type == type && m_Entries[i].Stack == uintStack )
+                    vecFileNames.push_back( m_Directory + "/" + m_Entries[i].File );
+            }
+
+            return vecFileNames;
+        }
+
+    protected:
+        IMBLSeriesIndex()
+            : m_NumberOfThreads( MultiThreader::GetGlobalDefaultNumberOfThreads() )
+            , m_LoadedFromIndexFile( false )
+            , m_ThreadEntries( ITK_NULLPTR )
+            , m_Threader( MultiThreader::New() )
+        {
+            m_FrameSize.Fill( 0 );
+        }
+
+        virtual ~IMBLSeriesIndex() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "Directory: " << m_Directory << std::endl;
+            os << indent << "IndexFileName: " << m_IndexFileName << std::endl;
+            os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+            os << indent << "LoadedFromIndexFile: " << m_LoadedFromIndexFile << std::endl;
+            os << indent << "NumberOfFrames: " << m_Entries.size() << std::endl;
+        }
+
+        /** Reads the headers of every NumberOfThreads-th frame from threadId */
+        void ThreadedReadFrameSizes( ThreadIdType threadId, ThreadIdType numberOfThreads )
+        {
+            std::vector< Entry > & vecEntries( *m_ThreadEntries );
+
+            for( size_t i = threadId; i < vecEntries.size() && m_ThreadErrors[threadId].empty(); i += numberOfThreads )
+            {
+                const std::string strFileName( m_Directory + "/" + vecEntries[i].File );
+
+                try
+                {
+                    ImageIOBase::Pointer pImageIO( ImageIOFactory::CreateImageIO( strFileName.c_str(), ImageIOFactory::ReadMode ) );
+                    if( pImageIO.IsNull() )
+                        itkExceptionMacro( "No ImageIO reads " << strFileName );
+
+                    pImageIO->SetFileName( strFileName );
+                    pImageIO->ReadImageInformation();
+
+                    vecEntries[i].Width = pImageIO->GetDimensions( 0 );
+                    vecEntries[i].Height = pImageIO->GetNumberOfDimensions() > 1 ? pImageIO->GetDimensions( 1 ) : 1;
+                }
+                catch( ExceptionObject & error )
+                {
+                    // Exceptions may not leave a thread, Update() rethrows
+                    m_ThreadErrors[threadId] = strFileName + ": " + error.GetDescription();
+                }
+            }
+        }
+
+        static ITK_THREAD_RETURN_TYPE ReadFrameSizesThreaderCallback( void * pArg )
+        {
+            MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+            Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+            pSelf->ThreadedReadFrameSizes( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+            return ITK_THREAD_RETURN_VALUE;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(IMBLSeriesIndex);
+
+        /** One frame file, ordered by type, stack then frame number */
+        struct Entry
+        {
+            Entry()
+                : Type( Dark )
+                , Stack( 0 )
+                , Frame( 0 )
+                , Width( 0 )
+                , Height( 0 )
+            {
+            }
+
+            bool operator<( const Entry & other ) const
+            {
+                if( Type != other.Type )
+                    return Type < other.Type;
+                if( Stack != other.Stack )
+                    return Stack < other.Stack;
+                if( Frame != other.Frame )
+                    return Frame < other.Frame;
+                return File < other.File;
+            }
+
+            FrameType           Type;
+            unsigned int        Stack;
+            SizeValueType       Frame;
+            SizeValueType       Width;
+            SizeValueType       Height;
+            std::string         File;
+        };
+
+        /** Reads the headers of the frames and checks they share one size */
+        void ReadFrameSizes( std::vector< Entry > & vecEntries )
+        {
+            m_ThreadEntries = &vecEntries;
+            m_ThreadErrors.assign( m_NumberOfThreads, std::string() );
+
+            m_Threader->SetNumberOfThreads( std::max( std::min( m_NumberOfThreads, static_cast< ThreadIdType >( vecEntries.size() ) ), static_cast< ThreadIdType >( 1 ) ) );
+            m_Threader->SetSingleMethod( this->ReadFrameSizesThreaderCallback, this );
+            m_Threader->SingleMethodExecute();
+
+            m_ThreadEntries = ITK_NULLPTR;
+
+            for( size_t i = 0; i < m_ThreadErrors.size(); i++ )
+            {
+                if( !m_ThreadErrors[i].empty() )
+                    itkExceptionMacro( "Unable to read the header of " << m_ThreadErrors[i] );
+            }
+
+            CheckFrameSizes( vecEntries );
+        }
+
+        void CheckFrameSizes( const std::vector< Entry > & vecEntries )
+        {
+            m_FrameSize.Fill( 0 );
+            if( vecEntries.empty() )
+                return;
+
+            for( size_t i = 1; i < vecEntries.size(); i++ )
+            {
+                if( vecEntries[i].Width != vecEntries[0].Width || vecEntries[i].Height != vecEntries[0].Height )
+                {
+                    itkExceptionMacro( vecEntries[i].File << " is " << vecEntries[i].Width << "x" << vecEntries[i].Height
+                                       << ", " << vecEntries[0].File << " is " << vecEntries[0].Width << "x" << vecEntries[0].Height );
+                }
+            }
+
+            m_FrameSize[0] = vecEntries[0].Width;
+            m_FrameSize[1] = vecEntries[0].Height;
+        }
+
+        /** Takes the frame sizes from the sidecar file if it records exactly
+         * the files listed, returning whether it did */
+        bool ReadIndexFile( std::vector< Entry > & vecEntries )
+        {
+            std::ifstream ifs( GetActualIndexFileName().c_str() );
+
+            std::string strMagic;
+            size_t uintNumEntries( 0 );
+            if( !( ifs >> strMagic >> uintNumEntries ) || strMagic != "IMBLSeriesIndex1" || uintNumEntries != vecEntries.size() )
+                return false;
+
+            std::vector< Entry > vecIndexed( vecEntries );
+            for( size_t i = 0; i < vecIndexed.size(); i++ )
+            {
+                std::string strFile;
+                if( !( ifs >> vecIndexed[i].Width >> vecIndexed[i].Height ) || !std::getline( ifs >> std::ws, strFile ) || strFile != vecIndexed[i].File )
+                    return false;
+            }
+
+            CheckFrameSizes( vecIndexed );
+            vecEntries.swap( vecIndexed );
+
+            return true;
+        }
+
+        /** Saves the index as a temporary file renamed over the sidecar file */
+        void WriteIndexFile( const std::vector< Entry > & vecEntries )
+        {
+            const std::string strFileName( GetActualIndexFileName() );
+            const std::string strTemporaryFileName( strFileName + ".tmp" );
+
+            {
+                std::ofstream ofs( strTemporaryFileName.c_str() );
+                ofs << "IMBLSeriesIndex1 " << vecEntries.size() << "\n";
+                for( size_t i = 0; i < vecEntries.size(); i++ )
+                    ofs << vecEntries[i].Width << " " << vecEntries[i].Height << " " << vecEntries[i].File << "\n";
+
+                if( !ofs.flush() )
+                {
+                    itkWarningMacro( "Unable to write the series index " << strTemporaryFileName );
+                    return;
+                }
+            }
+
+            if( !itksys::SystemTools::RenameFile( strTemporaryFileName.c_str(), strFileName.c_str() ) )
+            {
+                itksys::SystemTools::RemoveFile( strTemporaryFileName );
+                itkWarningMacro( "Unable to rename " << strTemporaryFileName << " to " << strFileName );
+            }
+        }
+
+        std::string                                         m_Directory;
+        std::string                                         m_IndexFileName;
+        ThreadIdType                                        m_NumberOfThreads;
+        bool                                                m_LoadedFromIndexFile;
+        FrameSizeType                                       m_FrameSize;
+        std::vector< Entry >                                m_Entries;
+
+        std::vector< Entry > *                              m_ThreadEntries;
+        std::vector< std::string >                          m_ThreadErrors;
+        MultiThreader::Pointer                              m_Threader;
+    };
+}
+
+#endif // itkIMBLSeriesIndex_h
@@ -0,0 +1,432 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkImageBufferPool_h
+#define itkImageBufferPool_h
+
+#include "itkImportImageContainer.h"
+#include "itkIntTypes.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+
+#if defined( __linux__ )
+#include <sys/mman.h>
+#endif
+
+namespace itk
+{
+    template< typename TElementIdentifier, typename TElement >
+    class PooledImageContainer;
+
+/** \class ImageBufferPool
+ *
+ * \brief Pool of image buffers reused across filter updates.
+ *
+ * Buffers released by images allocated from the pool are kept and handed out
+ * again for the next request of the same size, so a filter updated once per
+ * frame allocates only on its first update. The filters of this module draw
+ * their outputs and intermediate images from the pool passed to
+ * SetBufferPool(), and sharing one pool between the filters of a per-frame
+ * loop brings the steady-state allocations to zero.
+ *
+ * Images allocated with AllocateImage() hold a reference to the pool and
+ * return their buffer to it when released, so the pool lives as long as any
+ * of its buffers. Cached buffers are freed by Clear(), on destruction, or on
+ * release when MaximumCachedBytes would be exceeded.
+ *
+ * With UseHugePages, on Linux, buffers of 2 MB or more are mapped from
+ * huge pages, falling back to transparent huge pages if none are reserved,
+ * reducing the page faults and TLB misses of large frames. Elsewhere the
+ * setting is ignored.
+ *
+ * The pool is thread safe.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class ImageBufferPool : public Object
+    {
+    public:
+        typedef ImageBufferPool                             Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(ImageBufferPool, Object)
+
+        /** Map buffers of 2 MB or more from huge pages */
+        itkSetMacro( UseHugePages, bool )
+        itkGetConstMacro( UseHugePages, bool )
+        itkBooleanMacro( UseHugePages )
+
+        /** Largest total size of the released buffers kept for reuse, 0 for no limit */
+        itkSetMacro( MaximumCachedBytes, SizeValueType )
+        itkGetConstMacro( MaximumCachedBytes, SizeValueType )
+
+        /** Returns a buffer of uintBytes, reusing a released one of the same size if available */
+        void * Acquire( SizeValueType uintBytes )
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+
+            std::multimap< SizeValueType, void * >::iterator itFree( m_FreeBlocks.find( uintBytes ) );
+            if( itFree != m_FreeBlocks.end() )
+            {
+                void * p( itFree->second );
+                m_FreeBlocks.erase( itFree );
+                m_CachedBytes -= uintBytes;
+                m_NumberOfReuses++;
+                return p;
+            }
+
+            Block block;
+            block.Bytes = uintBytes;
+            block.MappedBytes = 0;
+
+            void * p( AllocateBlock( block ) );
+            m_Blocks[p] = block;
+            m_AllocatedBytes += uintBytes;
+            m_NumberOfAllocations++;
+
+            return p;
+        }
+
+        /** Returns a buffer obtained from Acquire() to the pool */
+        void Release( void * p )
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+
+            std::map< void *, Block >::iterator itBlock( m_Blocks.find( p ) );
+            if( itBlock == m_Blocks.end() )
+                itkExceptionMacro( "Buffer " << p << " was not allocated by this pool" );
+
+            const SizeValueType uintBytes( itBlock->second.Bytes );
+
+            if( m_MaximumCachedBytes > 0 && m_CachedBytes + uintBytes > m_MaximumCachedBytes )
+            {
+                FreeBlock( p, itBlock->second );
+                m_AllocatedBytes -= uintBytes;
+                m_Blocks.erase( itBlock );
+                return;
+            }
+
+            m_FreeBlocks.insert( std::make_pair( uintBytes, p ) );
+            m_CachedBytes += uintBytes;
+        }
+
+        /** Frees the buffers kept for reuse, buffers in use are unaffected */
+        void Clear()
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+
+            for( std::multimap< SizeValueType, void * >::iterator it = m_FreeBlocks.begin(); it != m_FreeBlocks.end(); ++it )
+            {
+                std::map< void *, Block >::iterator itBlock( m_Blocks.find( it->second ) );
+                FreeBlock( itBlock->first, itBlock->second );
+                m_AllocatedBytes -= itBlock->second.Bytes;
+                m_Blocks.erase( itBlock );
+            }
+
+            m_FreeBlocks.clear();
+            m_CachedBytes = 0;
+        }
+
+        /** Allocates the buffered region of an image (or vector image) from the pool */
+        template< typename TImage >
+        void AllocateImage( TImage * pImage, bool blnInitializePixels = false )
+        {
+            typedef typename TImage::PixelContainer                 PixelContainerType;
+            typedef PooledImageContainer< typename PixelContainerType::ElementIdentifier,
+                                          typename PixelContainerType::Element > PooledContainerType;
+
+            typename PooledContainerType::Pointer pContainer( PooledContainerType::New() );
+            pContainer->SetBufferPool( this );
+
+            pImage->SetPixelContainer( pContainer );
+            pImage->Allocate( blnInitializePixels );
+        }
+
+        /** Number of buffers allocated from the system, and handed out again */
+        SizeValueType GetNumberOfAllocations() const
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+            return m_NumberOfAllocations;
+        }
+
+        SizeValueType GetNumberOfReuses() const
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+            return m_NumberOfReuses;
+        }
+
+        /** Bytes of all buffers held, in use or cached, and of the cached buffers only */
+        SizeValueType GetAllocatedBytes() const
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+            return m_AllocatedBytes;
+        }
+
+        SizeValueType GetCachedBytes() const
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+            return m_CachedBytes;
+        }
+
+    protected:
+        ImageBufferPool()
+            : m_UseHugePages( false )
+            , m_MaximumCachedBytes( 0 )
+            , m_NumberOfAllocations( 0 )
+            , m_NumberOfReuses( 0 )
+            , m_AllocatedBytes( 0 )
+            , m_CachedBytes( 0 )
+        {
+        }
+
+        virtual ~ImageBufferPool() ITK_OVERRIDE
+        {
+            // Buffers in use hold a reference to the pool, so all are cached here
+            for( std::map< void *, Block >::iterator it = m_Blocks.begin(); it != m_Blocks.end(); ++it )
+                FreeBlock( it->first, it->second );
+        }
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "UseHugePages: " << m_UseHugePages << std::endl;
+            os << indent << "MaximumCachedBytes: " << m_MaximumCachedBytes << std::endl;
+            os << indent << "NumberOfAllocations: " << GetNumberOfAllocations() << std::endl;
+            os << indent << "NumberOfReuses: " << GetNumberOfReuses() << std::endl;
+            os << indent << "AllocatedBytes: " << GetAllocatedBytes() << std::endl;
+            os << indent << "CachedBytes: " << GetCachedBytes() << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(ImageBufferPool);
+
+        struct Block
+        {
+            SizeValueType   Bytes;
+            SizeValueType   MappedBytes;    // non-zero for buffers mapped from huge pages
+        };
+
+        void * AllocateBlock( Block & block )
+        {
+#if defined( __linux__ )
+            const SizeValueType uintHugePageBytes( 2 * 1024 * 1024 );
+
+            if( m_UseHugePages && block.Bytes >= uintHugePageBytes )
+            {
+                const SizeValueType uintMappedBytes( ( block.Bytes + uintHugePageBytes - 1 ) / uintHugePageBytes * uintHugePageBytes );
+
+                void * p( mmap( ITK_NULLPTR, uintMappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 ) );
+                if( p == MAP_FAILED )
+                {
+                    // No reserved huge pages, ask for transparent ones instead
+                    p = mmap( ITK_NULLPTR, uintMappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+                    if( p != MAP_FAILED )
+                        madvise( p, uintMappedBytes, MADV_HUGEPAGE );
+                }
+
+                if( p != MAP_FAILED )
+                {
+                    block.MappedBytes = uintMappedBytes;
+                    return p;
+                }
+            }
+#endif
+            void * p( std::malloc( block.Bytes > 0 ? block.Bytes : 1 ) );
+            if( !p )
+                throw MemoryAllocationError( __FILE__, __LINE__, "Failed to allocate image buffer", ITK_LOCATION );
+
+            return p;
+        }
+
+        static void FreeBlock( void * p, const Block & block )
+        {
+#if defined( __linux__ )
+            if( block.MappedBytes > 0 )
+            {
+                munmap( p, block.MappedBytes );
+                return;
+            }
+#endif
+            std::free( p );
+        }
+
+        bool                                                m_UseHugePages;
+        SizeValueType                                       m_MaximumCachedBytes;
+
+        mutable std::mutex                                  m_Mutex;
+        std::map< void *, Block >                           m_Blocks;
+        std::multimap< SizeValueType, void * >              m_FreeBlocks;
+        SizeValueType                                       m_NumberOfAllocations;
+        SizeValueType                                       m_NumberOfReuses;
+        SizeValueType                                       m_AllocatedBytes;
+        SizeValueType                                       m_CachedBytes;
+    };
+
+/** \class PooledImageContainer
+ *
+ * \brief Pixel container whose memory is drawn from an ImageBufferPool.
+ *
+ * Created by ImageBufferPool::AllocateImage(). Without a pool it behaves as
+ * ImportImageContainer.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TElementIdentifier, typename TElement >
+    class ITK_TEMPLATE_EXPORT PooledImageContainer : public ImportImageContainer< TElementIdentifier, TElement >
+    {
+    public:
+        typedef PooledImageContainer                                    Self;
+        typedef ImportImageContainer< TElementIdentifier, TElement >    Superclass;
+        typedef SmartPointer< Self >                                    Pointer;
+        typedef SmartPointer< const Self >                              ConstPointer;
+
+        typedef TElementIdentifier                                      ElementIdentifier;
+        typedef TElement                                                Element;
+
+        itkNewMacro(Self)
+        itkTypeMacro(PooledImageContainer, ImportImageContainer)
+
+        /** Pool of the buffers, to be set before the memory is allocated */
+        void SetBufferPool( ImageBufferPool * pPool )
+        {
+            m_BufferPool = pPool;
+        }
+
+        ImageBufferPool * GetBufferPool() const
+        {
+            return m_BufferPool.GetPointer();
+        }
+
+    protected:
+        PooledImageContainer()
+            : m_PoolAllocated( false )
+        {
+        }
+
+        virtual ~PooledImageContainer() ITK_OVERRIDE
+        {
+            // The superclass destructor would not dispatch to this class
+            this->DeallocateManagedMemory();
+        }
+
+        virtual TElement * AllocateElements( ElementIdentifier size, bool UseDefaultConstructor = false ) const ITK_OVERRIDE
+        {
+            if( !m_BufferPool )
+                return Superclass::AllocateElements( size, UseDefaultConstructor );
+
+            TElement * pElements( static_cast< TElement * >( m_BufferPool->Acquire( size * sizeof( TElement ) ) ) );
+
+            if( UseDefaultConstructor )
+            {
+                for( ElementIdentifier i = 0; i < size; i++ )
+                    new( pElements + i ) TElement();
+            }
+
+            m_PoolAllocated = true;
+
+            return pElements;
+        }
+
+        virtual void DeallocateManagedMemory() ITK_OVERRIDE
+        {
+            TElement * pElements( this->GetImportPointer() );
+
+            if( m_PoolAllocated && pElements && this->GetContainerManageMemory() )
+            {
+                // Hand the buffer back before the superclass resets the container
+                this->ContainerManageMemoryOff();
+                m_BufferPool->Release( pElements );
+            }
+
+            Superclass::DeallocateManagedMemory();
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(PooledImageContainer);
+
+        ImageBufferPool::Pointer                            m_BufferPool;
+        mutable bool                                        m_PoolAllocated;
+    };
+
+/** \class PooledOutputImageFilter
+ *
+ * \brief Allocates the outputs of an image filter from an ImageBufferPool.
+ *
+ * Used for the internal filters of the mini-pipelines in this module, so
+ * that their outputs and intermediate images are drawn from the pool of the
+ * enclosing filter. Without a pool the outputs are allocated as by TFilter.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TFilter >
+    class ITK_TEMPLATE_EXPORT PooledOutputImageFilter : public TFilter
+    {
+    public:
+        typedef PooledOutputImageFilter                     Self;
+        typedef TFilter                                     Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        typedef typename Superclass::OutputImageType        OutputImageType;
+
+        itkNewMacro(Self)
+        itkTypeMacro(PooledOutputImageFilter, ImageSource)
+
+        itkSetObjectMacro( BufferPool, ImageBufferPool )
+        itkGetModifiableObjectMacro( BufferPool, ImageBufferPool )
+
+    protected:
+        PooledOutputImageFilter() {}
+        virtual ~PooledOutputImageFilter() ITK_OVERRIDE {}
+
+        virtual void AllocateOutputs() ITK_OVERRIDE
+        {
+            if( !m_BufferPool )
+            {
+                Superclass::AllocateOutputs();
+                return;
+            }
+
+            for( unsigned int i = 0; i < this->GetNumberOfIndexedOutputs(); i++ )
+            {
+                OutputImageType * pOutput( this->GetOutput( i ) );
+
+                if( pOutput )
+                {
+                    pOutput->SetBufferedRegion( pOutput->GetRequestedRegion() );
+                    m_BufferPool->AllocateImage( pOutput );
+                }
+            }
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(PooledOutputImageFilter);
+
+        ImageBufferPool::Pointer                            m_BufferPool;
+    };
+}
+
+#endif // itkImageBufferPool_h
@@ -0,0 +1,765 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLiveProjectionProcessor_h
+#define itkLiveProjectionProcessor_h
+
+#include "itkBinnedMeanProjectionImageFilter.h"
+#include "itkComputePixelTraits.h"
+#include "itkDefectMapRepairImageFilter.h"
+#include "itkImageBufferPool.h"
+#include "itkImageIOFactory.h"
+#include "itkNumericTraits.h"
+#include "itkNegLogCheckedImageFilter.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include "itksys/Directory.hxx"
+#include "itksys/RegularExpression.hxx"
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined( __linux__ )
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace itk
+{
+/** \class LiveProjectionProcessor
+ *
+ * \brief Corrects the projections of a running scan as they are written.
+ *
+ * Watches Directory for projection files named SAMPLE_Y<stack>_T<tag>_<frame>.tif,
+ * as indexed by IMBLSeriesIndex, and passes each through the dark and flat
+ * field correction, the repair of the static defects of its stack and the
+ * negative log, handing the result to the frame callback. Start() is called
+ * once the darks, flats and defect maps are set; Run() then processes frames
+ * as they appear, or ProcessPending() those found since the last call.
+ *
+ * On Linux files are picked up by inotify when closed after writing or moved
+ * into the directory, so a detector writing to a temporary name should rename
+ * it when complete. Elsewhere, or with UseNotification off, the directory is
+ * listed every PollInterval seconds and a file taken once its length is
+ * unchanged between two listings. Files present at Start() are taken as
+ * complete.
+ *
+ * Latency matters more than throughput, so nothing is allocated per frame
+ * once started: frames are read by one ImageIO into a preallocated buffer,
+ * corrected in a single pass by the precomputed gain 1 / ( flat - dark ) into
+ * a buffer of BufferPool, repaired in place and converted by filters created
+ * and run on a warm-up frame by Start(). The corrected projection of a stack,
+ * and its preview binned by PreviewShrinkFactor, stay valid until the next
+ * frame of the stack.
+ *
+ * GetStatistics() reports the latency of each frame, from its detection to its
+ * output, against TargetLatency, and the backlog of frames detected but not
+ * yet processed, so that a pipeline falling behind the detector is seen while
+ * the scan runs. A frame that cannot be read or corrected is counted as failed
+ * and skipped.
+ *
+ * \sa IMBLSeriesIndex, DefectMapRepairImageFilter, NegLogCheckedImageFilter
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    class LiveProjectionProcessor : public Object
+    {
+    public:
+        typedef LiveProjectionProcessor                     Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(LiveProjectionProcessor, Object)
+
+        typedef TImage                                      ImageType;
+        typedef typename ImageType::Pointer                 ImagePointer;
+        typedef typename ImageType::ConstPointer            ImageConstPointer;
+        typedef typename ImageType::PixelType               PixelType;
+        typedef typename ImageType::RegionType              RegionType;
+        typedef typename ComputePixelTraits< PixelType >::ComputeType ComputeType;
+
+        typedef DefectMapRepairImageFilter< ImageType >     RepairFilterType;
+        typedef typename RepairFilterType::DefectMapType    DefectMapType;
+        typedef NegLogCheckedImageFilter< ImageType >       NegLogFilterType;
+        typedef BinnedMeanProjectionImageFilter< ImageType, ImageType > PreviewFilterType;
+
+        /** A projection file and its processing */
+        struct Frame
+        {
+            Frame()
+                : Stack( 0 )
+                , Number( 0 )
+                , DetectedSeconds( 0.0 )
+                , LatencySeconds( 0.0 )
+                , ProcessingSeconds( 0.0 )
+            {
+            }
+
+            std::string         FileName;
+            unsigned int        Stack;
+            SizeValueType       Number;
+            double              DetectedSeconds;    // since Start()
+            double              LatencySeconds;     // from detection to output
+            double              ProcessingSeconds;  // from reading to output
+        };
+
+        /** Latency and backlog since Start() */
+        struct Statistics
+        {
+            Statistics()
+                : FramesDetected( 0 )
+                , FramesProcessed( 0 )
+                , FramesFailed( 0 )
+                , FramesOverTarget( 0 )
+                , Backlog( 0 )
+                , MaximumBacklog( 0 )
+                , OldestPendingSeconds( 0.0 )
+                , LastLatency( 0.0 )
+                , MeanLatency( 0.0 )
+                , MaximumLatency( 0.0 )
+                , MeanProcessingSeconds( 0.0 )
+                , ArrivalsPerSecond( 0.0 )
+                , ProcessedPerSecond( 0.0 )
+                , FallingBehind( false )
+            {
+            }
+
+            SizeValueType       FramesDetected;
+            SizeValueType       FramesProcessed;
+            SizeValueType       FramesFailed;
+            SizeValueType       FramesOverTarget;       // latency above TargetLatency
+            SizeValueType       Backlog;                // detected and not yet processed
+            SizeValueType       MaximumBacklog;
+            double              OldestPendingSeconds;   // since detection of the oldest frame of the backlog
+            double              LastLatency;
+            double              MeanLatency;
+            double              MaximumLatency;
+            double              MeanProcessingSeconds;
+            double              ArrivalsPerSecond;      // detection rate of the frames
+            double              ProcessedPerSecond;     // rate the processing sustains, 1 / MeanProcessingSeconds
+            bool                FallingBehind;          // the backlog is older than TargetLatency, or arrives faster than processed
+        };
+
+        /** Called with each processed frame and its corrected projection */
+        typedef std::function< void( const Frame &, const ImageType * ) > FrameCallbackType;
+
+        /** Directory the detector writes the projections to */
+        itkSetStringMacro( Directory )
+        itkGetStringMacro( Directory )
+
+        /** Seconds between listings of the directory when not notified */
+        itkSetClampMacro( PollInterval, double, 0.001, NumericTraits< double >::max() )
+        itkGetConstMacro( PollInterval, double )
+
+        /** Seconds from detection to output a frame should take */
+        itkSetClampMacro( TargetLatency, double, 0.0, NumericTraits< double >::max() )
+        itkGetConstMacro( TargetLatency, double )
+
+        /** Whether to be notified of files on Linux rather than poll */
+        itkSetMacro( UseNotification, bool )
+        itkGetConstMacro( UseNotification, bool )
+        itkBooleanMacro( UseNotification )
+
+        /** Binning of the previews, 1 for the projections themselves */
+        itkSetClampMacro( PreviewShrinkFactor, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( PreviewShrinkFactor, unsigned int )
+
+        /** Pool of the corrected and converted frames */
+        itkSetObjectMacro( BufferPool, ImageBufferPool )
+        itkGetModifiableObjectMacro( BufferPool, ImageBufferPool )
+
+        void SetFrameCallback( const FrameCallbackType & callback )
+        {
+            m_FrameCallback = callback;
+        }
+
+        /** Average dark of a stack, the dark of stack 0 serving stacks without one */
+        void SetDark( unsigned int uintStack, const ImageType * pDark )
+        {
+            StackAt( uintStack ).Dark = pDark;
+            this->Modified();
+        }
+
+        /** Average flat of a stack, not dark corrected */
+        void SetFlat( unsigned int uintStack, const ImageType * pFlat )
+        {
+            StackAt( uintStack ).Flat = pFlat;
+            this->Modified();
+        }
+
+        /** Static defects of a stack, none repaired if not set */
+        void SetDefectMap( unsigned int uintStack, const DefectMapType * pDefectMap )
+        {
+            StackAt( uintStack ).DefectMap = pDefectMap;
+            this->Modified();
+        }
+
+        unsigned int GetNumberOfStacks() const { return static_cast< unsigned int >( m_Stacks.size() ); }
+
+        /** Whether Start() set up notification rather than polling */
+        bool GetNotified() const { return m_NotifyDescriptor >= 0; }
+
+        /** Last corrected projection of a stack, ITK_NULLPTR before the first */
+        const ImageType * GetProjection( unsigned int uintStack ) const
+        {
+            return uintStack < m_Stacks.size() && m_Stacks[uintStack].FramesProcessed > 0 ? m_Stacks[uintStack].NegLog->GetOutput() : ITK_NULLPTR;
+        }
+
+        /** Last projection of a stack binned by PreviewShrinkFactor */
+        const ImageType * GetPreview( unsigned int uintStack ) const
+        {
+            if( m_PreviewShrinkFactor == 1 || !GetProjection( uintStack ) )
+                return GetProjection( uintStack );
+
+            return m_Stacks[uintStack].Preview->GetOutput();
+        }
+
+        /** Error of the last frame that failed */
+        itkGetStringMacro( LastError )
+
+        /** Prepares the correction of every stack, warms up its filters and
+         * starts watching the directory */
+        void Start()
+        {
+            Stop();
+
+            if( m_Directory.empty() || !itksys::SystemTools::FileIsDirectory( m_Directory ) )
+                itkExceptionMacro( "No directory to watch: " << m_Directory );
+
+            if( m_Stacks.empty() || !m_Stacks[0].Dark )
+                itkExceptionMacro( "No dark for stack 0" );
+
+            m_Region = m_Stacks[0].Dark->GetLargestPossibleRegion();
+            const SizeValueType uintPixels( m_Region.GetNumberOfPixels() );
+
+            for( size_t s = 0; s < m_Stacks.size(); s++ )
+            {
+                StackState & stack( m_Stacks[s] );
+                if( !stack.Dark )
+                    stack.Dark = m_Stacks[0].Dark;
+
+                if( !stack.Flat )
+                    itkExceptionMacro( "No flat for stack " << s );
+
+                if( stack.Dark->GetBufferedRegion() != m_Region || stack.Flat->GetBufferedRegion() != m_Region )
+                    itkExceptionMacro( "The dark and flat of stack " << s << " are not buffered over " << m_Region );
+
+                if( stack.DefectMap && stack.DefectMap->GetRegion() != m_Region )
+                    itkExceptionMacro( "The defect map of stack " << s << " is not of region " << m_Region );
+
+                // Pixels the beam does not reach are corrected to 0, which the
+                // negative log maps to 0
+                stack.Gain.resize( uintPixels );
+                const PixelType * pDark( stack.Dark->GetBufferPointer() );
+                const PixelType * pFlat( stack.Flat->GetBufferPointer() );
+                for( SizeValueType i = 0; i < uintPixels; i++ )
+                {
+                    const ComputeType dblRange( static_cast< ComputeType >( pFlat[i] ) - static_cast< ComputeType >( pDark[i] ) );
+                    stack.Gain[i] = dblRange > 0 ? static_cast< ComputeType >( 1 ) / dblRange : static_cast< ComputeType >( 0 );
+                }
+
+                stack.Repair = RepairFilterType::New();
+                stack.Repair->SetDefectMap( stack.DefectMap );
+                stack.NegLog = NegLogFilterType::New();
+                stack.NegLog->SetBufferPool( m_BufferPool );
+                stack.Preview = PreviewFilterType::New();
+                stack.Preview->SetBinningFactor( m_PreviewShrinkFactor );
+                stack.Preview->SetInput( stack.NegLog->GetOutput() );
+                stack.FramesProcessed = 0;
+
+                // Twice, as the outputs of a frame hold their buffers until
+                // those of the next replace them
+                for( unsigned int i = 0; i < 2; i++ )
+                    ProcessFrameBuffer( stack, stack.Flat->GetBufferPointer() );
+            }
+
+            // Any ImageIO of TIFF, chosen by the extension alone as no frame exists yet
+            m_ImageIO = ImageIOFactory::CreateImageIO( "frame.tif", ImageIOFactory::WriteMode );
+            if( m_ImageIO.IsNull() )
+                itkExceptionMacro( "No ImageIO reads TIFF files" );
+
+            // Room for frames of up to the pixel size of the image type
+            m_RawBuffer.resize( uintPixels * sizeof( PixelType ) );
+
+            m_Statistics = Statistics();
+            m_Pending.clear();
+            m_Seen.clear();
+            m_Lengths.clear();
+            m_LatencySum = 0.0;
+            m_ProcessingSum = 0.0;
+            m_FirstDetected = -1.0;
+            m_LastDetected = -1.0;
+            m_LastError.clear();
+            m_StartTime = std::chrono::steady_clock::now();
+
+#if defined( __linux__ )
+            if( m_UseNotification )
+            {
+                m_NotifyDescriptor = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+                if( m_NotifyDescriptor >= 0 && inotify_add_watch( m_NotifyDescriptor, m_Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 )
+                {
+                    close( m_NotifyDescriptor );
+                    m_NotifyDescriptor = -1;
+                }
+
+                if( m_NotifyDescriptor < 0 )
+                    itkWarningMacro( "Unable to watch " << m_Directory << ", polling instead" );
+            }
+#endif
+
+            // Frames written before the watch started
+            ListDirectory( true );
+        }
+
+        /** Stops watching the directory */
+        void Stop()
+        {
+#if defined( __linux__ )
+            if( m_NotifyDescriptor >= 0 )
+                close( m_NotifyDescriptor );
+#endif
+            m_NotifyDescriptor = -1;
+        }
+
+        /** Processes the frames detected until the backlog is empty, returning
+         * how many. When notified, files written meanwhile are collected
+         * between frames, so that their detection times and the backlog are
+         * current. */
+        SizeValueType ProcessPending()
+        {
+            CollectFrames();
+
+            SizeValueType uintProcessed( 0 );
+            while( !m_Pending.empty() )
+            {
+                Frame frame( m_Pending.front() );
+                m_Pending.pop_front();
+
+                if( ProcessFrame( frame ) )
+                    uintProcessed++;
+
+                if( GetNotified() )
+                    CollectFrames();
+            }
+
+            return uintProcessed;
+        }
+
+        /** Processes frames as they appear until uintMaximumFrames are processed,
+         * 0 for no limit, or none appeared for dblIdleTimeout seconds */
+        SizeValueType Run( SizeValueType uintMaximumFrames, double dblIdleTimeout )
+        {
+            SizeValueType uintProcessed( 0 );
+            double dblLastActivity( GetSeconds() );
+
+            while( uintMaximumFrames == 0 || uintProcessed < uintMaximumFrames )
+            {
+                const SizeValueType uintFrames( ProcessPending() );
+                uintProcessed += uintFrames;
+
+                const double dblNow( GetSeconds() );
+                if( uintFrames > 0 )
+                    dblLastActivity = dblNow;
+                else if( dblNow - dblLastActivity >= dblIdleTimeout )
+                    break;
+                else
+                    WaitForFiles( std::min( m_PollInterval, dblIdleTimeout - ( dblNow - dblLastActivity ) ) );
+            }
+
+            return uintProcessed;
+        }
+
+        /** Latency and backlog, as of now */
+        Statistics GetStatistics() const
+        {
+            Statistics statistics( m_Statistics );
+            statistics.Backlog = m_Pending.size();
+            statistics.OldestPendingSeconds = m_Pending.empty() ? 0.0 : GetSeconds() - m_Pending.front().DetectedSeconds;
+
+            const SizeValueType uintDone( statistics.FramesProcessed + statistics.FramesFailed );
+            if( uintDone > 0 )
+            {
+                statistics.MeanProcessingSeconds = m_ProcessingSum / uintDone;
+                statistics.ProcessedPerSecond = m_ProcessingSum > 0.0 ? uintDone / m_ProcessingSum : 0.0;
+            }
+
+            if( statistics.FramesProcessed > 0 )
+                statistics.MeanLatency = m_LatencySum / statistics.FramesProcessed;
+
+            if( statistics.FramesDetected > 1 && m_LastDetected > m_FirstDetected )
+                statistics.ArrivalsPerSecond = ( statistics.FramesDetected - 1 ) / ( m_LastDetected - m_FirstDetected );
+
+            statistics.FallingBehind = statistics.OldestPendingSeconds > m_TargetLatency
+                                       || ( statistics.ProcessedPerSecond > 0.0 && statistics.ArrivalsPerSecond > statistics.ProcessedPerSecond );
+
+            return statistics;
+        }
+
+    protected:
+        LiveProjectionProcessor()
+            : m_PollInterval( 0.05 )
+            , m_TargetLatency( 0.1 )
+            , m_UseNotification( true )
+            , m_PreviewShrinkFactor( 1 )
+            , m_BufferPool( ImageBufferPool::New() )
+            , m_NotifyDescriptor( -1 )
+            , m_ProjectionExpression( "^SAMPLE_Y([0-9]+)_T[A-Z]+_([0-9]+)\\.tif$" )
+            , m_LatencySum( 0.0 )
+            , m_ProcessingSum( 0.0 )
+            , m_FirstDetected( -1.0 )
+            , m_LastDetected( -1.0 )
+            , m_StartTime( std::chrono::steady_clock::now() )
+        {
+        }
+
+        virtual ~LiveProjectionProcessor() ITK_OVERRIDE
+        {
+            Stop();
+        }
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "Directory: " << m_Directory << std::endl;
+            os << indent << "PollInterval: " << m_PollInterval << std::endl;
+            os << indent << "TargetLatency: " << m_TargetLatency << std::endl;
+            os << indent << "UseNotification: " << m_UseNotification << std::endl;
+            os << indent << "PreviewShrinkFactor: " << m_PreviewShrinkFactor << std::endl;
+            os << indent << "NumberOfStacks: " << m_Stacks.size() << std::endl;
+            os << indent << "FramesProcessed: " << m_Statistics.FramesProcessed << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(LiveProjectionProcessor);
+
+        /** Correction and filters of a stack */
+        struct StackState
+        {
+            StackState()
+                : FramesProcessed( 0 )
+            {
+            }
+
+            ImageConstPointer                   Dark;
+            ImageConstPointer                   Flat;
+            typename DefectMapType::ConstPointer DefectMap;
+            std::vector< ComputeType >          Gain;
+            typename RepairFilterType::Pointer  Repair;
+            typename NegLogFilterType::Pointer  NegLog;
+            typename PreviewFilterType::Pointer Preview;
+            SizeValueType                       FramesProcessed;
+        };
+
+        StackState & StackAt( unsigned int uintStack )
+        {
+            if( uintStack >= m_Stacks.size() )
+                m_Stacks.resize( uintStack + 1 );
+
+            return m_Stacks[uintStack];
+        }
+
+        double GetSeconds() const
+        {
+            return std::chrono::duration< double >( std::chrono::steady_clock::now() - m_StartTime ).count();
+        }
+
+        /** Queues a file of the directory if it is a projection not seen before */
+        void AddFile( const std::string & strFile, double dblDetected, std::vector< Frame > & vecFrames )
+        {
+            if( !m_ProjectionExpression.find( strFile ) || !m_Seen.insert( strFile ).second )
+                return;
+
+            Frame frame;
+            frame.FileName = m_Directory + "/" + strFile;
+            frame.Stack = static_cast< unsigned int >( std::atol( m_ProjectionExpression.match( 1 ).c_str() ) );
+            frame.Number = static_cast< SizeValueType >( std::atol( m_ProjectionExpression.match( 2 ).c_str() ) );
+            frame.DetectedSeconds = dblDetected;
+            vecFrames.push_back( frame );
+        }
+
+        /** Queues the projections found by a listing, complete if blnAll or
+         * of the same length as at the previous listing */
+        void ListDirectory( bool blnAll )
+        {
+            itksys::Directory directory;
+            if( !directory.Load( m_Directory ) )
+                return;
+
+            const double dblNow( GetSeconds() );
+            std::vector< Frame > vecFrames;
+
+            for( unsigned long i = 0; i < directory.GetNumberOfFiles(); i++ )
+            {
+                const std::string strFile( directory.GetFile( i ) );
+                if( m_Seen.count( strFile ) )
+                    continue;
+
+                if( !blnAll )
+                {
+                    const unsigned long uintLength( itksys::SystemTools::FileLength( m_Directory + "/" + strFile ) );
+                    std::map< std::string, unsigned long >::iterator itLength( m_Lengths.find( strFile ) );
+                    if( uintLength == 0 || itLength == m_Lengths.end() || itLength->second != uintLength )
+                    {
+                        m_Lengths[strFile] = uintLength;
+                        continue;
+                    }
+
+                    m_Lengths.erase( itLength );
+                }
+
+                AddFile( strFile, dblNow, vecFrames );
+            }
+
+            QueueFrames( vecFrames );
+        }
+
+        /** Queues the projections written since the last call */
+        void CollectFrames()
+        {
+#if defined( __linux__ )
+            if( m_NotifyDescriptor >= 0 )
+            {
+                std::vector< Frame > vecFrames;
+                bool blnOverflow( false );
+
+                alignas( struct inotify_event ) char arrBuffer[16384];
+                ssize_t intRead;
+                while( ( intRead = read( m_NotifyDescriptor, arrBuffer, sizeof( arrBuffer ) ) ) > 0 )
+                {
+                    const double dblNow( GetSeconds() );
+                    for( char * p = arrBuffer; p < arrBuffer + intRead; )
+                    {
+                        const struct inotify_event * pEvent( reinterpret_cast< const struct inotify_event * >( p ) );
+                        if( pEvent->mask & IN_Q_OVERFLOW )
+                            blnOverflow = true;
+                        else if( pEvent->len > 0 )
+                            AddFile( pEvent->name, dblNow, vecFrames );
+
+                        p += sizeof( struct inotify_event ) + pEvent->len;
+                    }
+                }
+
+                QueueFrames( vecFrames );
+
+                // Events were lost, the directory is listed instead
+                if( blnOverflow )
+                    ListDirectory( true );
+
+                return;
+            }
+#endif
+            ListDirectory( false );
+        }
+
+        /** Appends frames to the backlog in acquisition order */
+        void QueueFrames( std::vector< Frame > & vecFrames )
+        {
+            std::sort( vecFrames.begin(), vecFrames.end(), []( const Frame & a, const Frame & b )
+            {
+                return a.Number != b.Number ? a.Number < b.Number : a.Stack < b.Stack;
+            } );
+
+            for( size_t i = 0; i < vecFrames.size(); i++ )
+            {
+                if( m_FirstDetected < 0.0 )
+                    m_FirstDetected = vecFrames[i].DetectedSeconds;
+                m_LastDetected = vecFrames[i].DetectedSeconds;
+
+                m_Pending.push_back( vecFrames[i] );
+            }
+
+            m_Statistics.FramesDetected += vecFrames.size();
+            m_Statistics.Backlog = m_Pending.size();
+            m_Statistics.MaximumBacklog = std::max( m_Statistics.MaximumBacklog, m_Statistics.Backlog );
+        }
+
+        /** Waits up to dblSeconds for a file to be written */
+        void WaitForFiles( double dblSeconds ) const
+        {
+            if( dblSeconds <= 0.0 )
+                return;
+
+#if defined( __linux__ )
+            if( m_NotifyDescriptor >= 0 )
+            {
+                struct pollfd descriptor;
+                descriptor.fd = m_NotifyDescriptor;
+                descriptor.events = POLLIN;
+                descriptor.revents = 0;
+                poll( &descriptor, 1, static_cast< int >( dblSeconds * 1000.0 + 0.5 ) );
+                return;
+            }
+#endif
+            std::this_thread::sleep_for( std::chrono::duration< double >( dblSeconds ) );
+        }
+
+        /** Reads, corrects and converts a frame, returning whether it succeeded */
+        bool ProcessFrame( Frame & frame )
+        {
+            const double dblStart( GetSeconds() );
+
+            try
+            {
+                if( frame.Stack >= m_Stacks.size() )
+                    itkExceptionMacro( "No flat for stack " << frame.Stack );
+
+                m_ImageIO->SetFileName( frame.FileName );
+                m_ImageIO->ReadImageInformation();
+
+                if( m_ImageIO->GetNumberOfComponents() != 1 || m_ImageIO->GetDimensions( 0 ) != m_Region.GetSize( 0 )
+                    || ( ImageType::ImageDimension > 1 && m_ImageIO->GetDimensions( 1 ) != m_Region.GetSize( 1 ) ) )
+                {
+                    itkExceptionMacro( "Frame is not a scalar image of " << m_Region.GetSize() );
+                }
+
+                ImageIORegion regionIO( ImageType::ImageDimension );
+                for( unsigned int j = 0; j < ImageType::ImageDimension; j++ )
+                {
+                    regionIO.SetIndex( j, 0 );
+                    regionIO.SetSize( j, m_Region.GetSize( j ) );
+                }
+                m_ImageIO->SetIORegion( regionIO );
+
+                // Grown only for frames of a pixel larger than the image type
+                const SizeValueType uintBytes( m_Region.GetNumberOfPixels() * m_ImageIO->GetComponentSize() );
+                if( m_RawBuffer.size() < uintBytes )
+                    m_RawBuffer.resize( uintBytes );
+
+                m_ImageIO->Read( &m_RawBuffer[0] );
+
+                StackState & stack( m_Stacks[frame.Stack] );
+                switch( m_ImageIO->GetComponentType() )
+                {
+                    case ImageIOBase::UCHAR:  ProcessFrameBuffer( stack, reinterpret_cast< const unsigned char * >( &m_RawBuffer[0] ) ); break;
+                    case ImageIOBase::CHAR:   ProcessFrameBuffer( stack, reinterpret_cast< const char * >( &m_RawBuffer[0] ) ); break;
+                    case ImageIOBase::USHORT: ProcessFrameBuffer( stack, reinterpret_cast< const unsigned short * >( &m_RawBuffer[0] ) ); break;
+                    case ImageIOBase::SHORT:  ProcessFrameBuffer( stack, reinterpret_cast< const short * >( &m_RawBuffer[0] ) ); break;
+                    case ImageIOBase::UINT:   ProcessFrameBuffer( stack, reinterpret_cast< const unsigned int * >( &m_RawBuffer[0] ) ); break;
+                    case ImageIOBase::INT:    ProcessFrameBuffer( stack, reinterpret_cast< const int * >( &m_RawBuffer[0] ) ); break;
+                    case ImageIOBase::FLOAT:  ProcessFrameBuffer( stack, reinterpret_cast< const float * >( &m_RawBuffer[0] ) ); break;
+                    case ImageIOBase::DOUBLE: ProcessFrameBuffer( stack, reinterpret_cast< const double * >( &m_RawBuffer[0] ) ); break;
+                    default:
+                        itkExceptionMacro( "Unsupported pixel type " << m_ImageIO->GetComponentTypeAsString( m_ImageIO->GetComponentType() ) );
+                }
+
+                stack.FramesProcessed++;
+            }
+            catch( ExceptionObject & error )
+            {
+                m_LastError = frame.FileName + ": " + error.GetDescription();
+                itkWarningMacro( "Skipping " << m_LastError );
+
+                m_Statistics.FramesFailed++;
+                m_ProcessingSum += GetSeconds() - dblStart;
+                return false;
+            }
+
+            const double dblEnd( GetSeconds() );
+            frame.ProcessingSeconds = dblEnd - dblStart;
+            frame.LatencySeconds = dblEnd - frame.DetectedSeconds;
+
+            m_Statistics.FramesProcessed++;
+            m_Statistics.LastLatency = frame.LatencySeconds;
+            m_Statistics.MaximumLatency = std::max( m_Statistics.MaximumLatency, frame.LatencySeconds );
+            if( frame.LatencySeconds > m_TargetLatency )
+                m_Statistics.FramesOverTarget++;
+
+            m_LatencySum += frame.LatencySeconds;
+            m_ProcessingSum += frame.ProcessingSeconds;
+
+            if( m_FrameCallback )
+                m_FrameCallback( frame, m_Stacks[frame.Stack].NegLog->GetOutput() );
+
+            return true;
+        }
+
+        /** Corrects raw counts into a pooled frame and runs the filters of the stack */
+        template< typename TRawPixel >
+        void ProcessFrameBuffer( StackState & stack, const TRawPixel * pRaw )
+        {
+            ImagePointer pCorrected( ImageType::New() );
+            pCorrected->CopyInformation( stack.Dark );
+            pCorrected->SetRegions( m_Region );
+            m_BufferPool->AllocateImage( pCorrected.GetPointer() );
+
+            const SizeValueType uintPixels( m_Region.GetNumberOfPixels() );
+            const PixelType * pDark( stack.Dark->GetBufferPointer() );
+            const ComputeType * pGain( &stack.Gain[0] );
+            PixelType * pOut( pCorrected->GetBufferPointer() );
+
+            for( SizeValueType i = 0; i < uintPixels; i++ )
+                pOut[i] = static_cast< PixelType >( ( static_cast< ComputeType >( pRaw[i] ) - static_cast< ComputeType >( pDark[i] ) ) * pGain[i] );
+
+            // Repaired in place, the corrected frame becoming its output
+            if( stack.DefectMap )
+            {
+                stack.Repair->SetInput( pCorrected );
+                stack.NegLog->SetInput( stack.Repair->GetOutput() );
+            }
+            else
+                stack.NegLog->SetInput( pCorrected );
+
+            if( m_PreviewShrinkFactor > 1 )
+                stack.Preview->Update();
+            else
+                stack.NegLog->Update();
+        }
+
+        std::string                                         m_Directory;
+        double                                              m_PollInterval;
+        double                                              m_TargetLatency;
+        bool                                                m_UseNotification;
+        unsigned int                                        m_PreviewShrinkFactor;
+        ImageBufferPool::Pointer                            m_BufferPool;
+        FrameCallbackType                                   m_FrameCallback;
+
+        std::vector< StackState >                           m_Stacks;
+        RegionType                                          m_Region;
+        ImageIOBase::Pointer                                m_ImageIO;
+        std::vector< char >                                 m_RawBuffer;
+
+        int                                                 m_NotifyDescriptor;
+        itksys::RegularExpression                           m_ProjectionExpression;
+        std::set< std::string >                             m_Seen;
+        std::map< std::string, unsigned long >              m_Lengths;
+        std::deque< Frame >                                 m_Pending;
+
+        Statistics                                          m_Statistics;
+        double                                              m_LatencySum;
+        double                                              m_ProcessingSum;
+        double                                              m_FirstDetected;
+        double                                              m_LastDetected;
+        std::string                                         m_LastError;
+        std::chrono::steady_clock::time_point               m_StartTime;
+    };
+}
+
+#endif // itkLiveProjectionProcessor_h
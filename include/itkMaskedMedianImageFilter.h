@@ -20,6 +20,13 @@
 
 #include "itkBoxImageFilter.h"
 #include "itkImage.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+#include "itkComputePixelTraits.h"
+#include "itkNUMAPlacement.h"
+#include "itkPackedBitMaskImage.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -67,11 +74,16 @@ namespace itk
         typedef typename OutputImageType::PixelType                     OutputPixelType;
         typedef typename MaskImageType::PixelType                       MaskPixelType;
 
+        /** Neighborhoods are gathered and their median selected in this type,
+         * float for the reduced precision storage types */
+        typedef typename ComputePixelTraits< InputPixelType >::ComputeType InputComputeType;
+
         typedef typename InputImageType::RegionType                     InputImageRegionType;
         typedef typename OutputImageType::RegionType                    OutputImageRegionType;
         typedef typename MaskImageType::RegionType                      MaskImageRegionType;
 
         typedef typename InputImageType::SizeType                       InputSizeType;
+        typedef typename InputImageType::IndexType                      InputIndexType;
 
     #ifdef ITK_USE_CONCEPT_CHECKING
       // Begin concept checking
@@ -87,10 +99,50 @@ namespace itk
       itkSetInputMacro(MaskImage, MaskImageType);
       itkGetInputMacro(MaskImage, MaskImageType);
 
+      /** Maximum number of progress events per update. Progress is accounted
+       * per scanline, so this only limits the event rate seen by observers. */
+      itkSetMacro(NumberOfProgressUpdates, unsigned int);
+      itkGetConstMacro(NumberOfProgressUpdates, unsigned int);
+
+      /** With ExcludeMaskedPixels on, a masked pixel is replaced by the median
+       * of the unmasked pixels around it only, so that clustered defects do not
+       * outvote the good pixels and a small radius suffices. Starting from the
+       * radius of the filter, the neighborhood grows by a pixel in each
+       * dimension until it holds MinimumValidSamples unmasked pixels or reaches
+       * MaximumRadius. Pixels off the image are not gathered, and a pixel with
+       * no unmasked pixel within MaximumRadius is left unchanged. Off by
+       * default, the median then being over the whole neighborhood. */
+      itkSetMacro(ExcludeMaskedPixels, bool);
+      itkGetConstMacro(ExcludeMaskedPixels, bool);
+      itkBooleanMacro(ExcludeMaskedPixels);
+
+      itkSetClampMacro(MinimumValidSamples, unsigned int, 1, NumericTraits< unsigned int >::max());
+      itkGetConstMacro(MinimumValidSamples, unsigned int);
+
+      itkSetMacro(MaximumRadius, InputSizeType);
+      itkGetConstReferenceMacro(MaximumRadius, InputSizeType);
+
+      /** Statistics of the last update, see FilterInstrumentation */
+      itkGetModifiableObjectMacro(Instrumentation, FilterInstrumentation);
+
+      /** With a placement, threads run on their node and first write their
+       * rows of the output there. Null by default, see NUMAPlacement */
+      itkSetObjectMacro(NUMAPlacement, NUMAPlacement);
+      itkGetModifiableObjectMacro(NUMAPlacement, NUMAPlacement);
+
     protected:
         MaskedMedianImageFilter();
         virtual ~MaskedMedianImageFilter() ITK_OVERRIDE {}
 
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** Excluding masked pixels, the input and the mask are requested over
+         * the output padded by the larger of the radius and MaximumRadius */
+        void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+        void BeforeThreadedGenerateData() ITK_OVERRIDE;
+        void AfterThreadedGenerateData() ITK_OVERRIDE;
+
         /** MedianImageFilter can be implemented as a multithreaded filter.
          * Therefore, this implementation provides a ThreadedGenerateData()
          * routine which is called for each processing thread. The output
@@ -103,9 +155,24 @@ namespace itk
          *     ImageToImageFilter::GenerateData() */
         void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId) ITK_OVERRIDE;
 
+        /** Appends to pixels the unmasked pixels of regionValid around index,
+         * the neighborhood grown as set by MinimumValidSamples and
+         * MaximumRadius. Returns false if none was found. */
+        bool GatherUnmaskedNeighborhood( const InputImageType * pInput, const MaskImageType * pMask, const InputIndexType & index,
+                                         const InputImageRegionType & regionValid,
+                                         std::vector< InputComputeType > & pixels ) const;
 
     private:
         ITK_DISALLOW_COPY_AND_ASSIGN(MaskedMedianImageFilter);
+
+        unsigned int                                m_NumberOfProgressUpdates;
+        bool                                        m_ExcludeMaskedPixels;
+        unsigned int                                m_MinimumValidSamples;
+        InputSizeType                               m_MaximumRadius;
+        ChunkedProgressCounter                      m_ProgressCounter;
+
+        FilterInstrumentation::Pointer              m_Instrumentation;
+        NUMAPlacement::Pointer                      m_NUMAPlacement;
     };
 }
 
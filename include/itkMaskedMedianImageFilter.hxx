@@ -25,18 +25,25 @@
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkNeighborhoodAlgorithm.h"
+#include "itkImageScanlineConstIterator.h"
 #include "itkOffset.h"
-#include "itkProgressReporter.h"
+#include "itkChunkedProgressReporter.h"
 
 #include <vector>
 #include <algorithm>
+#include <cstdlib>
 
 #define DEFAULT_FILTER_RADIUS 3
+#define DEFAULT_MINIMUM_VALID_SAMPLES 4
 
 namespace itk
 {
     template< typename TInputImage, typename TOutputImage, typename TMaskImage >
     MaskedMedianImageFilter< TInputImage, TOutputImage, TMaskImage >::MaskedMedianImageFilter()
+        : m_NumberOfProgressUpdates( 100 )
+        , m_ExcludeMaskedPixels( false )
+        , m_MinimumValidSamples( DEFAULT_MINIMUM_VALID_SAMPLES )
+        , m_Instrumentation( FilterInstrumentation::New() )
     {
         this->AddRequiredInputName("MaskImage");
 
@@ -44,11 +51,76 @@ namespace itk
         typename TOutputImage::SizeType sizeRadius;
         sizeRadius.Fill( DEFAULT_FILTER_RADIUS );
         this->SetRadius( sizeRadius );
+
+        m_MaximumRadius.Fill( DEFAULT_FILTER_RADIUS );
+    }
+
+    template< typename TInputImage, typename TOutputImage, typename TMaskImage >
+    void MaskedMedianImageFilter< TInputImage, TOutputImage, TMaskImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "NumberOfProgressUpdates: " << m_NumberOfProgressUpdates << std::endl;
+        os << indent << "ExcludeMaskedPixels: " << m_ExcludeMaskedPixels << std::endl;
+        os << indent << "MinimumValidSamples: " << m_MinimumValidSamples << std::endl;
+        os << indent << "MaximumRadius: " << m_MaximumRadius << std::endl;
+    }
+
+    template< typename TInputImage, typename TOutputImage, typename TMaskImage >
+    void MaskedMedianImageFilter< TInputImage, TOutputImage, TMaskImage >::GenerateInputRequestedRegion()
+    {
+        Superclass::GenerateInputRequestedRegion();
+
+        if( !m_ExcludeMaskedPixels )
+            return;
+
+        InputSizeType radiusMaximum;
+        for( unsigned int j = 0; j < InputImageDimension; j++ )
+            radiusMaximum[j] = std::max( this->GetRadius()[j], m_MaximumRadius[j] );
+
+        InputImageRegionType regionRequested( this->GetOutput()->GetRequestedRegion() );
+        regionRequested.PadByRadius( radiusMaximum );
+
+        InputImageType * pInput( const_cast< InputImageType * >( this->GetInput() ) );
+        if( pInput )
+        {
+            InputImageRegionType regionInput( regionRequested );
+            regionInput.Crop( pInput->GetLargestPossibleRegion() );
+            pInput->SetRequestedRegion( regionInput );
+        }
+
+        MaskImageType * pMask( const_cast< MaskImageType * >( this->GetMaskImage() ) );
+        if( pMask )
+        {
+            MaskImageRegionType regionMask( regionRequested );
+            regionMask.Crop( pMask->GetLargestPossibleRegion() );
+            pMask->SetRequestedRegion( regionMask );
+        }
+    }
+
+    template< typename TInputImage, typename TOutputImage, typename TMaskImage >
+    void MaskedMedianImageFilter< TInputImage, TOutputImage, TMaskImage >::BeforeThreadedGenerateData()
+    {
+        Superclass::BeforeThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        m_ProgressCounter.Initialize( this->GetOutput()->GetRequestedRegion().GetNumberOfPixels(), m_NumberOfProgressUpdates );
+    }
+
+    template< typename TInputImage, typename TOutputImage, typename TMaskImage >
+    void MaskedMedianImageFilter< TInputImage, TOutputImage, TMaskImage >::AfterThreadedGenerateData()
+    {
+        Superclass::AfterThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationReport( this );
     }
 
     template< typename TInputImage, typename TOutputImage, typename TMaskImage >
     void MaskedMedianImageFilter< TInputImage, TOutputImage, TMaskImage >::ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId )
     {
+        NUMAPlacement::ScopedThreadPin pin( m_NUMAPlacement, threadId, this->GetNumberOfThreads() );
+
         // Allocate output
         typename OutputImageType::Pointer pOutput( this->GetOutput() );
         typename InputImageType::ConstPointer pInput( this->GetInput() );
@@ -59,21 +131,30 @@ namespace itk
         typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType
         faceList = bC( pInput, outputRegionForThread, this->GetRadius() );
 
-        // support progress methods/callbacks
-        ProgressReporter progress( this, threadId, outputRegionForThread.GetNumberOfPixels() );
+        // support progress methods/callbacks, accounted once per scanline
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter );
 
         // All of our neighborhoods have an odd number of pixels, so there is
         // always a median index (if there where an even number of pixels
         // in the neighborhood we have to average the middle two values).
         ZeroFluxNeumannBoundaryCondition< InputImageType > nbc;
-        std::vector< InputPixelType >                      pixels;
+        std::vector< InputComputeType >                    pixels;
+        std::vector< SizeValueType >                       vecStarts;
+        std::vector< SizeValueType >                       vecPositions;
+        std::vector< OffsetValueType >                     vecOffsets;
+
+        const InputPixelType * const pInputBuffer( pInput->GetBufferPointer() );
+
+        // Excluding masked pixels, the neighborhoods are gathered from where
+        // both the input and the mask are buffered
+        InputImageRegionType regionValid( pInput->GetBufferedRegion() );
+        regionValid.Crop( pMask->GetBufferedRegion() );
 
         // Process each of the boundary faces.  These are N-d regions which border
         // the edge of the buffer.
         for( typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType::iterator fit = faceList.begin(); fit != faceList.end(); ++fit )
         {
             ImageRegionConstIterator< InputImageType > itInput( ImageRegionConstIterator< InputImageType >( pInput, *fit ) );
-            ImageRegionConstIterator< MaskImageType > itMask( ImageRegionConstIterator< MaskImageType >( pMask, *fit ) );
             ImageRegionIterator< OutputImageType > itOutput( ImageRegionIterator< OutputImageType >( pOutput, *fit ) );
 
             ConstNeighborhoodIterator< InputImageType > bit( ConstNeighborhoodIterator< InputImageType >( this->GetRadius(), pInput, *fit ) );
@@ -81,33 +162,190 @@ namespace itk
             bit.GoToBegin();
 
             const unsigned int neighborhoodSize( bit.Size() );
-            const unsigned int medianPosition( neighborhoodSize / 2 );
+            const SizeValueType uintLineLength( fit->GetSize( 0 ) );
 
-            while( !bit.IsAtEnd() )
+            // Neighborhoods within the interior face never need the boundary
+            // condition, so they are gathered through a table of buffer offsets
+            // relative to the centre pixel rather than the neighborhood iterator
+            const bool blnInterior( !bit.GetNeedToUseBoundaryCondition() );
+            if( blnInterior )
             {
-                // collect all the pixels in the neighborhood, note that we use
-                // GetPixel on the NeighborhoodIterator to honor the boundary conditions
-                pixels.resize( neighborhoodSize );
+                vecOffsets.resize( neighborhoodSize );
                 for( unsigned int i = 0; i < neighborhoodSize; ++i )
-                    pixels[i] = ( bit.GetPixel( i ) );
+                    vecOffsets[i] = pInput->ComputeOffset( pInput->GetBufferedRegion().GetIndex() + bit.GetOffset( i ) );
+            }
 
-                // get the median value
-                const typename std::vector< InputPixelType >::iterator medianIterator( pixels.begin() + medianPosition );
-                std::nth_element( pixels.begin(), medianIterator, pixels.end() );
+            SizeValueType uintMediansComputed( 0 );
 
-                double dblMedianValue( static_cast< double >( *medianIterator ) );
+            while( !itOutput.IsAtEnd() )
+            {
+                const InputPixelType * pCenter( blnInterior ? pInputBuffer + pInput->ComputeOffset( itInput.GetIndex() ) : ITK_NULLPTR );
+                OutputPixelType * const pOutputLine( pOutput->GetBufferPointer() + pOutput->ComputeOffset( itOutput.GetIndex() ) );
+                const MaskScanlineConstIterator< MaskImageType > itMask( pMask, itInput.GetIndex(), uintLineLength );
 
-                // Apply median filter only to pixels with a non-zero mask value
-                itOutput.Set( itMask.Value() ? static_cast< typename OutputImageType::PixelType >(  dblMedianValue ) : itInput.Value() );
+                // The neighborhoods of the masked pixels of the line are
+                // gathered one after another, pixels[vecStarts[k]] onwards
+                // for the pixel at vecPositions[k], and then selected, each
+                // pass timed once, a single median being too short to time
+                pixels.clear();
+                vecStarts.assign( 1, 0 );
+                vecPositions.clear();
 
-                ++bit;
-                ++itOutput;
-                ++itInput;
-                ++itMask;
+                {
+                    itkCSIROTomoScopedPhase( m_Instrumentation, threadId, NeighborhoodGather );
 
-                progress.CompletedPixel();
+                    SizeValueType x( 0 );
+                    while( x < uintLineLength )
+                    {
+                        // Pixels with a zero mask value are copied without gathering
+                        // their neighborhood, a packed mask passing over a word of
+                        // them at a time
+                        const SizeValueType uintNextMasked( itMask.FindNextSet( x ) );
+                        for( ; x < uintNextMasked; ++x )
+                        {
+                            itOutput.Set( static_cast< OutputPixelType >( itInput.Value() ) );
+
+                            ++itOutput;
+                            ++itInput;
+                            if( blnInterior )
+                                ++pCenter;
+                            else
+                                ++bit;
+                        }
+
+                        if( x == uintLineLength )
+                            break;
+
+                        if( m_ExcludeMaskedPixels )
+                        {
+                            if( blnInterior )
+                                ++pCenter;
+                            else
+                                ++bit;
+
+                            if( !this->GatherUnmaskedNeighborhood( pInput, pMask, itInput.GetIndex(), regionValid, pixels ) )
+                                itOutput.Set( static_cast< OutputPixelType >( itInput.Value() ) );
+                        }
+                        else
+                        {
+                            // collect all the pixels in the neighborhood, note that we use
+                            // GetPixel on the NeighborhoodIterator to honor the boundary conditions
+                            const SizeValueType uintStart( pixels.size() );
+                            pixels.resize( uintStart + neighborhoodSize );
+                            if( blnInterior )
+                            {
+                                for( unsigned int i = 0; i < neighborhoodSize; ++i )
+                                    pixels[uintStart + i] = pCenter[vecOffsets[i]];
+                                ++pCenter;
+                            }
+                            else
+                            {
+                                for( unsigned int i = 0; i < neighborhoodSize; ++i )
+                                    pixels[uintStart + i] = ( bit.GetPixel( i ) );
+                                ++bit;
+                            }
+                        }
+
+                        if( pixels.size() > vecStarts.back() )
+                        {
+                            vecStarts.push_back( pixels.size() );
+                            vecPositions.push_back( x );
+                        }
+
+                        ++itOutput;
+                        ++itInput;
+                        ++x;
+                    }
+                }
+
+                {
+                    itkCSIROTomoScopedPhase( m_Instrumentation, threadId, MedianSelection );
+
+                    // Apply median filter only to pixels with a non-zero mask value
+                    for( size_t k = 0; k < vecPositions.size(); ++k )
+                    {
+                        const typename std::vector< InputComputeType >::iterator itBegin( pixels.begin() + vecStarts[k] );
+                        const typename std::vector< InputComputeType >::iterator itEnd( pixels.begin() + vecStarts[k + 1] );
+                        const typename std::vector< InputComputeType >::iterator medianIterator( itBegin + ( itEnd - itBegin ) / 2 );
+                        std::nth_element( itBegin, medianIterator, itEnd );
+
+                        pOutputLine[vecPositions[k]] = static_cast< OutputPixelType >( static_cast< double >( *medianIterator ) );
+                    }
+                }
+
+                uintMediansComputed += vecPositions.size();
+
+                progress.CompletedPixels( uintLineLength );
+            }
+
+            itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, fit->GetNumberOfPixels() );
+            itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, MediansComputed, uintMediansComputed );
+        }
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, BytesAllocated, pixels.capacity() * sizeof( InputComputeType )
+                                          + ( vecStarts.capacity() + vecPositions.capacity() ) * sizeof( SizeValueType ) );
+    }
+
+    template< typename TInputImage, typename TOutputImage, typename TMaskImage >
+    bool MaskedMedianImageFilter< TInputImage, TOutputImage, TMaskImage >::GatherUnmaskedNeighborhood( const InputImageType * pInput, const MaskImageType * pMask, const InputIndexType & index,
+                                                                                                       const InputImageRegionType & regionValid,
+                                                                                                       std::vector< InputComputeType > & pixels ) const
+    {
+        InputSizeType radius( this->GetRadius() );
+        InputSizeType radiusMaximum;
+        for( unsigned int j = 0; j < InputImageDimension; j++ )
+            radiusMaximum[j] = std::max( radius[j], m_MaximumRadius[j] );
+
+        const SizeValueType uintStart( pixels.size() );
+
+        // Each larger neighborhood only gathers the shell around the last
+        InputSizeType radiusGathered;
+        radiusGathered.Fill( 0 );
+        bool blnGathered( false );
+
+        InputSizeType sizeCenter;
+        sizeCenter.Fill( 1 );
+
+        for( ;; )
+        {
+            InputImageRegionType regionNeighborhood( index, sizeCenter );
+            regionNeighborhood.PadByRadius( radius );
+            regionNeighborhood.Crop( regionValid );
+
+            const SizeValueType uintLineLength( regionNeighborhood.GetSize( 0 ) );
+
+            ImageScanlineConstIterator< InputImageType > itNeighborhood( pInput, regionNeighborhood );
+            while( !itNeighborhood.IsAtEnd() )
+            {
+                const InputIndexType indexLine( itNeighborhood.GetIndex() );
+
+                bool blnLineGathered( blnGathered );
+                for( unsigned int j = 1; j < InputImageDimension && blnLineGathered; j++ )
+                    blnLineGathered = std::abs( indexLine[j] - index[j] ) <= static_cast< IndexValueType >( radiusGathered[j] );
+
+                const MaskScanlineConstIterator< MaskImageType > itMask( pMask, indexLine, uintLineLength );
+                for( SizeValueType x = 0; x < uintLineLength; ++x, ++itNeighborhood )
+                {
+                    if( blnLineGathered && std::abs( indexLine[0] + static_cast< IndexValueType >( x ) - index[0] ) <= static_cast< IndexValueType >( radiusGathered[0] ) )
+                        continue;
+
+                    if( !itMask.Get( x ) )
+                        pixels.push_back( itNeighborhood.Get() );
+                }
+
+                itNeighborhood.NextLine();
             }
+
+            if( pixels.size() - uintStart >= m_MinimumValidSamples || radius == radiusMaximum )
+                break;
+
+            radiusGathered = radius;
+            blnGathered = true;
+            for( unsigned int j = 0; j < InputImageDimension; j++ )
+                radius[j] = std::min( radius[j] + 1, radiusMaximum[j] );
         }
+
+        return pixels.size() > uintStart;
     }
 }
 
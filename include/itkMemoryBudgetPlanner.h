@@ -0,0 +1,578 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkMemoryBudgetPlanner_h
+#define itkMemoryBudgetPlanner_h
+
+#include "itkComputePixelTraits.h"
+#include "itkNumericTraits.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkPackedBitMaskImage.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace itk
+{
+/** \class MemoryBudgetPlanner
+ *
+ * \brief Estimates the peak memory of a processing chain and plans it to a budget.
+ *
+ * A chain is described as stages, each a sequence of filter steps run by one
+ * update, and the images held throughout, such as the flats, weights and
+ * projection stack, added as resident bytes. The Estimate methods give the
+ * footprint of a step of each filter of this module from the geometry of
+ * its input and its parameters: the whole input and output, the images it
+ * creates while updating (per-input copies of the stitching, the median
+ * image behind a mask) and the buffers it keeps whatever the region updated
+ * (computed weights, per-thread sinograms). Images read by a step but held
+ * elsewhere, e.g. the mean flat of a flat field correction or the mask of a
+ * masked median, are counted where they are held.
+ *
+ * Plan() takes for every stage whose peak, with the resident bytes, exceeds
+ * BudgetBytes the first of these that fits: running its steps that can in
+ * place, or streaming it in the fewest divisions of its output rows. A
+ * streamed stage holds its first input and its assembled output whole, its
+ * intermediates only for a piece of rows padded by the overlap of the steps
+ * downstream. Stages that fit neither way are planned to their smallest
+ * peak and reported over budget. Report() and WriteJSON() describe the plan,
+ * to be read before the chain is run.
+ *
+ * Estimates count image buffers only, not the allocator, the code or the
+ * small per-thread vectors of the filters, and should be read as a lower
+ * bound of the resident set.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class MemoryBudgetPlanner : public Object
+    {
+    public:
+        typedef MemoryBudgetPlanner                         Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(MemoryBudgetPlanner, Object)
+
+        /** Footprint of a filter, in bytes of its whole output */
+        struct Step
+        {
+            Step()
+                : Rows( 0 )
+                , OverlapRows( 0 )
+                , InputBytes( 0.0 )
+                , OutputBytes( 0.0 )
+                , IntermediateBytes( 0.0 )
+                , HeldBytes( 0.0 )
+                , Streamable( false )
+                , CanRunInPlace( false )
+            {
+            }
+
+            std::string         Name;
+            SizeValueType       Rows;               // along the slowest dimension of the output, split when streamed
+            SizeValueType       OverlapRows;        // input rows read beyond each side of a piece of output
+            double              InputBytes;         // counted for the first step of a stage, the others reading its predecessor
+            double              OutputBytes;
+            double              IntermediateBytes;  // images created while updating, scaled with the piece updated
+            double              HeldBytes;          // buffers independent of the piece updated
+            bool                Streamable;
+            bool                CanRunInPlace;      // the output may take the buffer of the input
+        };
+
+        typedef std::vector< Step >                         StepsType;
+
+        /** Steps run by one update and the plan chosen for them */
+        struct Stage
+        {
+            Stage()
+                : Divisions( 1 )
+                , InPlace( false )
+                , PeakBytes( 0.0 )
+                , UnplannedPeakBytes( 0.0 )
+                , WithinBudget( true )
+            {
+            }
+
+            std::string         Name;
+            StepsType           Steps;
+            unsigned int        Divisions;
+            bool                InPlace;
+            double              PeakBytes;          // as planned, with the resident bytes
+            double              UnplannedPeakBytes; // undivided and not in place, with the resident bytes
+            bool                WithinBudget;
+        };
+
+        /** Bytes the stages may peak at, with the resident bytes, 0 for no limit */
+        itkSetClampMacro( BudgetBytes, double, 0.0, NumericTraits< double >::max() )
+        itkGetConstMacro( BudgetBytes, double )
+
+        /** Bytes of the images held throughout the chain */
+        itkGetConstMacro( ResidentBytes, double )
+
+        /** Adds an image held while every stage runs */
+        void AddResident( const std::string & strName, double dblBytes )
+        {
+            m_Residents.push_back( std::make_pair( strName, dblBytes ) );
+            m_ResidentBytes += dblBytes;
+            this->Modified();
+        }
+
+        /** Adds a stage, returning its index */
+        unsigned int AddStage( const std::string & strName, const StepsType & vecSteps )
+        {
+            Stage stage;
+            stage.Name = strName;
+            stage.Steps = vecSteps;
+            m_Stages.push_back( stage );
+            this->Modified();
+
+            return static_cast< unsigned int >( m_Stages.size() - 1 );
+        }
+
+        unsigned int AddStage( const std::string & strName, const Step & step )
+        {
+            return AddStage( strName, StepsType( 1, step ) );
+        }
+
+        /** Removes the stages and resident images */
+        void Clear()
+        {
+            m_Stages.clear();
+            m_Residents.clear();
+            m_ResidentBytes = 0.0;
+            this->Modified();
+        }
+
+        unsigned int GetNumberOfStages() const { return static_cast< unsigned int >( m_Stages.size() ); }
+
+        const Stage & GetStage( unsigned int uintStage ) const
+        {
+            if( uintStage >= m_Stages.size() )
+                itkExceptionMacro( "No stage " << uintStage << " of " << m_Stages.size() );
+
+            return m_Stages[uintStage];
+        }
+
+        const Stage & GetStage( const std::string & strName ) const
+        {
+            for( size_t i = 0; i < m_Stages.size(); i++ )
+            {
+                if( m_Stages[i].Name == strName )
+                    return m_Stages[i];
+            }
+
+            itkExceptionMacro( "No stage " << strName );
+        }
+
+        /** Largest planned peak of the stages */
+        double GetPeakBytes() const
+        {
+            double dblPeak( m_ResidentBytes );
+            for( size_t i = 0; i < m_Stages.size(); i++ )
+                dblPeak = std::max( dblPeak, m_Stages[i].PeakBytes );
+
+            return dblPeak;
+        }
+
+        /** Whether every stage was planned within the budget */
+        bool GetWithinBudget() const
+        {
+            for( size_t i = 0; i < m_Stages.size(); i++ )
+            {
+                if( !m_Stages[i].WithinBudget )
+                    return false;
+            }
+
+            return true;
+        }
+
+        /** Chooses the divisions and in place runs of every stage */
+        void Plan()
+        {
+            for( size_t i = 0; i < m_Stages.size(); i++ )
+                PlanStage( m_Stages[i] );
+        }
+
+        /** Peak bytes of steps run as one update in uintDivisions pieces,
+         * resident images excluded */
+        static double ComputeStageBytes( const StepsType & vecSteps, unsigned int uintDivisions, bool blnInPlace )
+        {
+            if( vecSteps.empty() )
+                return 0.0;
+
+            const SizeValueType uintRows( std::max< SizeValueType >( vecSteps.back().Rows, 1 ) );
+            const SizeValueType uintDivs( std::min< SizeValueType >( std::max( uintDivisions, 1u ), uintRows ) );
+
+            double dblBytes( vecSteps.front().InputBytes );
+
+            // Output rows of each step, walking up from the last, each step
+            // requesting its pieces padded by its overlap from the one before
+            SizeValueType uintPieceRows( ( uintRows + uintDivs - 1 ) / uintDivs );
+            for( size_t k = vecSteps.size(); k-- > 0; )
+            {
+                const Step & step( vecSteps[k] );
+                const double dblFraction( uintDivs == 1 || step.Rows == 0 ? 1.0 : std::min( 1.0, static_cast< double >( uintPieceRows ) / step.Rows ) );
+
+                dblBytes += step.HeldBytes + step.IntermediateBytes * dblFraction;
+
+                // In place the output is the input, possible only undivided as
+                // streamed pieces differ from the regions of their inputs
+                if( !( blnInPlace && step.CanRunInPlace && uintDivs == 1 ) )
+                    dblBytes += step.OutputBytes * dblFraction;
+
+                // The last output is assembled whole from its pieces
+                if( k + 1 == vecSteps.size() && uintDivs > 1 )
+                    dblBytes += step.OutputBytes;
+
+                uintPieceRows += 2 * step.OverlapRows;
+            }
+
+            return dblBytes;
+        }
+
+        /** Describes the plan, a line per stage */
+        void Report( std::ostream & os ) const
+        {
+            os << "Memory plan: budget " << FormatMegabytes( m_BudgetBytes ) << ", resident " << FormatMegabytes( m_ResidentBytes )
+               << ", peak " << FormatMegabytes( GetPeakBytes() ) << ( GetWithinBudget() ? "" : ", over budget" ) << std::endl;
+
+            for( size_t i = 0; i < m_Residents.size(); i++ )
+                os << "  resident " << std::left << std::setw( 20 ) << m_Residents[i].first << std::right << FormatMegabytes( m_Residents[i].second ) << std::endl;
+
+            for( size_t i = 0; i < m_Stages.size(); i++ )
+            {
+                const Stage & stage( m_Stages[i] );
+                os << "  stage    " << std::left << std::setw( 20 ) << stage.Name << std::right << FormatMegabytes( stage.PeakBytes )
+                   << " (unplanned " << FormatMegabytes( stage.UnplannedPeakBytes ) << ")";
+                if( stage.Divisions > 1 )
+                    os << ", " << stage.Divisions << " divisions";
+                if( stage.InPlace )
+                    os << ", in place";
+                if( !stage.WithinBudget )
+                    os << ", over budget";
+                os << std::endl;
+            }
+        }
+
+        /** Writes the plan as a JSON object */
+        void WriteJSON( std::ostream & os ) const
+        {
+            os << "{\"budget_bytes\": " << m_BudgetBytes << ", \"resident_bytes\": " << m_ResidentBytes
+               << ", \"peak_bytes\": " << GetPeakBytes() << ", \"within_budget\": " << ( GetWithinBudget() ? "true" : "false" ) << ", \"stages\": [";
+
+            for( size_t i = 0; i < m_Stages.size(); i++ )
+            {
+                const Stage & stage( m_Stages[i] );
+                os << ( i > 0 ? ", " : "" ) << "{\"stage\": \"" << stage.Name << "\", \"divisions\": " << stage.Divisions
+                   << ", \"in_place\": " << ( stage.InPlace ? "true" : "false" ) << ", \"peak_bytes\": " << stage.PeakBytes
+                   << ", \"unplanned_peak_bytes\": " << stage.UnplannedPeakBytes
+                   << ", \"within_budget\": " << ( stage.WithinBudget ? "true" : "false" ) << "}";
+            }
+
+            os << "]}";
+        }
+
+        /** Bytes of an image of a size, packed masks by their words */
+        template< typename TImage >
+        static double ImageBytes( const typename TImage::SizeType & size )
+        {
+            return ImageBytes< TImage >( size, IsPackedBitMaskImage< TImage >() );
+        }
+
+        /** A pixelwise filter such as those dividing or subtracting images */
+        template< typename TImage >
+        static Step EstimatePixelwise( const std::string & strName, const typename TImage::SizeType & size, bool blnCanRunInPlace )
+        {
+            Step step;
+            step.Name = strName;
+            step.Rows = size[TImage::ImageDimension - 1];
+            step.InputBytes = ImageBytes< TImage >( size );
+            step.OutputBytes = step.InputBytes;
+            step.Streamable = true;
+            step.CanRunInPlace = blnCanRunInPlace;
+
+            return step;
+        }
+
+        /** BinnedMeanProjectionImageFilter of a frame series */
+        template< typename TInputImage, typename TOutputImage >
+        static Step EstimateBinnedMeanProjection( const typename TInputImage::SizeType & sizeInput, unsigned int uintBinningFactor )
+        {
+            const unsigned int uintFactor( std::max( uintBinningFactor, 1u ) );
+
+            typename TOutputImage::SizeType sizeOutput;
+            for( unsigned int j = 0; j < TOutputImage::ImageDimension; j++ )
+                sizeOutput[j] = sizeInput[j] / uintFactor;
+
+            Step step;
+            step.Name = "BinnedMeanProjectionImageFilter";
+            step.Rows = sizeOutput[TOutputImage::ImageDimension - 1];
+            step.InputBytes = ImageBytes< TInputImage >( sizeInput );
+            step.OutputBytes = ImageBytes< TOutputImage >( sizeOutput );
+            step.Streamable = true;
+
+            return step;
+        }
+
+        /** VerticalStitchingImageFilter of uintInputs images of sizeInput into
+         * sizeOutput, the inputs shifted by uintShiftRows */
+        template< typename TImage >
+        static Step EstimateVerticalStitching( const typename TImage::SizeType & sizeInput, unsigned int uintInputs,
+                                               const typename TImage::SizeType & sizeOutput, SizeValueType uintShiftRows, bool blnComputeWeighting )
+        {
+            typedef typename ComputePixelTraits< typename TImage::PixelType >::ComputeType ComputeType;
+
+            const SizeValueType uintNumInputs( std::max( uintInputs, 1u ) );
+            const SizeValueType uintRowPixels( sizeOutput[0] );
+            const SizeValueType uintTrimmedRows( sizeOutput[1] - ( uintNumInputs - 1 ) * uintShiftRows );
+
+            Step step;
+            step.Name = "VerticalStitchingImageFilter";
+            step.Rows = sizeOutput[1];
+            step.InputBytes = uintNumInputs * ImageBytes< TImage >( sizeInput );
+            step.OutputBytes = ImageBytes< TImage >( sizeOutput );
+
+            // A trimmed copy of every input, the output itself for one input
+            if( uintNumInputs > 1 )
+                step.IntermediateBytes = static_cast< double >( uintNumInputs * uintRowPixels * uintTrimmedRows ) * sizeof( typename TImage::PixelType );
+
+            // Alpha and beta, a component per overlap over the overlap rows
+            if( blnComputeWeighting && uintNumInputs > 1 && uintTrimmedRows > uintShiftRows )
+                step.HeldBytes = 2.0 * ( uintNumInputs - 1 ) * uintRowPixels * ( uintTrimmedRows - uintShiftRows ) * sizeof( ComputeType );
+
+            // Given the weights, a band of output rows is stitched from the
+            // rows of the copies blended into it
+            step.Streamable = !blnComputeWeighting || uintNumInputs < 2;
+
+            return step;
+        }
+
+        /** DynamicFlatFieldCorrectionImageFilter, the mean flat and eigenflats
+         * counted where held */
+        template< typename TImage >
+        static Step EstimateDynamicFlatFieldCorrection( const typename TImage::SizeType & size, unsigned int uintEigenFlats )
+        {
+            Step step( EstimatePixelwise< TImage >( "DynamicFlatFieldCorrectionImageFilter", size, false ) );
+
+            // Fitted weights of every row
+            step.HeldBytes = static_cast< double >( size[TImage::ImageDimension - 1] ) * uintEigenFlats * sizeof( double );
+
+            return step;
+        }
+
+        /** ThresholdedMedianMaskImageFilter, with its median image */
+        template< typename TInputImage, typename TOutputImage >
+        static Step EstimateThresholdedMedianMask( const typename TInputImage::SizeType & size, const typename TInputImage::SizeType & radius )
+        {
+            typename TOutputImage::SizeType sizeOutput;
+            for( unsigned int j = 0; j < TOutputImage::ImageDimension; j++ )
+                sizeOutput[j] = size[j];
+
+            Step step;
+            step.Name = "ThresholdedMedianMaskImageFilter";
+            step.Rows = size[TInputImage::ImageDimension - 1];
+            step.OverlapRows = radius[TInputImage::ImageDimension - 1];
+            step.InputBytes = ImageBytes< TInputImage >( size );
+            step.OutputBytes = ImageBytes< TOutputImage >( sizeOutput );
+            step.IntermediateBytes = step.InputBytes;
+            step.Streamable = true;
+
+            return step;
+        }
+
+        /** MaskedMedianImageFilter, the mask counted where produced */
+        template< typename TImage >
+        static Step EstimateMaskedMedian( const typename TImage::SizeType & size, const typename TImage::SizeType & radius )
+        {
+            Step step( EstimatePixelwise< TImage >( "MaskedMedianImageFilter", size, false ) );
+            step.OverlapRows = radius[TImage::ImageDimension - 1];
+
+            return step;
+        }
+
+        /** DefectMapRepairImageFilter, which repairs the whole image at once */
+        template< typename TImage >
+        static Step EstimateDefectMapRepair( const typename TImage::SizeType & size )
+        {
+            Step step( EstimatePixelwise< TImage >( "DefectMapRepairImageFilter", size, true ) );
+            step.Streamable = false;
+
+            return step;
+        }
+
+        /** NegLogCheckedImageFilter */
+        template< typename TImage >
+        static Step EstimateNegLog( const typename TImage::SizeType & size )
+        {
+            return EstimatePixelwise< TImage >( "NegLogCheckedImageFilter", size, false );
+        }
+
+        /** ParallelBeamFilteredBackProjectionImageFilter of a projection stack,
+         * with the sinograms of a block of slices per thread */
+        template< typename TInputImage, typename TOutputImage >
+        static Step EstimateFilteredBackProjection( const typename TInputImage::SizeType & sizeInput, SizeValueType uintReconstructionSize,
+                                                    unsigned int uintThreads, unsigned int uintSliceBlockSize )
+        {
+            const SizeValueType uintSize( uintReconstructionSize ? uintReconstructionSize : sizeInput[0] );
+
+            typename TOutputImage::SizeType sizeOutput;
+            sizeOutput[0] = uintSize;
+            sizeOutput[1] = uintSize;
+            sizeOutput[2] = sizeInput[1];
+
+            Step step;
+            step.Name = "ParallelBeamFilteredBackProjectionImageFilter";
+            step.Rows = sizeOutput[2];
+            step.InputBytes = ImageBytes< TInputImage >( sizeInput );
+            step.OutputBytes = ImageBytes< TOutputImage >( sizeOutput );
+            step.HeldBytes = static_cast< double >( uintThreads ) * uintSliceBlockSize * sizeInput[2] * sizeInput[0] * sizeof( float );
+            step.Streamable = true;
+
+            return step;
+        }
+
+    protected:
+        MemoryBudgetPlanner()
+            : m_BudgetBytes( 0.0 )
+            , m_ResidentBytes( 0.0 )
+        {
+        }
+
+        virtual ~MemoryBudgetPlanner() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "BudgetBytes: " << m_BudgetBytes << std::endl;
+            os << indent << "ResidentBytes: " << m_ResidentBytes << std::endl;
+            os << indent << "NumberOfStages: " << m_Stages.size() << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(MemoryBudgetPlanner);
+
+        template< typename TImage >
+        static double ImageBytes( const typename TImage::SizeType & size, std::false_type )
+        {
+            double dblPixels( 1.0 );
+            for( unsigned int j = 0; j < TImage::ImageDimension; j++ )
+                dblPixels *= size[j];
+
+            return dblPixels * sizeof( typename TImage::PixelType );
+        }
+
+        template< typename TImage >
+        static double ImageBytes( const typename TImage::SizeType & size, std::true_type )
+        {
+            double dblWords( static_cast< double >( ( size[0] + TImage::BitsPerWord - 1 ) / TImage::BitsPerWord ) );
+            for( unsigned int j = 1; j < TImage::ImageDimension; j++ )
+                dblWords *= size[j];
+
+            return dblWords * sizeof( typename TImage::WordType );
+        }
+
+        static std::string FormatMegabytes( double dblBytes )
+        {
+            std::ostringstream oss;
+            oss << std::fixed << std::setprecision( 1 ) << dblBytes / ( 1024.0 * 1024.0 ) << " MB";
+            return oss.str();
+        }
+
+        void PlanStage( Stage & stage ) const
+        {
+            const StepsType & vecSteps( stage.Steps );
+
+            bool blnCanRunInPlace( false );
+            bool blnStreamable( !vecSteps.empty() && vecSteps.back().Rows > 1 );
+            for( size_t k = 0; k < vecSteps.size(); k++ )
+            {
+                blnCanRunInPlace = blnCanRunInPlace || vecSteps[k].CanRunInPlace;
+                blnStreamable = blnStreamable && vecSteps[k].Streamable;
+            }
+
+            stage.Divisions = 1;
+            stage.InPlace = false;
+            stage.UnplannedPeakBytes = m_ResidentBytes + ComputeStageBytes( vecSteps, 1, false );
+            stage.PeakBytes = stage.UnplannedPeakBytes;
+            stage.WithinBudget = m_BudgetBytes <= 0.0 || stage.PeakBytes <= m_BudgetBytes;
+
+            if( stage.WithinBudget )
+                return;
+
+            // Running in place costs nothing, so it is tried first
+            if( blnCanRunInPlace )
+            {
+                stage.InPlace = true;
+                stage.PeakBytes = m_ResidentBytes + ComputeStageBytes( vecSteps, 1, true );
+                stage.WithinBudget = stage.PeakBytes <= m_BudgetBytes;
+
+                if( stage.WithinBudget )
+                    return;
+            }
+
+            if( !blnStreamable )
+                return;
+
+            // The fewest divisions that fit, the peak not growing with the divisions
+            const unsigned int uintMaxDivisions( static_cast< unsigned int >( std::min< SizeValueType >( vecSteps.back().Rows, NumericTraits< unsigned int >::max() ) ) );
+            const double dblMinimumPeak( m_ResidentBytes + ComputeStageBytes( vecSteps, uintMaxDivisions, false ) );
+            if( dblMinimumPeak > m_BudgetBytes )
+            {
+                if( dblMinimumPeak < stage.PeakBytes )
+                {
+                    stage.Divisions = uintMaxDivisions;
+                    stage.InPlace = false;
+                    stage.PeakBytes = dblMinimumPeak;
+                }
+                return;
+            }
+
+            unsigned int uintLow( 2 );
+            unsigned int uintHigh( uintMaxDivisions );
+            while( uintLow < uintHigh )
+            {
+                const unsigned int uintMid( uintLow + ( uintHigh - uintLow ) / 2 );
+                if( m_ResidentBytes + ComputeStageBytes( vecSteps, uintMid, false ) <= m_BudgetBytes )
+                    uintHigh = uintMid;
+                else
+                    uintLow = uintMid + 1;
+            }
+
+            stage.Divisions = uintLow;
+            stage.InPlace = false;
+            stage.PeakBytes = m_ResidentBytes + ComputeStageBytes( vecSteps, uintLow, false );
+            stage.WithinBudget = true;
+        }
+
+        double                                              m_BudgetBytes;
+        double                                              m_ResidentBytes;
+        std::vector< std::pair< std::string, double > >     m_Residents;
+        std::vector< Stage >                                m_Stages;
+    };
+}
+
+#endif // itkMemoryBudgetPlanner_h
@@ -0,0 +1,418 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkNUMAPlacement_h
+#define itkNUMAPlacement_h
+
+#include "itkDataObject.h"
+#include "itkImageRegionSplitterSlowDimension.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined( __linux__ )
+#include <sched.h>
+#endif
+
+namespace itk
+{
+/** \class NUMAPlacement
+ *
+ * \brief Places the threads and images of filter updates on NUMA nodes.
+ *
+ * Filters of this module given a placement with SetNUMAPlacement() run each
+ * thread on the CPUs of one node, the threads grouped so that consecutive
+ * thread ids, and with them consecutive bands of rows of the output, share a
+ * node. Pages are placed on the node of the thread that first writes them, so
+ * buffers first written by the threads that go on to process them, as with
+ * ForEachThreadRegion(), stay local to those threads, as do pooled buffers
+ * reused by updates split alike.
+ *
+ * Read-only inputs read by every thread, such as flats and stitching weights,
+ * are copied once to each node by Replicate(), the threads reading the copy
+ * of their node from GetReplica(). Replicas are kept, and only copied again
+ * once the image is modified, until ReleaseReplicas() or destruction.
+ *
+ * The nodes are read from /sys/devices/system/node, limited to the CPUs the
+ * process may run on, and can be overridden with SetNodeCPUs(). Elsewhere,
+ * and on machines with a single node, threads are not pinned and images not
+ * replicated.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class NUMAPlacement : public Object
+    {
+    public:
+        typedef NUMAPlacement                               Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(NUMAPlacement, Object)
+
+        /** CPUs of each node */
+        typedef std::vector< std::vector< int > >           NodeCPUsType;
+
+        /** Pin threads to the CPUs of their node, on by default */
+        itkSetMacro( PinThreads, bool )
+        itkGetConstMacro( PinThreads, bool )
+        itkBooleanMacro( PinThreads )
+
+        /** Replaces the detected nodes, releasing the replicas */
+        void SetNodeCPUs( const NodeCPUsType & vecNodeCPUs )
+        {
+            this->ReleaseReplicas();
+            m_NodeCPUs = vecNodeCPUs.empty() ? NodeCPUsType( 1 ) : vecNodeCPUs;
+            this->Modified();
+        }
+
+        const NodeCPUsType & GetNodeCPUs() const { return m_NodeCPUs; }
+
+        unsigned int GetNumberOfNodes() const { return static_cast< unsigned int >( m_NodeCPUs.size() ); }
+
+        /** Node of a thread, threads divided in contiguous groups between the nodes */
+        unsigned int GetNodeOfThread( ThreadIdType threadId, ThreadIdType numberOfThreads ) const
+        {
+            if( numberOfThreads == 0 || threadId >= numberOfThreads )
+                return 0;
+
+            return static_cast< unsigned int >( static_cast< SizeValueType >( threadId ) * m_NodeCPUs.size() / numberOfThreads );
+        }
+
+        /** Nodes as found on this machine, a single node without CPUs if unknown */
+        static NodeCPUsType DetectNodeCPUs()
+        {
+            NodeCPUsType vecNodeCPUs;
+#if defined( __linux__ )
+            cpu_set_t setAllowed;
+            CPU_ZERO( &setAllowed );
+            const bool blnAllowed( sched_getaffinity( 0, sizeof( setAllowed ), &setAllowed ) == 0 );
+
+            // Node directories are numbered from 0, possibly with gaps
+            for( unsigned int uintNode = 0; uintNode < 1024; uintNode++ )
+            {
+                std::ostringstream ossPath;
+                ossPath << "/sys/devices/system/node/node" << uintNode << "/cpulist";
+
+                std::ifstream ifs( ossPath.str().c_str() );
+                if( !ifs )
+                    continue;
+
+                std::string strList;
+                std::getline( ifs, strList );
+
+                const std::vector< int > vecListed( ParseCPUList( strList ) );
+                std::vector< int > vecCPUs;
+                for( size_t i = 0; i < vecListed.size(); i++ )
+                {
+                    if( !blnAllowed || ( vecListed[i] < CPU_SETSIZE && CPU_ISSET( vecListed[i], &setAllowed ) ) )
+                        vecCPUs.push_back( vecListed[i] );
+                }
+
+                if( !vecCPUs.empty() )
+                    vecNodeCPUs.push_back( vecCPUs );
+            }
+#endif
+            if( vecNodeCPUs.empty() )
+                vecNodeCPUs.resize( 1 );
+
+            return vecNodeCPUs;
+        }
+
+        /** Parses a list of CPUs as written by the kernel, e.g. "0-3,8,10-11" */
+        static std::vector< int > ParseCPUList( const std::string & strList )
+        {
+            std::vector< int > vecCPUs;
+            std::istringstream iss( strList );
+            std::string strRange;
+
+            while( std::getline( iss, strRange, ',' ) )
+            {
+                if( strRange.find_first_of( "0123456789" ) == std::string::npos )
+                    continue;
+
+                const std::string::size_type uintDash( strRange.find( '-' ) );
+                const int intFirst( std::atoi( strRange.c_str() ) );
+                const int intLast( uintDash == std::string::npos ? intFirst : std::atoi( strRange.c_str() + uintDash + 1 ) );
+
+                for( int intCPU = intFirst; intCPU <= intLast; intCPU++ )
+                    vecCPUs.push_back( intCPU );
+            }
+
+            return vecCPUs;
+        }
+
+        /** Runs the calling thread on the CPUs of a node for its lifetime,
+         * restoring the CPUs it ran on before */
+        class ScopedThreadPin
+        {
+        public:
+            ScopedThreadPin( const NUMAPlacement * pPlacement, ThreadIdType threadId, ThreadIdType numberOfThreads )
+                : m_Pinned( false )
+            {
+#if defined( __linux__ )
+                if( !pPlacement || !pPlacement->GetPinThreads() || pPlacement->GetNumberOfNodes() < 2 )
+                    return;
+
+                const std::vector< int > & vecCPUs( pPlacement->GetNodeCPUs()[pPlacement->GetNodeOfThread( threadId, numberOfThreads )] );
+                if( vecCPUs.empty() || sched_getaffinity( 0, sizeof( m_Previous ), &m_Previous ) != 0 )
+                    return;
+
+                m_Pinned = SetAffinity( vecCPUs );
+#else
+                (void)pPlacement;
+                (void)threadId;
+                (void)numberOfThreads;
+#endif
+            }
+
+            ~ScopedThreadPin()
+            {
+#if defined( __linux__ )
+                if( m_Pinned )
+                    sched_setaffinity( 0, sizeof( m_Previous ), &m_Previous );
+#endif
+            }
+
+        private:
+            ScopedThreadPin( const ScopedThreadPin & );
+            void operator=( const ScopedThreadPin & );
+
+            bool                                            m_Pinned;
+#if defined( __linux__ )
+            cpu_set_t                                       m_Previous;
+#endif
+        };
+
+        /** Calls function( regionThread, threadId ) for the pieces of region
+         * split by rows between numberOfThreads pinned threads, as a filter of
+         * as many threads splits its output, so that buffers first written
+         * here are local to the threads that later process them */
+        template< typename TRegion, typename TFunction >
+        void ForEachThreadRegion( const TRegion & region, ThreadIdType numberOfThreads, TFunction function ) const
+        {
+            ThreadRegionStruct< TRegion, TFunction > str;
+            str.Placement = this;
+            str.Region = &region;
+            str.Function = &function;
+
+            MultiThreader::Pointer pThreader( MultiThreader::New() );
+            pThreader->SetNumberOfThreads( std::max< ThreadIdType >( numberOfThreads, 1 ) );
+            pThreader->SetSingleMethod( ThreadRegionCallback< TRegion, TFunction >, &str );
+            pThreader->SingleMethodExecute();
+        }
+
+        /** Copies an image to every node, unless already copied since it was
+         * last modified */
+        template< typename TImage >
+        void Replicate( const TImage * pImage )
+        {
+            if( !pImage || m_NodeCPUs.size() < 2 )
+                return;
+
+            std::lock_guard< std::mutex > lock( m_Mutex );
+
+            Replica & replica( m_Replicas[pImage] );
+            if( replica.Images.size() == m_NodeCPUs.size() && replica.ModifiedTime == pImage->GetMTime() &&
+                replica.Buffer == pImage->GetBufferPointer() )
+                return;
+
+            replica.Images.assign( m_NodeCPUs.size(), DataObject::Pointer() );
+            replica.ModifiedTime = pImage->GetMTime();
+            replica.Buffer = pImage->GetBufferPointer();
+
+            // Each copy is allocated and written by a thread on its node
+            std::vector< typename TImage::Pointer > vecCopies( m_NodeCPUs.size() );
+            std::vector< std::thread > vecThreads;
+            for( size_t uintNode = 0; uintNode < m_NodeCPUs.size(); uintNode++ )
+            {
+                vecThreads.push_back( std::thread( [this, pImage, uintNode, &vecCopies]()
+                {
+                    if( m_PinThreads )
+                        SetAffinity( m_NodeCPUs[uintNode] );
+                    vecCopies[uintNode] = CopyImage( pImage );
+                } ) );
+            }
+
+            for( size_t i = 0; i < vecThreads.size(); i++ )
+                vecThreads[i].join();
+
+            for( size_t uintNode = 0; uintNode < m_NodeCPUs.size(); uintNode++ )
+                replica.Images[uintNode] = vecCopies[uintNode].GetPointer();
+        }
+
+        /** The copy of an image on a node, or the image itself if it has not
+         * been replicated since it was last modified */
+        template< typename TImage >
+        const TImage * GetReplica( const TImage * pImage, unsigned int uintNode ) const
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+
+            std::map< const DataObject *, Replica >::const_iterator it( m_Replicas.find( pImage ) );
+            if( it == m_Replicas.end() || uintNode >= it->second.Images.size() || it->second.ModifiedTime != pImage->GetMTime() ||
+                it->second.Buffer != pImage->GetBufferPointer() )
+                return pImage;
+
+            return static_cast< const TImage * >( it->second.Images[uintNode].GetPointer() );
+        }
+
+        /** Frees the replicas of an image, as when it is about to be replaced */
+        void ReleaseReplica( const DataObject * pImage )
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+            m_Replicas.erase( pImage );
+        }
+
+        /** Frees all replicas */
+        void ReleaseReplicas()
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+            m_Replicas.clear();
+        }
+
+        /** Number of images replicated */
+        SizeValueType GetNumberOfReplicatedImages() const
+        {
+            std::lock_guard< std::mutex > lock( m_Mutex );
+            return m_Replicas.size();
+        }
+
+    protected:
+        NUMAPlacement()
+            : m_PinThreads( true )
+            , m_NodeCPUs( DetectNodeCPUs() )
+        {
+        }
+
+        virtual ~NUMAPlacement() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "PinThreads: " << m_PinThreads << std::endl;
+            os << indent << "NumberOfNodes: " << m_NodeCPUs.size() << std::endl;
+            for( size_t i = 0; i < m_NodeCPUs.size(); i++ )
+                os << indent << "Node " << i << " CPUs: " << m_NodeCPUs[i].size() << std::endl;
+            os << indent << "NumberOfReplicatedImages: " << GetNumberOfReplicatedImages() << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(NUMAPlacement);
+
+        /** Copies of an image, one per node, as of the time it was copied */
+        struct Replica
+        {
+            Replica()
+                : ModifiedTime( 0 )
+                , Buffer( ITK_NULLPTR )
+            {
+            }
+
+            std::vector< DataObject::Pointer >  Images;
+            ModifiedTimeType                    ModifiedTime;
+            const void *                        Buffer;
+        };
+
+        template< typename TRegion, typename TFunction >
+        struct ThreadRegionStruct
+        {
+            const Self *        Placement;
+            const TRegion *     Region;
+            TFunction *         Function;
+        };
+
+        template< typename TRegion, typename TFunction >
+        static ITK_THREAD_RETURN_TYPE ThreadRegionCallback( void * pArg )
+        {
+            MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+            ThreadRegionStruct< TRegion, TFunction > * pStr( static_cast< ThreadRegionStruct< TRegion, TFunction > * >( pInfo->UserData ) );
+
+            const ThreadIdType threadId( pInfo->ThreadID );
+            const ThreadIdType numberOfThreads( pInfo->NumberOfThreads );
+
+            ImageRegionSplitterSlowDimension::Pointer pSplitter( ImageRegionSplitterSlowDimension::New() );
+
+            TRegion regionThread( *pStr->Region );
+            if( threadId < pSplitter->GetNumberOfSplits( regionThread, numberOfThreads ) )
+            {
+                pSplitter->GetSplit( threadId, numberOfThreads, regionThread );
+
+                ScopedThreadPin pin( pStr->Placement, threadId, numberOfThreads );
+                ( *pStr->Function )( regionThread, threadId );
+            }
+
+            return ITK_THREAD_RETURN_VALUE;
+        }
+
+        static bool SetAffinity( const std::vector< int > & vecCPUs )
+        {
+#if defined( __linux__ )
+            if( vecCPUs.empty() )
+                return false;
+
+            cpu_set_t setCPUs;
+            CPU_ZERO( &setCPUs );
+            for( size_t i = 0; i < vecCPUs.size(); i++ )
+            {
+                if( vecCPUs[i] >= 0 && vecCPUs[i] < CPU_SETSIZE )
+                    CPU_SET( vecCPUs[i], &setCPUs );
+            }
+
+            return sched_setaffinity( 0, sizeof( setCPUs ), &setCPUs ) == 0;
+#else
+            (void)vecCPUs;
+            return false;
+#endif
+        }
+
+        /** Copy of the buffered region of an image (or vector image) */
+        template< typename TImage >
+        static typename TImage::Pointer CopyImage( const TImage * pImage )
+        {
+            typename TImage::Pointer pCopy( TImage::New() );
+            pCopy->CopyInformation( pImage );
+            pCopy->SetNumberOfComponentsPerPixel( pImage->GetNumberOfComponentsPerPixel() );
+            pCopy->SetRegions( pImage->GetBufferedRegion() );
+            pCopy->Allocate();
+
+            const SizeValueType uintElements( pImage->GetPixelContainer()->Size() );
+            std::copy( pImage->GetBufferPointer(), pImage->GetBufferPointer() + uintElements, pCopy->GetBufferPointer() );
+
+            return pCopy;
+        }
+
+        bool                                                m_PinThreads;
+        NodeCPUsType                                        m_NodeCPUs;
+
+        mutable std::mutex                                  m_Mutex;
+        std::map< const DataObject *, Replica >             m_Replicas;
+    };
+}
+
+#endif // itkNUMAPlacement_h
@@ -20,6 +20,8 @@
 
 #include "itkImageToImageFilter.h"
 #include "itkProgressReporter.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkImageBufferPool.h"
 
 namespace itk
 {
@@ -51,6 +53,14 @@ namespace itk
         itkConceptMacro( FloatingPointPixel, ( itk::Concept::IsFloatingPoint< typename TImage::PixelType > ) );
     #endif
 
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+        /** Pool the output and intermediate images are drawn from, null to
+         * allocate them per update, see ImageBufferPool */
+        itkSetObjectMacro( BufferPool, ImageBufferPool )
+        itkGetModifiableObjectMacro( BufferPool, ImageBufferPool )
+
     protected:
         NegLogCheckedImageFilter();
         virtual ~NegLogCheckedImageFilter() ITK_OVERRIDE {}
@@ -61,6 +71,9 @@ namespace itk
     private:
         ITK_DISALLOW_COPY_AND_ASSIGN(NegLogCheckedImageFilter);
 
+        FilterInstrumentation::Pointer      m_Instrumentation;
+        ImageBufferPool::Pointer            m_BufferPool;
+
     };
 }
 
@@ -23,6 +23,7 @@
 #include "itkUnaryFunctorImageFilter.h"
 #include "itkMath.h"
 #include "itkNumericTraits.h"
+#include "itkProgressAccumulator.h"
 
 namespace itk
 {
@@ -56,6 +57,7 @@ namespace itk
 
     template< typename TImage > 
     NegLogCheckedImageFilter< TImage >::NegLogCheckedImageFilter()
+        : m_Instrumentation( FilterInstrumentation::New() )
     {
 
     }
@@ -69,14 +71,35 @@ namespace itk
     template< typename TImage >
     void NegLogCheckedImageFilter< TImage >::GenerateData()
     {
-        typedef UnaryFunctorImageFilter< TImage, TImage, Functor::NegLogChecked<typename TImage::PixelType, typename TImage::PixelType > > FunctorFilterType;
+        typedef PooledOutputImageFilter< UnaryFunctorImageFilter< TImage, TImage, Functor::NegLogChecked<typename TImage::PixelType, typename TImage::PixelType > > > FunctorFilterType;
+
+        // The functor reads a graft of the input and writes to a graft of the
+        // output, so that only the requested region is processed and the
+        // pipeline upstream is not updated again for the largest possible region
+        typename TImage::Pointer pInput( TImage::New() );
+        pInput->Graft( this->GetInput() );
 
         typename FunctorFilterType::Pointer pFunctorFilter( FunctorFilterType::New() );
 
-        pFunctorFilter->SetInput( this->GetInput() );
-        pFunctorFilter->Update();
+        pFunctorFilter->SetInput( pInput );
+        pFunctorFilter->GraftOutput( this->GetOutput() );
+        pFunctorFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+        pFunctorFilter->SetBufferPool( m_BufferPool );
+
+        ProgressAccumulator::Pointer pProgress( ProgressAccumulator::New() );
+        pProgress->SetMiniPipelineFilter( this );
+        pProgress->RegisterInternalFilter( pFunctorFilter, 1.0f );
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, 1 );
+        {
+            itkCSIROTomoScopedPhase( m_Instrumentation, 0, Functor );
+            pFunctorFilter->Update();
+        }
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, 0, PixelsProcessed, pFunctorFilter->GetOutput()->GetBufferedRegion().GetNumberOfPixels() );
+
+        this->GraftOutput( pFunctorFilter->GetOutput() );
 
-        this->GetOutput()->Graft( pFunctorFilter->GetOutput() );
+        itkCSIROTomoInstrumentationReport( this );
     }
 }
 
@@ -0,0 +1,166 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkNegLogLookupTableImageFilter_h
+#define itkNegLogLookupTableImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class NegLogLookupTableImageFilter
+ *
+ * \brief Converts integer detector counts to attenuation through a table.
+ *
+ * The counts of an 8 or 16 bit detector take at most 65536 values, so rather
+ * than evaluating a logarithm per pixel as NegLogCheckedImageFilter does, the
+ * attenuation of every possible count is computed once into a table and each
+ * pixel is a single lookup. The table is kept between updates and only
+ * recomputed when FlatValue or the LinearisationCoefficients change, so a
+ * whole scan is converted with one table.
+ *
+ * A count c of a row with flat count f is mapped to P( -log( c / f ) ), where
+ * P is the beam hardening linearisation polynomial whose coefficients, lowest
+ * order first, are LinearisationCoefficients, the identity when empty. Counts
+ * of zero or less map to zero, as in NegLogCheckedImageFilter. The flat count
+ * is FlatValue, multiplied by the entry of RowFlatValues for the row, along
+ * the second axis of the largest possible region, when those are set.
+ *
+ * With a scalar flat everything is folded into the table. Per-row flats cannot
+ * be folded into a single table, so the table then holds -log( c ) and the
+ * log of the row flat is added per pixel, followed by a Horner evaluation of
+ * the polynomial if one is set. Neither needs a transcendental per pixel.
+ *
+ * \sa NegLogCheckedImageFilter
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TInputImage, typename TOutputImage >
+    class ITK_TEMPLATE_EXPORT NegLogLookupTableImageFilter : public ImageToImageFilter< TInputImage, TOutputImage >
+    {
+    public:
+        typedef NegLogLookupTableImageFilter                        Self;
+        typedef ImageToImageFilter< TInputImage, TOutputImage >     Superclass;
+        typedef SmartPointer< Self >                                Pointer;
+        typedef SmartPointer< const Self >                          ConstPointer;
+
+        itkStaticConstMacro( InputImageDimension, unsigned int, TInputImage::ImageDimension );
+        itkStaticConstMacro( OutputImageDimension, unsigned int, TOutputImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(NegLogLookupTableImageFilter, ImageToImageFilter)
+
+        /** Image related typedefs. */
+        typedef TInputImage                                         InputImageType;
+        typedef TOutputImage                                        OutputImageType;
+        typedef typename InputImageType::PixelType                  InputPixelType;
+        typedef typename OutputImageType::PixelType                 OutputPixelType;
+        typedef typename OutputImageType::RegionType                OutputImageRegionType;
+
+        typedef std::vector< double >                               ValuesType;
+        typedef std::vector< OutputPixelType >                      TableType;
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( SameDimensionCheck, ( Concept::SameDimension< InputImageDimension, OutputImageDimension > ) );
+        itkConceptMacro( IntegerInputPixel, ( Concept::IsInteger< InputPixelType > ) );
+        itkConceptMacro( FloatingPointOutputPixel, ( Concept::IsFloatingPoint< OutputPixelType > ) );
+    #endif
+
+        static_assert( sizeof( InputPixelType ) <= 2, "NegLogLookupTableImageFilter tabulates 8 and 16 bit counts only" );
+
+        /** Flat count every pixel is normalised by, 1 by default */
+        itkSetMacro( FlatValue, double )
+        itkGetConstMacro( FlatValue, double )
+
+        /** Flat count of each row, relative to FlatValue, none by default */
+        void SetRowFlatValues( const ValuesType & values )
+        {
+            if( m_RowFlatValues != values )
+            {
+                m_RowFlatValues = values;
+                this->Modified();
+            }
+        }
+        itkGetConstReferenceMacro( RowFlatValues, ValuesType )
+
+        /** Beam hardening linearisation polynomial, lowest order first */
+        void SetLinearisationCoefficients( const ValuesType & coefficients )
+        {
+            if( m_LinearisationCoefficients != coefficients )
+            {
+                m_LinearisationCoefficients = coefficients;
+                this->Modified();
+            }
+        }
+        itkGetConstReferenceMacro( LinearisationCoefficients, ValuesType )
+
+        /** Table of the last update, indexed by the count less the lowest count
+         * of the pixel type */
+        itkGetConstReferenceMacro( Table, TableType )
+
+        /** Maximum number of progress events per update */
+        itkSetMacro( NumberOfProgressUpdates, unsigned int )
+        itkGetConstMacro( NumberOfProgressUpdates, unsigned int )
+
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+    protected:
+        NegLogLookupTableImageFilter();
+        virtual ~NegLogLookupTableImageFilter() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** Validates the parameters and recomputes the table if they changed */
+        void BeforeThreadedGenerateData() ITK_OVERRIDE;
+        void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+        void ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId ) ITK_OVERRIDE;
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(NegLogLookupTableImageFilter);
+
+        /** Linearisation polynomial at dblValue */
+        double EvaluatePolynomial( double dblValue ) const;
+
+        double                                      m_FlatValue;
+        ValuesType                                  m_RowFlatValues;
+        ValuesType                                  m_LinearisationCoefficients;
+        unsigned int                                m_NumberOfProgressUpdates;
+
+        // The table and the parameters it was computed for
+        TableType                                   m_Table;
+        double                                      m_TableFlatValue;
+        ValuesType                                  m_TableCoefficients;
+        bool                                        m_TablePerRow;
+
+        // Log of the flat count of each row, when per-row flats are set
+        std::vector< double >                       m_RowLogFlats;
+
+        ChunkedProgressCounter                      m_ProgressCounter;
+        FilterInstrumentation::Pointer              m_Instrumentation;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkNegLogLookupTableImageFilter.hxx"
+#endif
+
+#endif // itkNegLogLookupTableImageFilter_h
@@ -0,0 +1,204 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkNegLogLookupTableImageFilter_hxx
+#define itkNegLogLookupTableImageFilter_hxx
+
+#include "itkNegLogLookupTableImageFilter.h"
+
+#include "itkImageScanlineConstIterator.h"
+#include "itkImageScanlineIterator.h"
+#include "itkNumericTraits.h"
+
+#include <cmath>
+#include <cstddef>
+
+namespace itk
+{
+    template< typename TInputImage, typename TOutputImage >
+    NegLogLookupTableImageFilter< TInputImage, TOutputImage >::NegLogLookupTableImageFilter()
+        : m_FlatValue( 1.0 )
+        , m_NumberOfProgressUpdates( 100 )
+        , m_TableFlatValue( 0.0 )
+        , m_TablePerRow( false )
+        , m_Instrumentation( FilterInstrumentation::New() )
+    {
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void NegLogLookupTableImageFilter< TInputImage, TOutputImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "FlatValue: " << m_FlatValue << std::endl;
+        os << indent << "NumberOfRowFlatValues: " << m_RowFlatValues.size() << std::endl;
+        os << indent << "LinearisationCoefficients:";
+        for( size_t i = 0; i < m_LinearisationCoefficients.size(); i++ )
+            os << " " << m_LinearisationCoefficients[i];
+        os << std::endl;
+        os << indent << "NumberOfProgressUpdates: " << m_NumberOfProgressUpdates << std::endl;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    double NegLogLookupTableImageFilter< TInputImage, TOutputImage >::EvaluatePolynomial( double dblValue ) const
+    {
+        if( m_LinearisationCoefficients.empty() )
+            return dblValue;
+
+        double dblResult( 0.0 );
+        for( size_t i = m_LinearisationCoefficients.size(); i-- > 0; )
+            dblResult = dblResult * dblValue + m_LinearisationCoefficients[i];
+
+        return dblResult;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void NegLogLookupTableImageFilter< TInputImage, TOutputImage >::BeforeThreadedGenerateData()
+    {
+        Superclass::BeforeThreadedGenerateData();
+
+        if( !( m_FlatValue > 0.0 ) )
+            itkExceptionMacro( "FlatValue must be positive, not " << m_FlatValue );
+
+        const bool blnPerRow( !m_RowFlatValues.empty() );
+
+        m_RowLogFlats.clear();
+        if( blnPerRow )
+        {
+            if( InputImageDimension < 2 )
+                itkExceptionMacro( "Per-row flats need images of at least two dimensions" );
+
+            const SizeValueType uintNumRows( this->GetInput()->GetLargestPossibleRegion().GetSize( 1 ) );
+            if( m_RowFlatValues.size() != uintNumRows )
+                itkExceptionMacro( m_RowFlatValues.size() << " row flats set for " << uintNumRows << " rows" );
+
+            m_RowLogFlats.resize( uintNumRows );
+            for( SizeValueType i = 0; i < uintNumRows; i++ )
+            {
+                if( !( m_RowFlatValues[i] > 0.0 ) )
+                    itkExceptionMacro( "Flat of row " << i << " must be positive, not " << m_RowFlatValues[i] );
+
+                m_RowLogFlats[i] = std::log( m_FlatValue * m_RowFlatValues[i] );
+            }
+        }
+
+        // The table only depends on the flat and the polynomial, and holds
+        // -log( c ) alone with per-row flats
+        if( m_Table.empty() || blnPerRow != m_TablePerRow || ( !blnPerRow && ( m_FlatValue != m_TableFlatValue || m_LinearisationCoefficients != m_TableCoefficients ) ) )
+        {
+            const double dblLowest( NumericTraits< InputPixelType >::NonpositiveMin() );
+            const double dblHighest( NumericTraits< InputPixelType >::max() );
+
+            m_Table.resize( static_cast< size_t >( dblHighest - dblLowest ) + 1 );
+            for( size_t i = 0; i < m_Table.size(); i++ )
+            {
+                const double dblCount( dblLowest + i );
+
+                if( dblCount <= 0.0 )
+                    m_Table[i] = NumericTraits< OutputPixelType >::ZeroValue();
+                else if( blnPerRow )
+                    m_Table[i] = static_cast< OutputPixelType >( -std::log( dblCount ) );
+                else
+                    m_Table[i] = static_cast< OutputPixelType >( EvaluatePolynomial( -std::log( dblCount / m_FlatValue ) ) );
+            }
+
+            m_TableFlatValue = m_FlatValue;
+            m_TableCoefficients = m_LinearisationCoefficients;
+            m_TablePerRow = blnPerRow;
+        }
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        m_ProgressCounter.Initialize( this->GetOutput()->GetRequestedRegion().GetNumberOfPixels(), m_NumberOfProgressUpdates );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void NegLogLookupTableImageFilter< TInputImage, TOutputImage >::AfterThreadedGenerateData()
+    {
+        Superclass::AfterThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void NegLogLookupTableImageFilter< TInputImage, TOutputImage >::ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId )
+    {
+        const InputImageType * pInput( this->GetInput() );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        // support progress methods/callbacks, accounted once per scanline
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter );
+
+        itkCSIROTomoScopedPhase( m_Instrumentation, threadId, Functor );
+
+        const OutputPixelType * pTable( &m_Table[0] - static_cast< std::ptrdiff_t >( NumericTraits< InputPixelType >::NonpositiveMin() ) );
+        const bool blnPerRow( !m_RowLogFlats.empty() );
+        const bool blnPolynomial( !m_LinearisationCoefficients.empty() );
+
+        // Rows run along the second axis, per-row flats needing one
+        const unsigned int uintRowAxis( InputImageDimension > 1 ? 1 : 0 );
+        const IndexValueType intFirstRow( pInput->GetLargestPossibleRegion().GetIndex( uintRowAxis ) );
+
+        ImageScanlineConstIterator< InputImageType > itInput( pInput, outputRegionForThread );
+        ImageScanlineIterator< OutputImageType > itOutput( pOutput, outputRegionForThread );
+
+        const SizeValueType uintLineLength( outputRegionForThread.GetSize( 0 ) );
+
+        while( !itInput.IsAtEnd() )
+        {
+            if( !blnPerRow )
+            {
+                while( !itInput.IsAtEndOfLine() )
+                {
+                    itOutput.Set( pTable[itInput.Get()] );
+
+                    ++itInput;
+                    ++itOutput;
+                }
+            }
+            else
+            {
+                const double dblRowLogFlat( m_RowLogFlats[itInput.GetIndex()[uintRowAxis] - intFirstRow] );
+
+                while( !itInput.IsAtEndOfLine() )
+                {
+                    const InputPixelType count( itInput.Get() );
+
+                    if( count <= NumericTraits< InputPixelType >::ZeroValue() )
+                        itOutput.Set( NumericTraits< OutputPixelType >::ZeroValue() );
+                    else
+                    {
+                        const double dblAttenuation( static_cast< double >( pTable[count] ) + dblRowLogFlat );
+                        itOutput.Set( static_cast< OutputPixelType >( blnPolynomial ? EvaluatePolynomial( dblAttenuation ) : dblAttenuation ) );
+                    }
+
+                    ++itInput;
+                    ++itOutput;
+                }
+            }
+
+            itInput.NextLine();
+            itOutput.NextLine();
+
+            progress.CompletedPixels( uintLineLength );
+        }
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, outputRegionForThread.GetNumberOfPixels() );
+    }
+}
+
+#endif // itkNegLogLookupTableImageFilter_hxx
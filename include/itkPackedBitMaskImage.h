@@ -0,0 +1,382 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkPackedBitMaskImage_h
+#define itkPackedBitMaskImage_h
+
+#include "itkImageBase.h"
+#include "itkImageScanlineConstIterator.h"
+#include "itkImageScanlineIterator.h"
+#include "itkImportImageContainer.h"
+#include "itkIntTypes.h"
+#include "itkObjectFactory.h"
+
+#include <algorithm>
+#include <type_traits>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+namespace itk
+{
+/** \class PackedBitMaskImage
+ *
+ * \brief Binary mask storing one bit per pixel.
+ *
+ * A mask image for MaskedMedianImageFilter, and an output image of
+ * ThresholdedMedianMaskImageFilter, taking an eighth of the memory of an
+ * unsigned char mask. Pixels are packed along the first dimension into
+ * 64-bit words, least significant bit first, and every row of the buffered
+ * region starts on a new word, so rows can be written by different threads
+ * and scanned a word at a time with MaskScanlineConstIterator.
+ *
+ * The image takes part in pipelines as any other ImageBase, but it has no
+ * pixel iterators; pixels are accessed through GetPixel()/SetPixel(), the
+ * scanline iterators below, or by converting from and to an itk::Image with
+ * Pack() and Unpack().
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< unsigned int VImageDimension >
+    class ITK_TEMPLATE_EXPORT PackedBitMaskImage : public ImageBase< VImageDimension >
+    {
+    public:
+        typedef PackedBitMaskImage                          Self;
+        typedef ImageBase< VImageDimension >                Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(PackedBitMaskImage, ImageBase)
+
+        itkStaticConstMacro( ImageDimension, unsigned int, VImageDimension );
+
+        typedef bool                                        PixelType;
+        typedef uint64_t                                    WordType;
+        itkStaticConstMacro( BitsPerWord, unsigned int, 64 );
+
+        /** The buffer holds words rather than pixels */
+        typedef ImportImageContainer< SizeValueType, WordType > PixelContainer;
+        typedef typename PixelContainer::Pointer            PixelContainerPointer;
+        typedef typename PixelContainer::ConstPointer       PixelContainerConstPointer;
+
+        typedef typename Superclass::IndexType              IndexType;
+        typedef typename Superclass::SizeType               SizeType;
+        typedef typename Superclass::RegionType             RegionType;
+
+        /** Allocates the words of the buffered region, cleared if initializePixels is set */
+        virtual void Allocate( bool initializePixels = false ) ITK_OVERRIDE
+        {
+            this->ComputeOffsetTable();
+
+            const RegionType & regionBuffered( this->GetBufferedRegion() );
+            const SizeValueType uintRowLength( regionBuffered.GetSize( 0 ) );
+
+            m_WordsPerRow = ( uintRowLength + BitsPerWord - 1 ) / BitsPerWord;
+            const SizeValueType uintRows( uintRowLength > 0 ? regionBuffered.GetNumberOfPixels() / uintRowLength : 0 );
+
+            m_Buffer->Reserve( uintRows * m_WordsPerRow, initializePixels );
+        }
+
+        virtual void Initialize() ITK_OVERRIDE
+        {
+            Superclass::Initialize();
+
+            // Replace rather than release the container, it may be shared by a graft
+            m_Buffer = PixelContainer::New();
+            m_WordsPerRow = 0;
+        }
+
+        virtual void Graft( const DataObject * data ) ITK_OVERRIDE
+        {
+            Superclass::Graft( data );
+
+            const Self * pImage( dynamic_cast< const Self * >( data ) );
+            if( !pImage )
+                itkExceptionMacro( "Cannot graft " << ( data ? data->GetNameOfClass() : "null" ) << " onto " << this->GetNameOfClass() );
+
+            m_Buffer = const_cast< PixelContainer * >( pImage->GetPixelContainer() );
+            m_WordsPerRow = pImage->m_WordsPerRow;
+        }
+
+        /** Sets every word of the buffer, padding bits included */
+        void FillBuffer( bool blnValue )
+        {
+            std::fill( m_Buffer->GetBufferPointer(), m_Buffer->GetBufferPointer() + m_Buffer->Size(),
+                       blnValue ? ~static_cast< WordType >( 0 ) : static_cast< WordType >( 0 ) );
+        }
+
+        bool GetPixel( const IndexType & index ) const
+        {
+            const SizeValueType uintBit( index[0] - this->GetBufferedRegion().GetIndex( 0 ) );
+            return ( GetRowWords( index )[uintBit / BitsPerWord] >> ( uintBit % BitsPerWord ) ) & 1;
+        }
+
+        void SetPixel( const IndexType & index, bool blnValue )
+        {
+            const SizeValueType uintBit( index[0] - this->GetBufferedRegion().GetIndex( 0 ) );
+            WordType & word( GetRowWords( index )[uintBit / BitsPerWord] );
+            const WordType wordBit( static_cast< WordType >( 1 ) << ( uintBit % BitsPerWord ) );
+
+            word = blnValue ? ( word | wordBit ) : ( word & ~wordBit );
+        }
+
+        /** Words of the row containing index, the first holding the first pixel
+         * of the buffered row */
+        WordType * GetRowWords( const IndexType & index )
+        {
+            return m_Buffer->GetBufferPointer() + ComputeRow( index ) * m_WordsPerRow;
+        }
+
+        const WordType * GetRowWords( const IndexType & index ) const
+        {
+            return m_Buffer->GetBufferPointer() + ComputeRow( index ) * m_WordsPerRow;
+        }
+
+        SizeValueType GetWordsPerRow() const
+        {
+            return m_WordsPerRow;
+        }
+
+        PixelContainer * GetPixelContainer()
+        {
+            return m_Buffer.GetPointer();
+        }
+
+        const PixelContainer * GetPixelContainer() const
+        {
+            return m_Buffer.GetPointer();
+        }
+
+        void SetPixelContainer( PixelContainer * pContainer )
+        {
+            if( m_Buffer != pContainer )
+            {
+                m_Buffer = pContainer;
+                this->Modified();
+            }
+        }
+
+        /** Packs the buffered region of an image, non-zero pixels being set */
+        template< typename TImage >
+        void Pack( const TImage * pImage )
+        {
+            this->CopyInformation( pImage );
+            this->SetBufferedRegion( pImage->GetBufferedRegion() );
+            this->SetRequestedRegion( pImage->GetBufferedRegion() );
+            this->Allocate( true );
+
+            ImageScanlineConstIterator< TImage > it( pImage, pImage->GetBufferedRegion() );
+            while( !it.IsAtEnd() )
+            {
+                WordType * pWords( GetRowWords( it.GetIndex() ) );
+
+                for( SizeValueType x = 0; !it.IsAtEndOfLine(); ++x, ++it )
+                {
+                    if( it.Get() )
+                        pWords[x / BitsPerWord] |= static_cast< WordType >( 1 ) << ( x % BitsPerWord );
+                }
+
+                it.NextLine();
+            }
+        }
+
+        /** Unpacks to an image of the same geometry, set pixels becoming one */
+        template< typename TImage >
+        void Unpack( TImage * pImage ) const
+        {
+            pImage->CopyInformation( this );
+            pImage->SetRegions( this->GetBufferedRegion() );
+            pImage->Allocate();
+
+            ImageScanlineIterator< TImage > it( pImage, this->GetBufferedRegion() );
+            while( !it.IsAtEnd() )
+            {
+                const WordType * pWords( GetRowWords( it.GetIndex() ) );
+
+                for( SizeValueType x = 0; !it.IsAtEndOfLine(); ++x, ++it )
+                    it.Set( ( pWords[x / BitsPerWord] >> ( x % BitsPerWord ) ) & 1 ? NumericTraits< typename TImage::PixelType >::OneValue()
+                                                                                  : NumericTraits< typename TImage::PixelType >::ZeroValue() );
+
+                it.NextLine();
+            }
+        }
+
+        /** Number of trailing zero bits of a non-zero word */
+        static unsigned int CountTrailingZeros( WordType word )
+        {
+#if defined( __GNUC__ ) || defined( __clang__ )
+            return static_cast< unsigned int >( __builtin_ctzll( word ) );
+#elif defined( _MSC_VER ) && defined( _WIN64 )
+            unsigned long ulIndex;
+            _BitScanForward64( &ulIndex, word );
+            return static_cast< unsigned int >( ulIndex );
+#else
+            unsigned int uintZeros( 0 );
+            for( ; !( word & 1 ); word >>= 1 )
+                uintZeros++;
+            return uintZeros;
+#endif
+        }
+
+    protected:
+        PackedBitMaskImage()
+            : m_Buffer( PixelContainer::New() )
+            , m_WordsPerRow( 0 )
+        {
+        }
+
+        virtual ~PackedBitMaskImage() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "WordsPerRow: " << m_WordsPerRow << std::endl;
+            os << indent << "PixelContainer: " << std::endl;
+            m_Buffer->Print( os, indent.GetNextIndent() );
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(PackedBitMaskImage);
+
+        /** Row of the buffered region containing index, counted over the
+         * dimensions after the first */
+        SizeValueType ComputeRow( const IndexType & index ) const
+        {
+            const RegionType & regionBuffered( this->GetBufferedRegion() );
+
+            SizeValueType uintRow( 0 );
+            SizeValueType uintStride( 1 );
+            for( unsigned int d = 1; d < VImageDimension; d++ )
+            {
+                uintRow += ( index[d] - regionBuffered.GetIndex( d ) ) * uintStride;
+                uintStride *= regionBuffered.GetSize( d );
+            }
+
+            return uintRow;
+        }
+
+        PixelContainerPointer                               m_Buffer;
+        SizeValueType                                       m_WordsPerRow;
+    };
+
+    /** True for the packed mask types, for choosing code paths at compile time */
+    template< typename TImage >
+    struct IsPackedBitMaskImage : public std::false_type
+    {
+    };
+
+    template< unsigned int VImageDimension >
+    struct IsPackedBitMaskImage< PackedBitMaskImage< VImageDimension > > : public std::true_type
+    {
+    };
+
+/** \class MaskScanlineConstIterator
+ *
+ * \brief Reads one scanline of a mask image.
+ *
+ * FindNextSet() returns the position of the next set pixel, letting a filter
+ * pass over the clear pixels of a mask without testing each one. For an
+ * itk::Image mask the pixels are tested one by one; the specialization for
+ * PackedBitMaskImage tests a word at a time, skipping 64 clear pixels with a
+ * single comparison.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TMaskImage >
+    class MaskScanlineConstIterator
+    {
+    public:
+        typedef typename TMaskImage::IndexType              IndexType;
+        typedef typename TMaskImage::PixelType              PixelType;
+
+        /** Scanline of uintLength pixels starting at index, which must be buffered */
+        MaskScanlineConstIterator( const TMaskImage * pMask, const IndexType & index, SizeValueType uintLength )
+            : m_Pixels( pMask->GetBufferPointer() + pMask->ComputeOffset( index ) )
+            , m_Length( uintLength )
+        {
+        }
+
+        bool Get( SizeValueType x ) const
+        {
+            return m_Pixels[x] != NumericTraits< PixelType >::ZeroValue();
+        }
+
+        /** Position of the first set pixel at or after x, the scanline length if none */
+        SizeValueType FindNextSet( SizeValueType x ) const
+        {
+            while( x < m_Length && m_Pixels[x] == NumericTraits< PixelType >::ZeroValue() )
+                ++x;
+
+            return x;
+        }
+
+    private:
+        const PixelType *                                   m_Pixels;
+        SizeValueType                                       m_Length;
+    };
+
+    template< unsigned int VImageDimension >
+    class MaskScanlineConstIterator< PackedBitMaskImage< VImageDimension > >
+    {
+    public:
+        typedef PackedBitMaskImage< VImageDimension >       MaskImageType;
+        typedef typename MaskImageType::IndexType           IndexType;
+        typedef typename MaskImageType::WordType            WordType;
+
+        MaskScanlineConstIterator( const MaskImageType * pMask, const IndexType & index, SizeValueType uintLength )
+            : m_Words( pMask->GetRowWords( index ) )
+            , m_Offset( index[0] - pMask->GetBufferedRegion().GetIndex( 0 ) )
+            , m_Length( uintLength )
+        {
+        }
+
+        bool Get( SizeValueType x ) const
+        {
+            const SizeValueType uintBit( m_Offset + x );
+            return ( m_Words[uintBit / MaskImageType::BitsPerWord] >> ( uintBit % MaskImageType::BitsPerWord ) ) & 1;
+        }
+
+        SizeValueType FindNextSet( SizeValueType x ) const
+        {
+            const SizeValueType uintEnd( m_Offset + m_Length );
+            SizeValueType uintBit( m_Offset + x );
+
+            while( uintBit < uintEnd )
+            {
+                // Bits of the current word from uintBit on
+                const WordType word( m_Words[uintBit / MaskImageType::BitsPerWord] >> ( uintBit % MaskImageType::BitsPerWord ) );
+
+                if( word )
+                    return std::min( uintBit + MaskImageType::CountTrailingZeros( word ), uintEnd ) - m_Offset;
+
+                uintBit = ( uintBit / MaskImageType::BitsPerWord + 1 ) * MaskImageType::BitsPerWord;
+            }
+
+            return m_Length;
+        }
+
+    private:
+        const WordType *                                    m_Words;
+        SizeValueType                                       m_Offset;
+        SizeValueType                                       m_Length;
+    };
+}
+
+#endif // itkPackedBitMaskImage_h
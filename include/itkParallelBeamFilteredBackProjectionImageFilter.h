@@ -0,0 +1,170 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkParallelBeamFilteredBackProjectionImageFilter_h
+#define itkParallelBeamFilteredBackProjectionImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+
+#include "vnl/algo/vnl_fft_1d.h"
+
+#include <memory>
+#include <vector>
+
+namespace itk
+{
+/** \class ParallelBeamFilteredBackProjectionImageFilter
+ *
+ * \brief Filtered back-projection of a parallel beam projection stack.
+ *
+ * The input is a stack of preprocessed (NegLog) projections with the
+ * detector column along axis 0, the detector row along axis 1 and the
+ * projection number along axis 2, i.e. the projections produced by the other
+ * filters of this module joined in acquisition order. Each detector row
+ * forms the sinogram of one output slice: the output has an x/y grid of
+ * ReconstructionSize pixels of the detector column spacing, centred on the
+ * rotation axis, and one slice per detector row.
+ *
+ * Projections are filtered with a ramp or Shepp-Logan kernel by FFT, using
+ * plans that are cached between updates, and back-projected by linear
+ * interpolation. Threads work on blocks of SliceBlockSize slices, filtering
+ * the sinograms of their block and then back-projecting them tile by tile,
+ * so that the sample positions computed for a tile are reused for every
+ * slice of the block.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TInputImage, typename TOutputImage = TInputImage >
+    class ITK_TEMPLATE_EXPORT ParallelBeamFilteredBackProjectionImageFilter : public ImageToImageFilter< TInputImage, TOutputImage >
+    {
+    public:
+        typedef ParallelBeamFilteredBackProjectionImageFilter       Self;
+        typedef ImageToImageFilter< TInputImage, TOutputImage >     Superclass;
+        typedef SmartPointer< Self >                                Pointer;
+        typedef SmartPointer< const Self >                          ConstPointer;
+
+        itkStaticConstMacro( InputImageDimension, unsigned int, TInputImage::ImageDimension );
+        itkStaticConstMacro( OutputImageDimension, unsigned int, TOutputImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(ParallelBeamFilteredBackProjectionImageFilter, ImageToImageFilter)
+
+        /** Image related typedefs. */
+        typedef TInputImage                                         InputImageType;
+        typedef TOutputImage                                        OutputImageType;
+        typedef typename InputImageType::PixelType                  InputPixelType;
+        typedef typename OutputImageType::PixelType                 OutputPixelType;
+        typedef typename InputImageType::RegionType                 InputImageRegionType;
+        typedef typename OutputImageType::RegionType                OutputImageRegionType;
+
+        typedef vnl_fft_1d< double >                                FFTType;
+
+        /** Kernel applied to the projections before back-projection */
+        typedef enum
+        {
+            RampFilter = 0,
+            SheppLoganFilter
+        } ReconstructionFilterType;
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( InputIsThreeDimensional, ( Concept::SameDimension< InputImageDimension, 3 > ) );
+        itkConceptMacro( OutputIsThreeDimensional, ( Concept::SameDimension< OutputImageDimension, 3 > ) );
+    #endif
+
+        itkSetMacro( ReconstructionFilter, ReconstructionFilterType )
+        itkGetConstMacro( ReconstructionFilter, ReconstructionFilterType )
+
+        /** Angle of the first projection, in radians */
+        itkSetMacro( AngleStart, double )
+        itkGetConstMacro( AngleStart, double )
+
+        /** Angle between projections in radians, 0 spreads the projections over 180 degrees */
+        itkSetMacro( AngleStep, double )
+        itkGetConstMacro( AngleStep, double )
+
+        /** Position of the rotation axis relative to the detector centre, in detector columns */
+        itkSetMacro( CenterOfRotationOffset, double )
+        itkGetConstMacro( CenterOfRotationOffset, double )
+
+        /** Width and height of the reconstructed slices, 0 uses the detector width */
+        itkSetMacro( ReconstructionSize, unsigned int )
+        itkGetConstMacro( ReconstructionSize, unsigned int )
+
+        /** Number of slices a thread filters and back-projects together */
+        itkSetClampMacro( SliceBlockSize, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( SliceBlockSize, unsigned int )
+
+        /** Maximum number of progress events per update */
+        itkSetMacro( NumberOfProgressUpdates, unsigned int )
+        itkGetConstMacro( NumberOfProgressUpdates, unsigned int )
+
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+    protected:
+        ParallelBeamFilteredBackProjectionImageFilter();
+        virtual ~ParallelBeamFilteredBackProjectionImageFilter() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** The output is a volume of slices rather than a projection stack */
+        virtual void GenerateOutputInformation() ITK_OVERRIDE;
+
+        /** Every detector column and projection of the requested slices is needed */
+        virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+        virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
+        virtual void ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId ) ITK_OVERRIDE;
+        virtual void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+        /** Computes the frequency response of the reconstruction kernel for the current FFT length */
+        void ComputeFilterResponse();
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(ParallelBeamFilteredBackProjectionImageFilter);
+
+        ReconstructionFilterType                    m_ReconstructionFilter;
+        double                                      m_AngleStart;
+        double                                      m_AngleStep;
+        double                                      m_CenterOfRotationOffset;
+        unsigned int                                m_ReconstructionSize;
+        unsigned int                                m_SliceBlockSize;
+        unsigned int                                m_NumberOfProgressUpdates;
+
+        // Cached between updates, rebuilt when the detector width or kernel changes
+        unsigned int                                m_FFTLength;
+        ReconstructionFilterType                    m_FilterResponseType;
+        std::vector< double >                       m_FilterResponse;
+        std::vector< std::unique_ptr< FFTType > >   m_FFTPlans;
+
+        // Per update geometry shared by the threads
+        std::vector< double >                       m_Cosines;
+        std::vector< double >                       m_Sines;
+        double                                      m_Scale;
+
+        ChunkedProgressCounter                      m_ProgressCounter;
+        FilterInstrumentation::Pointer              m_Instrumentation;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkParallelBeamFilteredBackProjectionImageFilter.hxx"
+#endif
+
+#endif // itkParallelBeamFilteredBackProjectionImageFilter_h
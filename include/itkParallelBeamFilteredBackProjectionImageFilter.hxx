@@ -0,0 +1,384 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkParallelBeamFilteredBackProjectionImageFilter_hxx
+#define itkParallelBeamFilteredBackProjectionImageFilter_hxx
+
+#include "itkParallelBeamFilteredBackProjectionImageFilter.h"
+
+#include "itkMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+#define FBP_TILE_SIZE 32
+#define FBP_GUARD_WIDTH 2
+
+namespace itk
+{
+    template< typename TInputImage, typename TOutputImage >
+    ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::ParallelBeamFilteredBackProjectionImageFilter()
+        : m_ReconstructionFilter( RampFilter )
+        , m_AngleStart( 0.0 )
+        , m_AngleStep( 0.0 )
+        , m_CenterOfRotationOffset( 0.0 )
+        , m_ReconstructionSize( 0 )
+        , m_SliceBlockSize( 4 )
+        , m_NumberOfProgressUpdates( 100 )
+        , m_FFTLength( 0 )
+        , m_FilterResponseType( RampFilter )
+        , m_Scale( 1.0 )
+        , m_Instrumentation( FilterInstrumentation::New() )
+    {
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "ReconstructionFilter: " << ( m_ReconstructionFilter == RampFilter ? "Ramp" : "SheppLogan" ) << std::endl;
+        os << indent << "AngleStart: " << m_AngleStart << std::endl;
+        os << indent << "AngleStep: " << m_AngleStep << std::endl;
+        os << indent << "CenterOfRotationOffset: " << m_CenterOfRotationOffset << std::endl;
+        os << indent << "ReconstructionSize: " << m_ReconstructionSize << std::endl;
+        os << indent << "SliceBlockSize: " << m_SliceBlockSize << std::endl;
+        os << indent << "NumberOfProgressUpdates: " << m_NumberOfProgressUpdates << std::endl;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::GenerateOutputInformation()
+    {
+        Superclass::GenerateOutputInformation();
+
+        const InputImageType * pInput( this->GetInput() );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        if( !pInput || !pOutput )
+            return;
+
+        const InputImageRegionType & regionInput( pInput->GetLargestPossibleRegion() );
+        const SizeValueType uintSize( m_ReconstructionSize ? m_ReconstructionSize : regionInput.GetSize( 0 ) );
+
+        // Slices keep the index of their detector row
+        typename OutputImageType::IndexType indexOutput;
+        indexOutput[0] = 0;
+        indexOutput[1] = 0;
+        indexOutput[2] = regionInput.GetIndex( 1 );
+
+        typename OutputImageType::SizeType sizeOutput;
+        sizeOutput[0] = uintSize;
+        sizeOutput[1] = uintSize;
+        sizeOutput[2] = regionInput.GetSize( 1 );
+
+        typename OutputImageType::SpacingType spacingOutput;
+        spacingOutput[0] = pInput->GetSpacing()[0];
+        spacingOutput[1] = pInput->GetSpacing()[0];
+        spacingOutput[2] = pInput->GetSpacing()[1];
+
+        // The x/y grid is centred on the rotation axis
+        typename OutputImageType::PointType pointOrigin;
+        pointOrigin[0] = -0.5 * ( uintSize - 1.0 ) * spacingOutput[0];
+        pointOrigin[1] = -0.5 * ( uintSize - 1.0 ) * spacingOutput[1];
+        pointOrigin[2] = pInput->GetOrigin()[1];
+
+        typename OutputImageType::DirectionType direction;
+        direction.SetIdentity();
+
+        pOutput->SetLargestPossibleRegion( OutputImageRegionType( indexOutput, sizeOutput ) );
+        pOutput->SetSpacing( spacingOutput );
+        pOutput->SetOrigin( pointOrigin );
+        pOutput->SetDirection( direction );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::GenerateInputRequestedRegion()
+    {
+        Superclass::GenerateInputRequestedRegion();
+
+        InputImageType * pInput( const_cast< InputImageType * >( this->GetInput() ) );
+
+        if( !pInput )
+            return;
+
+        const OutputImageRegionType & regionOutput( this->GetOutput()->GetRequestedRegion() );
+
+        InputImageRegionType regionRequested( pInput->GetLargestPossibleRegion() );
+        regionRequested.SetIndex( 1, regionOutput.GetIndex( 2 ) );
+        regionRequested.SetSize( 1, regionOutput.GetSize( 2 ) );
+        regionRequested.Crop( pInput->GetLargestPossibleRegion() );
+
+        pInput->SetRequestedRegion( regionRequested );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::ComputeFilterResponse()
+    {
+        // Spatial kernels sampled at the detector pitch (Kak & Slaney), which
+        // unlike a sampled |f| response have no DC offset
+        vnl_vector< std::complex< double > > vecKernel( m_FFTLength, std::complex< double >( 0.0, 0.0 ) );
+
+        for( unsigned int n = 0; n <= m_FFTLength / 2; n++ )
+        {
+            double dblValue( 0.0 );
+
+            if( m_ReconstructionFilter == SheppLoganFilter )
+                dblValue = -2.0 / ( Math::pi * Math::pi * ( 4.0 * n * n - 1.0 ) );
+            else if( n == 0 )
+                dblValue = 0.25;
+            else if( n % 2 )
+                dblValue = -1.0 / ( Math::pi * Math::pi * n * n );
+
+            vecKernel[n] = dblValue;
+            if( n > 0 && n < m_FFTLength - n )
+                vecKernel[m_FFTLength - n] = dblValue;
+        }
+
+        m_FFTPlans[0]->fwd_transform( vecKernel );
+
+        m_FilterResponse.resize( m_FFTLength );
+        for( unsigned int k = 0; k < m_FFTLength; k++ )
+            m_FilterResponse[k] = vecKernel[k].real();
+
+        m_FilterResponseType = m_ReconstructionFilter;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::BeforeThreadedGenerateData()
+    {
+        Superclass::BeforeThreadedGenerateData();
+
+        const InputImageType * pInput( this->GetInput() );
+        const InputImageRegionType & regionInput( pInput->GetLargestPossibleRegion() );
+
+        const SizeValueType uintWidth( regionInput.GetSize( 0 ) );
+        const SizeValueType uintNumProjections( regionInput.GetSize( 2 ) );
+
+        if( uintWidth < 2 || uintNumProjections < 1 )
+            itkExceptionMacro( "At least one projection two detector columns wide is required" );
+
+        // Zero padding to at least twice the width avoids circular convolution
+        unsigned int uintFFTLength( 2 );
+        while( uintFFTLength < 2 * uintWidth )
+            uintFFTLength *= 2;
+
+        // Plans and the kernel response are kept while the geometry is unchanged
+        const ThreadIdType numberOfThreads( std::max( this->GetNumberOfThreads(), static_cast< ThreadIdType >( 1 ) ) );
+        if( uintFFTLength != m_FFTLength )
+            m_FFTPlans.clear();
+
+        m_FFTLength = uintFFTLength;
+        while( m_FFTPlans.size() < numberOfThreads )
+            m_FFTPlans.push_back( std::unique_ptr< FFTType >( new FFTType( m_FFTLength ) ) );
+
+        if( m_FilterResponse.size() != m_FFTLength || m_FilterResponseType != m_ReconstructionFilter )
+            ComputeFilterResponse();
+
+        const double dblAngleStep( m_AngleStep != 0.0 ? m_AngleStep : Math::pi / uintNumProjections );
+
+        m_Cosines.resize( uintNumProjections );
+        m_Sines.resize( uintNumProjections );
+        for( SizeValueType p = 0; p < uintNumProjections; p++ )
+        {
+            m_Cosines[p] = std::cos( m_AngleStart + p * dblAngleStep );
+            m_Sines[p] = std::sin( m_AngleStart + p * dblAngleStep );
+        }
+
+        // Angular weight, halved for scans covering 360 degrees, the inverse FFT
+        // normalisation and the detector pitch of the kernel
+        const double dblAngularWeight( std::min( std::fabs( dblAngleStep ), Math::pi / uintNumProjections ) );
+        m_Scale = dblAngularWeight / ( m_FFTLength * pInput->GetSpacing()[0] );
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        m_ProgressCounter.Initialize( this->GetOutput()->GetRequestedRegion().GetNumberOfPixels(), m_NumberOfProgressUpdates );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::AfterThreadedGenerateData()
+    {
+        Superclass::AfterThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ParallelBeamFilteredBackProjectionImageFilter< TInputImage, TOutputImage >::ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId )
+    {
+        const InputImageType * pInput( this->GetInput() );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        const InputImageRegionType & regionInput( pInput->GetLargestPossibleRegion() );
+        const SizeValueType uintWidth( regionInput.GetSize( 0 ) );
+        const SizeValueType uintNumProjections( regionInput.GetSize( 2 ) );
+
+        // Each filtered row has FBP_GUARD_WIDTH zeros either side, the last two
+        // read by the samples falling outside the detector
+        const SizeValueType uintRowLength( uintWidth + 2 * FBP_GUARD_WIDTH );
+        const SizeValueType uintOutsideIndex( uintRowLength - 2 );
+        const SizeValueType uintSize( pOutput->GetLargestPossibleRegion().GetSize( 0 ) );
+
+        const double dblCentre( 0.5 * ( uintSize - 1.0 ) );
+        const double dblRotationAxis( 0.5 * ( uintWidth - 1.0 ) + m_CenterOfRotationOffset + FBP_GUARD_WIDTH );
+
+        const InputPixelType * const pInputBuffer( pInput->GetBufferPointer() );
+        OutputPixelType * const pOutputBuffer( pOutput->GetBufferPointer() );
+
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter );
+
+        FFTType & fft( *m_FFTPlans[threadId] );
+        vnl_vector< std::complex< double > > vecLine( m_FFTLength );
+
+        // Filtered sinograms of the current slice block, one guarded row per projection
+        std::vector< float > vecSinograms( m_SliceBlockSize * uintNumProjections * uintRowLength, 0.0f );
+
+        // Back-projection tile accumulators and the sample positions of one tile row
+        std::vector< float > vecTile( m_SliceBlockSize * FBP_TILE_SIZE * FBP_TILE_SIZE );
+        std::vector< SizeValueType > vecSampleIndex( FBP_TILE_SIZE );
+        std::vector< float > vecSampleFraction( FBP_TILE_SIZE );
+
+        const IndexValueType intStartX( outputRegionForThread.GetIndex( 0 ) );
+        const IndexValueType intStartY( outputRegionForThread.GetIndex( 1 ) );
+        const IndexValueType intEndX( intStartX + static_cast< IndexValueType >( outputRegionForThread.GetSize( 0 ) ) );
+        const IndexValueType intEndY( intStartY + static_cast< IndexValueType >( outputRegionForThread.GetSize( 1 ) ) );
+        const IndexValueType intEndZ( outputRegionForThread.GetIndex( 2 ) + static_cast< IndexValueType >( outputRegionForThread.GetSize( 2 ) ) );
+
+        for( IndexValueType intBlockZ = outputRegionForThread.GetIndex( 2 ); intBlockZ < intEndZ; intBlockZ += m_SliceBlockSize )
+        {
+            const SizeValueType uintSlices( std::min( static_cast< SizeValueType >( m_SliceBlockSize ), static_cast< SizeValueType >( intEndZ - intBlockZ ) ) );
+
+            {
+                itkCSIROTomoScopedPhase( m_Instrumentation, threadId, Filtering );
+
+                typename InputImageType::IndexType indexRow( regionInput.GetIndex() );
+
+                for( SizeValueType s = 0; s < uintSlices; s++ )
+                {
+                    indexRow[1] = intBlockZ + static_cast< IndexValueType >( s );
+
+                    for( SizeValueType p = 0; p < uintNumProjections; p++ )
+                    {
+                        indexRow[2] = regionInput.GetIndex( 2 ) + static_cast< IndexValueType >( p );
+                        const InputPixelType * pRowInput( pInputBuffer + pInput->ComputeOffset( indexRow ) );
+
+                        for( SizeValueType u = 0; u < uintWidth; u++ )
+                            vecLine[u] = std::complex< double >( static_cast< double >( pRowInput[u] ), 0.0 );
+                        for( SizeValueType u = uintWidth; u < m_FFTLength; u++ )
+                            vecLine[u] = std::complex< double >( 0.0, 0.0 );
+
+                        fft.fwd_transform( vecLine );
+                        for( unsigned int k = 0; k < m_FFTLength; k++ )
+                            vecLine[k] *= m_FilterResponse[k];
+                        fft.bwd_transform( vecLine );
+
+                        float * pRow( &vecSinograms[( s * uintNumProjections + p ) * uintRowLength + FBP_GUARD_WIDTH] );
+                        for( SizeValueType u = 0; u < uintWidth; u++ )
+                            pRow[u] = static_cast< float >( vecLine[u].real() * m_Scale );
+                    }
+                }
+            }
+
+            {
+                itkCSIROTomoScopedPhase( m_Instrumentation, threadId, BackProjection );
+
+                for( IndexValueType intTileY = intStartY; intTileY < intEndY; intTileY += FBP_TILE_SIZE )
+                {
+                    const SizeValueType uintTileHeight( std::min( static_cast< SizeValueType >( FBP_TILE_SIZE ), static_cast< SizeValueType >( intEndY - intTileY ) ) );
+
+                    for( IndexValueType intTileX = intStartX; intTileX < intEndX; intTileX += FBP_TILE_SIZE )
+                    {
+                        const SizeValueType uintTileWidth( std::min( static_cast< SizeValueType >( FBP_TILE_SIZE ), static_cast< SizeValueType >( intEndX - intTileX ) ) );
+
+                        std::fill( vecTile.begin(), vecTile.end(), 0.0f );
+
+                        for( SizeValueType p = 0; p < uintNumProjections; p++ )
+                        {
+                            const double dblCos( m_Cosines[p] );
+                            const double dblSin( m_Sines[p] );
+
+                            for( SizeValueType y = 0; y < uintTileHeight; y++ )
+                            {
+                                // Sample positions along the tile row, shared by every slice of the block
+                                const double dblRowStart( ( intTileX - dblCentre ) * dblCos + ( intTileY + static_cast< double >( y ) - dblCentre ) * dblSin + dblRotationAxis );
+
+                                // Samples outside the detector read two guard zeros, so the
+                                // slices below are interpolated without bounds checks
+                                for( SizeValueType x = 0; x < uintTileWidth; x++ )
+                                {
+                                    const double dblSample( dblRowStart + x * dblCos );
+                                    if( dblSample >= 0.0 && dblSample < uintOutsideIndex )
+                                    {
+                                        const SizeValueType uintIndex( static_cast< SizeValueType >( dblSample ) );
+
+                                        vecSampleIndex[x] = uintIndex;
+                                        vecSampleFraction[x] = static_cast< float >( dblSample - uintIndex );
+                                    }
+                                    else
+                                    {
+                                        vecSampleIndex[x] = uintOutsideIndex;
+                                        vecSampleFraction[x] = 0.0f;
+                                    }
+                                }
+
+                                for( SizeValueType s = 0; s < uintSlices; s++ )
+                                {
+                                    const float * pRow( &vecSinograms[( s * uintNumProjections + p ) * uintRowLength] );
+                                    float * pAccumulator( &vecTile[( s * FBP_TILE_SIZE + y ) * FBP_TILE_SIZE] );
+
+                                    for( SizeValueType x = 0; x < uintTileWidth; x++ )
+                                    {
+                                        const float fltLower( pRow[vecSampleIndex[x]] );
+                                        pAccumulator[x] += fltLower + vecSampleFraction[x] * ( pRow[vecSampleIndex[x] + 1] - fltLower );
+                                    }
+                                }
+                            }
+                        }
+
+                        typename OutputImageType::IndexType indexOutput;
+                        indexOutput[0] = intTileX;
+
+                        for( SizeValueType s = 0; s < uintSlices; s++ )
+                        {
+                            indexOutput[2] = intBlockZ + static_cast< IndexValueType >( s );
+
+                            for( SizeValueType y = 0; y < uintTileHeight; y++ )
+                            {
+                                indexOutput[1] = intTileY + static_cast< IndexValueType >( y );
+
+                                OutputPixelType * pRowOutput( pOutputBuffer + pOutput->ComputeOffset( indexOutput ) );
+                                const float * pAccumulator( &vecTile[( s * FBP_TILE_SIZE + y ) * FBP_TILE_SIZE] );
+
+                                for( SizeValueType x = 0; x < uintTileWidth; x++ )
+                                    pRowOutput[x] = static_cast< OutputPixelType >( pAccumulator[x] );
+                            }
+                        }
+                    }
+                }
+            }
+
+            const SizeValueType uintBlockPixels( uintSlices * outputRegionForThread.GetSize( 0 ) * outputRegionForThread.GetSize( 1 ) );
+            itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, uintBlockPixels );
+
+            progress.CompletedPixels( uintBlockPixels );
+        }
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, BytesAllocated, ( vecSinograms.size() + vecTile.size() ) * sizeof( float ) );
+    }
+}
+
+#endif // itkParallelBeamFilteredBackProjectionImageFilter_hxx
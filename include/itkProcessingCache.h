@@ -0,0 +1,323 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkProcessingCache_h
+#define itkProcessingCache_h
+
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include "itksys/MD5.h"
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class ProcessingCache
+ *
+ * \brief On-disk store of processing results keyed by their inputs.
+ *
+ * A processing stage describes everything its result depends on in a Key:
+ * the content hashes of its input files or images, its filter parameters
+ * (radius, thresholds, VerticalShift, trim points, ...) and the digests of
+ * the keys of the stages it depends on. Load() returns the result stored
+ * under the MD5 digest of that description, or null if the stage has to be
+ * run, after which Store() saves its result for the next run. A stage whose
+ * inputs and parameters are unchanged is therefore skipped, and chaining the
+ * digests of upstream keys invalidates every result downstream of a change.
+ *
+ * Results are written as uncompressed MetaImage files named after the stage
+ * and digest in the cache directory. Entries are written to a temporary file
+ * and renamed, so an interrupted run never leaves a partial entry, and an
+ * entry that cannot be read is treated as a miss. With no directory set
+ * every Load() misses and Store() does nothing.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    class ProcessingCache : public Object
+    {
+    public:
+        typedef ProcessingCache                             Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(ProcessingCache, Object)
+
+        /** Description of the inputs and parameters of one stage */
+        class Key
+        {
+        public:
+            explicit Key( const std::string & strStage )
+                : m_Stage( strStage )
+            {
+            }
+
+            const std::string & GetStage() const
+            {
+                return m_Stage;
+            }
+
+            /** Adds a named parameter, floating point values at full precision */
+            template< typename TValue >
+            void Add( const std::string & strName, const TValue & value )
+            {
+                std::ostringstream ss;
+                ss << std::setprecision( 17 ) << value;
+                AddString( strName, ss.str() );
+            }
+
+            void AddString( const std::string & strName, const std::string & strValue )
+            {
+                m_Description += strName + "=" + strValue + "\n";
+            }
+
+            /** Adds the digest of an upstream key */
+            void AddKey( const std::string & strName, const Key & key )
+            {
+                AddString( strName, key.GetDigest() );
+            }
+
+            /** Adds the content hash of a file */
+            void AddFile( const std::string & strName, const std::string & strFileName )
+            {
+                AddString( strName, ProcessingCache::HashFile( strFileName ) );
+            }
+
+            /** Adds the content hash of an image, geometry included */
+            template< typename TImage >
+            void AddImage( const std::string & strName, const TImage * pImage )
+            {
+                AddString( strName, ProcessingCache::HashImage( pImage ) );
+            }
+
+            const std::string & GetDescription() const
+            {
+                return m_Description;
+            }
+
+            std::string GetDigest() const
+            {
+                return ProcessingCache::HashBytes( m_Stage + "\n" + m_Description );
+            }
+
+        private:
+            std::string             m_Stage;
+            std::string             m_Description;
+        };
+
+        /** Directory of the stored results, created on the first Store() */
+        itkSetStringMacro( Directory )
+        itkGetStringMacro( Directory )
+
+        /** Number of Load() calls that found a stored result, and that did not */
+        itkGetConstMacro( Hits, SizeValueType )
+        itkGetConstMacro( Misses, SizeValueType )
+
+        /** File of the result stored under a key. A stage with several results
+         * stores each with its own suffix. */
+        std::string GetFileName( const Key & key, const std::string & strSuffix = "" ) const
+        {
+            return m_Directory + "/" + key.GetStage() + "_" + key.GetDigest() + strSuffix + ".mha";
+        }
+
+        /** Returns the result stored under the key, or null if there is none */
+        template< typename TImage >
+        typename TImage::Pointer Load( const Key & key, const std::string & strSuffix = "" )
+        {
+            typename TImage::Pointer pImage;
+
+            const std::string strFileName( GetFileName( key, strSuffix ) );
+            if( !m_Directory.empty() && itksys::SystemTools::FileExists( strFileName.c_str(), true ) )
+            {
+                typedef ImageFileReader< TImage > ReaderType;
+                typename ReaderType::Pointer pReader( ReaderType::New() );
+                pReader->SetFileName( strFileName );
+
+                try
+                {
+                    pReader->Update();
+                    pImage = pReader->GetOutput();
+                    pImage->DisconnectPipeline();
+                }
+                catch( ExceptionObject & error )
+                {
+                    itkWarningMacro( "Ignoring unreadable cache entry " << strFileName << ": " << error.GetDescription() );
+                    pImage = ITK_NULLPTR;
+                }
+            }
+
+            if( pImage )
+                m_Hits++;
+            else
+                m_Misses++;
+
+            return pImage;
+        }
+
+        /** Stores the result of a stage under its key */
+        template< typename TImage >
+        void Store( const Key & key, const TImage * pImage, const std::string & strSuffix = "" )
+        {
+            if( m_Directory.empty() || !pImage )
+                return;
+
+            if( !itksys::SystemTools::MakeDirectory( m_Directory.c_str() ) )
+                itkExceptionMacro( "Unable to create cache directory " << m_Directory );
+
+            const std::string strFileName( GetFileName( key, strSuffix ) );
+            const std::string strTemporaryFileName( strFileName.substr( 0, strFileName.size() - 4 ) + ".tmp.mha" );
+
+            typedef ImageFileWriter< TImage > WriterType;
+            typename WriterType::Pointer pWriter( WriterType::New() );
+            pWriter->SetInput( pImage );
+            pWriter->SetFileName( strTemporaryFileName );
+            pWriter->Update();
+
+            if( !itksys::SystemTools::RenameFile( strTemporaryFileName.c_str(), strFileName.c_str() ) )
+                itkExceptionMacro( "Unable to rename " << strTemporaryFileName << " to " << strFileName );
+        }
+
+        /** MD5 digest of a string */
+        static std::string HashBytes( const std::string & str )
+        {
+            Hash hash;
+            hash.Append( str.data(), str.size() );
+            return hash.Finalize();
+        }
+
+        /** MD5 digest of the contents of a file, read in 1 MB blocks */
+        static std::string HashFile( const std::string & strFileName )
+        {
+            std::ifstream ifs( strFileName.c_str(), std::ios::binary );
+            if( !ifs )
+                itkGenericExceptionMacro( "Unable to open " << strFileName );
+
+            Hash hash;
+            std::vector< char > vecBlock( 1 << 20 );
+
+            while( ifs )
+            {
+                ifs.read( &vecBlock[0], vecBlock.size() );
+                hash.Append( &vecBlock[0], static_cast< size_t >( ifs.gcount() ) );
+            }
+
+            return hash.Finalize();
+        }
+
+        /** MD5 digest of the buffered pixels and the geometry of an image */
+        template< typename TImage >
+        static std::string HashImage( const TImage * pImage )
+        {
+            // The region by its values, as printing it includes its address
+            const typename TImage::RegionType & region( pImage->GetBufferedRegion() );
+
+            std::ostringstream ssGeometry;
+            ssGeometry << std::setprecision( 17 );
+            for( unsigned int d = 0; d < TImage::ImageDimension; d++ )
+                ssGeometry << region.GetIndex()[d] << ' ' << region.GetSize()[d] << ' ';
+            ssGeometry << pImage->GetSpacing() << pImage->GetOrigin() << pImage->GetDirection()
+                       << pImage->GetNumberOfComponentsPerPixel() << sizeof( typename TImage::InternalPixelType );
+
+            Hash hash;
+            const std::string strGeometry( ssGeometry.str() );
+            hash.Append( strGeometry.data(), strGeometry.size() );
+            hash.Append( pImage->GetBufferPointer(), pImage->GetPixelContainer()->Size() * sizeof( typename TImage::InternalPixelType ) );
+
+            return hash.Finalize();
+        }
+
+    protected:
+        ProcessingCache()
+            : m_Hits( 0 )
+            , m_Misses( 0 )
+        {
+        }
+
+        virtual ~ProcessingCache() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "Directory: " << m_Directory << std::endl;
+            os << indent << "Hits: " << m_Hits << std::endl;
+            os << indent << "Misses: " << m_Misses << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(ProcessingCache);
+
+        /** Incremental MD5, appending buffers larger than the int length
+         * taken by kwsys in pieces */
+        class Hash
+        {
+        public:
+            Hash()
+                : m_MD5( itksysMD5_New() )
+            {
+                itksysMD5_Initialize( m_MD5 );
+            }
+
+            ~Hash()
+            {
+                itksysMD5_Delete( m_MD5 );
+            }
+
+            void Append( const void * pData, size_t uintBytes )
+            {
+                const unsigned char * p( static_cast< const unsigned char * >( pData ) );
+
+                while( uintBytes > 0 )
+                {
+                    const size_t uintPiece( std::min( uintBytes, static_cast< size_t >( 1 ) << 30 ) );
+                    itksysMD5_Append( m_MD5, p, static_cast< int >( uintPiece ) );
+                    p += uintPiece;
+                    uintBytes -= uintPiece;
+                }
+            }
+
+            std::string Finalize()
+            {
+                char arrHex[32];
+                itksysMD5_FinalizeHex( m_MD5, arrHex );
+                return std::string( arrHex, 32 );
+            }
+
+        private:
+            Hash( const Hash & );
+            void operator=( const Hash & );
+
+            itksysMD5 *             m_MD5;
+        };
+
+        std::string                                         m_Directory;
+        SizeValueType                                       m_Hits;
+        SizeValueType                                       m_Misses;
+    };
+}
+
+#endif // itkProcessingCache_h
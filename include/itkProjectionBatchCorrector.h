@@ -0,0 +1,261 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkProjectionBatchCorrector_h
+#define itkProjectionBatchCorrector_h
+
+#include "itkComputePixelTraits.h"
+#include "itkDetectorDefectMap.h"
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkNegLogCheckedImageFilter.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace itk
+{
+/** \class ProjectionBatchCorrector
+ *
+ * \brief Corrects a contiguous stack of projections held in caller memory.
+ *
+ * The frames of a batch are N consecutive buffers of the region of Dark, as
+ * an (N, rows, columns) C-contiguous array lays them out. Each is corrected by
+ * ( raw - dark ) / ( flat - dark ), its defects repaired by the median of
+ * their stencils in DefectMap if set, and converted by the negative log of
+ * NegLogCheckedImageFilter, into the matching frame of the output buffer. No
+ * image is created and nothing is copied: the output may be the input itself
+ * when the raw pixels are of the pixel type.
+ *
+ * Update() computes the gain 1 / ( flat - dark ) once the dark, flat or map
+ * change. Process() then spreads the frames over NumberOfThreads threads,
+ * each correcting whole frames, so that a batch costs one call rather than a
+ * pipeline update per frame. PyProjectionBatch passes NumPy arrays to it with
+ * the GIL released.
+ *
+ * \sa PyProjectionBatch, DefectMapRepairImageFilter, NegLogCheckedImageFilter
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    class ProjectionBatchCorrector : public Object
+    {
+    public:
+        typedef ProjectionBatchCorrector                    Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(ProjectionBatchCorrector, Object)
+
+        typedef TImage                                      ImageType;
+        typedef typename ImageType::PixelType               PixelType;
+        typedef typename ImageType::RegionType              RegionType;
+        typedef typename ComputePixelTraits< PixelType >::ComputeType ComputeType;
+        typedef DetectorDefectMap< ImageType::ImageDimension > DefectMapType;
+
+        /** Average dark, of the region of every frame */
+        itkSetConstObjectMacro( Dark, ImageType )
+        itkGetConstObjectMacro( Dark, ImageType )
+
+        /** Average flat, not dark corrected */
+        itkSetConstObjectMacro( Flat, ImageType )
+        itkGetConstObjectMacro( Flat, ImageType )
+
+        /** Static defects, none repaired if not set */
+        itkSetConstObjectMacro( DefectMap, DefectMapType )
+        itkGetConstObjectMacro( DefectMap, DefectMapType )
+
+        /** Threads the frames of a batch are spread over */
+        itkSetClampMacro( NumberOfThreads, ThreadIdType, 1, ITK_MAX_THREADS )
+        itkGetConstMacro( NumberOfThreads, ThreadIdType )
+
+        /** Pixels of each frame */
+        SizeValueType GetNumberOfPixelsPerFrame() const
+        {
+            return m_Region.GetNumberOfPixels();
+        }
+
+        /** Whether the gain is current with the dark, flat and defect map */
+        bool IsUpdated() const
+        {
+            return !m_Gain.empty() && m_UpdateTime.GetMTime() >= GetMTime();
+        }
+
+        ModifiedTimeType GetMTime() const ITK_OVERRIDE
+        {
+            ModifiedTimeType uintMTime( Superclass::GetMTime() );
+            if( m_DefectMap )
+                uintMTime = std::max( uintMTime, m_DefectMap->GetMTime() );
+
+            return uintMTime;
+        }
+
+        /** Computes the gain of every pixel, those the beam does not reach
+         * corrected to 0 which the negative log maps to 0 */
+        void Update()
+        {
+            if( !m_Dark || !m_Flat )
+                itkExceptionMacro( "No dark or flat set" );
+
+            m_Region = m_Dark->GetBufferedRegion();
+            if( m_Flat->GetBufferedRegion() != m_Region )
+                itkExceptionMacro( "Flat buffered over " << m_Flat->GetBufferedRegion() << " rather than the region of the dark " << m_Region );
+
+            if( m_DefectMap && m_DefectMap->GetRegion() != m_Region )
+                itkExceptionMacro( "Defect map of region " << m_DefectMap->GetRegion() << " rather than the region of the dark " << m_Region );
+
+            const SizeValueType uintPixels( m_Region.GetNumberOfPixels() );
+            const PixelType * pDark( m_Dark->GetBufferPointer() );
+            const PixelType * pFlat( m_Flat->GetBufferPointer() );
+
+            m_Gain.resize( uintPixels );
+            for( SizeValueType i = 0; i < uintPixels; i++ )
+            {
+                const ComputeType dblRange( static_cast< ComputeType >( pFlat[i] ) - static_cast< ComputeType >( pDark[i] ) );
+                m_Gain[i] = dblRange > 0 ? static_cast< ComputeType >( 1 ) / dblRange : static_cast< ComputeType >( 0 );
+            }
+
+            m_UpdateTime.Modified();
+        }
+
+        /** Corrects uintFrames frames of raw counts into pOutput, which may be
+         * pRaw when TRawPixel is the pixel type */
+        template< typename TRawPixel >
+        void Process( const TRawPixel * pRaw, PixelType * pOutput, SizeValueType uintFrames )
+        {
+            if( !IsUpdated() )
+                itkExceptionMacro( "Update() before processing" );
+
+            const SizeValueType uintPixels( m_Region.GetNumberOfPixels() );
+
+            m_ThreadFrames = uintFrames;
+            m_ThreadBody = [this, pRaw, pOutput, uintPixels]( SizeValueType uintFrame, std::vector< ComputeType > & vecStencil )
+            {
+                ProcessFrame( pRaw + uintFrame * uintPixels, pOutput + uintFrame * uintPixels, vecStencil );
+            };
+
+            m_Threader->SetNumberOfThreads( static_cast< ThreadIdType >( std::min< SizeValueType >( m_NumberOfThreads, std::max< SizeValueType >( uintFrames, 1 ) ) ) );
+            m_Threader->SetSingleMethod( this->ProcessThreaderCallback, this );
+            m_Threader->SingleMethodExecute();
+
+            m_ThreadBody = ThreadBodyType();
+        }
+
+    protected:
+        ProjectionBatchCorrector()
+            : m_NumberOfThreads( MultiThreader::GetGlobalDefaultNumberOfThreads() )
+            , m_Threader( MultiThreader::New() )
+            , m_ThreadFrames( 0 )
+        {
+        }
+
+        virtual ~ProjectionBatchCorrector() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+            os << indent << "Region: " << m_Region << std::endl;
+            os << indent << "NumberOfDefects: " << ( m_DefectMap ? m_DefectMap->GetNumberOfDefects() : 0 ) << std::endl;
+        }
+
+        /** Corrects whole frames, a contiguous share of the batch per thread */
+        void ThreadedProcess( ThreadIdType threadId, ThreadIdType numberOfThreads )
+        {
+            const SizeValueType uintFirst( m_ThreadFrames * threadId / numberOfThreads );
+            const SizeValueType uintEnd( m_ThreadFrames * ( threadId + 1 ) / numberOfThreads );
+
+            std::vector< ComputeType > vecStencil;
+            for( SizeValueType f = uintFirst; f < uintEnd; f++ )
+                m_ThreadBody( f, vecStencil );
+        }
+
+        static ITK_THREAD_RETURN_TYPE ProcessThreaderCallback( void * pArg )
+        {
+            MultiThreader::ThreadInfoStruct * pInfo( static_cast< MultiThreader::ThreadInfoStruct * >( pArg ) );
+            Self * pSelf( static_cast< Self * >( pInfo->UserData ) );
+
+            pSelf->ThreadedProcess( pInfo->ThreadID, pInfo->NumberOfThreads );
+
+            return ITK_THREAD_RETURN_VALUE;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(ProjectionBatchCorrector);
+
+        typedef std::function< void( SizeValueType, std::vector< ComputeType > & ) > ThreadBodyType;
+
+        template< typename TRawPixel >
+        void ProcessFrame( const TRawPixel * pRaw, PixelType * pOutput, std::vector< ComputeType > & vecStencil ) const
+        {
+            const SizeValueType uintPixels( m_Region.GetNumberOfPixels() );
+            const PixelType * pDark( m_Dark->GetBufferPointer() );
+            const ComputeType * pGain( &m_Gain[0] );
+
+            for( SizeValueType i = 0; i < uintPixels; i++ )
+                pOutput[i] = static_cast< PixelType >( ( static_cast< ComputeType >( pRaw[i] ) - static_cast< ComputeType >( pDark[i] ) ) * pGain[i] );
+
+            // No stencil reads a defect, so the frame is repaired in place
+            if( m_DefectMap )
+            {
+                const typename DefectMapType::OffsetsType & vecDefects( m_DefectMap->GetDefectOffsets() );
+                for( SizeValueType i = 0; i < vecDefects.size(); i++ )
+                {
+                    const SizeValueType uintStencilSize( m_DefectMap->GetStencilSize( i ) );
+                    if( uintStencilSize == 0 )
+                        continue;
+
+                    const PixelType * pCenter( pOutput + vecDefects[i] );
+                    const OffsetValueType * pStencil( m_DefectMap->GetStencil( i ) );
+
+                    vecStencil.resize( uintStencilSize );
+                    for( SizeValueType k = 0; k < uintStencilSize; ++k )
+                        vecStencil[k] = pCenter[pStencil[k]];
+
+                    const typename std::vector< ComputeType >::iterator medianIterator( vecStencil.begin() + uintStencilSize / 2 );
+                    std::nth_element( vecStencil.begin(), medianIterator, vecStencil.end() );
+
+                    pOutput[vecDefects[i]] = static_cast< PixelType >( static_cast< double >( *medianIterator ) );
+                }
+            }
+
+            const Functor::NegLogChecked< PixelType, PixelType > functorNegLog;
+            for( SizeValueType i = 0; i < uintPixels; i++ )
+                pOutput[i] = functorNegLog( pOutput[i] );
+        }
+
+        typename ImageType::ConstPointer                    m_Dark;
+        typename ImageType::ConstPointer                    m_Flat;
+        typename DefectMapType::ConstPointer                m_DefectMap;
+        ThreadIdType                                        m_NumberOfThreads;
+
+        RegionType                                          m_Region;
+        std::vector< ComputeType >                          m_Gain;
+        TimeStamp                                           m_UpdateTime;
+
+        MultiThreader::Pointer                              m_Threader;
+        SizeValueType                                       m_ThreadFrames;
+        ThreadBodyType                                      m_ThreadBody;
+    };
+}
+
+#endif // itkProjectionBatchCorrector_h
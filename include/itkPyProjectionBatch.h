@@ -0,0 +1,190 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkPyProjectionBatch_h
+#define itkPyProjectionBatch_h
+
+#include "itkProjectionBatchCorrector.h"
+
+// The python header defines _POSIX_C_SOURCE without a preceding #undef
+#undef _POSIX_C_SOURCE
+#undef _XOPEN_SOURCE
+#include <Python.h>
+
+#include <string>
+
+namespace itk
+{
+/** \class PyProjectionBatch
+ *
+ * \brief Corrects a NumPy stack of projections with the GIL released.
+ *
+ * Correct() takes a C-contiguous (N, rows, columns) array of raw counts, of
+ * unsigned 8, 16 or 32 bit or float pixels, and a writable C-contiguous array
+ * of the same shape of the pixel type of the corrector, which may be the input
+ * array itself. Both are accessed through the buffer protocol without a copy,
+ * and the whole stack is corrected by ProjectionBatchCorrector::Process()
+ * between Py_BEGIN_ALLOW_THREADS and Py_END_ALLOW_THREADS, so that other
+ * Python threads, e.g. one loading the next stack, run meanwhile.
+ *
+ * From Python:
+ *   corrector = itk.ProjectionBatchCorrector[itk.Image[itk.F, 2]].New()
+ *   corrector.SetDark( dark ); corrector.SetFlat( flat )
+ *   itk.PyProjectionBatch[itk.Image[itk.F, 2]].Correct( corrector, counts, out )
+ *
+ * \sa ProjectionBatchCorrector
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    class PyProjectionBatch
+    {
+    public:
+        typedef PyProjectionBatch                           Self;
+
+        typedef TImage                                      ImageType;
+        typedef typename ImageType::PixelType               PixelType;
+        typedef ProjectionBatchCorrector< ImageType >       CorrectorType;
+
+        /** Corrects the projections into the output, returning the number of frames */
+        static SizeValueType Correct( CorrectorType * pCorrector, PyObject * pProjections, PyObject * pOutput )
+        {
+            if( !pCorrector )
+                itkGenericExceptionMacro( "No corrector" );
+
+            // The gain is computed with the GIL held, the corrector being
+            // shared with the interpreter
+            if( !pCorrector->IsUpdated() )
+                pCorrector->Update();
+
+            const typename ImageType::SizeType & size( pCorrector->GetDark()->GetBufferedRegion().GetSize() );
+
+            ScopedBuffer bufferInput( pProjections, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT );
+            ScopedBuffer bufferOutput( pOutput, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE );
+
+            const Py_buffer & input( bufferInput.Get() );
+            const Py_buffer & output( bufferOutput.Get() );
+
+            if( input.ndim != 3 || input.shape[1] != static_cast< Py_ssize_t >( size[1] ) || input.shape[2] != static_cast< Py_ssize_t >( size[0] ) )
+                itkGenericExceptionMacro( "Projections are not an ( N, " << size[1] << ", " << size[0] << " ) array" );
+
+            if( output.ndim != 3 || output.shape[0] != input.shape[0] || output.shape[1] != input.shape[1] || output.shape[2] != input.shape[2] )
+                itkGenericExceptionMacro( "Output is not of the shape of the projections" );
+
+            if( !IsFormat< PixelType >( output ) )
+                itkGenericExceptionMacro( "Output is not of the pixel type of the corrector, format " << output.format );
+
+            const SizeValueType uintFrames( static_cast< SizeValueType >( input.shape[0] ) );
+            PixelType * pOut( static_cast< PixelType * >( output.buf ) );
+
+            if( IsFormat< unsigned short >( input ) )
+                return Process( pCorrector, static_cast< const unsigned short * >( input.buf ), pOut, uintFrames );
+            else if( IsFormat< float >( input ) )
+                return Process( pCorrector, static_cast< const float * >( input.buf ), pOut, uintFrames );
+            else if( IsFormat< unsigned char >( input ) )
+                return Process( pCorrector, static_cast< const unsigned char * >( input.buf ), pOut, uintFrames );
+            else if( IsFormat< unsigned int >( input ) )
+                return Process( pCorrector, static_cast< const unsigned int * >( input.buf ), pOut, uintFrames );
+            else if( IsFormat< double >( input ) )
+                return Process( pCorrector, static_cast< const double * >( input.buf ), pOut, uintFrames );
+
+            itkGenericExceptionMacro( "Unsupported projection format " << input.format );
+        }
+
+    private:
+        PyProjectionBatch(const Self &);
+        void operator=(const Self &);
+
+        /** Buffer of a Python object, released when it leaves scope */
+        class ScopedBuffer
+        {
+        public:
+            ScopedBuffer( PyObject * pObject, int intFlags )
+                : m_Acquired( false )
+            {
+                if( !pObject || PyObject_GetBuffer( pObject, &m_Buffer, intFlags ) != 0 )
+                {
+                    PyErr_Clear();
+                    itkGenericExceptionMacro( "Object is not a C-contiguous" << ( intFlags & PyBUF_WRITABLE ? " writable" : "" ) << " buffer" );
+                }
+
+                m_Acquired = true;
+            }
+
+            ~ScopedBuffer()
+            {
+                if( m_Acquired )
+                    PyBuffer_Release( &m_Buffer );
+            }
+
+            const Py_buffer & Get() const { return m_Buffer; }
+
+        private:
+            ScopedBuffer(const ScopedBuffer &);
+            void operator=(const ScopedBuffer &);
+
+            Py_buffer   m_Buffer;
+            bool        m_Acquired;
+        };
+
+        template< typename TPixel >
+        static bool IsFormat( const Py_buffer & buffer )
+        {
+            if( buffer.itemsize != static_cast< Py_ssize_t >( sizeof( TPixel ) ) || !buffer.format )
+                return false;
+
+            // Native byte order only, '<' on the little-endian hosts NumPy reports it for
+            std::string strFormat( buffer.format );
+            if( !strFormat.empty() && ( strFormat[0] == '@' || strFormat[0] == '=' || strFormat[0] == '<' ) )
+                strFormat.erase( 0, 1 );
+
+            if( strFormat.size() != 1 )
+                return false;
+
+            const char chrFormat( strFormat[0] );
+            if( NumericTraits< TPixel >::is_integer )
+                return NumericTraits< TPixel >::is_signed ? ( chrFormat == 'b' || chrFormat == 'h' || chrFormat == 'i' || chrFormat == 'l' || chrFormat == 'q' )
+                                                          : ( chrFormat == 'B' || chrFormat == 'H' || chrFormat == 'I' || chrFormat == 'L' || chrFormat == 'Q' );
+
+            return chrFormat == 'e' || chrFormat == 'f' || chrFormat == 'd';
+        }
+
+        template< typename TRawPixel >
+        static SizeValueType Process( CorrectorType * pCorrector, const TRawPixel * pRaw, PixelType * pOutput, SizeValueType uintFrames )
+        {
+            // Exceptions may not cross the release of the GIL
+            std::string strError;
+
+            Py_BEGIN_ALLOW_THREADS
+            try
+            {
+                pCorrector->Process( pRaw, pOutput, uintFrames );
+            }
+            catch( ExceptionObject & error )
+            {
+                strError = error.GetDescription();
+            }
+            Py_END_ALLOW_THREADS
+
+            if( !strError.empty() )
+                itkGenericExceptionMacro( << strError );
+
+            return uintFrames;
+        }
+    };
+}
+
+#endif // itkPyProjectionBatch_h
@@ -0,0 +1,298 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkShardedProcessRunner_h
+#define itkShardedProcessRunner_h
+
+#include "itkNumericTraits.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define ITKCSIROTomo_HAS_FORK
+#endif
+
+namespace itk
+{
+/** \class ShardedProcessRunner
+ *
+ * \brief Runs a function over shards of a range of items in local processes.
+ *
+ * Run() splits NumberOfItems items, e.g. the projections of a scan, into
+ * NumberOfShards contiguous shards and calls the shard function for each in
+ * a worker process forked from the calling one, so that parts of a workflow
+ * that a single process runs serially proceed in parallel, one process per
+ * core or NUMA domain. Each worker reports back through a pipe whether its
+ * shard completed and how long it took, collected in GetShardResults().
+ *
+ * Workers inherit the memory of the calling process copy on write, so images
+ * large enough to matter should be placed in a SharedMemoryImage and mapped
+ * before Run(), as must any output the workers produce; the workers inherit
+ * the mappings, and the segments can be removed before they are forked. Workers
+ * exit without destroying the objects of the calling process. Run() should be
+ * called while no other thread of the process holds a lock, as only the
+ * calling thread is forked.
+ *
+ * With a single shard, or where processes cannot be forked, the shards are
+ * run one after the other in the calling process.
+ *
+ * \sa SharedMemoryImage
+ * \ingroup ITKCSIROTomo
+ */
+    class ShardedProcessRunner : public Object
+    {
+    public:
+        typedef ShardedProcessRunner                        Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(ShardedProcessRunner, Object)
+
+        /** Called with the first item, the number of items and the shard */
+        typedef std::function< void( SizeValueType, SizeValueType, unsigned int ) > ShardFunctionType;
+
+        /** Completion and timing of a shard */
+        struct ShardResult
+        {
+            ShardResult()
+                : First( 0 )
+                , Count( 0 )
+                , Completed( false )
+                , Seconds( 0.0 )
+            {
+            }
+
+            SizeValueType       First;
+            SizeValueType       Count;
+            bool                Completed;
+            double              Seconds;
+            std::string         Error;
+        };
+
+        typedef std::vector< ShardResult >                  ShardResultsType;
+
+        /** Worker processes, 1 to run in the calling process */
+        itkSetClampMacro( NumberOfShards, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( NumberOfShards, unsigned int )
+
+        itkSetMacro( NumberOfItems, SizeValueType )
+        itkGetConstMacro( NumberOfItems, SizeValueType )
+
+        /** Shards of the last Run(), in item order */
+        const ShardResultsType & GetShardResults() const { return m_ShardResults; }
+
+        /** Seconds of the last Run(), from the first fork to the last exit */
+        itkGetConstMacro( Seconds, double )
+
+        /** Runs the shards and waits for all, throwing if any did not complete */
+        void Run( const ShardFunctionType & function )
+        {
+            const unsigned int uintNumShards( static_cast< unsigned int >( std::min< SizeValueType >( m_NumberOfShards, std::max< SizeValueType >( m_NumberOfItems, 1 ) ) ) );
+
+            m_ShardResults.assign( uintNumShards, ShardResult() );
+            for( unsigned int i = 0; i < uintNumShards; i++ )
+            {
+                // The first shards take one more item each when they do not divide evenly
+                m_ShardResults[i].Count = m_NumberOfItems / uintNumShards + ( i < m_NumberOfItems % uintNumShards ? 1 : 0 );
+                m_ShardResults[i].First = i > 0 ? m_ShardResults[i - 1].First + m_ShardResults[i - 1].Count : 0;
+            }
+
+            const std::chrono::steady_clock::time_point timeStart( std::chrono::steady_clock::now() );
+
+#ifdef ITKCSIROTomo_HAS_FORK
+            if( uintNumShards > 1 )
+                RunProcesses( function );
+            else
+#endif
+            {
+                for( unsigned int i = 0; i < uintNumShards; i++ )
+                    RunShard( function, i, m_ShardResults[i] );
+            }
+
+            m_Seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - timeStart ).count();
+
+            std::ostringstream ossErrors;
+            for( unsigned int i = 0; i < uintNumShards; i++ )
+            {
+                if( !m_ShardResults[i].Completed )
+                    ossErrors << " shard " << i << ": " << m_ShardResults[i].Error;
+            }
+
+            if( !ossErrors.str().empty() )
+                itkExceptionMacro( "Incomplete shards," << ossErrors.str() );
+        }
+
+    protected:
+        ShardedProcessRunner()
+            : m_NumberOfShards( 1 )
+            , m_NumberOfItems( 0 )
+            , m_Seconds( 0.0 )
+        {
+        }
+
+        virtual ~ShardedProcessRunner() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "NumberOfShards: " << m_NumberOfShards << std::endl;
+            os << indent << "NumberOfItems: " << m_NumberOfItems << std::endl;
+            os << indent << "Seconds: " << m_Seconds << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(ShardedProcessRunner);
+
+        /** Runs a shard in this process, recording its completion */
+        static void RunShard( const ShardFunctionType & function, unsigned int uintShard, ShardResult & result )
+        {
+            const std::chrono::steady_clock::time_point timeStart( std::chrono::steady_clock::now() );
+
+            try
+            {
+                function( result.First, result.Count, uintShard );
+                result.Completed = true;
+            }
+            catch( ExceptionObject & error )
+            {
+                result.Error = error.GetDescription();
+            }
+            catch( std::exception & error )
+            {
+                result.Error = error.what();
+            }
+
+            result.Seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - timeStart ).count();
+        }
+
+#ifdef ITKCSIROTomo_HAS_FORK
+        /** Forks a worker per shard, each writing its result to a pipe as
+         * "<completed> <seconds>" followed by any error */
+        void RunProcesses( const ShardFunctionType & function )
+        {
+            std::vector< pid_t > vecProcesses( m_ShardResults.size(), -1 );
+            std::vector< int > vecPipes( m_ShardResults.size(), -1 );
+
+            // Buffered output would otherwise be written again by every worker
+            std::cout.flush();
+            std::cerr.flush();
+            std::fflush( ITK_NULLPTR );
+
+            for( size_t i = 0; i < m_ShardResults.size(); i++ )
+            {
+                int arrPipe[2];
+                if( pipe( arrPipe ) != 0 )
+                {
+                    m_ShardResults[i].Error = "unable to create a pipe";
+                    continue;
+                }
+
+                const pid_t pid( fork() );
+                if( pid == 0 )
+                {
+                    close( arrPipe[0] );
+                    for( size_t j = 0; j < i; j++ )
+                    {
+                        if( vecPipes[j] >= 0 )
+                            close( vecPipes[j] );
+                    }
+
+                    ShardResult result( m_ShardResults[i] );
+                    RunShard( function, static_cast< unsigned int >( i ), result );
+
+                    std::ostringstream oss;
+                    oss.precision( 17 );
+                    oss << ( result.Completed ? 1 : 0 ) << " " << result.Seconds << " " << result.Error;
+                    const std::string strReport( oss.str() );
+
+                    std::cout.flush();
+                    std::cerr.flush();
+
+                    const ssize_t intWritten( write( arrPipe[1], strReport.data(), strReport.size() ) );
+                    close( arrPipe[1] );
+                    _exit( intWritten == static_cast< ssize_t >( strReport.size() ) && result.Completed ? 0 : 1 );
+                }
+
+                close( arrPipe[1] );
+                if( pid < 0 )
+                {
+                    close( arrPipe[0] );
+                    m_ShardResults[i].Error = "unable to fork a worker";
+                    continue;
+                }
+
+                vecProcesses[i] = pid;
+                vecPipes[i] = arrPipe[0];
+            }
+
+            for( size_t i = 0; i < m_ShardResults.size(); i++ )
+            {
+                if( vecProcesses[i] < 0 )
+                    continue;
+
+                std::string strReport;
+                char arrBuffer[4096];
+                ssize_t intRead;
+                while( ( intRead = read( vecPipes[i], arrBuffer, sizeof( arrBuffer ) ) ) > 0 )
+                    strReport.append( arrBuffer, static_cast< size_t >( intRead ) );
+                close( vecPipes[i] );
+
+                int intStatus( 0 );
+                waitpid( vecProcesses[i], &intStatus, 0 );
+
+                std::istringstream iss( strReport );
+                int intCompleted( 0 );
+                if( !( iss >> intCompleted >> m_ShardResults[i].Seconds ) )
+                {
+                    std::ostringstream oss;
+                    oss << "worker " << vecProcesses[i] << " exited without a report";
+                    if( WIFSIGNALED( intStatus ) )
+                        oss << " on signal " << WTERMSIG( intStatus );
+                    m_ShardResults[i].Error = oss.str();
+                    continue;
+                }
+
+                std::getline( iss >> std::ws, m_ShardResults[i].Error, '\0' );
+                m_ShardResults[i].Completed = intCompleted == 1 && WIFEXITED( intStatus ) && WEXITSTATUS( intStatus ) == 0;
+            }
+        }
+#endif
+
+        unsigned int                                        m_NumberOfShards;
+        SizeValueType                                       m_NumberOfItems;
+        ShardResultsType                                    m_ShardResults;
+        double                                              m_Seconds;
+    };
+}
+
+#endif // itkShardedProcessRunner_h
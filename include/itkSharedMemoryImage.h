@@ -0,0 +1,367 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkSharedMemoryImage_h
+#define itkSharedMemoryImage_h
+
+#include "itkImportImageContainer.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkVectorImage.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ITKCSIROTomo_HAS_SHARED_MEMORY
+#endif
+
+namespace itk
+{
+/** \class SharedMemoryImageContainer
+ *
+ * \brief Pixel container of an image mapped from a SharedMemoryImage.
+ *
+ * Unmaps the segment when the image releases its pixels.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TElementIdentifier, typename TElement >
+    class ITK_TEMPLATE_EXPORT SharedMemoryImageContainer : public ImportImageContainer< TElementIdentifier, TElement >
+    {
+    public:
+        typedef SharedMemoryImageContainer                              Self;
+        typedef ImportImageContainer< TElementIdentifier, TElement >    Superclass;
+        typedef SmartPointer< Self >                                    Pointer;
+        typedef SmartPointer< const Self >                              ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(SharedMemoryImageContainer, ImportImageContainer)
+
+        /** Mapping holding the elements, unmapped on destruction */
+        void SetMapping( void * pMapping, SizeValueType uintMappedBytes )
+        {
+            m_Mapping = pMapping;
+            m_MappedBytes = uintMappedBytes;
+        }
+
+    protected:
+        SharedMemoryImageContainer()
+            : m_Mapping( ITK_NULLPTR )
+            , m_MappedBytes( 0 )
+        {
+        }
+
+        virtual ~SharedMemoryImageContainer() ITK_OVERRIDE
+        {
+#ifdef ITKCSIROTomo_HAS_SHARED_MEMORY
+            if( m_Mapping )
+                munmap( m_Mapping, m_MappedBytes );
+#endif
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(SharedMemoryImageContainer);
+
+        void *                                              m_Mapping;
+        SizeValueType                                       m_MappedBytes;
+    };
+
+/** \class SharedMemoryImageTraits
+ *
+ * \brief Number of buffer elements per pixel of an image held in a
+ * SharedMemoryImage.
+ *
+ * An Image holds one element per pixel, a VectorImage as many as it has
+ * components, which are set on the image mapped from a segment.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    struct SharedMemoryImageTraits
+    {
+        static const bool VariableComponents = false;
+
+        static unsigned int GetNumberOfComponents( const TImage * )
+        {
+            return 1;
+        }
+
+        static void SetNumberOfComponents( TImage *, unsigned int )
+        {
+        }
+    };
+
+    template< typename TPixel, unsigned int VImageDimension >
+    struct SharedMemoryImageTraits< VectorImage< TPixel, VImageDimension > >
+    {
+        typedef VectorImage< TPixel, VImageDimension >      ImageType;
+
+        static const bool VariableComponents = true;
+
+        static unsigned int GetNumberOfComponents( const ImageType * pImage )
+        {
+            return pImage->GetNumberOfComponentsPerPixel();
+        }
+
+        static void SetNumberOfComponents( ImageType * pImage, unsigned int uintComponents )
+        {
+            pImage->SetNumberOfComponentsPerPixel( uintComponents );
+        }
+    };
+
+/** \class SharedMemoryImage
+ *
+ * \brief Image held in a named POSIX shared memory segment.
+ *
+ * Create() places the geometry and pixels of an image in a new segment named
+ * Name, and Map() maps the segment, in this or any other local process, as an
+ * image whose pixels are the segment itself, so that processes working on one
+ * acquisition, e.g. the shards of a ShardedProcessRunner, share a single copy
+ * of its flat, dark and weight images. Images are mapped read only unless
+ * writable is asked for, as for an output shared by the processes.
+ *
+ * The segment is removed when the SharedMemoryImage that created it is
+ * destroyed, or by Remove(), while images already mapped stay valid until
+ * released. Mappings are inherited by processes forked afterwards, so a
+ * segment shared only with forked workers is best mapped before they are
+ * forked and removed at once: a segment left named while its processes
+ * run outlives them in /dev/shm should they die. Only images of trivially
+ * copyable pixels, or VectorImages of trivially copyable components, can be
+ * shared.
+ *
+ * Unavailable where POSIX shared memory is not, where Create() and Map()
+ * throw.
+ *
+ * \sa ShardedProcessRunner
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TImage >
+    class ITK_TEMPLATE_EXPORT SharedMemoryImage : public Object
+    {
+    public:
+        typedef SharedMemoryImage                           Self;
+        typedef Object                                      Superclass;
+        typedef SmartPointer< Self >                        Pointer;
+        typedef SmartPointer< const Self >                  ConstPointer;
+
+        itkNewMacro(Self)
+        itkTypeMacro(SharedMemoryImage, Object)
+
+        /** Image related typedefs. */
+        typedef TImage                                      ImageType;
+        typedef typename ImageType::Pointer                 ImagePointer;
+        typedef typename ImageType::PixelType               PixelType;
+        typedef typename ImageType::InternalPixelType       InternalPixelType;
+        typedef typename ImageType::RegionType              RegionType;
+
+        typedef SharedMemoryImageTraits< ImageType >        TraitsType;
+
+        typedef SharedMemoryImageContainer< SizeValueType, InternalPixelType > ContainerType;
+
+        itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+        /** Name of the segment, a slash followed by up to 250 other characters */
+        itkSetStringMacro( Name )
+        itkGetStringMacro( Name )
+
+        /** Whether this object created the segment and removes it */
+        itkGetConstMacro( Owner, bool )
+
+        /** Creates the segment holding the buffered region and pixels of
+         * pImage, or a zeroed largest possible region if it has no buffer */
+        void Create( const ImageType * pImage )
+        {
+#ifdef ITKCSIROTomo_HAS_SHARED_MEMORY
+            this->Remove();
+
+            const bool blnCopyPixels( pImage->GetBufferPointer() != ITK_NULLPTR );
+            const RegionType region( blnCopyPixels ? pImage->GetBufferedRegion() : pImage->GetLargestPossibleRegion() );
+
+            Header header;
+            std::memset( &header, 0, sizeof( header ) );
+            std::memcpy( header.Magic, "CSTKSHM", 8 );
+            header.Dimension = ImageDimension;
+            header.ElementSize = sizeof( InternalPixelType );
+            header.Components = TraitsType::GetNumberOfComponents( pImage );
+            for( unsigned int j = 0; j < ImageDimension; j++ )
+            {
+                header.Index[j] = region.GetIndex( j );
+                header.Size[j] = region.GetSize( j );
+                header.Spacing[j] = pImage->GetSpacing()[j];
+                header.Origin[j] = pImage->GetOrigin()[j];
+                for( unsigned int k = 0; k < ImageDimension; k++ )
+                    header.Direction[j * ImageDimension + k] = pImage->GetDirection()[j][k];
+            }
+
+            const SizeValueType uintPixelBytes( region.GetNumberOfPixels() * header.Components * sizeof( InternalPixelType ) );
+            const SizeValueType uintBytes( PixelOffset + uintPixelBytes );
+
+            const int intFile( shm_open( m_Name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR ) );
+            if( intFile < 0 )
+                itkExceptionMacro( "Unable to create the shared memory segment " << m_Name << ": " << std::strerror( errno ) );
+
+            void * pMapping( MAP_FAILED );
+            if( ftruncate( intFile, static_cast< off_t >( uintBytes ) ) == 0 )
+                pMapping = mmap( ITK_NULLPTR, uintBytes, PROT_READ | PROT_WRITE, MAP_SHARED, intFile, 0 );
+            close( intFile );
+
+            if( pMapping == MAP_FAILED )
+            {
+                shm_unlink( m_Name.c_str() );
+                itkExceptionMacro( "Unable to allocate " << uintBytes << " bytes of shared memory for " << m_Name );
+            }
+
+            std::memcpy( pMapping, &header, sizeof( header ) );
+            if( blnCopyPixels )
+                std::memcpy( static_cast< char * >( pMapping ) + PixelOffset, pImage->GetBufferPointer(), uintPixelBytes );
+
+            munmap( pMapping, uintBytes );
+            m_Owner = true;
+#else
+            (void)pImage;
+            itkExceptionMacro( "No POSIX shared memory on this platform" );
+#endif
+        }
+
+        /** Maps the segment as an image, read only unless blnWritable */
+        ImagePointer Map( bool blnWritable = false ) const
+        {
+#ifdef ITKCSIROTomo_HAS_SHARED_MEMORY
+            const int intFile( shm_open( m_Name.c_str(), blnWritable ? O_RDWR : O_RDONLY, 0 ) );
+            if( intFile < 0 )
+                itkExceptionMacro( "Unable to open the shared memory segment " << m_Name << ": " << std::strerror( errno ) );
+
+            struct stat status;
+            void * pMapping( MAP_FAILED );
+            if( fstat( intFile, &status ) == 0 && static_cast< SizeValueType >( status.st_size ) >= PixelOffset )
+                pMapping = mmap( ITK_NULLPTR, static_cast< size_t >( status.st_size ), blnWritable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, intFile, 0 );
+            close( intFile );
+
+            if( pMapping == MAP_FAILED )
+                itkExceptionMacro( "Unable to map the shared memory segment " << m_Name );
+
+            const SizeValueType uintMappedBytes( static_cast< SizeValueType >( status.st_size ) );
+
+            // Released with the image, or here if the segment is not an image
+            typename ContainerType::Pointer pContainer( ContainerType::New() );
+            pContainer->SetMapping( pMapping, uintMappedBytes );
+
+            Header header;
+            std::memcpy( &header, pMapping, sizeof( header ) );
+            if( std::memcmp( header.Magic, "CSTKSHM", 8 ) != 0 || header.Dimension != ImageDimension || header.ElementSize != sizeof( InternalPixelType )
+                || header.Components == 0 || ( header.Components != 1 && !TraitsType::VariableComponents ) )
+                itkExceptionMacro( "The shared memory segment " << m_Name << " does not hold an image of this type" );
+
+            RegionType region;
+            typename ImageType::SpacingType spacing;
+            typename ImageType::PointType origin;
+            typename ImageType::DirectionType direction;
+            for( unsigned int j = 0; j < ImageDimension; j++ )
+            {
+                region.SetIndex( j, static_cast< IndexValueType >( header.Index[j] ) );
+                region.SetSize( j, static_cast< SizeValueType >( header.Size[j] ) );
+                spacing[j] = header.Spacing[j];
+                origin[j] = header.Origin[j];
+                for( unsigned int k = 0; k < ImageDimension; k++ )
+                    direction[j][k] = header.Direction[j * ImageDimension + k];
+            }
+
+            const SizeValueType uintElements( region.GetNumberOfPixels() * header.Components );
+            if( PixelOffset + uintElements * sizeof( InternalPixelType ) > uintMappedBytes )
+                itkExceptionMacro( "The shared memory segment " << m_Name << " is truncated" );
+
+            pContainer->SetImportPointer( reinterpret_cast< InternalPixelType * >( static_cast< char * >( pMapping ) + PixelOffset ),
+                                          uintElements, false );
+
+            ImagePointer pImage( ImageType::New() );
+            TraitsType::SetNumberOfComponents( pImage.GetPointer(), header.Components );
+            pImage->SetRegions( region );
+            pImage->SetSpacing( spacing );
+            pImage->SetOrigin( origin );
+            pImage->SetDirection( direction );
+            pImage->SetPixelContainer( pContainer );
+
+            return pImage;
+#else
+            (void)blnWritable;
+            itkExceptionMacro( "No POSIX shared memory on this platform" );
+#endif
+        }
+
+        /** Removes the segment if this object created it */
+        void Remove()
+        {
+#ifdef ITKCSIROTomo_HAS_SHARED_MEMORY
+            if( m_Owner )
+                shm_unlink( m_Name.c_str() );
+#endif
+            m_Owner = false;
+        }
+
+    protected:
+        SharedMemoryImage()
+            : m_Owner( false )
+        {
+        }
+
+        virtual ~SharedMemoryImage() ITK_OVERRIDE
+        {
+            this->Remove();
+        }
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE
+        {
+            Superclass::PrintSelf( os, indent );
+
+            os << indent << "Name: " << m_Name << std::endl;
+            os << indent << "Owner: " << m_Owner << std::endl;
+        }
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(SharedMemoryImage);
+
+        /** Geometry at the start of the segment, the pixels following at
+         * PixelOffset */
+        struct Header
+        {
+            char                Magic[8];
+            std::uint32_t       Dimension;
+            std::uint32_t       ElementSize;
+            std::uint32_t       Components;
+            std::int64_t        Index[ImageDimension];
+            std::uint64_t       Size[ImageDimension];
+            double              Spacing[ImageDimension];
+            double              Origin[ImageDimension];
+            double              Direction[ImageDimension * ImageDimension];
+        };
+
+        // Pixels start on a cache line boundary
+        static const SizeValueType PixelOffset = ( sizeof( Header ) + 63 ) / 64 * 64;
+
+        std::string                                         m_Name;
+        bool                                                m_Owner;
+    };
+}
+
+#endif // itkSharedMemoryImage_h
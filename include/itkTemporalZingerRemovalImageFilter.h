@@ -0,0 +1,137 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkTemporalZingerRemovalImageFilter_h
+#define itkTemporalZingerRemovalImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+#include "itkComputePixelTraits.h"
+
+namespace itk
+{
+/** \class TemporalZingerRemovalImageFilter
+ *
+ * \brief Removes zingers from a projection stack by comparing each pixel
+ * with the same pixel in the neighbouring projections.
+ *
+ * The input is a projection stack with the projection number along axis 2.
+ * Each pixel is compared with the median of the same detector pixel over the
+ * projections within Radius of its own, and replaced by that median if it
+ * falls below ThresholdLower or above ThresholdUpper times it, as done
+ * spatially by ThresholdedMedianMaskImageFilter. The window is clamped at the
+ * first and last projections of the scan.
+ *
+ * Only the requested projections and Radius projections either side of them
+ * are requested from the input, so a scan of any length is processed in
+ * bounded memory when the output is streamed along the projections, e.g. by
+ * a StreamingImageFilter or a streaming writer. Each thread walks its
+ * detector rows through the projections keeping the 2 * Radius + 1 rows of
+ * the window in a ring, so every input row is read and converted once, and
+ * selects the medians of a whole row at a time with a branch-free sorting
+ * network over the window, vectorized across the detector columns.
+ *
+ * \ingroup ITKCSIROTomo
+ */
+    template< typename TInputImage, typename TOutputImage = TInputImage >
+    class ITK_TEMPLATE_EXPORT TemporalZingerRemovalImageFilter : public ImageToImageFilter< TInputImage, TOutputImage >
+    {
+    public:
+        typedef TemporalZingerRemovalImageFilter                    Self;
+        typedef ImageToImageFilter< TInputImage, TOutputImage >     Superclass;
+        typedef SmartPointer< Self >                                Pointer;
+        typedef SmartPointer< const Self >                          ConstPointer;
+
+        itkStaticConstMacro( InputImageDimension, unsigned int, TInputImage::ImageDimension );
+        itkStaticConstMacro( OutputImageDimension, unsigned int, TOutputImage::ImageDimension );
+
+        itkNewMacro(Self)
+        itkTypeMacro(TemporalZingerRemovalImageFilter, ImageToImageFilter)
+
+        /** Image related typedefs. */
+        typedef TInputImage                                         InputImageType;
+        typedef TOutputImage                                        OutputImageType;
+        typedef typename InputImageType::PixelType                  InputPixelType;
+        typedef typename OutputImageType::PixelType                 OutputPixelType;
+        typedef typename InputImageType::IndexType                  InputIndexType;
+        typedef typename InputImageType::RegionType                 InputImageRegionType;
+        typedef typename OutputImageType::RegionType                OutputImageRegionType;
+
+        /** Windows are held and their median selected in this type, float for
+         * the reduced precision storage types */
+        typedef typename ComputePixelTraits< InputPixelType >::ComputeType InputComputeType;
+
+    #ifdef ITK_USE_CONCEPT_CHECKING
+        itkConceptMacro( InputIsThreeDimensional, ( Concept::SameDimension< InputImageDimension, 3 > ) );
+        itkConceptMacro( OutputIsThreeDimensional, ( Concept::SameDimension< OutputImageDimension, 3 > ) );
+        itkConceptMacro( InputConvertibleToOutputCheck, ( Concept::Convertible< InputComputeType, OutputPixelType > ) );
+    #endif
+
+        /** Number of projections either side of a pixel within its window */
+        itkSetClampMacro( Radius, unsigned int, 1, NumericTraits< unsigned int >::max() )
+        itkGetConstMacro( Radius, unsigned int )
+
+        /** Pixels below ThresholdLower or above ThresholdUpper times their
+         * temporal median are replaced by it */
+        itkSetMacro( ThresholdLower, double )
+        itkGetConstMacro( ThresholdLower, double )
+        itkSetMacro( ThresholdUpper, double )
+        itkGetConstMacro( ThresholdUpper, double )
+
+        /** Maximum number of progress events per update */
+        itkSetMacro( NumberOfProgressUpdates, unsigned int )
+        itkGetConstMacro( NumberOfProgressUpdates, unsigned int )
+
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+    protected:
+        TemporalZingerRemovalImageFilter();
+        virtual ~TemporalZingerRemovalImageFilter() ITK_OVERRIDE {}
+
+        void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+        /** The requested projections are padded by Radius either side */
+        virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+        virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
+        virtual void ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId ) ITK_OVERRIDE;
+        virtual void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+    private:
+        ITK_DISALLOW_COPY_AND_ASSIGN(TemporalZingerRemovalImageFilter);
+
+        /** Converts uintLength input pixels from index on, the projection
+         * clamped to those buffered */
+        void LoadRow( const InputImageType * pInput, InputIndexType index, SizeValueType uintLength, InputComputeType * pRow ) const;
+
+        unsigned int                                m_Radius;
+        double                                      m_ThresholdLower;
+        double                                      m_ThresholdUpper;
+        unsigned int                                m_NumberOfProgressUpdates;
+
+        ChunkedProgressCounter                      m_ProgressCounter;
+        FilterInstrumentation::Pointer              m_Instrumentation;
+    };
+}
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTemporalZingerRemovalImageFilter.hxx"
+#endif
+
+#endif // itkTemporalZingerRemovalImageFilter_h
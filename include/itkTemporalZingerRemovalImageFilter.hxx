@@ -0,0 +1,201 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkTemporalZingerRemovalImageFilter_hxx
+#define itkTemporalZingerRemovalImageFilter_hxx
+
+#include "itkTemporalZingerRemovalImageFilter.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace itk
+{
+    template< typename TInputImage, typename TOutputImage >
+    TemporalZingerRemovalImageFilter< TInputImage, TOutputImage >::TemporalZingerRemovalImageFilter()
+        : m_Radius( 2 )
+        , m_ThresholdLower( 0.0 )
+        , m_ThresholdUpper( 1.5 )
+        , m_NumberOfProgressUpdates( 100 )
+        , m_Instrumentation( FilterInstrumentation::New() )
+    {
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void TemporalZingerRemovalImageFilter< TInputImage, TOutputImage >::PrintSelf( std::ostream& os, Indent indent ) const
+    {
+        Superclass::PrintSelf( os, indent );
+
+        os << indent << "Radius: " << m_Radius << std::endl;
+        os << indent << "ThresholdLower: " << m_ThresholdLower << std::endl;
+        os << indent << "ThresholdUpper: " << m_ThresholdUpper << std::endl;
+        os << indent << "NumberOfProgressUpdates: " << m_NumberOfProgressUpdates << std::endl;
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void TemporalZingerRemovalImageFilter< TInputImage, TOutputImage >::GenerateInputRequestedRegion()
+    {
+        Superclass::GenerateInputRequestedRegion();
+
+        InputImageType * pInput( const_cast< InputImageType * >( this->GetInput() ) );
+
+        if( !pInput )
+            return;
+
+        InputImageRegionType regionRequested( this->GetOutput()->GetRequestedRegion() );
+        regionRequested.SetIndex( 2, regionRequested.GetIndex( 2 ) - static_cast< IndexValueType >( m_Radius ) );
+        regionRequested.SetSize( 2, regionRequested.GetSize( 2 ) + 2 * m_Radius );
+        regionRequested.Crop( pInput->GetLargestPossibleRegion() );
+
+        pInput->SetRequestedRegion( regionRequested );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void TemporalZingerRemovalImageFilter< TInputImage, TOutputImage >::BeforeThreadedGenerateData()
+    {
+        Superclass::BeforeThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        m_ProgressCounter.Initialize( this->GetOutput()->GetRequestedRegion().GetNumberOfPixels(), m_NumberOfProgressUpdates );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void TemporalZingerRemovalImageFilter< TInputImage, TOutputImage >::AfterThreadedGenerateData()
+    {
+        Superclass::AfterThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void TemporalZingerRemovalImageFilter< TInputImage, TOutputImage >::LoadRow( const InputImageType * pInput, InputIndexType index, SizeValueType uintLength, InputComputeType * pRow ) const
+    {
+        const InputImageRegionType & regionBuffered( pInput->GetBufferedRegion() );
+        const IndexValueType intFirst( regionBuffered.GetIndex( 2 ) );
+        const IndexValueType intLast( intFirst + static_cast< IndexValueType >( regionBuffered.GetSize( 2 ) ) - 1 );
+
+        index[2] = std::min( std::max( index[2], intFirst ), intLast );
+
+        const InputPixelType * pPixels( pInput->GetBufferPointer() + pInput->ComputeOffset( index ) );
+        for( SizeValueType x = 0; x < uintLength; ++x )
+            pRow[x] = static_cast< InputComputeType >( pPixels[x] );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void TemporalZingerRemovalImageFilter< TInputImage, TOutputImage >::ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId )
+    {
+        const InputImageType * pInput( this->GetInput() );
+        OutputImageType * pOutput( this->GetOutput() );
+
+        // support progress methods/callbacks, accounted once per scanline
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter );
+
+        const unsigned int uintWindow( 2 * m_Radius + 1 );
+        const IndexValueType intRadius( static_cast< IndexValueType >( m_Radius ) );
+        const SizeValueType uintLineLength( outputRegionForThread.GetSize( 0 ) );
+
+        const IndexValueType intRowStart( outputRegionForThread.GetIndex( 1 ) );
+        const IndexValueType intRowEnd( intRowStart + static_cast< IndexValueType >( outputRegionForThread.GetSize( 1 ) ) );
+        const IndexValueType intProjectionStart( outputRegionForThread.GetIndex( 2 ) );
+        const IndexValueType intProjectionEnd( intProjectionStart + static_cast< IndexValueType >( outputRegionForThread.GetSize( 2 ) ) );
+
+        // Ring of the rows of the window, projection p held in slot
+        // ( p - intProjectionStart + intRadius ) % uintWindow, and the window
+        // copied out of it for sorting, one row per slot
+        std::vector< InputComputeType > vecRing( uintWindow * uintLineLength );
+        std::vector< InputComputeType > vecWindow( uintWindow * uintLineLength );
+
+        InputComputeType * const pMedians( &vecWindow[m_Radius * uintLineLength] );
+
+        InputIndexType index( outputRegionForThread.GetIndex() );
+
+        for( index[1] = intRowStart; index[1] < intRowEnd; index[1]++ )
+        {
+            {
+                itkCSIROTomoScopedPhase( m_Instrumentation, threadId, NeighborhoodGather );
+
+                // The window of the first projection but its last row, loaded
+                // at the first step
+                for( IndexValueType p = intProjectionStart - intRadius; p < intProjectionStart + intRadius; p++ )
+                {
+                    index[2] = p;
+                    LoadRow( pInput, index, uintLineLength, &vecRing[( ( p - intProjectionStart + intRadius ) % uintWindow ) * uintLineLength] );
+                }
+            }
+
+            for( IndexValueType z = intProjectionStart; z < intProjectionEnd; z++ )
+            {
+                {
+                    itkCSIROTomoScopedPhase( m_Instrumentation, threadId, NeighborhoodGather );
+
+                    // Slide the window on by one projection
+                    index[2] = z + intRadius;
+                    LoadRow( pInput, index, uintLineLength, &vecRing[( ( z - intProjectionStart + 2 * intRadius ) % uintWindow ) * uintLineLength] );
+
+                    std::copy( vecRing.begin(), vecRing.end(), vecWindow.begin() );
+                }
+
+                {
+                    itkCSIROTomoScopedPhase( m_Instrumentation, threadId, MedianSelection );
+
+                    // Odd-even transposition sort of the window rows, every
+                    // column sorted at once by branch-free compare-exchanges
+                    for( unsigned int uintPass = 0; uintPass < uintWindow; uintPass++ )
+                    {
+                        for( unsigned int i = uintPass % 2; i + 1 < uintWindow; i += 2 )
+                        {
+                            InputComputeType * pLower( &vecWindow[i * uintLineLength] );
+                            InputComputeType * pUpper( &vecWindow[( i + 1 ) * uintLineLength] );
+
+                            for( SizeValueType x = 0; x < uintLineLength; ++x )
+                            {
+                                const InputComputeType lower( std::min( pLower[x], pUpper[x] ) );
+                                const InputComputeType upper( std::max( pLower[x], pUpper[x] ) );
+                                pLower[x] = lower;
+                                pUpper[x] = upper;
+                            }
+                        }
+                    }
+                }
+
+                // Replace the pixels outside the threshold range of their median
+                const InputComputeType * pPixels( &vecRing[( ( z - intProjectionStart + intRadius ) % uintWindow ) * uintLineLength] );
+
+                index[2] = z;
+                OutputPixelType * pOutputPixels( pOutput->GetBufferPointer() + pOutput->ComputeOffset( index ) );
+
+                for( SizeValueType x = 0; x < uintLineLength; ++x )
+                {
+                    const double dblPixelValue( static_cast< double >( pPixels[x] ) );
+                    const double dblMedianValue( static_cast< double >( pMedians[x] ) );
+
+                    pOutputPixels[x] = static_cast< OutputPixelType >( dblPixelValue < m_ThresholdLower * dblMedianValue || dblPixelValue > m_ThresholdUpper * dblMedianValue
+                                                                       ? pMedians[x] : pPixels[x] );
+                }
+
+                progress.CompletedPixels( uintLineLength );
+            }
+        }
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, outputRegionForThread.GetNumberOfPixels() );
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, MediansComputed, outputRegionForThread.GetNumberOfPixels() );
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, BytesAllocated, ( vecRing.capacity() + vecWindow.capacity() ) * sizeof( InputComputeType ) );
+    }
+}
+
+#endif // itkTemporalZingerRemovalImageFilter_hxx
@@ -20,6 +20,11 @@
 
 #include "itkBoxImageFilter.h"
 #include "itkImage.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkChunkedProgressReporter.h"
+#include "itkComputePixelTraits.h"
+#include "itkNUMAPlacement.h"
+#include "itkPackedBitMaskImage.h"
 
 namespace itk
 {
@@ -59,6 +64,10 @@ namespace itk
         typedef typename InputImageType::PixelType  InputPixelType;
         typedef typename OutputImageType::PixelType OutputPixelType;
 
+        /** Neighborhoods are gathered and their median selected in this type,
+         * float for the reduced precision storage types */
+        typedef typename ComputePixelTraits< InputPixelType >::ComputeType InputComputeType;
+
         typedef typename InputImageType::RegionType  InputImageRegionType;
         typedef typename OutputImageType::RegionType OutputImageRegionType;
 
@@ -82,10 +91,26 @@ namespace itk
       itkSetMacro( Iterations, unsigned int )
       itkGetConstMacro( Iterations, unsigned int )
 
+      /** Maximum number of progress events per update. Progress is accounted
+       * per scanline, so this only limits the event rate seen by observers. */
+      itkSetMacro( NumberOfProgressUpdates, unsigned int )
+      itkGetConstMacro( NumberOfProgressUpdates, unsigned int )
+
+      /** Statistics of the last update, see FilterInstrumentation */
+      itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+      /** With a placement, threads run on their node and first write their
+       * rows of the output there. Null by default, see NUMAPlacement */
+      itkSetObjectMacro( NUMAPlacement, NUMAPlacement )
+      itkGetModifiableObjectMacro( NUMAPlacement, NUMAPlacement )
+
     protected:
         ThresholdedMedianImageFilter();
         virtual ~ThresholdedMedianImageFilter() ITK_OVERRIDE {}
 
+        void BeforeThreadedGenerateData() ITK_OVERRIDE;
+        void AfterThreadedGenerateData() ITK_OVERRIDE;
+
         /** MedianImageFilter can be implemented as a multithreaded filter.
          * Therefore, this implementation provides a ThreadedGenerateData()
          * routine which is called for each processing thread. The output
@@ -102,9 +127,19 @@ namespace itk
     private:
         ITK_DISALLOW_COPY_AND_ASSIGN(ThresholdedMedianImageFilter);
 
+        /** The median kernel, not instantiated for packed bit mask outputs,
+         * which only ThresholdedMedianMaskImageFilter produces */
+        void ThreadedGenerateMedian(const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId, std::false_type);
+        void ThreadedGenerateMedian(const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId, std::true_type);
+
         double                      m_ThresholdLower;
         double                      m_ThresholdUpper;
         unsigned int                m_Iterations;
+        unsigned int                m_NumberOfProgressUpdates;
+        ChunkedProgressCounter      m_ProgressCounter;
+
+        FilterInstrumentation::Pointer m_Instrumentation;
+        NUMAPlacement::Pointer      m_NUMAPlacement;
     };
 }
 
@@ -27,7 +27,7 @@
 #include "itkImageRegionConstIterator.h"
 #include "itkNeighborhoodAlgorithm.h"
 #include "itkOffset.h"
-#include "itkProgressReporter.h"
+#include "itkChunkedProgressReporter.h"
 
 #include <vector>
 #include <algorithm>
@@ -41,6 +41,8 @@ namespace itk
         : m_ThresholdLower( 0.0 )
         , m_ThresholdUpper( 1.0 )
         , m_Iterations( 1 )
+        , m_NumberOfProgressUpdates( 100 )
+        , m_Instrumentation( FilterInstrumentation::New() )
     {
         // Set default filter radius
         typename TOutputImage::SizeType sizeRadius;
@@ -48,8 +50,40 @@ namespace itk
         this->SetRadius( sizeRadius );
     }
 
+    template< typename TInputImage, typename TOutputImage >
+    void ThresholdedMedianImageFilter< TInputImage, TOutputImage >::BeforeThreadedGenerateData()
+    {
+        Superclass::BeforeThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, this->GetNumberOfThreads() );
+
+        m_ProgressCounter.Initialize( this->GetOutput()->GetRequestedRegion().GetNumberOfPixels(), m_NumberOfProgressUpdates );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ThresholdedMedianImageFilter< TInputImage, TOutputImage >::AfterThreadedGenerateData()
+    {
+        Superclass::AfterThreadedGenerateData();
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
     template< typename TInputImage, typename TOutputImage >
     void ThresholdedMedianImageFilter< TInputImage, TOutputImage >::ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId )
+    {
+        NUMAPlacement::ScopedThreadPin pin( m_NUMAPlacement, threadId, this->GetNumberOfThreads() );
+
+        this->ThreadedGenerateMedian( outputRegionForThread, threadId, IsPackedBitMaskImage< TOutputImage >() );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ThresholdedMedianImageFilter< TInputImage, TOutputImage >::ThreadedGenerateMedian( const OutputImageRegionType &, ThreadIdType, std::true_type )
+    {
+        itkExceptionMacro( "A packed bit mask is not a median image, use ThresholdedMedianMaskImageFilter to produce one" );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ThresholdedMedianImageFilter< TInputImage, TOutputImage >::ThreadedGenerateMedian( const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId, std::false_type )
     {
         // Allocate output
         typename OutputImageType::Pointer output( this->GetOutput() );
@@ -60,14 +94,17 @@ namespace itk
         typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType
         faceList = bC( input, outputRegionForThread, this->GetRadius() );
 
-        // support progress methods/callbacks
-        ProgressReporter progress( this, threadId, outputRegionForThread.GetNumberOfPixels() );
+        // support progress methods/callbacks, accounted once per scanline
+        ChunkedProgressReporter progress( this, threadId, m_ProgressCounter );
 
         // All of our neighborhoods have an odd number of pixels, so there is
         // always a median index (if there where an even number of pixels
         // in the neighborhood we have to average the middle two values).
         ZeroFluxNeumannBoundaryCondition< InputImageType > nbc;
-        std::vector< InputPixelType >                      pixels;
+        std::vector< InputComputeType >                    pixels;
+        std::vector< OffsetValueType >                     vecOffsets;
+
+        const InputPixelType * const pInputBuffer( input->GetBufferPointer() );
 
         // Process each of the boundary faces.  These are N-d regions which border
         // the edge of the buffer.
@@ -82,32 +119,80 @@ namespace itk
 
             const unsigned int neighborhoodSize( bit.Size() );
             const unsigned int medianPosition( neighborhoodSize / 2 );
+            const SizeValueType uintLineLength( fit->GetSize( 0 ) );
 
-            while( !bit.IsAtEnd() )
+            // The neighborhoods of a line, gathered one after another
+            pixels.resize( uintLineLength * neighborhoodSize );
+
+            // Neighborhoods within the interior face never need the boundary
+            // condition, so they are gathered through a table of buffer offsets
+            // relative to the centre pixel rather than the neighborhood iterator
+            const bool blnInterior( !bit.GetNeedToUseBoundaryCondition() );
+            if( blnInterior )
             {
-                // collect all the pixels in the neighborhood, note that we use
-                // GetPixel on the NeighborhoodIterator to honor the boundary conditions
-                pixels.resize( neighborhoodSize );
+                vecOffsets.resize( neighborhoodSize );
                 for( unsigned int i = 0; i < neighborhoodSize; ++i )
-                    pixels[i] = ( bit.GetPixel( i ) );
-
-                // get the median value
-                const typename std::vector< InputPixelType >::iterator medianIterator( pixels.begin() + medianPosition );
-                std::nth_element( pixels.begin(), medianIterator, pixels.end() );
-
-                double dblPixelValue( static_cast< double >( itInput.Value() ) );
-                double dblMedianValue( static_cast< double >( *medianIterator ) );
-
-                // Apply median filter only to pixels that fall outside the threshold range
-                itOutput.Set( dblPixelValue > m_ThresholdLower && dblPixelValue <= m_ThresholdUpper ? itInput.Value() : static_cast< typename OutputImageType::PixelType >(  dblMedianValue ) );
-
-                ++bit;
-                ++itOutput;
-                ++itInput;
+                    vecOffsets[i] = input->ComputeOffset( input->GetBufferedRegion().GetIndex() + bit.GetOffset( i ) );
+            }
 
-                progress.CompletedPixel();
+            while( !itOutput.IsAtEnd() )
+            {
+                const InputPixelType * pCenter( blnInterior ? pInputBuffer + input->ComputeOffset( itInput.GetIndex() ) : ITK_NULLPTR );
+
+                // The line is gathered and then selected, each pass timed
+                // once, a single median being too short to time
+                {
+                    itkCSIROTomoScopedPhase( m_Instrumentation, threadId, NeighborhoodGather );
+
+                    // collect all the pixels in the neighborhood, note that we use
+                    // GetPixel on the NeighborhoodIterator to honor the boundary conditions
+                    typename std::vector< InputComputeType >::iterator itGathered( pixels.begin() );
+                    for( SizeValueType x = 0; x < uintLineLength; ++x )
+                    {
+                        if( blnInterior )
+                        {
+                            for( unsigned int i = 0; i < neighborhoodSize; ++i )
+                                *itGathered++ = pCenter[vecOffsets[i]];
+                            ++pCenter;
+                        }
+                        else
+                        {
+                            for( unsigned int i = 0; i < neighborhoodSize; ++i )
+                                *itGathered++ = ( bit.GetPixel( i ) );
+                            ++bit;
+                        }
+                    }
+                }
+
+                {
+                    itkCSIROTomoScopedPhase( m_Instrumentation, threadId, MedianSelection );
+
+                    typename std::vector< InputComputeType >::iterator itNeighborhood( pixels.begin() );
+                    for( SizeValueType x = 0; x < uintLineLength; ++x, itNeighborhood += neighborhoodSize )
+                    {
+                        // get the median value
+                        const typename std::vector< InputComputeType >::iterator medianIterator( itNeighborhood + medianPosition );
+                        std::nth_element( itNeighborhood, medianIterator, itNeighborhood + neighborhoodSize );
+
+                        double dblPixelValue( static_cast< double >( itInput.Value() ) );
+                        double dblMedianValue( static_cast< double >( *medianIterator ) );
+
+                        // Apply median filter only to pixels that fall outside the threshold range
+                        itOutput.Set( dblPixelValue > m_ThresholdLower && dblPixelValue <= m_ThresholdUpper ? static_cast< OutputPixelType >( itInput.Value() ) : static_cast< OutputPixelType >( dblMedianValue ) );
+
+                        ++itOutput;
+                        ++itInput;
+                    }
+                }
+
+                progress.CompletedPixels( uintLineLength );
             }
+
+            itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, PixelsProcessed, fit->GetNumberOfPixels() );
+            itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, MediansComputed, fit->GetNumberOfPixels() );
         }
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, threadId, BytesAllocated, pixels.capacity() * sizeof( InputComputeType ) );
     }
 }
 
@@ -20,6 +20,9 @@
 
 #include "itkThresholdedMedianImageFilter.h"
 #include "itkProgressReporter.h"
+#include "itkImageBufferPool.h"
+#include "itkPackedBitMaskImage.h"
+#include "itkProgressAccumulator.h"
 
 namespace itk
 {
@@ -45,6 +48,11 @@ namespace itk
 
         itkNewMacro(Self)
         itkTypeMacro(ThresholdedMedianMaskImageFilter, ThresholdedMedianImageFilter)
+
+        /** Pool the output and intermediate images are drawn from, null to
+         * allocate them per update, see ImageBufferPool */
+        itkSetObjectMacro( BufferPool, ImageBufferPool )
+        itkGetModifiableObjectMacro( BufferPool, ImageBufferPool )
     protected:
         ThresholdedMedianMaskImageFilter();
         virtual ~ThresholdedMedianMaskImageFilter() ITK_OVERRIDE {}
@@ -53,6 +61,13 @@ namespace itk
         void GenerateData() ITK_OVERRIDE;
     private:
         ITK_DISALLOW_COPY_AND_ASSIGN(ThresholdedMedianMaskImageFilter);
+
+        /** Compares the input with its thresholded median into the output, through
+         * a functor filter for image outputs, a word at a time for PackedBitMaskImage */
+        void GenerateMask( TInputImage * pInput, TInputImage * pMedian, ProgressAccumulator * pProgress, std::false_type );
+        void GenerateMask( TInputImage * pInput, TInputImage * pMedian, ProgressAccumulator * pProgress, std::true_type );
+
+        ImageBufferPool::Pointer            m_BufferPool;
     };
 }
 
@@ -21,8 +21,10 @@
 #include "itkThresholdedMedianMaskImageFilter.h"
 
 #include "itkBinaryFunctorImageFilter.h"
+#include "itkImageScanlineConstIterator.h"
 #include "itkMath.h"
 #include "itkNumericTraits.h"
+#include "itkProgressAccumulator.h"
 #include "itkThresholdedMedianMaskImageFilter.h"
 
 #ifdef PENDING_REMOVAL
@@ -79,29 +81,124 @@ namespace itk
     template< typename TInputImage, typename TOutputImage >
     void ThresholdedMedianMaskImageFilter< TInputImage, TOutputImage >::GenerateData()
     {
-        typedef Functor::ThresholdedMask< typename TInputImage::PixelType, typename TInputImage::PixelType > FunctorThreholdedMaskType;
-        typedef BinaryFunctorImageFilter< TInputImage, TInputImage, TOutputImage, FunctorThreholdedMaskType > FunctorFilterType;
-        typedef ThresholdedMedianImageFilter< TInputImage, TInputImage >  ThresholdedMedianImageFilterType;
+        typedef PooledOutputImageFilter< ThresholdedMedianImageFilter< TInputImage, TInputImage > > ThresholdedMedianImageFilterType;
+
+        // The internal filters read a graft of the input, so that they work on
+        // the padded region requested by this filter without updating the
+        // pipeline upstream of it for the largest possible region
+        typename TInputImage::Pointer pInput( TInputImage::New() );
+        pInput->Graft( this->GetInput() );
 
         // First, do thresholded median filtering on the input
         typename ThresholdedMedianImageFilterType::Pointer pThresholdedMedianFilter( ThresholdedMedianImageFilterType::New() );
         pThresholdedMedianFilter->SetThresholdLower( this->GetThresholdLower() );
         pThresholdedMedianFilter->SetThresholdUpper( this->GetThresholdUpper() );
-        pThresholdedMedianFilter->SetInput( this->GetInput() );
+        pThresholdedMedianFilter->SetInput( pInput );
         pThresholdedMedianFilter->SetRadius( this->GetRadius() );
+        pThresholdedMedianFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+        pThresholdedMedianFilter->SetNumberOfProgressUpdates( this->GetNumberOfProgressUpdates() );
+        pThresholdedMedianFilter->SetBufferPool( m_BufferPool );
+        pThresholdedMedianFilter->SetNUMAPlacement( this->GetNUMAPlacement() );
+
+        // Forward the progress of the mini-pipeline, the median dominates the run time
+        ProgressAccumulator::Pointer pProgress( ProgressAccumulator::New() );
+        pProgress->SetMiniPipelineFilter( this );
+        pProgress->RegisterInternalFilter( pThresholdedMedianFilter, 0.9f );
+
+        // Run the median first so that its phases are not charged to the functor,
+        // over the requested region of this filter only
+        pThresholdedMedianFilter->GetOutput()->SetRequestedRegion( this->GetOutput()->GetRequestedRegion() );
+        pThresholdedMedianFilter->Update();
+
+        itkCSIROTomoInstrumentationInitialize( this->GetModifiableInstrumentation(), 1 );
+        {
+            itkCSIROTomoScopedPhase( this->GetModifiableInstrumentation(), 0, Functor );
+            this->GenerateMask( pInput, pThresholdedMedianFilter->GetOutput(), pProgress, IsPackedBitMaskImage< TOutputImage >() );
+        }
+
+        // The median image is an intermediate of this filter
+        itkCSIROTomoInstrumentationMerge( this->GetModifiableInstrumentation(), pThresholdedMedianFilter->GetInstrumentation() );
+        itkCSIROTomoInstrumentationCount( this->GetModifiableInstrumentation(), 0, BytesAllocated,
+                                          pThresholdedMedianFilter->GetOutput()->GetBufferedRegion().GetNumberOfPixels() * sizeof( typename TInputImage::PixelType ) );
+
+        itkCSIROTomoInstrumentationReport( this );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ThresholdedMedianMaskImageFilter< TInputImage, TOutputImage >::GenerateMask( TInputImage * pInput, TInputImage * pMedian, ProgressAccumulator * pProgress, std::false_type )
+    {
+        typedef Functor::ThresholdedMask< typename TInputImage::PixelType, typename TInputImage::PixelType > FunctorThreholdedMaskType;
+        typedef PooledOutputImageFilter< BinaryFunctorImageFilter< TInputImage, TInputImage, TOutputImage, FunctorThreholdedMaskType > > FunctorFilterType;
 
         typename FunctorFilterType::Pointer pFunctorFilter( FunctorFilterType::New() );
+        pFunctorFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+        pFunctorFilter->SetBufferPool( m_BufferPool );
+        pProgress->RegisterInternalFilter( pFunctorFilter, 0.1f );
 
         // Set functor bounds
         FunctorThreholdedMaskType & functorThreshold( pFunctorFilter->GetFunctor() );
         functorThreshold.SetThresholdLower( this->GetThresholdLower() );
         functorThreshold.SetThresholdUpper( this->GetThresholdUpper() );
 
-        pFunctorFilter->SetInput1( this->GetInput() );
-        pFunctorFilter->SetInput2( pThresholdedMedianFilter->GetOutput() );
+        pFunctorFilter->SetInput1( pInput );
+        pFunctorFilter->SetInput2( pMedian );
+        pFunctorFilter->GraftOutput( this->GetOutput() );
         pFunctorFilter->Update();
 
-        this->GetOutput()->Graft( pFunctorFilter->GetOutput() );
+        this->GraftOutput( pFunctorFilter->GetOutput() );
+    }
+
+    template< typename TInputImage, typename TOutputImage >
+    void ThresholdedMedianMaskImageFilter< TInputImage, TOutputImage >::GenerateMask( TInputImage * pInput, TInputImage * pMedian, ProgressAccumulator *, std::true_type )
+    {
+        typedef typename TOutputImage::WordType WordType;
+
+        Functor::ThresholdedMask< typename TInputImage::PixelType, bool > functorThreshold;
+        functorThreshold.SetThresholdLower( this->GetThresholdLower() );
+        functorThreshold.SetThresholdUpper( this->GetThresholdUpper() );
+
+        TOutputImage * pOutput( this->GetOutput() );
+        const typename TOutputImage::RegionType regionOutput( pOutput->GetRequestedRegion() );
+
+        pOutput->SetBufferedRegion( regionOutput );
+        if( m_BufferPool )
+            m_BufferPool->AllocateImage( pOutput );
+        else
+            pOutput->Allocate();
+
+        // Bits are gathered in a register and stored a word at a time, the
+        // padding of the last word of each row left clear
+        ImageScanlineConstIterator< TInputImage > itInput( pInput, regionOutput );
+        ImageScanlineConstIterator< TInputImage > itMedian( pMedian, regionOutput );
+
+        while( !itInput.IsAtEnd() )
+        {
+            WordType * pWords( pOutput->GetRowWords( itInput.GetIndex() ) );
+            WordType word( 0 );
+            unsigned int uintBit( 0 );
+
+            while( !itInput.IsAtEndOfLine() )
+            {
+                if( functorThreshold( itInput.Get(), itMedian.Get() ) )
+                    word |= static_cast< WordType >( 1 ) << uintBit;
+
+                if( ++uintBit == TOutputImage::BitsPerWord )
+                {
+                    *pWords++ = word;
+                    word = 0;
+                    uintBit = 0;
+                }
+
+                ++itInput;
+                ++itMedian;
+            }
+
+            if( uintBit > 0 )
+                *pWords = word;
+
+            itInput.NextLine();
+            itMedian.NextLine();
+        }
     }
 }
 
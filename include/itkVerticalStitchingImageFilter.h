@@ -22,6 +22,10 @@
 #include "itkNumericTraits.h"
 #include "itkProgressReporter.h"
 #include "itkVectorImage.h"
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkComputePixelTraits.h"
+#include "itkImageBufferPool.h"
+#include "itkNUMAPlacement.h"
 
 namespace itk
 {
@@ -59,7 +63,16 @@ namespace itk
 
         typedef typename TWeighting::PixelType                      WeightingPixelType;
 
-        typedef itk::VectorImage< PixelType, WeightingImageDimension >      WeightingImageType;
+        /** Weights are held in the compute type, float for the reduced precision
+         * storage types */
+        typedef typename ComputePixelTraits< PixelType >::ComputeType       ComputeType;
+
+        /** Blended sums and column means are accumulated in the accumulate
+         * type, float for the reduced precision storage types, and cast to the
+         * pixel type once when stored */
+        typedef typename NumericTraits< PixelType >::AccumulateType         AccumulateType;
+
+        typedef itk::VectorImage< ComputeType, WeightingImageDimension >    WeightingImageType;
         typedef typename WeightingImageType::Pointer                        WeightingImageTypePointer;
 
         itkSetMacro( ComputeWeighting, bool )
@@ -88,6 +101,21 @@ namespace itk
         itkSetMacro( WeightingBeta, WeightingImageTypePointer )
         itkGetConstMacro( WeightingBeta, WeightingImageTypePointer )
 
+        /** Statistics of the last update, see FilterInstrumentation */
+        itkGetModifiableObjectMacro( Instrumentation, FilterInstrumentation )
+
+        /** Pool the output, the intermediate images and the computed weights
+         * are drawn from, null to allocate them per update, see ImageBufferPool */
+        itkSetObjectMacro( BufferPool, ImageBufferPool )
+        itkGetModifiableObjectMacro( BufferPool, ImageBufferPool )
+
+        /** With a placement, the trimmed copies and the output are written, and
+         * the inputs blended, by pinned threads in bands of output rows, each
+         * copy row by the thread blending it, and the weights are read from
+         * replicas on the node of the thread. Null by default, see NUMAPlacement */
+        itkSetObjectMacro( NUMAPlacement, NUMAPlacement )
+        itkGetModifiableObjectMacro( NUMAPlacement, NUMAPlacement )
+
     protected:
         VerticalStitchingImageFilter();
         virtual ~VerticalStitchingImageFilter() ITK_OVERRIDE {}
@@ -106,15 +134,43 @@ namespace itk
          */
         virtual void GenerateOutputInformation() ITK_OVERRIDE;
 
-        /** StitchingImageFilter needs a smaller input requested region than
-         * output requested region.  As such, PadImageFilterBase needs to
-         * provide an implementation for GenerateInputRequestedRegion() in
-         * order to inform the pipeline execution model.
+        /** Each input is requested for the rows of its trimmed region blended
+         * into the band of output rows requested, or for its nearest row if
+         * none are, so that the stitching streams a band at a time.
          * \sa ProcessObject::GenerateInputRequestedRegion()  */
         virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
 
+        /** Computing the weights, the output is produced for the largest
+         * possible region, the weights needing whole columns of every input */
+        virtual void EnlargeOutputRequestedRegion( DataObject * pOutput ) ITK_OVERRIDE;
+
         RegionType ComputeTrimRegion( typename TImage::ConstPointer pImage );
-        typename TImage::Pointer CreateRegionCopy( typename TImage::ConstPointer pImage, typename TImage::RegionType region );
+
+        /** The rows of the trimmed copy of input uintInput blended into
+         * regionOutput, indexed as the output less uintInput shifts, false if
+         * there are none */
+        bool ComputeCopyRegion( const RegionType & regionTrimmed, const RegionType & regionOutput, unsigned int uintInput, RegionType & regionCopy ) const;
+
+        /** Copy of the rows regionCopy of the trimmed region of pImage, see
+         * ComputeCopyRegion() */
+        typename TImage::Pointer CreateRegionCopy( typename TImage::ConstPointer pImage, const RegionType & regionTrimmed, const RegionType & regionCopy );
+
+        /** Allocates from the buffer pool if one is set */
+        template< typename TAllocatedImage >
+        void AllocateImage( TAllocatedImage * pImage );
+
+        /** Trimmed copies of the inputs written by the threads blending each of
+         * their rows into the rows of regionOutput, null for the inputs blended
+         * into none, see SetNUMAPlacement() */
+        void CreateRegionCopiesThreaded( const RegionType & regionTrimmed, const RegionType & regionOutput, std::vector< typename TImage::Pointer > & vecCopies );
+
+        /** Blends the weighted copies into the output a band of rows per thread */
+        void BlendThreaded( const std::vector< typename TImage::Pointer > & vecCopies, TImage * pImageOutput );
+
+        /** Blends the weighted copies into the rows of regionRows of the output,
+         * for the threaded and serial blending alike */
+        void BlendRegion( const std::vector< typename TImage::Pointer > & vecCopies, TImage * pImageOutput, const RegionType & regionRows,
+                          const WeightingImageType * pAlpha, const WeightingImageType * pBeta ) const;
 
         virtual void CreateWeightingVectorImages( std::vector<typename TImage::Pointer> & vecImages );
 
@@ -136,6 +192,10 @@ namespace itk
         WeightingImageTypePointer                  m_WeightingBeta;
 
         unsigned int                               m_VerticalShiftPixels;
+
+        FilterInstrumentation::Pointer             m_Instrumentation;
+        ImageBufferPool::Pointer                   m_BufferPool;
+        NUMAPlacement::Pointer                     m_NUMAPlacement;
     };
 }
 
@@ -21,12 +21,10 @@
 
 #include "itkVerticalStitchingImageFilter.h"
 #include "itkImageAlgorithm.h"
-#include "itkMeanProjectionImageFilter.h"
 #include "itkComposeImageFilter.h"
 #include "itkImageLinearConstIteratorWithIndex.h"
 #include "itkImageLinearIteratorWithIndex.h"
 #include "itkImageScanlineConstIterator.h"
-#include "itkExtractImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
 
 namespace itk
@@ -38,6 +36,8 @@ namespace itk
         , m_VerticalShift( 0.0 )
         , m_WeightingAlpha( NULL )
         , m_WeightingBeta( NULL )
+        , m_VerticalShiftPixels( 0 )
+        , m_Instrumentation( FilterInstrumentation::New() )
     {
         m_TrimPointMin.Fill( 0.0 );
         m_TrimPointMax.Fill( 0.0 );
@@ -51,22 +51,197 @@ namespace itk
 
 
     template< typename TImage, typename TWeighting >
-    typename TImage::Pointer VerticalStitchingImageFilter< TImage, TWeighting >::CreateRegionCopy( typename TImage::ConstPointer pImage, typename TImage::RegionType region )
+    bool VerticalStitchingImageFilter< TImage, TWeighting >::ComputeCopyRegion( const RegionType & regionTrimmed, const RegionType & regionOutput,
+                                                                              unsigned int uintInput, RegionType & regionCopy ) const
     {
-        // Create a new image with zero-based indexes containing
-        // a copy of the contents of the passed image/region
-        RegionType regionCopy( region.GetSize() );
+        // Copies are indexed as the output, the rows of copy i counted from
+        // zero at output row i * shift
+        RegionType regionCopyLargest( regionTrimmed );
+        regionCopyLargest.SetIndex( 1, 0 );
+
+        regionCopy = regionOutput;
+        regionCopy.GetModifiableIndex()[1] -= static_cast< IndexValueType >( uintInput * m_VerticalShiftPixels );
+
+        return regionCopy.Crop( regionCopyLargest );
+    }
+
+    template< typename TImage, typename TWeighting >
+    typename TImage::Pointer VerticalStitchingImageFilter< TImage, TWeighting >::CreateRegionCopy( typename TImage::ConstPointer pImage, const RegionType & regionTrimmed,
+                                                                                                 const RegionType & regionCopy )
+    {
+        itkCSIROTomoScopedPhase( m_Instrumentation, 0, RegionCopy );
+
+        // Create a new image over the trimmed region, its rows counted from
+        // zero, buffering a copy of the rows of regionCopy only
+        RegionType regionCopyLargest( regionTrimmed );
+        regionCopyLargest.SetIndex( 1, 0 );
+
+        RegionType regionSource( regionCopy );
+        regionSource.SetIndex( 1, regionTrimmed.GetIndex( 1 ) + regionCopy.GetIndex( 1 ) );
+
         typename TImage::Pointer pImageCopy( TImage::New() );
-        pImageCopy->SetRegions( regionCopy );
+        pImageCopy->SetLargestPossibleRegion( regionCopyLargest );
+        pImageCopy->SetBufferedRegion( regionCopy );
+        pImageCopy->SetRequestedRegion( regionCopy );
         pImageCopy->SetSpacing( pImage->GetSpacing() );
-        pImageCopy->Allocate();
+        AllocateImage( pImageCopy );
 
         // Copy region
-        ImageAlgorithm::Copy( pImage.GetPointer(), pImageCopy.GetPointer(), region, regionCopy );
+        ImageAlgorithm::Copy( pImage.GetPointer(), pImageCopy.GetPointer(), regionSource, regionCopy );
+
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, 0, BytesAllocated, regionCopy.GetNumberOfPixels() * sizeof( PixelType ) );
 
         return pImageCopy;
     }
 
+    template< typename TImage, typename TWeighting >
+    template< typename TAllocatedImage >
+    void VerticalStitchingImageFilter< TImage, TWeighting >::AllocateImage( TAllocatedImage * pImage )
+    {
+        // Copies, weights and the output are returned to the pool when
+        // released, so the next update of the same size reuses them
+        if( m_BufferPool )
+            m_BufferPool->AllocateImage( pImage );
+        else
+            pImage->Allocate();
+    }
+
+    template< typename TImage, typename TWeighting >
+    void VerticalStitchingImageFilter< TImage, TWeighting >::CreateRegionCopiesThreaded( const RegionType & regionTrimmed, const RegionType & regionOutput,
+                                                                                       std::vector< typename TImage::Pointer > & vecCopies )
+    {
+        itkCSIROTomoScopedPhase( m_Instrumentation, 0, RegionCopy );
+
+        RegionType regionCopyLargest( regionTrimmed );
+        regionCopyLargest.SetIndex( 1, 0 );
+
+        // Allocated here, but not written until the threads copy into them,
+        // null for the inputs not blended into regionOutput
+        vecCopies.clear();
+        for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
+        {
+            RegionType regionCopy;
+            if( !ComputeCopyRegion( regionTrimmed, regionOutput, i, regionCopy ) )
+            {
+                vecCopies.push_back( ITK_NULLPTR );
+                continue;
+            }
+
+            typename TImage::Pointer pImageCopy( TImage::New() );
+            pImageCopy->SetLargestPossibleRegion( regionCopyLargest );
+            pImageCopy->SetBufferedRegion( regionCopy );
+            pImageCopy->SetRequestedRegion( regionCopy );
+            pImageCopy->SetSpacing( this->GetInput( i )->GetSpacing() );
+            AllocateImage( pImageCopy );
+            vecCopies.push_back( pImageCopy );
+
+            itkCSIROTomoInstrumentationCount( m_Instrumentation, 0, BytesAllocated, regionCopy.GetNumberOfPixels() * sizeof( PixelType ) );
+        }
+
+        m_NUMAPlacement->ForEachThreadRegion( regionOutput, this->GetNumberOfThreads(), [&]( const RegionType & regionThread, ThreadIdType )
+        {
+            for( unsigned int i = 0; i < vecCopies.size(); i++ )
+            {
+                if( !vecCopies[i] )
+                    continue;
+
+                // Row r of copy i is blended into output row r + i * shift
+                RegionType regionRows( regionThread );
+                regionRows.GetModifiableIndex()[1] -= static_cast< IndexValueType >( i * m_VerticalShiftPixels );
+
+                if( !regionRows.Crop( vecCopies[i]->GetBufferedRegion() ) )
+                    continue;
+
+                RegionType regionSource( regionRows );
+                regionSource.SetIndex( 1, regionTrimmed.GetIndex( 1 ) + regionRows.GetIndex( 1 ) );
+
+                ImageAlgorithm::Copy( this->GetInput( i ), vecCopies[i].GetPointer(), regionSource, regionRows );
+            }
+        } );
+    }
+
+    template< typename TImage, typename TWeighting >
+    void VerticalStitchingImageFilter< TImage, TWeighting >::BlendThreaded( const std::vector< typename TImage::Pointer > & vecCopies, TImage * pImageOutput )
+    {
+        const WeightingImageType * pWeightingAlpha( m_WeightingAlpha );
+        const WeightingImageType * pWeightingBeta( m_WeightingBeta );
+
+        m_NUMAPlacement->Replicate( pWeightingAlpha );
+        m_NUMAPlacement->Replicate( pWeightingBeta );
+
+        const ThreadIdType numberOfThreads( this->GetNumberOfThreads() );
+
+        m_NUMAPlacement->ForEachThreadRegion( pImageOutput->GetBufferedRegion(), numberOfThreads, [&]( const RegionType & regionThread, ThreadIdType threadId )
+        {
+            const unsigned int uintNode( m_NUMAPlacement->GetNodeOfThread( threadId, numberOfThreads ) );
+
+            BlendRegion( vecCopies, pImageOutput, regionThread, m_NUMAPlacement->GetReplica( pWeightingAlpha, uintNode ), m_NUMAPlacement->GetReplica( pWeightingBeta, uintNode ) );
+        } );
+    }
+
+    template< typename TImage, typename TWeighting >
+    void VerticalStitchingImageFilter< TImage, TWeighting >::BlendRegion( const std::vector< typename TImage::Pointer > & vecCopies, TImage * pImageOutput, const RegionType & regionRows,
+                                                                        const WeightingImageType * pAlpha, const WeightingImageType * pBeta ) const
+    {
+        const IndexValueType intShift( m_VerticalShiftPixels );
+        const IndexValueType intOverlap( m_RegionWeighting.GetSize( 1 ) );
+        const unsigned int uintNumOverlap( static_cast< unsigned int >( vecCopies.size() - 1 ) );
+
+        const SizeValueType uintLineLength( regionRows.GetSize( 0 ) );
+        std::vector< AccumulateType > vecLine( uintLineLength );
+
+        ImageScanlineConstIterator< TImage > itOutput( pImageOutput, regionRows );
+        for( ; !itOutput.IsAtEnd(); itOutput.NextLine() )
+        {
+            const IndexType indexOutput( itOutput.GetIndex() );
+            std::fill( vecLine.begin(), vecLine.end(), NumericTraits< AccumulateType >::ZeroValue() );
+
+            // The inputs are added in order, each scaled by beta in its upper
+            // overlap then alpha in its lower
+            for( unsigned int i = 0; i < vecCopies.size(); i++ )
+            {
+                IndexType indexCopy( indexOutput );
+                indexCopy[1] -= static_cast< IndexValueType >( i ) * intShift;
+
+                // Only the rows of the band requested are copied
+                if( !vecCopies[i] || !vecCopies[i]->GetBufferedRegion().IsInside( indexCopy ) )
+                    continue;
+
+                const PixelType * pCopyLine( vecCopies[i]->GetBufferPointer() + vecCopies[i]->ComputeOffset( indexCopy ) );
+
+                // The weights are indexed as the copies, over their overlap
+                // rows, whichever band is blended
+                IndexType indexWeighting( indexCopy );
+
+                const ComputeType * pBetaLine( ITK_NULLPTR );
+                if( i > 0 && indexCopy[1] < intOverlap )
+                    pBetaLine = pBeta->GetBufferPointer() + pBeta->ComputeOffset( indexWeighting ) * uintNumOverlap + ( i - 1 );
+
+                const ComputeType * pAlphaLine( ITK_NULLPTR );
+                if( i < uintNumOverlap && indexCopy[1] >= intShift )
+                {
+                    indexWeighting[1] -= intShift;
+                    pAlphaLine = pAlpha->GetBufferPointer() + pAlpha->ComputeOffset( indexWeighting ) * uintNumOverlap + i;
+                }
+
+                for( SizeValueType x = 0; x < uintLineLength; ++x )
+                {
+                    AccumulateType value( static_cast< AccumulateType >( pCopyLine[x] ) );
+                    if( pBetaLine )
+                        value *= pBetaLine[x * uintNumOverlap];
+                    if( pAlphaLine )
+                        value *= pAlphaLine[x * uintNumOverlap];
+
+                    vecLine[x] += value;
+                }
+            }
+
+            PixelType * pOutputLine( pImageOutput->GetBufferPointer() + pImageOutput->ComputeOffset( indexOutput ) );
+            for( SizeValueType x = 0; x < uintLineLength; ++x )
+                pOutputLine[x] = static_cast< PixelType >( vecLine[x] );
+        }
+    }
+
     template< typename TImage, typename TWeighting >
     typename TImage::RegionType VerticalStitchingImageFilter< TImage, TWeighting >::ComputeTrimRegion( typename TImage::ConstPointer pImage )
     {
@@ -95,49 +270,73 @@ namespace itk
     template< typename TImage, typename TWeighting >
     void VerticalStitchingImageFilter< TImage, TWeighting >::CreateWeightingVectorImages( std::vector<typename TImage::Pointer> & vecImages )
     {
-        typedef itk::ExtractImageFilter< TImage, TImage > ExtractImageFilterType;
-        typedef itk::MeanProjectionImageFilter< TImage, TImage > MeanProjectionImageFilterType;
+        typedef itk::Image< AccumulateType, ImageDimension > MeanImageType;
+        typedef typename NumericTraits< AccumulateType >::AccumulateType MeanSumType;
+        typedef typename NumericTraits< PixelType >::RealType MeanRealType;
 
         if( vecImages.size() == 1 )
           return;
 
+        itkCSIROTomoScopedPhase( m_Instrumentation, 0, Weighting );
+
         unsigned int uintNumOverlap( vecImages.size() - 1 );
 
         // Set initial weighting value to 1.0
         typename WeightingImageType::PixelType valInitial( uintNumOverlap );
         valInitial.Fill( 1.0 );
 
+        // The weights being replaced, their buffers can be reused for the
+        // new ones unless held elsewhere
+        m_WeightingAlpha = ITK_NULLPTR;
+        m_WeightingBeta = ITK_NULLPTR;
+
         // Create VectorImages for Alpha & Beta weightings
         WeightingImageTypePointer pWeightingAlpha( WeightingImageType::New() );
         pWeightingAlpha->SetRegions( m_RegionWeighting );
         pWeightingAlpha->SetVectorLength( uintNumOverlap );
-        pWeightingAlpha->Allocate();
+        AllocateImage( pWeightingAlpha.GetPointer() );
         pWeightingAlpha->FillBuffer( valInitial );
 
         WeightingImageTypePointer pWeightingBeta( WeightingImageType::New() );
         pWeightingBeta->SetRegions( m_RegionWeighting );
         pWeightingBeta->SetVectorLength( uintNumOverlap );
-        pWeightingBeta->Allocate();
+        AllocateImage( pWeightingBeta.GetPointer() );
         pWeightingBeta->FillBuffer( valInitial );
 
-        // Create a vector column-wise mean images
-        std::vector< typename TImage::Pointer > vecColumnWiseMeans;
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, 0, BytesAllocated, 2 * m_RegionWeighting.GetNumberOfPixels() * uintNumOverlap * sizeof( ComputeType ) );
+
+        // Column-wise means of the non-overlap region of each image, summed
+        // down the columns a row at a time as MeanProjectionImageFilter would
+        RegionType regionMean( m_RegionNonOverlap );
+        regionMean.SetIndex( 1, 0 );
+        regionMean.SetSize( 1, 1 );
+
+        const SizeValueType uintLineLength( m_RegionNonOverlap.GetSize( 0 ) );
+        const SizeValueType uintMeanRows( m_RegionNonOverlap.GetSize( 1 ) );
+        std::vector< MeanSumType > vecSums( uintLineLength );
+
+        std::vector< typename MeanImageType::Pointer > vecColumnWiseMeans;
         for( typename std::vector< typename TImage::Pointer >::const_iterator itVec = vecImages.begin(); itVec != vecImages.end(); itVec++ )
         {
-            // Extract non-overlap region
-            typename ExtractImageFilterType::Pointer pExtractNonOverlapImageFilter( ExtractImageFilterType::New() );
-            pExtractNonOverlapImageFilter->SetInput( *itVec );
-            pExtractNonOverlapImageFilter->SetExtractionRegion( m_RegionNonOverlap );
+            typename MeanImageType::Pointer pMean( MeanImageType::New() );
+            pMean->SetRegions( regionMean );
+            AllocateImage( pMean.GetPointer() );
+
+            std::fill( vecSums.begin(), vecSums.end(), NumericTraits< MeanSumType >::ZeroValue() );
 
-            // Compute mean projection along vertical axis
-            typename MeanProjectionImageFilterType::Pointer pMeanProjectionImageFilter( MeanProjectionImageFilterType::New() );
-            pMeanProjectionImageFilter->SetInput( pExtractNonOverlapImageFilter->GetOutput() );
-            pMeanProjectionImageFilter->SetProjectionDimension( 1 );
-            pMeanProjectionImageFilter->Update();
+            ImageScanlineConstIterator< TImage > itNonOverlap( *itVec, m_RegionNonOverlap );
+            for( ; !itNonOverlap.IsAtEnd(); itNonOverlap.NextLine() )
+            {
+                const PixelType * pLine( ( *itVec )->GetBufferPointer() + ( *itVec )->ComputeOffset( itNonOverlap.GetIndex() ) );
+                for( SizeValueType x = 0; x < uintLineLength; ++x )
+                    vecSums[x] += static_cast< MeanSumType >( static_cast< ComputeType >( pLine[x] ) );
+            }
 
-            vecColumnWiseMeans.push_back( pMeanProjectionImageFilter->GetOutput() );
+            AccumulateType * pMeanLine( pMean->GetBufferPointer() );
+            for( SizeValueType x = 0; x < uintLineLength; ++x )
+                pMeanLine[x] = static_cast< AccumulateType >( static_cast< MeanRealType >( vecSums[x] ) / uintMeanRows );
 
-            pMeanProjectionImageFilter->GetOutput()->DisconnectPipeline();
+            vecColumnWiseMeans.push_back( pMean );
         }
 
         RegionType regionColumnUpper( m_RegionOverlapUpper );
@@ -151,7 +350,7 @@ namespace itk
 
         for( unsigned int i = 0; i < uintNumOverlap; i++ )
         {
-            itk::ImageScanlineConstIterator< TImage > itMeanColumn( vecColumnWiseMeans[i], vecColumnWiseMeans[i]->GetLargestPossibleRegion() );
+            itk::ImageScanlineConstIterator< MeanImageType > itMeanColumn( vecColumnWiseMeans[i], vecColumnWiseMeans[i]->GetLargestPossibleRegion() );
 
             while( !itMeanColumn.IsAtEnd() )
             {
@@ -226,8 +425,10 @@ namespace itk
             }
         }
 
-        this->SetWeightingAlpha( pWeightingAlpha );
-        this->SetWeightingBeta( pWeightingBeta );
+        // Set without marking the filter modified, which would have it run
+        // again on the next update
+        m_WeightingAlpha = pWeightingAlpha;
+        m_WeightingBeta = pWeightingBeta;
     }
 
 
@@ -243,101 +444,154 @@ namespace itk
 
         RegionType regionTrimmed( ComputeTrimRegion( pInputImage ) );
 
+        itkCSIROTomoInstrumentationInitialize( m_Instrumentation, 1 );
+
+        // Only the band of rows requested is stitched, from the rows of the
+        // copies blended into it
+        const RegionType regionOutput( pOutput->GetLargestPossibleRegion() );
+        const RegionType regionRequested( pOutput->GetRequestedRegion() );
+
+        // Create a vector of trimmed input images to be used in subsequent operations
+        std::vector<typename TImage::Pointer> vecRescaledImages;
+        if( m_NUMAPlacement )
+            CreateRegionCopiesThreaded( regionTrimmed, regionRequested, vecRescaledImages );
+        else
+        {
+            for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
+            {
+                RegionType regionCopy;
+                if( ComputeCopyRegion( regionTrimmed, regionRequested, i, regionCopy ) )
+                    vecRescaledImages.push_back( CreateRegionCopy( this->GetInput( i ), regionTrimmed, regionCopy ) );
+                else
+                    vecRescaledImages.push_back( ITK_NULLPTR );
+            }
+        }
+
+        SizeValueType uintPixelsCopied( 0 );
+        for( unsigned int i = 0; i < vecRescaledImages.size(); i++ )
+        {
+            if( vecRescaledImages[i] )
+                uintPixelsCopied += vecRescaledImages[i]->GetBufferedRegion().GetNumberOfPixels();
+        }
+
+        // The copy of a single input is indexed as the output
         if( this->GetNumberOfInputs() == 1 )
         {
-            this->GraftOutput( CreateRegionCopy( pInputImage, regionTrimmed ) );
+            this->GraftOutput( vecRescaledImages[0] );
+            itkCSIROTomoInstrumentationCount( m_Instrumentation, 0, PixelsProcessed, uintPixelsCopied );
+            itkCSIROTomoInstrumentationReport( this );
             return;
         }
 
-        RegionType regionOutput( pOutput->GetLargestPossibleRegion() );
-
         typename TImage::Pointer pImageOutput( TImage::New() );
-        pImageOutput->SetRegions( regionOutput );
+        pImageOutput->SetLargestPossibleRegion( regionOutput );
+        pImageOutput->SetBufferedRegion( regionRequested );
+        pImageOutput->SetRequestedRegion( regionRequested );
         pImageOutput->SetSpacing( pInputImage->GetSpacing() );
-        pImageOutput->Allocate();
-        pImageOutput->FillBuffer( 0 );
+        AllocateImage( pImageOutput );
 
-        // Create a vector of trimmed input images to be used in subsequent operations
-        std::vector<typename TImage::Pointer> vecRescaledImages;
-        for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-            vecRescaledImages.push_back( CreateRegionCopy( this->GetInput( i ), regionTrimmed ) );
+        // Not zeroed, the blending writing every row whole
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, 0, BytesAllocated, regionRequested.GetNumberOfPixels() * sizeof( PixelType ) );
 
         if( this->GetComputeWeighting() )
-            CreateWeightingVectorImages( vecRescaledImages );
-
-        itk::ImageRegionIterator< WeightingImageType > itAlpha( this->GetWeightingAlpha(), m_RegionWeighting );
-        itk::ImageRegionIterator< WeightingImageType > itBeta( this->GetWeightingBeta(), m_RegionWeighting );
-
-        // Apply scaling to trimmed images prior to stitching
-        for( unsigned int i = 0; i < this->GetNumberOfInputs() - 1; i++ )
         {
-          itAlpha.GoToBegin();
-          itBeta.GoToBegin();
-
-           itk::ImageRegionIterator< TImage > itOverlapLowerN( vecRescaledImages[i], m_RegionOverlapLower );
-           itk::ImageRegionIterator< TImage > itOverlapUpperN1( vecRescaledImages[i+1], m_RegionOverlapUpper );
-
-           IndexType indexIterator;
+            // The weights are replaced, and with them their replicas
+            if( m_NUMAPlacement )
+            {
+                m_NUMAPlacement->ReleaseReplica( m_WeightingAlpha );
+                m_NUMAPlacement->ReleaseReplica( m_WeightingBeta );
+            }
 
-           while( !itOverlapLowerN.IsAtEnd() )
-           {
-               indexIterator = itAlpha.GetIndex();
+            CreateWeightingVectorImages( vecRescaledImages );
+        }
 
-               typename itk::ImageRegionIterator< WeightingImageType >::PixelType valAlpha( itAlpha.Get() );
-               typename itk::ImageRegionIterator< WeightingImageType >::PixelType valBeta( itBeta.Get() );
+        if( m_NUMAPlacement )
+        {
+            itkCSIROTomoScopedPhase( m_Instrumentation, 0, Blending );
 
-              // double dblN( itOverlapLowerN.Value() );
-               //double dblN1( itOverlapUpperN1.Value() );
+            BlendThreaded( vecRescaledImages, pImageOutput );
+            this->UpdateProgress( 1.0f );
+        }
+        else
+        {
+            itkCSIROTomoScopedPhase( m_Instrumentation, 0, Blending );
 
-               //double dblAlpha( valAlpha[i] );
-               //double dblBeta( valBeta[i] );
+            // Blended by bands of the rows requested, one per input, progress
+            // being reported after each
+            const SizeValueType uintRows( regionRequested.GetSize( 1 ) );
+            const unsigned int uintNumBands( this->GetNumberOfInputs() );
+            for( unsigned int i = 0; i < uintNumBands; i++ )
+            {
+                RegionType regionBand( regionRequested );
+                regionBand.SetIndex( 1, regionRequested.GetIndex( 1 ) + static_cast< IndexValueType >( uintRows * i / uintNumBands ) );
+                regionBand.SetSize( 1, uintRows * ( i + 1 ) / uintNumBands - uintRows * i / uintNumBands );
 
-               // Apply alpha scaling to lower overlap on N image
-               itOverlapLowerN.Value() *= valAlpha[i];
+                if( regionBand.GetSize( 1 ) > 0 )
+                    BlendRegion( vecRescaledImages, pImageOutput, regionBand, this->GetWeightingAlpha(), this->GetWeightingBeta() );
 
-                // Apply beta scaling to upper overlap on N+1 image
-               itOverlapUpperN1.Value() *= valBeta[i];
+                this->UpdateProgress( static_cast< float >( i + 1 ) / static_cast< float >( uintNumBands ) );
+                if( this->GetAbortGenerateData() )
+                {
+                    ProcessAborted e( __FILE__, __LINE__ );
+                    e.SetDescription( "Process aborted." );
+                    e.SetLocation( ITK_LOCATION );
+                    throw e;
+                }
+            }
+        }
 
-               //double dblNpost( itOverlapLowerN.Value() );
-               //double dblN1post( itOverlapUpperN1.Value() );
+        itkCSIROTomoInstrumentationCount( m_Instrumentation, 0, PixelsProcessed, uintPixelsCopied );
 
-               ++itAlpha;
-               ++itBeta;
-               ++itOverlapLowerN;
-               ++itOverlapUpperN1;
-           }
-        }
+        this->GraftOutput( pImageOutput );
 
+        itkCSIROTomoInstrumentationReport( this );
+    }
 
-        RegionType regionOutputN( vecRescaledImages[0]->GetLargestPossibleRegion() );
+    template< typename TImage, typename TWeighting >
+    void VerticalStitchingImageFilter< TImage, TWeighting >::GenerateInputRequestedRegion()
+    {
+        const RegionType regionRequested( this->GetOutput()->GetRequestedRegion() );
 
-        // Finally, add trimed, rescaled images to stitched output image
+        // Each input is requested for the rows of its trimmed region blended
+        // into the rows requested, row r of input i giving output row
+        // r + i * shift
         for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
         {
-            itk::ImageRegionIterator< TImage > itInputScaled( vecRescaledImages[i], vecRescaledImages[i]->GetLargestPossibleRegion() );
-            itk::ImageRegionIterator< TImage > itOutput( pImageOutput, regionOutputN );
+            TImage * pInput( const_cast< TImage * >( this->GetInput( i ) ) );
+
+            if( !pInput )
+                continue;
 
-            while( !itOutput.IsAtEnd() )
+            const RegionType regionTrimmed( ComputeTrimRegion( pInput ) );
+
+            RegionType regionCopy;
+            if( !ComputeCopyRegion( regionTrimmed, regionRequested, i, regionCopy ) )
             {
-                itOutput.Value() += itInputScaled.Value();
-                ++itInputScaled;
-                ++itOutput;
+                // Not blended into the band, but updated with the others, so
+                // for its nearest row only
+                const bool blnAbove( regionRequested.GetIndex( 1 ) < static_cast< IndexValueType >( i * m_VerticalShiftPixels ) );
+
+                regionCopy = regionRequested;
+                regionCopy.SetIndex( 1, blnAbove ? 0 : static_cast< IndexValueType >( regionTrimmed.GetSize( 1 ) ) - 1 );
+                regionCopy.SetSize( 1, 1 );
             }
 
-            // Shift regionOutputN for the next iteration
-            regionOutputN.GetModifiableIndex()[1] += m_VerticalShiftPixels;
-        }
+            RegionType regionInput( regionCopy );
+            regionInput.SetIndex( 1, regionTrimmed.GetIndex( 1 ) + regionCopy.GetIndex( 1 ) );
 
-        this->GraftOutput( pImageOutput );
+            pInput->SetRequestedRegion( regionInput );
+        }
     }
 
     template< typename TImage, typename TWeighting >
-    void VerticalStitchingImageFilter< TImage, TWeighting >::GenerateInputRequestedRegion()
+    void VerticalStitchingImageFilter< TImage, TWeighting >::EnlargeOutputRequestedRegion( DataObject * pOutput )
     {
-        // Get pointer to the input
-        //typename TWeightingVectorImage::Pointer pInput(  const_cast< TWeightingVectorImage * >( this->GetInput() ) );
-        //const InputRegionType & regionLargestInput( pInput->GetLargestPossibleRegion() );
-        //pInput->SetRequestedRegion( regionLargestInput );
+        Superclass::EnlargeOutputRequestedRegion( pOutput );
+
+        // The weights are computed from whole columns of every input, so only
+        // stitching with given weights is streamed, a band of rows at a time
+        if( m_ComputeWeighting && this->GetNumberOfInputs() > 1 )
+            pOutput->SetRequestedRegionToLargestPossibleRegion();
     }
 
     template< typename TImage, typename TWeighting >
@@ -357,8 +611,11 @@ namespace itk
 
         if( uintNumInputs == 1 )
         {
-            // Set the output size to the trimmed input size
-            pOutput->SetLargestPossibleRegion( regionTrimmed );
+            // Set the output size to the trimmed input size, its rows counted
+            // from zero as the stitched ones are
+            RegionType regionOutput( regionTrimmed );
+            regionOutput.SetIndex( 1, 0 );
+            pOutput->SetLargestPossibleRegion( regionOutput );
             return;
         }
 
@@ -368,11 +625,13 @@ namespace itk
         // Initialize output size to be updated
         SizeType sizeOutput( regionOutput.GetSize() );
 
-        // Get the index position of the shift
+        // Get the index position of the shift, measured down the columns from
+        // the origin, which binned images place at the centre of the first
+        // pixel block rather than at zero
         IndexType indexVerticalShift;
-        PointType pointVerticalShift;
-        pointVerticalShift.Fill( 0.0 );
-        pointVerticalShift[1] = m_VerticalShift;
+        PointType pointVerticalShift( pInputImage->GetOrigin() );
+        for( unsigned int i = 0; i < ImageDimension; i++ )
+            pointVerticalShift[i] += pInputImage->GetDirection()[i][1] * m_VerticalShift;
 
         pInputImage->TransformPhysicalPointToIndex( pointVerticalShift, indexVerticalShift );
 
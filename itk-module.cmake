@@ -13,6 +13,8 @@ itk_module(ITKCSIROTomo
 	ITKSpatialObjects
 	ITKIOImageBase
 	ITKImageIntensity
+	ITKZLIB
+	ITKHDF5
   TEST_DEPENDS
 	ITKImageGrid
 	ITKTestKernel
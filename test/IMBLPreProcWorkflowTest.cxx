@@ -17,238 +17,1131 @@
  *=========================================================================*/
 
 #include "itkMaskedMedianImageFilter.h"
+#include "itkNegLogCheckedImageFilter.h"
+#include "itkImageBufferPool.h"
+#include "itkMemoryBudgetPlanner.h"
+#include "itkPackedBitMaskImage.h"
+#include "itkParallelBeamFilteredBackProjectionImageFilter.h"
+#include "itkShardedProcessRunner.h"
+#include "itkSharedMemoryImage.h"
 #include "itkThresholdedMedianMaskImageFilter.h"
 
-#include "itkCommand.h"
-#include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkImageSeriesReader.h"
-#include "itkRegularExpressionSeriesFileNames.h"
-#include "itkMeanProjectionImageFilter.h"
+#include "itkBinnedMeanProjectionImageFilter.h"
+#include "itkChunkedStackImageFileWriter.h"
+#include "itkLiveProjectionProcessor.h"
+#include "itkClampImageFilter.h"
 #include "itkChangeInformationImageFilter.h"
+#include "itkSubtractImageFilter.h"
+#include "itkDivideImageFilter.h"
+#include "itkExtractImageFilter.h"
+#include "itkStreamingImageFilter.h"
+#include "itkDynamicFlatFieldCorrectionImageFilter.h"
+#include "itkDefectMapRepairImageFilter.h"
+#include "itkEigenFlatCalculator.h"
 #include "itkVerticalStitchingImageFilter.h"
 
+#include "itkIMBLPreProcWorkflowUtilities.h"
+
 #include "itkTestingMacros.h"
 
-using ImageType = itk::Image< float, 2 >;
-using VolumeType = itk::Image< float, 3 >;
-using MaskImageType = itk::Image< unsigned char, 2 >;
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using ImageType = IMBLPreProcWorkflow::ImageType;
+using VolumeType = IMBLPreProcWorkflow::VolumeType;
+using MaskImageType = itk::PackedBitMaskImage< 2 >;
 
-using ImageReader = itk::ImageFileReader< ImageType >;
-using ImageSeriesReader = itk::ImageSeriesReader< VolumeType >;
-using RegexSeriesFileNames = itk::RegularExpressionSeriesFileNames;
-using FileNamesContainer = ImageSeriesReader::FileNamesContainer;
 using ImageWriter = itk::ImageFileWriter< ImageType >;
-using MaskImageWriter = itk::ImageFileWriter< MaskImageType >;
 using ChangeInformationImageType = itk::ChangeInformationImageFilter< ImageType >;
-using MeanProjectionImageFilter = itk::MeanProjectionImageFilter< VolumeType, ImageType >;
+using MeanProjectionImageFilter = itk::BinnedMeanProjectionImageFilter< VolumeType, ImageType >;
+using BinFrameFilter = itk::BinnedMeanProjectionImageFilter< ImageType, ImageType >;
+using SubtractImageFilter = itk::SubtractImageFilter< ImageType >;
+using DivideImageFilter = itk::DivideImageFilter< ImageType, ImageType, ImageType >;
+using ExtractFrameFilter = itk::ExtractImageFilter< VolumeType, ImageType >;
+using EigenFlatCalculatorType = itk::EigenFlatCalculator< ImageType >;
+using DynamicFlatFieldCorrectionImageFilterType = itk::DynamicFlatFieldCorrectionImageFilter< ImageType >;
 using VerticalStitchingImageFilter = itk::VerticalStitchingImageFilter< ImageType, ImageType >;
-using VerticalStitchingVolumeFilter = itk::VerticalStitchingImageFilter< VolumeType, ImageType >;
+using ThresholdedMedianMaskImageFilterType = itk::ThresholdedMedianMaskImageFilter< ImageType, MaskImageType >;
+using DefectMapRepairImageFilterType = itk::DefectMapRepairImageFilter< ImageType >;
+using DetectorDefectMapType = DefectMapRepairImageFilterType::DefectMapType;
+using MaskedMedianImageFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, MaskImageType >;
+using NegLogCheckedImageFilterType = itk::NegLogCheckedImageFilter< ImageType >;
+using FilteredBackProjectionFilterType = itk::ParallelBeamFilteredBackProjectionImageFilter< VolumeType, VolumeType >;
+using WeightingImageType = VerticalStitchingImageFilter::WeightingImageType;
+using CacheKey = IMBLPreProcWorkflow::CacheKey;
+using MemoryBudgetPlanner = itk::MemoryBudgetPlanner;
+
+using IMBLPreProcWorkflow::WorkflowSettings;
+using IMBLPreProcWorkflow::WorkflowSource;
+using IMBLPreProcWorkflow::SyntheticWorkflowSource;
+using IMBLPreProcWorkflow::FileWorkflowSource;
+using IMBLPreProcWorkflow::StageStatistics;
+using IMBLPreProcWorkflow::WorkflowReport;
 
 namespace
 {
-    class ShowProgress : public itk::Command
+    /** Sets the geometry of a frame binned by uintBinning from detector pixels
+     * of dblSpacing, the origin at the centre of the first block of detector
+     * pixels as placed by BinnedMeanProjectionImageFilter */
+    ImageType::Pointer ChangeImageSpacing( ImageType::Pointer pImage, double dblSpacing, unsigned int uintBinning )
+    {
+        ImageType::SpacingType spacing;
+        spacing.Fill( dblSpacing * uintBinning );
+
+        ImageType::PointType origin;
+        origin.Fill( 0.5 * ( uintBinning - 1.0 ) * dblSpacing );
+
+        ChangeInformationImageType::Pointer pChangeImageInfoFilter( ChangeInformationImageType::New() );
+        pChangeImageInfoFilter->SetInput( pImage );
+        pChangeImageInfoFilter->SetOutputSpacing( spacing );
+        pChangeImageInfoFilter->ChangeSpacingOn();
+        pChangeImageInfoFilter->SetOutputOrigin( origin );
+        pChangeImageInfoFilter->ChangeOriginOn();
+        pChangeImageInfoFilter->Update();
+
+        return pChangeImageInfoFilter->GetOutput();
+    }
+
+    /** Bins a single frame for a preview run */
+    ImageType::Pointer BinFrame( ImageType::Pointer pFrame, unsigned int uintBinning )
+    {
+        if( uintBinning == 1 )
+            return pFrame;
+
+        BinFrameFilter::Pointer pBinFrameFilter( BinFrameFilter::New() );
+        pBinFrameFilter->SetInput( pFrame );
+        pBinFrameFilter->SetBinningFactor( uintBinning );
+        pBinFrameFilter->Update();
+
+        return pBinFrameFilter->GetOutput();
+    }
+
+    template< typename TImage >
+    double ImageBytes( const TImage * pImage )
+    {
+        return static_cast< double >( pImage->GetBufferedRegion().GetNumberOfPixels() ) * sizeof( typename TImage::PixelType );
+    }
+
+    double ImageBytes( const MaskImageType * pMask )
+    {
+        return static_cast< double >( pMask->GetPixelContainer()->Size() ) * sizeof( MaskImageType::WordType );
+    }
+
+    /** Places a copy of the image in a new shared memory segment, returning
+     * it mapped. The segment is removed at once, the workers forked later
+     * sharing the mapping they inherit, so that none is left behind should
+     * a process die. */
+    template< typename TImage >
+    typename TImage::Pointer ShareImage( const TImage * pImage, const std::string & strName, bool blnWritable = false )
+    {
+        typename itk::SharedMemoryImage< TImage >::Pointer pShared( itk::SharedMemoryImage< TImage >::New() );
+        pShared->SetName( strName );
+        pShared->Create( pImage );
+
+        typename TImage::Pointer pMapped( pShared->Map( blnWritable ) );
+        pShared->Remove();
+
+        return pMapped;
+    }
+
+    /** Runs the filter and charges its time and traffic to the stage. Input
+     * bytes are the passed image bytes, output bytes those of the filter output. */
+    template< typename TFilter >
+    void RunStage( TFilter * pFilter, double dblInputBytes, StageStatistics & stage )
+    {
+        const double dblStart( CSIROTomoBenchmark::Now() );
+        pFilter->Update();
+        stage.dblSeconds += CSIROTomoBenchmark::Now() - dblStart;
+
+        const double dblOutputBytes( ImageBytes( pFilter->GetOutput() ) );
+        stage.dblBytesAllocated += dblOutputBytes;
+        stage.dblBytesMoved += dblInputBytes + dblOutputBytes;
+    }
+
+    /** Runs the filter as planned, streamed in the planned divisions of its
+     * output rows, returning the output */
+    template< typename TFilter >
+    typename TFilter::OutputImageType::Pointer RunPlannedStage( TFilter * pFilter, const MemoryBudgetPlanner::Stage & plan, double dblInputBytes, StageStatistics & stage )
     {
-    public:
-        itkNewMacro( ShowProgress )
+        typedef typename TFilter::OutputImageType OutputImageType;
 
-        void Execute( itk::Object* caller, const itk::EventObject& event ) override
+        if( plan.Divisions < 2 )
         {
-            Execute( dynamic_cast< const itk::Object* >( caller ), event );
+            RunStage( pFilter, dblInputBytes, stage );
+            return pFilter->GetOutput();
         }
 
-        void Execute( const itk::Object* caller, const itk::EventObject& event ) override
+        typename itk::StreamingImageFilter< OutputImageType, OutputImageType >::Pointer pStreamingFilter( itk::StreamingImageFilter< OutputImageType, OutputImageType >::New() );
+        pStreamingFilter->SetInput( pFilter->GetOutput() );
+        pStreamingFilter->SetNumberOfStreamDivisions( plan.Divisions );
+        RunStage( pStreamingFilter.GetPointer(), dblInputBytes, stage );
+
+        return pStreamingFilter->GetOutput();
+    }
+
+    /** Estimates the memory of every stage of the workflow from the geometry
+     * of the frames and plans the stages to the budget of the settings */
+    MemoryBudgetPlanner::Pointer PlanWorkflowMemory( const WorkflowSettings & settings, const ImageType::SizeType & sizeFrame, unsigned int uintNumProjections )
+    {
+        MemoryBudgetPlanner::Pointer pPlanner( MemoryBudgetPlanner::New() );
+        pPlanner->SetBudgetBytes( settings.dblMemoryBudget * 1024.0 * 1024.0 );
+
+        // Frames as binned, placed as by ChangeImageSpacing
+        ImageType::SizeType size;
+        for( unsigned int j = 0; j < 2; j++ )
+            size[j] = sizeFrame[j] / settings.uintBinning;
+
+        ImageType::SpacingType spacing;
+        spacing.Fill( settings.dblSpacing * settings.uintBinning );
+
+        ImageType::PointType origin;
+        origin.Fill( 0.5 * ( settings.uintBinning - 1.0 ) * settings.dblSpacing );
+
+        ImageType::PointType pointTrimMin;
+        pointTrimMin[0] = 0.0;
+        pointTrimMin[1] = settings.dblTrimTop;
+
+        ImageType::PointType pointTrimMax;
+        pointTrimMax[0] = size[0] * spacing[0];
+        pointTrimMax[1] = size[1] * spacing[1] - settings.dblTrimBottom;
+
+        // The stitched geometry from the information of unallocated frames
+        VerticalStitchingImageFilter::Pointer pStitchingInformation( VerticalStitchingImageFilter::New() );
+        pStitchingInformation->SetVerticalShift( settings.dblVerticalShift );
+        pStitchingInformation->SetTrimPointMin( pointTrimMin );
+        pStitchingInformation->SetTrimPointMax( pointTrimMax );
+        for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
         {
-            if ( !itk::ProgressEvent().CheckEvent( &event ) )
-                return;
+            ImageType::Pointer pFrameInformation( ImageType::New() );
+            pFrameInformation->SetRegions( size );
+            pFrameInformation->SetSpacing( spacing );
+            pFrameInformation->SetOrigin( origin );
+            pStitchingInformation->SetInput( uintStackIdx, pFrameInformation );
+        }
+        pStitchingInformation->UpdateOutputInformation();
+
+        const ImageType::SizeType sizeStitched( pStitchingInformation->GetOutput()->GetLargestPossibleRegion().GetSize() );
+        const itk::SizeValueType uintShiftRows( static_cast< itk::SizeValueType >( settings.dblVerticalShift / spacing[1] + 0.5 ) );
+
+        ThresholdedMedianMaskImageFilterType::RadiusType radius;
+        radius.Fill( std::max( ( settings.uintRadius + settings.uintBinning / 2 ) / settings.uintBinning, 1u ) );
+
+        const double dblStitchedBytes( MemoryBudgetPlanner::ImageBytes< ImageType >( sizeStitched ) );
+        const MemoryBudgetPlanner::Step stepFlatStitch( MemoryBudgetPlanner::EstimateVerticalStitching< ImageType >( size, settings.uintNumStacks, sizeStitched, uintShiftRows, true ) );
+
+        pPlanner->AddResident( "dark", MemoryBudgetPlanner::ImageBytes< ImageType >( size ) );
+        pPlanner->AddResident( "stitched_flat", dblStitchedBytes );
+        pPlanner->AddResident( "weights", stepFlatStitch.HeldBytes );
+        if( settings.uintNumEigenFlats > 0 )
+            pPlanner->AddResident( "eigenflats", settings.uintNumStacks * settings.uintNumEigenFlats * dblStitchedBytes );
+        if( settings.blnReconstruct )
+            pPlanner->AddResident( "projection_stack", uintNumProjections * dblStitchedBytes );
+
+        VolumeType::SizeType sizeSeries;
+        sizeSeries[0] = sizeFrame[0];
+        sizeSeries[1] = sizeFrame[1];
 
-            const auto* pProcessObject( dynamic_cast< const itk::ProcessObject* >( caller ) );
+        sizeSeries[2] = settings.uintNumDarks;
+        pPlanner->AddStage( "dark_average", MemoryBudgetPlanner::EstimateBinnedMeanProjection< VolumeType, ImageType >( sizeSeries, settings.uintBinning ) );
 
-            if ( !pProcessObject )
-                return;
+        // Averaged and dark corrected a stack at a time, the eigenflat basis
+        // of the stack held meanwhile
+        sizeSeries[2] = settings.uintNumFlats;
+        MemoryBudgetPlanner::StepsType vecSteps;
+        vecSteps.push_back( MemoryBudgetPlanner::EstimateBinnedMeanProjection< VolumeType, ImageType >( sizeSeries, settings.uintBinning ) );
+        vecSteps.back().Streamable = false; // updated whole to change its spacing
+        vecSteps.push_back( MemoryBudgetPlanner::EstimatePixelwise< ImageType >( "SubtractImageFilter", size, true ) );
+        if( settings.uintNumEigenFlats > 0 )
+            vecSteps.back().HeldBytes = ( settings.uintNumEigenFlats + 1.0 ) * MemoryBudgetPlanner::ImageBytes< ImageType >( size );
+        pPlanner->AddStage( "flat_average", vecSteps );
 
-            std::cout << " " << pProcessObject->GetProgress();
+        pPlanner->AddStage( "flat_stitch", stepFlatStitch );
+
+        // The darks are subtracted from the frames of every stack before stitching
+        vecSteps.clear();
+        vecSteps.push_back( MemoryBudgetPlanner::EstimatePixelwise< ImageType >( "SubtractImageFilter", size, true ) );
+        vecSteps.back().InputBytes *= settings.uintNumStacks;
+        vecSteps.back().OutputBytes *= settings.uintNumStacks;
+        vecSteps.push_back( MemoryBudgetPlanner::EstimateVerticalStitching< ImageType >( size, settings.uintNumStacks, sizeStitched, uintShiftRows, false ) );
+        pPlanner->AddStage( "projection_stitch", vecSteps );
+
+        if( settings.uintNumEigenFlats > 0 )
+            pPlanner->AddStage( "flat_normalise", MemoryBudgetPlanner::EstimateDynamicFlatFieldCorrection< ImageType >( sizeStitched, settings.uintNumStacks * settings.uintNumEigenFlats ) );
+        else
+            pPlanner->AddStage( "flat_normalise", MemoryBudgetPlanner::EstimatePixelwise< ImageType >( "DivideImageFilter", sizeStitched, true ) );
+
+        vecSteps.clear();
+        if( settings.blnDefectMap )
+            vecSteps.push_back( MemoryBudgetPlanner::EstimateDefectMapRepair< ImageType >( sizeStitched ) );
+        else
+        {
+            vecSteps.push_back( MemoryBudgetPlanner::EstimateThresholdedMedianMask< ImageType, MaskImageType >( sizeStitched, radius ) );
+            vecSteps.push_back( MemoryBudgetPlanner::EstimateMaskedMedian< ImageType >( sizeStitched, radius ) );
         }
-    };
-}
+        vecSteps.push_back( MemoryBudgetPlanner::EstimateNegLog< ImageType >( sizeStitched ) );
+        pPlanner->AddStage( "projection_repair", vecSteps );
 
-FileNamesContainer GetRegexFiles( const std::string& strDir, const std::string& strRegex )
-{
-    RegexSeriesFileNames::Pointer pRegexFileNames( RegexSeriesFileNames::New() );
-    pRegexFileNames->SetDirectory( strDir );
-    pRegexFileNames->SetRegularExpression( strRegex );
-    pRegexFileNames->NumericSortOn();
+        if( settings.blnReconstruct )
+        {
+            FilteredBackProjectionFilterType::Pointer pReconstructionFilter( FilteredBackProjectionFilterType::New() );
 
-    return pRegexFileNames->GetFileNames();
-}
+            VolumeType::SizeType sizeStack;
+            sizeStack[0] = sizeStitched[0];
+            sizeStack[1] = sizeStitched[1];
+            sizeStack[2] = uintNumProjections;
 
-FileNamesContainer GetDarkFiles( const std::string& strDir, unsigned int uintStack )
-{
-    std::stringstream ssRegex;
-    ssRegex << "DF_Y" << uintStack << "_[A-Z]+_([0-9]+).tif";
+            // The stack is resident already
+            MemoryBudgetPlanner::Step stepReconstruct( MemoryBudgetPlanner::EstimateFilteredBackProjection< VolumeType, VolumeType >(
+                sizeStack, 0, pReconstructionFilter->GetNumberOfThreads(), pReconstructionFilter->GetSliceBlockSize() ) );
+            stepReconstruct.InputBytes = 0.0;
+            pPlanner->AddStage( "reconstruct", stepReconstruct );
+        }
 
-    return GetRegexFiles( strDir, ssRegex.str() );
-}
+        pPlanner->Plan();
 
-FileNamesContainer GetFlatFiles( const std::string& strDir, unsigned int uintStack )
-{
-    std::stringstream ssRegex;
-    ssRegex << "BG_Y" << uintStack << "_[A-Z]+_([0-9]+).tif";
+        return pPlanner;
+    }
 
-    return GetRegexFiles( strDir, ssRegex.str() );
-}
+    /** Corrects the projections as a detector writes them to strLiveDir, each
+     * stack by its own dark, flat and defect map found in the flat, as the
+     * stacks are not stitched live. Synthetic projections are written there by
+     * a detector thread every dblFrameInterval seconds, under temporary names
+     * renamed once complete; with --input-dir only the darks and flats are read
+     * and the projections awaited from the detector. */
+    int RunLiveWorkflow( const WorkflowSettings & settings, WorkflowSource & source )
+    {
+        using LiveProcessorType = itk::LiveProjectionProcessor< ImageType >;
+        using CountImageType = itk::Image< unsigned short, 2 >;
+        using ClampImageFilterType = itk::ClampImageFilter< ImageType, CountImageType >;
+        using CountWriter = itk::ImageFileWriter< CountImageType >;
 
-FileNamesContainer GetProjectionFiles( const std::string& strDir, unsigned int uintStack )
-{
-    std::stringstream ssRegex;
-    ssRegex << "SAMPLE_Y" << uintStack << "_T[A-Z]+_([0-9]+).tif";
+        const unsigned int uintNumProjections( source.GetNumberOfProjections() );
+        const itk::SizeValueType uintNumFrames( static_cast< itk::SizeValueType >( settings.uintNumStacks ) * uintNumProjections );
+        const bool blnSynthetic( settings.strInputDir.empty() );
 
-    return GetRegexFiles( strDir, ssRegex.str() );
-}
+        LiveProcessorType::Pointer pProcessor( LiveProcessorType::New() );
+        pProcessor->SetDirectory( settings.strLiveDir );
+        pProcessor->SetTargetLatency( settings.dblTargetLatency );
+        pProcessor->SetPreviewShrinkFactor( settings.uintBinning );
 
-VolumeType::Pointer ReadImageSeries( const FileNamesContainer& vecFileNames )
-{
-    ImageSeriesReader::Pointer pSeriesReader( ImageSeriesReader::New() );
-    pSeriesReader->SetFileNames( vecFileNames );
-    pSeriesReader->Update();
-    return pSeriesReader->GetOutput();
-}
+        // Frames arrive in any order, so their checksums are summed
+        std::uint64_t uint64Checksum( 0 );
+        pProcessor->SetFrameCallback( [&]( const LiveProcessorType::Frame &, const ImageType * pProjection )
+        {
+            uint64Checksum += CSIROTomoBenchmark::ComputeChecksum( pProjection, 1.0e-4 );
+        } );
 
-ImageType::Pointer ChangeImageSpacing( ImageType::Pointer pImage, double dblSpacing )
-{
-    ImageType::SpacingType spacing;
-    spacing.Fill( dblSpacing );
+        std::string strDetectorError;
+        LiveProcessorType::Statistics statistics;
+        double dblSeconds( 0.0 );
+
+        try
+        {
+            itksys::SystemTools::MakeDirectory( settings.strLiveDir );
+
+            MeanProjectionImageFilter::Pointer pMeanDarkFilter( MeanProjectionImageFilter::New() );
+            pMeanDarkFilter->SetInput( source.GetDarks() );
+            pMeanDarkFilter->Update();
+            ImageType::Pointer pAverageDark( pMeanDarkFilter->GetOutput() );
+            pProcessor->SetDark( 0, pAverageDark );
+
+            ThresholdedMedianMaskImageFilterType::RadiusType radiusFilter;
+            radiusFilter.Fill( settings.uintRadius );
+
+            for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
+            {
+                MeanProjectionImageFilter::Pointer pMeanFlatFilter( MeanProjectionImageFilter::New() );
+                pMeanFlatFilter->SetInput( source.GetFlats( uintStackIdx ) );
+                pMeanFlatFilter->Update();
+                pProcessor->SetFlat( uintStackIdx, pMeanFlatFilter->GetOutput() );
+
+                SubtractImageFilter::Pointer pSubtractDark( SubtractImageFilter::New() );
+                pSubtractDark->SetInput1( pMeanFlatFilter->GetOutput() );
+                pSubtractDark->SetInput2( pAverageDark );
+
+                ThresholdedMedianMaskImageFilterType::Pointer pFlatMaskFilter( ThresholdedMedianMaskImageFilterType::New() );
+                pFlatMaskFilter->SetInput( pSubtractDark->GetOutput() );
+                pFlatMaskFilter->SetThresholdLower( 0.5 );
+                pFlatMaskFilter->SetThresholdUpper( 1.5 );
+                pFlatMaskFilter->SetRadius( radiusFilter );
+                pFlatMaskFilter->Update();
+
+                DetectorDefectMapType::Pointer pDefectMap( DetectorDefectMapType::New() );
+                pDefectMap->Initialize( pAverageDark->GetLargestPossibleRegion() );
+                pDefectMap->SetRadius( radiusFilter );
+                pDefectMap->AddDefects( pFlatMaskFilter->GetOutput() );
+                pDefectMap->Update();
+                pProcessor->SetDefectMap( uintStackIdx, pDefectMap );
+            }
+
+            // Frames of an earlier run would be taken as written before the start
+            std::vector< std::string > vecNames;
+            for( unsigned int uintProjection = 0; uintProjection < uintNumProjections; uintProjection++ )
+            {
+                for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
+                {
+                    std::ostringstream ossName;
+                    ossName << "SAMPLE_Y" << uintStackIdx << "_TOMO_" << uintProjection << ".tif";
+                    vecNames.push_back( ossName.str() );
+
+                    if( blnSynthetic )
+                        itksys::SystemTools::RemoveFile( settings.strLiveDir + "/" + ossName.str() );
+                }
+            }
+
+            pProcessor->Start();
+
+            std::thread threadDetector;
+            if( blnSynthetic )
+            {
+                threadDetector = std::thread( [&]()
+                {
+                    try
+                    {
+                        for( size_t i = 0; i < vecNames.size(); i++ )
+                        {
+                            std::this_thread::sleep_for( std::chrono::duration< double >( settings.dblFrameInterval ) );
+
+                            // Saturated at the range of the detector
+                            ClampImageFilterType::Pointer pClampFilter( ClampImageFilterType::New() );
+                            pClampFilter->SetInput( source.GetProjection( static_cast< unsigned int >( i % settings.uintNumStacks ),
+                                                                            static_cast< unsigned int >( i / settings.uintNumStacks ) ) );
+
+                            const std::string strFile( settings.strLiveDir + "/" + vecNames[i] );
+                            CountWriter::Pointer pWriter( CountWriter::New() );
+                            pWriter->SetInput( pClampFilter->GetOutput() );
+                            pWriter->SetFileName( settings.strLiveDir + "/tmp_" + vecNames[i] );
+                            pWriter->Update();
 
-    ChangeInformationImageType::Pointer pChangeImageInfoFilter( ChangeInformationImageType::New() );
-    pChangeImageInfoFilter->SetInput( pImage );
-    pChangeImageInfoFilter->SetOutputSpacing( spacing );
-    pChangeImageInfoFilter->ChangeSpacingOn();
-    pChangeImageInfoFilter->Update();
+                            itksys::SystemTools::RenameFile( ( settings.strLiveDir + "/tmp_" + vecNames[i] ).c_str(), strFile.c_str() );
+                        }
+                    }
+                    catch( itk::ExceptionObject & error )
+                    {
+                        strDetectorError = error.GetDescription();
+                    }
+                } );
+            }
 
-    return pChangeImageInfoFilter->GetOutput();
+            const double dblStart( CSIROTomoBenchmark::Now() );
+            pProcessor->Run( uintNumFrames, settings.dblLiveTimeout );
+            dblSeconds = CSIROTomoBenchmark::Now() - dblStart;
+
+            if( threadDetector.joinable() )
+                threadDetector.join();
+
+            pProcessor->Stop();
+            statistics = pProcessor->GetStatistics();
+        }
+        catch( itk::ExceptionObject & error )
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if( !strDetectorError.empty() )
+        {
+            std::cerr << "Error writing the frames: " << strDetectorError << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const std::string strChecksum( CSIROTomoBenchmark::ChecksumToString( uint64Checksum ) );
+
+        WorkflowReport report( settings.strOutputFile );
+        if( !report.IsOpen() )
+        {
+            std::cerr << "Unable to open " << settings.strOutputFile << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::ostream & os( report.GetStream() );
+
+        os << "{\"benchmark\": \"IMBLPreProcLive\", \"stacks\": " << settings.uintNumStacks
+           << ", \"width\": " << settings.uintWidth << ", \"height\": " << settings.uintHeight
+           << ", \"projections\": " << uintNumProjections
+           << ", \"frame_interval_seconds\": " << settings.dblFrameInterval
+           << ", \"target_latency_seconds\": " << settings.dblTargetLatency
+           << ", \"notified\": " << ( pProcessor->GetNotified() ? "true" : "false" )
+           << ", \"seconds\": " << dblSeconds
+           << ", \"frames_detected\": " << statistics.FramesDetected
+           << ", \"frames_processed\": " << statistics.FramesProcessed
+           << ", \"frames_failed\": " << statistics.FramesFailed
+           << ", \"frames_over_target\": " << statistics.FramesOverTarget
+           << ", \"mean_latency_seconds\": " << statistics.MeanLatency
+           << ", \"max_latency_seconds\": " << statistics.MaximumLatency
+           << ", \"mean_processing_seconds\": " << statistics.MeanProcessingSeconds
+           << ", \"max_backlog\": " << statistics.MaximumBacklog
+           << ", \"arrivals_per_second\": " << statistics.ArrivalsPerSecond
+           << ", \"processed_per_second\": " << statistics.ProcessedPerSecond
+           << ", \"peak_rss_bytes\": " << CSIROTomoBenchmark::GetPeakRSSBytes()
+           << ", \"buffer_pool_allocations\": " << pProcessor->GetBufferPool()->GetNumberOfAllocations()
+           << ", \"buffer_pool_reuses\": " << pProcessor->GetBufferPool()->GetNumberOfReuses();
+        report.WriteChecksum( strChecksum );
+
+        std::cout << "Processed " << statistics.FramesProcessed << " of " << uintNumFrames << " frames, mean latency "
+                  << statistics.MeanLatency << " s, maximum " << statistics.MaximumLatency << " s" << std::endl;
+
+        if( blnSynthetic && statistics.FramesProcessed != uintNumFrames )
+        {
+            std::cerr << "Frames were missed or failed: " << pProcessor->GetLastError() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return IMBLPreProcWorkflow::CheckGolden( settings, strChecksum );
+    }
 }
 
 int IMBLPreProcWorkflowTest( int argc, char * argv[] )
 {
-    if( argc < 1 )
+    WorkflowSettings settings;
+    if( !ParseArguments( argc, argv, settings ) )
+        return EXIT_FAILURE;
+
+    if( settings.uintNumStacks < 2 )
     {
-        std::cerr << "Usage: " << argv[0];
-        std::cerr << std::endl;
+        std::cerr << "At least two stacks are required for stitching" << std::endl;
         return EXIT_FAILURE;
     }
 
-#ifdef LOCAL_TEST
-    const unsigned int uintNumStacks( 4 );
-    const double dblSpacing( 0.1 );
-    const double dblVerticalShift( 15.7 );
+    if( settings.dblVerticalShift <= 0.0 )
+        settings.dblVerticalShift = ( settings.uintHeight - settings.uintHeight / 4 ) * settings.dblSpacing;
+
+    std::unique_ptr< WorkflowSource > pSource;
+    if( settings.strInputDir.empty() )
+        pSource.reset( new SyntheticWorkflowSource( settings ) );
+    else
+        pSource.reset( new FileWorkflowSource( settings ) );
+
+    // Live, each frame is corrected as it is written rather than the scan as a whole
+    if( !settings.strLiveDir.empty() )
+        return RunLiveWorkflow( settings, *pSource );
+
+    std::vector< StageStatistics > vecStages;
+    vecStages.push_back( StageStatistics( "dark_average" ) );
+    vecStages.push_back( StageStatistics( "flat_average" ) );
+    vecStages.push_back( StageStatistics( "flat_stitch" ) );
+    vecStages.push_back( StageStatistics( "projection_stitch" ) );
+    vecStages.push_back( StageStatistics( "flat_normalise" ) );
+    vecStages.push_back( StageStatistics( "defect_mask" ) );
+    vecStages.push_back( StageStatistics( "masked_median" ) );
+    vecStages.push_back( StageStatistics( "neglog" ) );
+    if( settings.blnReconstruct )
+        vecStages.push_back( StageStatistics( "reconstruct" ) );
+
+    StageStatistics & stageDark( vecStages[0] );
+    StageStatistics & stageFlatAverage( vecStages[1] );
+    StageStatistics & stageFlatStitch( vecStages[2] );
+    StageStatistics & stageProjectionStitch( vecStages[3] );
+    StageStatistics & stageNormalise( vecStages[4] );
+    StageStatistics & stageMask( vecStages[5] );
+    StageStatistics & stageMaskedMedian( vecStages[6] );
+    StageStatistics & stageNegLog( vecStages[7] );
+
+    std::uint64_t uint64Checksum( 0xcbf29ce484222325ull );
+
+    // Projection preprocessing in worker processes, timed per shard
+    itk::ShardedProcessRunner::ShardResultsType vecShardResults;
+    double dblShardedSeconds( 0.0 );
+
+    // Results of stages whose inputs and parameters are unchanged since a
+    // previous run are loaded from the cache directory instead of recomputed
+    itk::ProcessingCache::Pointer pCache( itk::ProcessingCache::New() );
+    pCache->SetDirectory( settings.strCacheDir );
 
-    std::string strInputDir( "/mnt/csiro/civ/archive/IMBL/13393a/input/4704628_60keV_6m_2mGy" );
+    // Per-projection filters draw their images from a shared pool, so that
+    // after the first projection they allocate nothing
+    itk::ImageBufferPool::Pointer pBufferPool( itk::ImageBufferPool::New() );
+    pBufferPool->SetUseHugePages( settings.blnHugePages );
+
+    // Stages are planned to the memory budget before any is run
+    MemoryBudgetPlanner::Pointer pPlanner;
 
     try
     {
+        pPlanner = PlanWorkflowMemory( settings, pSource->GetFrameSize(), pSource->GetNumberOfProjections() );
+        pPlanner->Report( std::cout );
+        if( !pPlanner->GetWithinBudget() )
+            std::cout << "Warning: the memory budget cannot be met, stages over budget run at their smallest peak" << std::endl;
+
+        for( size_t i = 0; i < settings.vecExpectStreamed.size(); i++ )
+        {
+            if( pPlanner->GetStage( settings.vecExpectStreamed[i] ).Divisions < 2 )
+            {
+                std::cerr << "The stage " << settings.vecExpectStreamed[i] << " is not streamed to the budget" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        const MemoryBudgetPlanner::Stage & planDark( pPlanner->GetStage( "dark_average" ) );
+        const MemoryBudgetPlanner::Stage & planFlatAverage( pPlanner->GetStage( "flat_average" ) );
+        const MemoryBudgetPlanner::Stage & planProjectionStitch( pPlanner->GetStage( "projection_stitch" ) );
+        const MemoryBudgetPlanner::Stage & planNormalise( pPlanner->GetStage( "flat_normalise" ) );
+        const MemoryBudgetPlanner::Stage & planRepair( pPlanner->GetStage( "projection_repair" ) );
+
         // Create averaged dark image from the first set of dark files
-        MeanProjectionImageFilter::Pointer pMeanProjectionImageFilter( MeanProjectionImageFilter::New() );
-        pMeanProjectionImageFilter->SetInput( ReadImageSeries( GetDarkFiles( strInputDir, 0 ) ) );
+        CacheKey keyDark( "dark_average" );
+        pSource->AddDarksToKey( keyDark );
+        keyDark.Add( "spacing", settings.dblSpacing );
+        if( settings.uintBinning > 1 )
+            keyDark.Add( "binning", settings.uintBinning );
 
-        ImageType::Pointer pAverageDark( ChangeImageSpacing( pMeanProjectionImageFilter->GetOutput(), dblSpacing ) );
-        ImageType::RegionType regionRawImage( pAverageDark->GetLargestPossibleRegion() );
+        ImageType::Pointer pAverageDark( pCache->Load< ImageType >( keyDark ) );
+        if( pAverageDark )
+            stageDark.uintCacheHits++;
+        else
+        {
+            VolumeType::Pointer pDarks( pSource->GetDarks() );
 
-        // Create a vector af averaged flats for each stack
-        std::vector<ImageType::Pointer> vecFlats;
+            MeanProjectionImageFilter::Pointer pMeanProjectionImageFilter( MeanProjectionImageFilter::New() );
+            pMeanProjectionImageFilter->SetInput( pDarks );
+            pMeanProjectionImageFilter->SetBinningFactor( settings.uintBinning );
+            pAverageDark = ChangeImageSpacing( RunPlannedStage( pMeanProjectionImageFilter.GetPointer(), planDark, ImageBytes( pDarks.GetPointer() ), stageDark ),
+                                               settings.dblSpacing, settings.uintBinning );
+            pCache->Store( keyDark, pAverageDark.GetPointer() );
+        }
 
-        // Stitch averaged flats, computing weigting matrices
-        VerticalStitchingImageFilter::Pointer pVerticalStitchingImageFilter( VerticalStitchingImageFilter::New() );
-        pVerticalStitchingImageFilter->SetVerticalShift( dblVerticalShift );
+        ImageType::RegionType regionRawImage( pAverageDark->GetLargestPossibleRegion() );
 
         ImageType::PointType pointTrimMin;
         pointTrimMin[0] = 0.0;
-        pointTrimMin[1] = 0.2;
-
-        pVerticalStitchingImageFilter->SetTrimPointMin( pointTrimMin );
+        pointTrimMin[1] = settings.dblTrimTop;
 
         ImageType::PointType pointTrimMax;
-        pointTrimMax[0] = static_cast<double>( regionRawImage.GetSize( 0 ) ) * dblSpacing;
-        pointTrimMax[1] = ( static_cast<double>( regionRawImage.GetSize( 1 ) ) * dblSpacing ) - 1.1;
+        pointTrimMax[0] = static_cast<double>( regionRawImage.GetSize( 0 ) ) * pAverageDark->GetSpacing()[0];
+        pointTrimMax[1] = ( static_cast<double>( regionRawImage.GetSize( 1 ) ) * pAverageDark->GetSpacing()[1] ) - settings.dblTrimBottom;
 
-        pVerticalStitchingImageFilter->SetTrimPointMax( pointTrimMax );
+        // The stitch depends on the dark corrected average flat of every stack
+        std::vector< CacheKey > vecFlatKeys;
+        CacheKey keyStitch( "flat_stitch" );
 
-        // create average flats for each stack, adding the result to a vector
-        for( unsigned int uintStackIdx = 0; uintStackIdx < uintNumStacks; uintStackIdx++ )
+        for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
         {
-            MeanProjectionImageFilter::Pointer pMeanProjectionImageFilter( MeanProjectionImageFilter::New() );
-            pMeanProjectionImageFilter->SetInput( ReadImageSeries( GetFlatFiles( strInputDir, uintStackIdx ) ) );
+            vecFlatKeys.push_back( CacheKey( "flat_average" ) );
+            vecFlatKeys.back().AddKey( "dark", keyDark );
+            vecFlatKeys.back().Add( "spacing", settings.dblSpacing );
+            pSource->AddFlatsToKey( vecFlatKeys.back(), uintStackIdx );
+
+            keyStitch.AddKey( "flat", vecFlatKeys.back() );
+        }
 
-            pVerticalStitchingImageFilter->SetInput( uintStackIdx, ChangeImageSpacing( pMeanProjectionImageFilter->GetOutput(), dblSpacing ) );
+        keyStitch.Add( "vertical_shift", settings.dblVerticalShift );
+        keyStitch.Add( "trim_min", pointTrimMin );
+        keyStitch.Add( "trim_max", pointTrimMax );
 
-            //vecFlats.push_back( ChangeImageSpacing( pMeanProjectionImageFilter->GetOutput(), dblSpacing ) );
+        ImageType::Pointer pStitchedFlat( pCache->Load< ImageType >( keyStitch ) );
+        WeightingImageType::Pointer pWeightingAlpha;
+        WeightingImageType::Pointer pWeightingBeta;
+        if( pStitchedFlat )
+        {
+            pWeightingAlpha = pCache->Load< WeightingImageType >( keyStitch, "_alpha" );
+            pWeightingBeta = pCache->Load< WeightingImageType >( keyStitch, "_beta" );
         }
 
-        pVerticalStitchingImageFilter->Update();
-        ImageType::Pointer pStitchedFlat( pVerticalStitchingImageFilter->GetOutput() );
+        if( pStitchedFlat && pWeightingAlpha && pWeightingBeta )
+            stageFlatStitch.uintCacheHits++;
+        else
+        {
+            // Stitch averaged flats, computing weigting matrices
+            VerticalStitchingImageFilter::Pointer pVerticalStitchingImageFilter( VerticalStitchingImageFilter::New() );
+            pVerticalStitchingImageFilter->SetVerticalShift( settings.dblVerticalShift );
+            pVerticalStitchingImageFilter->SetTrimPointMin( pointTrimMin );
+            pVerticalStitchingImageFilter->SetTrimPointMax( pointTrimMax );
 
-        ImageWriter::Pointer pImageWriter( ImageWriter::New() );
-        pImageWriter->SetInput( pStitchedFlat );
-        pImageWriter->SetFileName( "workflow_stitched_flat.mhd" );
-        pImageWriter->Update();
+            // Create dark corrected average flats for each stack
+            double dblStitchInputBytes( 0.0 );
+            for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
+            {
+                ImageType::Pointer pAverageFlat( pCache->Load< ImageType >( vecFlatKeys[uintStackIdx] ) );
+                if( pAverageFlat )
+                    stageFlatAverage.uintCacheHits++;
+                else
+                {
+                    VolumeType::Pointer pFlats( pSource->GetFlats( uintStackIdx ) );
 
-    }
-    catch( itk::ExceptionObject & error )
-    {
-        std::cerr << "Error: " << error << std::endl;
-        return EXIT_FAILURE;
-    }
+                    MeanProjectionImageFilter::Pointer pMeanFlatFilter( MeanProjectionImageFilter::New() );
+                    pMeanFlatFilter->SetInput( pFlats );
+                    pMeanFlatFilter->SetBinningFactor( settings.uintBinning );
+                    RunStage( pMeanFlatFilter.GetPointer(), ImageBytes( pFlats.GetPointer() ), stageFlatAverage );
 
-#ifdef TEMP_REMOVED
-    itk::ImageFileReader< ImageType >::Pointer pImageFileReader( itk::ImageFileReader< ImageType >::New() );
-    pImageFileReader->SetFileName( "stitched.mhd" );
-    pImageFileReader->Update();
-    ImageType::Pointer pImage( pImageFileReader->GetOutput() );
+                    SubtractImageFilter::Pointer pSubtractDark( SubtractImageFilter::New() );
+                    pSubtractDark->SetInput1( ChangeImageSpacing( pMeanFlatFilter->GetOutput(), settings.dblSpacing, settings.uintBinning ) );
+                    pSubtractDark->SetInput2( pAverageDark );
+                    if( planFlatAverage.InPlace )
+                        pSubtractDark->InPlaceOn();
+                    RunStage( pSubtractDark.GetPointer(), 2.0 * ImageBytes( pAverageDark.GetPointer() ), stageFlatAverage );
 
-    using ThresholdedMedianMaskImageFilterType = itk::ThresholdedMedianMaskImageFilter< ImageType, MaskImageType >;
-    ThresholdedMedianMaskImageFilterType::Pointer pThresholdedMedianMaskImageFilter( ThresholdedMedianMaskImageFilterType::New() );
-    pThresholdedMedianMaskImageFilter->SetInput( pImage );
-    pThresholdedMedianMaskImageFilter->SetThresholdLower( 0.5 );
-    pThresholdedMedianMaskImageFilter->SetThresholdUpper( 1.5 );
+                    pAverageFlat = pSubtractDark->GetOutput();
+                    pCache->Store( vecFlatKeys[uintStackIdx], pAverageFlat.GetPointer() );
+                }
 
-    ThresholdedMedianMaskImageFilterType::RadiusType radiusFilter;
-    radiusFilter.Fill( 3 );
-    pThresholdedMedianMaskImageFilter->SetRadius( radiusFilter );
-    pThresholdedMedianMaskImageFilter->Update();
-    MaskImageType::ConstPointer pMask( pThresholdedMedianMaskImageFilter->GetOutput() );
+                pVerticalStitchingImageFilter->SetInput( uintStackIdx, pAverageFlat );
+                dblStitchInputBytes += ImageBytes( pAverageDark.GetPointer() );
+            }
 
-    MaskImageWriter::Pointer pMaskImageFileWriter( MaskImageWriter::New() );
-    pMaskImageFileWriter->SetInput( pMask );
-    pMaskImageFileWriter->SetFileName( "mask.mhd" );
-    pMaskImageFileWriter->Update();
+            RunStage( pVerticalStitchingImageFilter.GetPointer(), dblStitchInputBytes, stageFlatStitch );
+            pStitchedFlat = pVerticalStitchingImageFilter->GetOutput();
+            pWeightingAlpha = pVerticalStitchingImageFilter->GetWeightingAlpha();
+            pWeightingBeta = pVerticalStitchingImageFilter->GetWeightingBeta();
 
-    using MaskedMedianImageFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, MaskImageType >;
-    MaskedMedianImageFilterType::Pointer pMaskedMedianImageFilter( MaskedMedianImageFilterType::New() );
+            pCache->Store( keyStitch, pStitchedFlat.GetPointer() );
+            pCache->Store( keyStitch, pWeightingAlpha.GetPointer(), "_alpha" );
+            pCache->Store( keyStitch, pWeightingBeta.GetPointer(), "_beta" );
+        }
 
-    EXERCISE_BASIC_OBJECT_METHODS( pMaskedMedianImageFilter, MaskedMedianImageFilter, BoxImageFilter );
+        // Projections are stitched with the weights computed from the flats
+        VerticalStitchingImageFilter::Pointer pProjectionStitchingFilter( VerticalStitchingImageFilter::New() );
+        pProjectionStitchingFilter->SetVerticalShift( settings.dblVerticalShift );
+        pProjectionStitchingFilter->SetTrimPointMin( pointTrimMin );
+        pProjectionStitchingFilter->SetTrimPointMax( pointTrimMax );
+        pProjectionStitchingFilter->ComputeWeightingOff();
+        pProjectionStitchingFilter->SetWeightingAlpha( pWeightingAlpha );
+        pProjectionStitchingFilter->SetWeightingBeta( pWeightingBeta );
+        pProjectionStitchingFilter->SetBufferPool( pBufferPool );
 
-    ShowProgress::Pointer pShowProgress( ShowProgress::New() );
-    pMaskedMedianImageFilter->AddObserver( itk::ProgressEvent(), pShowProgress );
-    pMaskedMedianImageFilter->SetInput( pImage );
-    pMaskedMedianImageFilter->SetMaskImage( pMask );
-    pMaskedMedianImageFilter->SetRadius( radiusFilter );
+        // Eigenflats of the flat series of each stack, stitched alike the
+        // average flats with every other stack zero, model the drift of the
+        // beam behind each projection
+        std::vector< ImageType::Pointer > vecStitchedEigenFlats;
+        if( settings.uintNumEigenFlats > 0 )
+        {
+            VerticalStitchingImageFilter::Pointer pEigenFlatStitchingFilter( VerticalStitchingImageFilter::New() );
+            pEigenFlatStitchingFilter->SetVerticalShift( settings.dblVerticalShift );
+            pEigenFlatStitchingFilter->SetTrimPointMin( pointTrimMin );
+            pEigenFlatStitchingFilter->SetTrimPointMax( pointTrimMax );
+            pEigenFlatStitchingFilter->ComputeWeightingOff();
+            pEigenFlatStitchingFilter->SetWeightingAlpha( pWeightingAlpha );
+            pEigenFlatStitchingFilter->SetWeightingBeta( pWeightingBeta );
 
-    try
-    {
-        pMaskedMedianImageFilter->Update();
+            ImageType::Pointer pZero( ImageType::New() );
+            pZero->CopyInformation( pAverageDark );
+            pZero->SetRegions( regionRawImage );
+            pZero->Allocate();
+            pZero->FillBuffer( 0.0f );
+
+            for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
+            {
+                VolumeType::Pointer pFlats( pSource->GetFlats( uintStackIdx ) );
+
+                MeanProjectionImageFilter::Pointer pMeanFlatFilter( MeanProjectionImageFilter::New() );
+                pMeanFlatFilter->SetInput( pFlats );
+                pMeanFlatFilter->SetBinningFactor( settings.uintBinning );
+                RunStage( pMeanFlatFilter.GetPointer(), ImageBytes( pFlats.GetPointer() ), stageFlatAverage );
+
+                SubtractImageFilter::Pointer pSubtractDark( SubtractImageFilter::New() );
+                pSubtractDark->SetInput1( ChangeImageSpacing( pMeanFlatFilter->GetOutput(), settings.dblSpacing, settings.uintBinning ) );
+                pSubtractDark->SetInput2( pAverageDark );
+                RunStage( pSubtractDark.GetPointer(), 2.0 * ImageBytes( pAverageDark.GetPointer() ), stageFlatAverage );
+
+                EigenFlatCalculatorType::Pointer pEigenFlatCalculator( EigenFlatCalculatorType::New() );
+                pEigenFlatCalculator->SetNumberOfEigenFlats( settings.uintNumEigenFlats );
+                pEigenFlatCalculator->SetMeanFlat( pSubtractDark->GetOutput() );
+
+                // Dark corrected and added a frame at a time, so that no
+                // corrected copy of the series is held
+                const double dblStart( CSIROTomoBenchmark::Now() );
+
+                VolumeType::RegionType regionFrame( pFlats->GetLargestPossibleRegion() );
+                const itk::IndexValueType intFirstFrame( regionFrame.GetIndex( 2 ) );
+                const itk::SizeValueType uintNumFrames( regionFrame.GetSize( 2 ) );
+                regionFrame.SetSize( 2, 0 );
+
+                for( itk::SizeValueType f = 0; f < uintNumFrames; f++ )
+                {
+                    regionFrame.SetIndex( 2, intFirstFrame + static_cast< itk::IndexValueType >( f ) );
+
+                    ExtractFrameFilter::Pointer pExtractFrame( ExtractFrameFilter::New() );
+                    pExtractFrame->SetInput( pFlats );
+                    pExtractFrame->SetExtractionRegion( regionFrame );
+                    pExtractFrame->SetDirectionCollapseToSubmatrix();
+
+                    SubtractImageFilter::Pointer pSubtractFrameDark( SubtractImageFilter::New() );
+                    pSubtractFrameDark->SetInput1( ChangeImageSpacing( BinFrame( pExtractFrame->GetOutput(), settings.uintBinning ), settings.dblSpacing, settings.uintBinning ) );
+                    pSubtractFrameDark->SetInput2( pAverageDark );
+                    pSubtractFrameDark->Update();
+
+                    pEigenFlatCalculator->AddFlat( pSubtractFrameDark->GetOutput() );
+                }
+
+                stageFlatAverage.dblSeconds += CSIROTomoBenchmark::Now() - dblStart;
+                stageFlatAverage.dblBytesMoved += ImageBytes( pFlats.GetPointer() );
+
+                for( unsigned int k = 0; k < pEigenFlatCalculator->GetNumberOfComputedEigenFlats(); k++ )
+                {
+                    for( unsigned int j = 0; j < settings.uintNumStacks; j++ )
+                        pEigenFlatStitchingFilter->SetInput( j, pZero );
+                    pEigenFlatStitchingFilter->SetInput( uintStackIdx, pEigenFlatCalculator->GetEigenFlat( k ) );
+
+                    RunStage( pEigenFlatStitchingFilter.GetPointer(), settings.uintNumStacks * ImageBytes( pAverageDark.GetPointer() ), stageFlatStitch );
+
+                    vecStitchedEigenFlats.push_back( pEigenFlatStitchingFilter->GetOutput() );
+                    vecStitchedEigenFlats.back()->DisconnectPipeline();
+                }
+            }
+        }
+
+        // The eigenflat weights of each projection are fitted over the columns
+        // left of the phantom
+        ImageType::RegionType regionFit( pStitchedFlat->GetLargestPossibleRegion() );
+        regionFit.SetSize( 0, regionFit.GetSize( 0 ) / 8 );
+
+        ThresholdedMedianMaskImageFilterType::RadiusType radiusFilter;
+        radiusFilter.Fill( std::max( ( settings.uintRadius + settings.uintBinning / 2 ) / settings.uintBinning, 1u ) );
+
+        const double dblThresholdLower( 0.5 );
+        const double dblThresholdUpper( 1.5 );
+
+        // Static defects are found once, as the pixels of the flat departing
+        // from its local median, rather than in every projection. Zingers,
+        // which differ between projections, are then left unrepaired.
+        DetectorDefectMapType::Pointer pDefectMap;
+        if( settings.blnDefectMap )
+        {
+            ThresholdedMedianMaskImageFilterType::Pointer pFlatMaskFilter( ThresholdedMedianMaskImageFilterType::New() );
+            pFlatMaskFilter->SetInput( pStitchedFlat );
+            pFlatMaskFilter->SetThresholdLower( dblThresholdLower );
+            pFlatMaskFilter->SetThresholdUpper( dblThresholdUpper );
+            pFlatMaskFilter->SetRadius( radiusFilter );
+            RunStage( pFlatMaskFilter.GetPointer(), ImageBytes( pStitchedFlat.GetPointer() ), stageMask );
+
+            const double dblStart( CSIROTomoBenchmark::Now() );
+            pDefectMap = DetectorDefectMapType::New();
+            pDefectMap->Initialize( pStitchedFlat->GetLargestPossibleRegion() );
+            pDefectMap->SetRadius( radiusFilter );
+            pDefectMap->AddDefects( pFlatMaskFilter->GetOutput() );
+            pDefectMap->Update();
+            stageMask.dblSeconds += CSIROTomoBenchmark::Now() - dblStart;
+        }
+
+        const unsigned int uintNumProjections( pSource->GetNumberOfProjections() );
+
+        // Preprocessed projections are gathered in memory for the reconstruction
+        VolumeType::Pointer pProjectionStack;
+        if( settings.blnReconstruct )
+        {
+            VolumeType::SizeType sizeStack;
+            sizeStack[0] = pStitchedFlat->GetLargestPossibleRegion().GetSize( 0 );
+            sizeStack[1] = pStitchedFlat->GetLargestPossibleRegion().GetSize( 1 );
+            sizeStack[2] = uintNumProjections;
+
+            VolumeType::SpacingType spacingStack;
+            spacingStack[0] = pStitchedFlat->GetSpacing()[0];
+            spacingStack[1] = pStitchedFlat->GetSpacing()[1];
+            spacingStack[2] = 1.0;
+
+            pProjectionStack = VolumeType::New();
+            pProjectionStack->SetRegions( sizeStack );
+            pProjectionStack->SetSpacing( spacingStack );
+            pProjectionStack->Allocate();
+        }
+
+        CacheKey keyReconstruct( "reconstruct" );
+        keyReconstruct.Add( "center_of_rotation_offset", settings.dblCenterOfRotationOffset );
 
-        ImageWriter::Pointer pImageFileWriter( ImageWriter::New() );
-        pImageFileWriter->SetInput( pMaskedMedianImageFilter->GetOutput() );
-        pImageFileWriter->SetFileName( "median_masked.mhd" );
-        pImageFileWriter->Update();
+        // Only projections whose frames, flats or parameters changed are reprocessed
+        auto CreateProjectionKey = [&]( unsigned int uintProjection )
+        {
+            CacheKey keyProjection( "projection" );
+            keyProjection.AddKey( "dark", keyDark );
+            keyProjection.AddKey( "flat_stitch", keyStitch );
+            for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
+                pSource->AddProjectionToKey( keyProjection, uintStackIdx, uintProjection );
+            keyProjection.Add( "spacing", settings.dblSpacing );
+            if( settings.uintNumEigenFlats > 0 )
+                keyProjection.Add( "eigenflats", settings.uintNumEigenFlats );
+            keyProjection.Add( "radius", radiusFilter );
+            keyProjection.Add( "threshold_lower", dblThresholdLower );
+            keyProjection.Add( "threshold_upper", dblThresholdUpper );
+            if( settings.blnDefectMap )
+                keyProjection.Add( "defect_map", 1 );
+
+            return keyProjection;
+        };
+
+        // Preprocesses a projection, or loads it from the cache
+        auto ProcessProjection = [&]( unsigned int uintProjection, const CacheKey & keyProjection ) -> ImageType::Pointer
+        {
+            ImageType::Pointer pProjection( pCache->Load< ImageType >( keyProjection ) );
+            if( pProjection )
+            {
+                stageProjectionStitch.uintCacheHits++;
+                stageNormalise.uintCacheHits++;
+                stageMask.uintCacheHits++;
+                stageMaskedMedian.uintCacheHits++;
+                stageNegLog.uintCacheHits++;
+            }
+            else
+            {
+                // Frame acquisition (synthesis or file read) is not charged to any stage
+                std::vector< ImageType::Pointer > vecFrames;
+                for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
+                    vecFrames.push_back( ChangeImageSpacing( BinFrame( pSource->GetProjection( uintStackIdx, uintProjection ), settings.uintBinning ),
+                                                           settings.dblSpacing, settings.uintBinning ) );
+
+                for( unsigned int uintStackIdx = 0; uintStackIdx < settings.uintNumStacks; uintStackIdx++ )
+                {
+                    SubtractImageFilter::Pointer pSubtractDark( SubtractImageFilter::New() );
+                    pSubtractDark->SetInput1( vecFrames[uintStackIdx] );
+                    pSubtractDark->SetInput2( pAverageDark );
+                    if( planProjectionStitch.InPlace )
+                        pSubtractDark->InPlaceOn();
+
+                    // Streamed, the darks are subtracted piece by piece with
+                    // the stitching, which is charged for the chain
+                    if( planProjectionStitch.Divisions < 2 )
+                        RunStage( pSubtractDark.GetPointer(), 2.0 * ImageBytes( pAverageDark.GetPointer() ), stageProjectionStitch );
+
+                    pProjectionStitchingFilter->SetInput( uintStackIdx, pSubtractDark->GetOutput() );
+                }
+
+                ImageType::Pointer pStitched( RunPlannedStage( pProjectionStitchingFilter.GetPointer(), planProjectionStitch,
+                                                               settings.uintNumStacks * ImageBytes( pAverageDark.GetPointer() ), stageProjectionStitch ) );
+
+                ImageType::Pointer pNormalised;
+                if( vecStitchedEigenFlats.empty() )
+                {
+                    DivideImageFilter::Pointer pDivideFilter( DivideImageFilter::New() );
+                    pDivideFilter->SetInput1( pStitched );
+                    pDivideFilter->SetInput2( pStitchedFlat );
+                    if( planNormalise.InPlace )
+                        pDivideFilter->InPlaceOn();
+                    pNormalised = RunPlannedStage( pDivideFilter.GetPointer(), planNormalise, 2.0 * ImageBytes( pStitchedFlat.GetPointer() ), stageNormalise );
+                }
+                else
+                {
+                    DynamicFlatFieldCorrectionImageFilterType::Pointer pDynamicFlatFieldFilter( DynamicFlatFieldCorrectionImageFilterType::New() );
+                    pDynamicFlatFieldFilter->SetInput( pStitched );
+                    pDynamicFlatFieldFilter->SetMeanFlat( pStitchedFlat );
+                    for( unsigned int k = 0; k < vecStitchedEigenFlats.size(); k++ )
+                        pDynamicFlatFieldFilter->SetEigenFlat( k, vecStitchedEigenFlats[k] );
+                    pDynamicFlatFieldFilter->SetFitRegion( regionFit );
+                    pNormalised = RunPlannedStage( pDynamicFlatFieldFilter.GetPointer(), planNormalise,
+                                                   ( 2.0 + vecStitchedEigenFlats.size() ) * ImageBytes( pStitchedFlat.GetPointer() ), stageNormalise );
+                }
+
+                // Repaired in place from the stencils of the defect map, or
+                // from a mask of the defects and zingers of this projection.
+                // Streamed, the mask and masked median are updated piece by
+                // piece with the NegLog, which is charged for the chain.
+                ImageType::Pointer pRepaired;
+                if( pDefectMap )
+                {
+                    DefectMapRepairImageFilterType::Pointer pDefectMapRepairFilter( DefectMapRepairImageFilterType::New() );
+                    pDefectMapRepairFilter->SetInput( pNormalised );
+                    pDefectMapRepairFilter->SetDefectMap( pDefectMap );
+                    RunStage( pDefectMapRepairFilter.GetPointer(), ImageBytes( pStitchedFlat.GetPointer() ), stageMaskedMedian );
+
+                    pRepaired = pDefectMapRepairFilter->GetOutput();
+                }
+                else
+                {
+                    ThresholdedMedianMaskImageFilterType::Pointer pThresholdedMedianMaskImageFilter( ThresholdedMedianMaskImageFilterType::New() );
+                    pThresholdedMedianMaskImageFilter->SetInput( pNormalised );
+                    pThresholdedMedianMaskImageFilter->SetThresholdLower( dblThresholdLower );
+                    pThresholdedMedianMaskImageFilter->SetThresholdUpper( dblThresholdUpper );
+                    pThresholdedMedianMaskImageFilter->SetRadius( radiusFilter );
+                    pThresholdedMedianMaskImageFilter->SetBufferPool( pBufferPool );
+                    if( planRepair.Divisions < 2 )
+                        RunStage( pThresholdedMedianMaskImageFilter.GetPointer(), ImageBytes( pStitchedFlat.GetPointer() ), stageMask );
+
+                    MaskedMedianImageFilterType::Pointer pMaskedMedianImageFilter( MaskedMedianImageFilterType::New() );
+                    pMaskedMedianImageFilter->SetInput( pNormalised );
+                    pMaskedMedianImageFilter->SetMaskImage( pThresholdedMedianMaskImageFilter->GetOutput() );
+                    pMaskedMedianImageFilter->SetRadius( radiusFilter );
+                    if( planRepair.Divisions < 2 )
+                        RunStage( pMaskedMedianImageFilter.GetPointer(),
+                                  ImageBytes( pStitchedFlat.GetPointer() ) + ImageBytes( pThresholdedMedianMaskImageFilter->GetOutput() ), stageMaskedMedian );
+
+                    pRepaired = pMaskedMedianImageFilter->GetOutput();
+                }
+
+                NegLogCheckedImageFilterType::Pointer pNegLogFilter( NegLogCheckedImageFilterType::New() );
+                pNegLogFilter->SetInput( pRepaired );
+                pNegLogFilter->SetBufferPool( pBufferPool );
+                pProjection = RunPlannedStage( pNegLogFilter.GetPointer(), planRepair, ImageBytes( pStitchedFlat.GetPointer() ), stageNegLog );
+                pCache->Store( keyProjection, pProjection.GetPointer() );
+            }
+
+            return pProjection;
+        };
+
+        // With shards, worker processes preprocess their projections into a
+        // stack in shared memory, mapping the dark, flats and weights placed
+        // there once rather than each holding a copy. The stage statistics of
+        // the projections stay with the workers, which are timed as a whole.
+        VolumeType::Pointer pShardedProjections;
+        if( settings.uintNumShards > 1 )
+        {
+            std::ostringstream ossPrefix;
+            ossPrefix << "/CSIROTomoWorkflow" << getpid();
+
+            // This process releases its copies for the shared ones, whose
+            // mappings the workers inherit
+            pAverageDark = ShareImage( pAverageDark.GetPointer(), ossPrefix.str() + "_dark" );
+            pStitchedFlat = ShareImage( pStitchedFlat.GetPointer(), ossPrefix.str() + "_flat" );
+            pWeightingAlpha = ShareImage( pWeightingAlpha.GetPointer(), ossPrefix.str() + "_alpha" );
+            pWeightingBeta = ShareImage( pWeightingBeta.GetPointer(), ossPrefix.str() + "_beta" );
+            pProjectionStitchingFilter->SetWeightingAlpha( pWeightingAlpha );
+            pProjectionStitchingFilter->SetWeightingBeta( pWeightingBeta );
+
+            for( unsigned int k = 0; k < vecStitchedEigenFlats.size(); k++ )
+            {
+                std::ostringstream ossName;
+                ossName << ossPrefix.str() << "_eigenflat" << k;
+                vecStitchedEigenFlats[k] = ShareImage( vecStitchedEigenFlats[k].GetPointer(), ossName.str() );
+            }
+
+            VolumeType::SizeType sizeStack;
+            sizeStack[0] = pStitchedFlat->GetLargestPossibleRegion().GetSize( 0 );
+            sizeStack[1] = pStitchedFlat->GetLargestPossibleRegion().GetSize( 1 );
+            sizeStack[2] = uintNumProjections;
+
+            // Created zeroed from the geometry alone
+            VolumeType::Pointer pStackInformation( VolumeType::New() );
+            pStackInformation->SetRegions( sizeStack );
+            pShardedProjections = ShareImage( pStackInformation.GetPointer(), ossPrefix.str() + "_projections", true );
+
+            itk::ShardedProcessRunner::Pointer pRunner( itk::ShardedProcessRunner::New() );
+            pRunner->SetNumberOfShards( settings.uintNumShards );
+            pRunner->SetNumberOfItems( uintNumProjections );
+            pRunner->Run( [&]( itk::SizeValueType uintFirst, itk::SizeValueType uintCount, unsigned int )
+            {
+                for( itk::SizeValueType p = uintFirst; p < uintFirst + uintCount; p++ )
+                {
+                    const unsigned int uintProjection( static_cast< unsigned int >( p ) );
+                    ImageType::Pointer pProjection( ProcessProjection( uintProjection, CreateProjectionKey( uintProjection ) ) );
+
+                    const itk::SizeValueType uintPixels( pProjection->GetBufferedRegion().GetNumberOfPixels() );
+                    std::copy( pProjection->GetBufferPointer(), pProjection->GetBufferPointer() + uintPixels,
+                               pShardedProjections->GetBufferPointer() + p * uintPixels );
+                }
+            } );
+
+            vecShardResults = pRunner->GetShardResults();
+            dblShardedSeconds = pRunner->GetSeconds();
+        }
+
+        for( unsigned int uintProjection = 0; uintProjection < uintNumProjections; uintProjection++ )
+        {
+            const CacheKey keyProjection( CreateProjectionKey( uintProjection ) );
+            keyReconstruct.AddKey( "projection", keyProjection );
+
+            ImageType::Pointer pProjection;
+            if( pShardedProjections )
+            {
+                pProjection = ImageType::New();
+                pProjection->CopyInformation( pStitchedFlat );
+                pProjection->SetRegions( pStitchedFlat->GetLargestPossibleRegion() );
+                pProjection->Allocate();
 
+                const itk::SizeValueType uintPixels( pProjection->GetBufferedRegion().GetNumberOfPixels() );
+                const float * pShardedPixels( pShardedProjections->GetBufferPointer() + uintProjection * uintPixels );
+                std::copy( pShardedPixels, pShardedPixels + uintPixels, pProjection->GetBufferPointer() );
+            }
+            else
+                pProjection = ProcessProjection( uintProjection, keyProjection );
+
+            uint64Checksum = CSIROTomoBenchmark::ComputeChecksum( pProjection.GetPointer(), 1.0e-4, uint64Checksum );
+
+            if( pProjectionStack )
+            {
+                const itk::SizeValueType uintPixels( pProjection->GetBufferedRegion().GetNumberOfPixels() );
+
+                std::copy( pProjection->GetBufferPointer(), pProjection->GetBufferPointer() + uintPixels,
+                           pProjectionStack->GetBufferPointer() + uintProjection * uintPixels );
+            }
+        }
+
+        if( pProjectionStack )
+        {
+            VolumeType::Pointer pReconstruction( pCache->Load< VolumeType >( keyReconstruct ) );
+            if( pReconstruction )
+                vecStages[8].uintCacheHits++;
+            else
+            {
+                FilteredBackProjectionFilterType::Pointer pReconstructionFilter( FilteredBackProjectionFilterType::New() );
+                pReconstructionFilter->SetInput( pProjectionStack );
+                pReconstructionFilter->SetCenterOfRotationOffset( settings.dblCenterOfRotationOffset / settings.uintBinning );
+                pReconstruction = RunPlannedStage( pReconstructionFilter.GetPointer(), pPlanner->GetStage( "reconstruct" ),
+                                                   ImageBytes( pProjectionStack.GetPointer() ), vecStages[8] );
+                pCache->Store( keyReconstruct, pReconstruction.GetPointer() );
+            }
+
+            if( !settings.strOutputFile.empty() )
+            {
+                // The projection stack in chunks, readable a sinogram slab at a time
+                itk::ChunkedStackImageFileWriter< VolumeType >::Pointer pStackWriter( itk::ChunkedStackImageFileWriter< VolumeType >::New() );
+                pStackWriter->SetInput( pProjectionStack );
+                pStackWriter->SetFileName( settings.strOutputFile + ".projections.cstk" );
+                pStackWriter->Update();
+
+                itk::ImageFileWriter< VolumeType >::Pointer pVolumeWriter( itk::ImageFileWriter< VolumeType >::New() );
+                pVolumeWriter->SetInput( pReconstruction );
+                pVolumeWriter->SetFileName( settings.strOutputFile + ".reconstruction.mhd" );
+                pVolumeWriter->Update();
+            }
+        }
+
+        if( !settings.strOutputFile.empty() )
+        {
+            ImageWriter::Pointer pImageWriter( ImageWriter::New() );
+            pImageWriter->SetInput( pStitchedFlat );
+            pImageWriter->SetFileName( settings.strOutputFile + ".stitched_flat.mhd" );
+            pImageWriter->Update();
+        }
     }
     catch( itk::ExceptionObject & error )
     {
         std::cerr << "Error: " << error << std::endl;
         return EXIT_FAILURE;
     }
-#endif
-#endif
 
-    return EXIT_SUCCESS;
+    const std::string strChecksum( CSIROTomoBenchmark::ChecksumToString( uint64Checksum ) );
+
+    WorkflowReport report( settings.strOutputFile );
+    if( !report.IsOpen() )
+    {
+        std::cerr << "Unable to open " << settings.strOutputFile << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ostream & os( report.GetStream() );
+
+    double dblTotalSeconds( 0.0 );
+    double dblTotalBytesMoved( 0.0 );
+
+    os << "{\"benchmark\": \"IMBLPreProcWorkflow\", \"stacks\": " << settings.uintNumStacks
+       << ", \"width\": " << settings.uintWidth << ", \"height\": " << settings.uintHeight
+       << ", \"projections\": " << settings.uintNumProjections << ", \"binning\": " << settings.uintBinning;
+    report.WriteStages( vecStages, dblTotalSeconds, dblTotalBytesMoved );
+
+    os << ", \"shards\": [";
+    for( size_t i = 0; i < vecShardResults.size(); i++ )
+    {
+        os << ( i > 0 ? ", " : "" ) << "{\"first\": " << vecShardResults[i].First << ", \"count\": " << vecShardResults[i].Count
+           << ", \"seconds\": " << vecShardResults[i].Seconds << "}";
+    }
+
+    // The projection stages of sharded runs are only known as a whole
+    dblTotalSeconds += dblShardedSeconds;
+
+    os << "], \"total_seconds\": " << dblTotalSeconds
+       << ", \"total_bandwidth_bytes_per_second\": " << ( dblTotalSeconds > 0.0 ? dblTotalBytesMoved / dblTotalSeconds : 0.0 )
+       << ", \"peak_rss_bytes\": " << CSIROTomoBenchmark::GetPeakRSSBytes()
+       << ", \"buffer_pool_allocations\": " << pBufferPool->GetNumberOfAllocations()
+       << ", \"buffer_pool_reuses\": " << pBufferPool->GetNumberOfReuses();
+
+    if( pPlanner )
+    {
+        os << ", \"memory_plan\": ";
+        pPlanner->WriteJSON( os );
+    }
+
+    report.WriteChecksum( strChecksum );
+
+    return IMBLPreProcWorkflow::CheckGolden( settings, strChecksum );
 }
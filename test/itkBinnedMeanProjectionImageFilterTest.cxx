@@ -0,0 +1,201 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkBinnedMeanProjectionImageFilter.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMeanProjectionImageFilter.h"
+#include "itkTestingMacros.h"
+
+#include <cmath>
+
+#define SERIES_WIDTH 29
+#define SERIES_HEIGHT 14
+#define SERIES_FRAMES 7
+
+using ImageType = itk::Image< float, 2 >;
+using VolumeType = itk::Image< float, 3 >;
+using BinnedMeanProjectionImageFilterType = itk::BinnedMeanProjectionImageFilter< VolumeType, ImageType >;
+using BinnedFrameImageFilterType = itk::BinnedMeanProjectionImageFilter< ImageType, ImageType >;
+using MeanProjectionImageFilterType = itk::MeanProjectionImageFilter< VolumeType, ImageType >;
+
+namespace
+{
+    VolumeType::Pointer CreateSeries()
+    {
+        VolumeType::SizeType size;
+        size[0] = SERIES_WIDTH;
+        size[1] = SERIES_HEIGHT;
+        size[2] = SERIES_FRAMES;
+
+        VolumeType::SpacingType spacing;
+        spacing.Fill( 0.1 );
+
+        VolumeType::Pointer pSeries( VolumeType::New() );
+        pSeries->SetRegions( size );
+        pSeries->SetSpacing( spacing );
+        pSeries->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< VolumeType > it( pSeries, pSeries->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            const VolumeType::IndexType index( it.GetIndex() );
+            it.Set( static_cast< float >( 100.0 + 20.0 * std::sin( 0.4 * index[0] ) * std::cos( 0.3 * index[1] ) + 3.0 * index[2] + ( index[0] * 7 + index[1] * 3 ) % 5 ) );
+        }
+
+        return pSeries;
+    }
+
+    /** Binned mean of the series checked pixel by pixel, and the output
+     * geometry against the input blocks */
+    bool CheckBinnedMean( const VolumeType * pSeries, const ImageType * pBinned, unsigned int uintFactor )
+    {
+        const ImageType::RegionType & regionBinned( pBinned->GetLargestPossibleRegion() );
+
+        if( regionBinned.GetSize( 0 ) != SERIES_WIDTH / uintFactor || regionBinned.GetSize( 1 ) != SERIES_HEIGHT / uintFactor )
+        {
+            std::cerr << "Binned size " << regionBinned.GetSize() << " for factor " << uintFactor << std::endl;
+            return false;
+        }
+
+        itk::ImageRegionConstIteratorWithIndex< ImageType > it( pBinned, regionBinned );
+        for( ; !it.IsAtEnd(); ++it )
+        {
+            const ImageType::IndexType index( it.GetIndex() );
+
+            double dblSum( 0.0 );
+            double dblX( 0.0 );
+            double dblY( 0.0 );
+            VolumeType::IndexType indexSeries;
+            for( indexSeries[2] = 0; indexSeries[2] < SERIES_FRAMES; indexSeries[2]++ )
+            {
+                for( unsigned int j = 0; j < uintFactor; j++ )
+                {
+                    for( unsigned int i = 0; i < uintFactor; i++ )
+                    {
+                        indexSeries[0] = index[0] * uintFactor + i;
+                        indexSeries[1] = index[1] * uintFactor + j;
+                        dblSum += pSeries->GetPixel( indexSeries );
+
+                        VolumeType::PointType point;
+                        pSeries->TransformIndexToPhysicalPoint( indexSeries, point );
+                        dblX += point[0];
+                        dblY += point[1];
+                    }
+                }
+            }
+
+            const double dblCount( SERIES_FRAMES * uintFactor * uintFactor );
+
+            if( std::fabs( it.Get() - dblSum / dblCount ) > 1.0e-4 )
+            {
+                std::cerr << "Pixel " << index << " binned by " << uintFactor << " is " << it.Get() << ", expected " << dblSum / dblCount << std::endl;
+                return false;
+            }
+
+            // The output pixel lies at the centre of its input block
+            ImageType::PointType point;
+            pBinned->TransformIndexToPhysicalPoint( index, point );
+            if( std::fabs( point[0] - dblX / dblCount ) > 1.0e-9 || std::fabs( point[1] - dblY / dblCount ) > 1.0e-9 )
+            {
+                std::cerr << "Pixel " << index << " binned by " << uintFactor << " lies at " << point << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int itkBinnedMeanProjectionImageFilterTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VolumeType::Pointer pSeries( CreateSeries() );
+
+    BinnedMeanProjectionImageFilterType::Pointer pFilter( BinnedMeanProjectionImageFilterType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pFilter, BinnedMeanProjectionImageFilter, ImageToImageFilter );
+
+    pFilter->SetInput( pSeries );
+    pFilter->SetNumberOfFramesPerChunk( 3 );
+    TEST_SET_GET_VALUE( static_cast< itk::SizeValueType >( 3 ), pFilter->GetNumberOfFramesPerChunk() );
+
+    // Unbinned, the filter averages as MeanProjectionImageFilter does
+    MeanProjectionImageFilterType::Pointer pMeanProjection( MeanProjectionImageFilterType::New() );
+    pMeanProjection->SetInput( pSeries );
+    TRY_EXPECT_NO_EXCEPTION( pMeanProjection->Update() );
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+
+    TEST_EXPECT_TRUE( CheckBinnedMean( pSeries, pFilter->GetOutput(), 1 ) );
+    TEST_EXPECT_EQUAL( pFilter->GetOutput()->GetLargestPossibleRegion(), pMeanProjection->GetOutput()->GetLargestPossibleRegion() );
+    TEST_EXPECT_EQUAL( pFilter->GetOutput()->GetOrigin(), pMeanProjection->GetOutput()->GetOrigin() );
+
+    // Frames accumulated a chunk at a time alike for any chunk length
+    for( unsigned int uintFactor = 2; uintFactor <= 4; uintFactor++ )
+    {
+        pFilter->SetBinningFactor( uintFactor );
+        TEST_SET_GET_VALUE( uintFactor, pFilter->GetBinningFactor() );
+
+        for( itk::SizeValueType uintChunk = 1; uintChunk <= SERIES_FRAMES; uintChunk += 3 )
+        {
+            pFilter->SetNumberOfFramesPerChunk( uintChunk );
+            TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+            TEST_EXPECT_TRUE( CheckBinnedMean( pSeries, pFilter->GetOutput(), uintFactor ) );
+            TEST_EXPECT_EQUAL( pFilter->GetOutput()->GetSpacing()[0], 0.1 * uintFactor );
+        }
+    }
+
+    // A factor beyond the input size is an error
+    pFilter->SetBinningFactor( SERIES_HEIGHT + 1 );
+    TRY_EXPECT_EXCEPTION( pFilter->Update() );
+
+    // A single frame is binned alike
+    ImageType::Pointer pFrame( ImageType::New() );
+    {
+        ImageType::SizeType size;
+        size[0] = SERIES_WIDTH;
+        size[1] = SERIES_HEIGHT;
+        pFrame->SetRegions( size );
+        pFrame->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pFrame, pFrame->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( static_cast< float >( it.GetIndex()[0] + 100 * it.GetIndex()[1] ) );
+    }
+
+    BinnedFrameImageFilterType::Pointer pFrameFilter( BinnedFrameImageFilterType::New() );
+    pFrameFilter->SetInput( pFrame );
+    pFrameFilter->SetBinningFactor( 2 );
+    TRY_EXPECT_NO_EXCEPTION( pFrameFilter->Update() );
+
+    ImageType::IndexType index;
+    index[0] = 3;
+    index[1] = 5;
+    // Mean of columns 6-7 and rows 10-11
+    TEST_EXPECT_EQUAL( pFrameFilter->GetOutput()->GetPixel( index ), 6.5f + 1050.0f );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
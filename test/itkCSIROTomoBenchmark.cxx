@@ -0,0 +1,344 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkBFloat16.h"
+#include "itkFloat16.h"
+#include "itkMaskedMedianImageFilter.h"
+#include "itkNegLogCheckedImageFilter.h"
+#include "itkThresholdedMedianImageFilter.h"
+#include "itkThresholdedMedianMaskImageFilter.h"
+#include "itkVerticalStitchingImageFilter.h"
+
+#include "itkCSIROTomoBenchmarkUtilities.h"
+
+#include "itkTestingMacros.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using FloatImageType = itk::Image< float, 2 >;
+using UShortImageType = itk::Image< unsigned short, 2 >;
+using HalfImageType = itk::Image< itk::Float16, 2 >;
+using BHalfImageType = itk::Image< itk::BFloat16, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+
+namespace
+{
+    struct BenchmarkSettings
+    {
+        BenchmarkSettings()
+            : uintWidth( 512 )
+            , uintHeight( 512 )
+            , uintBits( 16 )
+            , uintMaxStacks( 8 )
+            , uintRepeats( 3 )
+            , dblDefectDensity( 0.001 )
+            , vecRadii( CSIROTomoBenchmark::ParseList( "1,2,3" ) )
+            , vecThreads( CSIROTomoBenchmark::DefaultThreadCounts() )
+            , strStorage( "float" )
+        {
+        }
+
+        unsigned int                uintWidth;
+        unsigned int                uintHeight;
+        unsigned int                uintBits;
+        unsigned int                uintMaxStacks;
+        unsigned int                uintRepeats;
+        double                      dblDefectDensity;
+        std::vector< unsigned int > vecRadii;
+        std::vector< unsigned int > vecThreads;
+        std::string                 strStorage;
+        std::string                 strOutputFile;
+
+        // Set with --numa, shared by every filter benchmarked
+        itk::NUMAPlacement::Pointer pPlacement;
+    };
+
+    /** Parameters suffix naming the nodes used, empty without a placement */
+    std::string PlacementParameters( const BenchmarkSettings & settings )
+    {
+        std::stringstream ss;
+        if( settings.pPlacement )
+            ss << " numa_nodes=" << settings.pPlacement->GetNumberOfNodes();
+        return ss.str();
+    }
+
+    /** Times the passed filter for every configured thread count */
+    template< typename TFilter >
+    void BenchmarkFilter( TFilter * pFilter, const std::string & strName, const std::string & strParameters, double dblPixels,
+                          const BenchmarkSettings & settings, std::vector< CSIROTomoBenchmark::Result > & vecResults )
+    {
+        double dblSingleThreadSeconds( 0.0 );
+
+        for( std::vector< unsigned int >::const_iterator it = settings.vecThreads.begin(); it != settings.vecThreads.end(); ++it )
+        {
+            pFilter->SetNumberOfThreads( *it );
+
+            CSIROTomoBenchmark::Result result;
+            result.strFilter = strName;
+            result.strParameters = strParameters;
+            result.uintThreads = *it;
+            result.dblPixels = dblPixels;
+            result.dblSeconds = CSIROTomoBenchmark::TimeUpdate( pFilter, settings.uintRepeats );
+
+            // Efficiency is reported relative to the first (usually single threaded) measurement
+            if( it == settings.vecThreads.begin() )
+                dblSingleThreadSeconds = result.dblSeconds * *it;
+
+            result.dblSingleThreadSeconds = dblSingleThreadSeconds;
+            result.dblPeakRSSBytes = CSIROTomoBenchmark::GetPeakRSSBytes();
+
+            std::cerr << strName << " [" << strParameters << "] threads=" << *it << " " << result.dblSeconds << " s" << std::endl;
+            vecResults.push_back( result );
+        }
+    }
+
+    /** Median variants and mask generation on a raw frame of pixel type TPixel */
+    template< typename TPixel >
+    void BenchmarkFrameFilters( const BenchmarkSettings & settings, std::vector< CSIROTomoBenchmark::Result > & vecResults )
+    {
+        using RawImageType = itk::Image< TPixel, 2 >;
+        using ThresholdedMedianFilterType = itk::ThresholdedMedianImageFilter< RawImageType, RawImageType >;
+        using ThresholdedMedianMaskFilterType = itk::ThresholdedMedianMaskImageFilter< RawImageType, MaskImageType >;
+        using MaskedMedianFilterType = itk::MaskedMedianImageFilter< RawImageType, RawImageType, MaskImageType >;
+
+        typename RawImageType::SizeType size;
+        size[0] = settings.uintWidth;
+        size[1] = settings.uintHeight;
+
+        CSIROTomoBenchmark::FrameParameters params;
+        params.dblDefectDensity = settings.dblDefectDensity;
+
+        typename RawImageType::Pointer pFrame( CSIROTomoBenchmark::CreateDetectorFrame< RawImageType >( size, params ) );
+        const double dblPixels( static_cast< double >( size[0] ) * size[1] );
+
+        for( std::vector< unsigned int >::const_iterator itRadius = settings.vecRadii.begin(); itRadius != settings.vecRadii.end(); ++itRadius )
+        {
+            std::stringstream ssParameters;
+            ssParameters << "radius=" << *itRadius << " bits=" << settings.uintBits << " defects=" << settings.dblDefectDensity
+                         << PlacementParameters( settings );
+
+            typename ThresholdedMedianFilterType::RadiusType radius;
+            radius.Fill( *itRadius );
+
+            typename ThresholdedMedianFilterType::Pointer pThresholdedMedian( ThresholdedMedianFilterType::New() );
+            pThresholdedMedian->SetInput( pFrame );
+            pThresholdedMedian->SetRadius( radius );
+            pThresholdedMedian->SetThresholdLower( 1.0 );
+            pThresholdedMedian->SetThresholdUpper( 0.9 * itk::NumericTraits< TPixel >::max() );
+            pThresholdedMedian->SetNUMAPlacement( settings.pPlacement );
+            BenchmarkFilter( pThresholdedMedian.GetPointer(), "ThresholdedMedianImageFilter", ssParameters.str(), dblPixels, settings, vecResults );
+
+            typename ThresholdedMedianMaskFilterType::Pointer pMask( ThresholdedMedianMaskFilterType::New() );
+            pMask->SetInput( pFrame );
+            pMask->SetRadius( radius );
+            pMask->SetThresholdLower( 0.5 );
+            pMask->SetThresholdUpper( 1.5 );
+            pMask->SetNUMAPlacement( settings.pPlacement );
+            BenchmarkFilter( pMask.GetPointer(), "ThresholdedMedianMaskImageFilter", ssParameters.str(), dblPixels, settings, vecResults );
+
+            typename MaskedMedianFilterType::Pointer pMaskedMedian( MaskedMedianFilterType::New() );
+            pMaskedMedian->SetInput( pFrame );
+            pMaskedMedian->SetMaskImage( pMask->GetOutput() );
+            pMaskedMedian->SetRadius( radius );
+            pMaskedMedian->SetNUMAPlacement( settings.pPlacement );
+            pMask->Update();
+            BenchmarkFilter( pMaskedMedian.GetPointer(), "MaskedMedianImageFilter", ssParameters.str(), dblPixels, settings, vecResults );
+        }
+    }
+
+    /** NegLog on normalised (floating point) transmission held in TStorageImage */
+    template< typename TStorageImage >
+    void BenchmarkNegLog( const BenchmarkSettings & settings, std::vector< CSIROTomoBenchmark::Result > & vecResults )
+    {
+        using NegLogFilterType = itk::NegLogCheckedImageFilter< TStorageImage >;
+
+        typename TStorageImage::SizeType size;
+        size[0] = settings.uintWidth;
+        size[1] = settings.uintHeight;
+
+        CSIROTomoBenchmark::FrameParameters params;
+        params.dblDefectDensity = settings.dblDefectDensity;
+        params.dblIntensity = 1.0;
+
+        typename TStorageImage::Pointer pTransmission( CSIROTomoBenchmark::CreateDetectorFrame< TStorageImage >( size, params ) );
+        const double dblPixels( static_cast< double >( size[0] ) * size[1] );
+
+        typename NegLogFilterType::Pointer pNegLog( NegLogFilterType::New() );
+        pNegLog->SetInput( pTransmission );
+        BenchmarkFilter( pNegLog.GetPointer(), "NegLogCheckedImageFilter", "storage=" + settings.strStorage, dblPixels, settings, vecResults );
+    }
+
+    /** Stitching of 2 to MaxStacks averaged flats, held in TStorageImage, with weighting computation */
+    template< typename TStorageImage >
+    void BenchmarkStitching( const BenchmarkSettings & settings, std::vector< CSIROTomoBenchmark::Result > & vecResults )
+    {
+        using StitchingFilterType = itk::VerticalStitchingImageFilter< TStorageImage, TStorageImage >;
+
+        typename TStorageImage::SizeType size;
+        size[0] = settings.uintWidth;
+        size[1] = settings.uintHeight;
+
+        // Stacks overlap by a quarter of their height
+        const unsigned int uintShift( settings.uintHeight - settings.uintHeight / 4 );
+
+        for( unsigned int uintStacks = 2; uintStacks <= settings.uintMaxStacks; uintStacks++ )
+        {
+            typename StitchingFilterType::Pointer pStitching( StitchingFilterType::New() );
+            pStitching->SetVerticalShift( static_cast< double >( uintShift ) );
+            pStitching->SetNUMAPlacement( settings.pPlacement );
+
+            for( unsigned int i = 0; i < uintStacks; i++ )
+            {
+                CSIROTomoBenchmark::FrameParameters params;
+                params.dblDefectDensity = 0.0;
+                params.uintRowOffset = i * uintShift;
+                params.uintTotalRows = uintShift * ( uintStacks - 1 ) + settings.uintHeight;
+                params.uint64NoiseSeed = 100 + i;
+
+                pStitching->SetInput( i, CSIROTomoBenchmark::CreateDetectorFrame< TStorageImage >( size, params ) );
+            }
+
+            std::stringstream ssParameters;
+            ssParameters << "stacks=" << uintStacks << " shift=" << uintShift << " storage=" << settings.strStorage
+                         << PlacementParameters( settings );
+
+            const double dblPixels( static_cast< double >( size[0] ) * size[1] * uintStacks );
+            BenchmarkFilter( pStitching.GetPointer(), "VerticalStitchingImageFilter", ssParameters.str(), dblPixels, settings, vecResults );
+        }
+    }
+}
+
+int itkCSIROTomoBenchmark( int argc, char * argv[] )
+{
+    BenchmarkSettings settings;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        const std::string strArg( argv[i] );
+        const bool blnHasValue( i + 1 < argc );
+
+        if( strArg == "--size" && i + 2 < argc )
+        {
+            settings.uintWidth = std::atoi( argv[++i] );
+            settings.uintHeight = std::atoi( argv[++i] );
+        }
+        else if( strArg == "--bits" && blnHasValue )
+            settings.uintBits = std::atoi( argv[++i] );
+        else if( strArg == "--defects" && blnHasValue )
+            settings.dblDefectDensity = std::atof( argv[++i] );
+        else if( strArg == "--stacks" && blnHasValue )
+            settings.uintMaxStacks = std::atoi( argv[++i] );
+        else if( strArg == "--radii" && blnHasValue )
+            settings.vecRadii = CSIROTomoBenchmark::ParseList( argv[++i] );
+        else if( strArg == "--threads" && blnHasValue )
+            settings.vecThreads = CSIROTomoBenchmark::ParseList( argv[++i] );
+        else if( strArg == "--repeats" && blnHasValue )
+            settings.uintRepeats = std::atoi( argv[++i] );
+        else if( strArg == "--storage" && blnHasValue )
+            settings.strStorage = argv[++i];
+        else if( strArg == "--output" && blnHasValue )
+            settings.strOutputFile = argv[++i];
+        else if( strArg == "--numa" )
+            settings.pPlacement = itk::NUMAPlacement::New();
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--size width height] [--bits 16|32] [--defects density] [--stacks maxStacks]"
+                      << " [--radii 1,2,3] [--threads 1,2,4] [--repeats n] [--storage float|float16|bfloat16] [--output results.json]"
+                      << " [--numa]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if( settings.uintBits != 16 && settings.uintBits != 32 )
+    {
+        std::cerr << "Unsupported bit depth " << settings.uintBits << ", expecting 16 or 32" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if( settings.strStorage != "float" && settings.strStorage != "float16" && settings.strStorage != "bfloat16" )
+    {
+        std::cerr << "Unsupported storage type " << settings.strStorage << ", expecting float, float16 or bfloat16" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if( settings.vecThreads.empty() || settings.vecRadii.empty() || settings.uintMaxStacks < 2 )
+    {
+        std::cerr << "At least one thread count, one radius and two stacks are required" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector< CSIROTomoBenchmark::Result > vecResults;
+
+    try
+    {
+        if( settings.uintBits == 16 )
+            BenchmarkFrameFilters< unsigned short >( settings, vecResults );
+        else
+            BenchmarkFrameFilters< float >( settings, vecResults );
+
+        // Intermediate images (normalised projections, averaged flats) in the selected storage type
+        if( settings.strStorage == "float16" )
+        {
+            BenchmarkNegLog< HalfImageType >( settings, vecResults );
+            BenchmarkStitching< HalfImageType >( settings, vecResults );
+        }
+        else if( settings.strStorage == "bfloat16" )
+        {
+            BenchmarkNegLog< BHalfImageType >( settings, vecResults );
+            BenchmarkStitching< BHalfImageType >( settings, vecResults );
+        }
+        else
+        {
+            BenchmarkNegLog< FloatImageType >( settings, vecResults );
+            BenchmarkStitching< FloatImageType >( settings, vecResults );
+        }
+    }
+    catch( itk::ExceptionObject & error )
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream ofs;
+    if( !settings.strOutputFile.empty() )
+    {
+        ofs.open( settings.strOutputFile.c_str() );
+        if( !ofs )
+        {
+            std::cerr << "Unable to open " << settings.strOutputFile << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream & os( settings.strOutputFile.empty() ? std::cout : ofs );
+
+    os << "{\"benchmark\": \"CSIROTomo\", \"width\": " << settings.uintWidth << ", \"height\": " << settings.uintHeight
+       << ", \"bits\": " << settings.uintBits << ", \"results\": [" << std::endl;
+
+    for( std::vector< CSIROTomoBenchmark::Result >::const_iterator it = vecResults.begin(); it != vecResults.end(); ++it )
+    {
+        os << "  ";
+        it->WriteJSON( os );
+        os << ( it + 1 != vecResults.end() ? "," : "" ) << std::endl;
+    }
+
+    os << "]}" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,340 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkCSIROTomoBenchmarkUtilities_h
+#define itkCSIROTomoBenchmarkUtilities_h
+
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMultiThreader.h"
+#include "itkNumericTraits.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined( _WIN32 )
+#include <sys/resource.h>
+#endif
+
+// Helpers shared by the CSIROTomo benchmark drivers. Everything here is
+// deterministic so that repeated runs (and runs on different machines)
+// process exactly the same synthetic data.
+namespace CSIROTomoBenchmark
+{
+    /** Small, portable xorshift generator. The standard library distributions
+     * are implementation defined, so they are avoided to keep the synthetic
+     * data identical across platforms. */
+    class RandomGenerator
+    {
+    public:
+        explicit RandomGenerator( std::uint64_t uint64Seed )
+            : m_State( uint64Seed ? uint64Seed : 0x9E3779B97F4A7C15ull )
+        {
+        }
+
+        std::uint64_t NextUInt()
+        {
+            m_State ^= m_State << 13;
+            m_State ^= m_State >> 7;
+            m_State ^= m_State << 17;
+            return m_State;
+        }
+
+        // Uniform in [0, 1)
+        double NextUniform()
+        {
+            return static_cast< double >( NextUInt() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+        }
+
+        // Approximately normal (Irwin-Hall, 4 samples), zero mean, unit variance
+        double NextGaussian()
+        {
+            double dblSum( 0.0 );
+            for( unsigned int i = 0; i < 4; i++ )
+                dblSum += NextUniform();
+
+            return ( dblSum - 2.0 ) * std::sqrt( 3.0 );
+        }
+
+    private:
+        std::uint64_t m_State;
+    };
+
+    /** Parameters describing a synthetic detector frame. The frame is a smooth
+     * beam profile expressed in global (stitched) row coordinates, so frames
+     * generated with different row offsets overlap consistently. */
+    struct FrameParameters
+    {
+        FrameParameters()
+            : dblIntensity( 40000.0 )
+            , dblDarkLevel( 0.0 )
+            , dblNoise( 0.01 )
+            , dblDefectDensity( 0.001 )
+            , dblZingerDensity( 0.0 )
+            , dblAngle( 0.0 )
+            , blnPhantom( false )
+            , uintRowOffset( 0 )
+            , uintTotalRows( 0 )
+            , uint64DefectSeed( 1 )
+            , uint64NoiseSeed( 2 )
+        {
+        }
+
+        double          dblIntensity;       // peak counts above the dark level
+        double          dblDarkLevel;       // dark current offset
+        double          dblNoise;           // relative gaussian noise
+        double          dblDefectDensity;   // fraction of dead/hot pixels (static per detector)
+        double          dblZingerDensity;   // fraction of zinger hits (varies per frame)
+        double          dblAngle;           // projection angle in radians, used with blnPhantom
+        bool            blnPhantom;         // attenuate the beam by the phantom projection
+        unsigned int    uintRowOffset;      // first global row covered by this frame
+        unsigned int    uintTotalRows;      // global height of the beam profile (0 = frame height)
+        std::uint64_t   uint64DefectSeed;
+        std::uint64_t   uint64NoiseSeed;
+    };
+
+    /** Parallel beam line integral through a phantom made of two vertical
+     * cylinders: a large centred one and a small one orbiting the rotation axis.
+     * dblX is the normalised detector column in [-0.5, 0.5]. */
+    inline double PhantomLineIntegral( double dblX, double dblAngle )
+    {
+        const double dblRadiusOuter( 0.3 );
+        const double dblRadiusInner( 0.08 );
+        const double dblOrbit( 0.15 );
+        const double dblMuOuter( 2.0 );
+        const double dblMuInner( 4.0 );
+
+        double dblIntegral( 0.0 );
+
+        if( std::fabs( dblX ) < dblRadiusOuter )
+            dblIntegral += 2.0 * dblMuOuter * std::sqrt( dblRadiusOuter * dblRadiusOuter - dblX * dblX );
+
+        const double dblXInner( dblX - dblOrbit * std::cos( dblAngle ) );
+        if( std::fabs( dblXInner ) < dblRadiusInner )
+            dblIntegral += 2.0 * dblMuInner * std::sqrt( dblRadiusInner * dblRadiusInner - dblXInner * dblXInner );
+
+        return dblIntegral;
+    }
+
+    template< typename TImage >
+    typename TImage::Pointer CreateDetectorFrame( const typename TImage::SizeType & size, const FrameParameters & params, double dblSpacing = 1.0 )
+    {
+        typedef typename TImage::PixelType PixelType;
+
+        typename TImage::Pointer pImage( TImage::New() );
+        pImage->SetRegions( size );
+
+        typename TImage::SpacingType spacing;
+        spacing.Fill( dblSpacing );
+        pImage->SetSpacing( spacing );
+        pImage->Allocate();
+
+        const double dblMax( std::min( static_cast< double >( itk::NumericTraits< PixelType >::max() ), params.dblDarkLevel + 4.0 * params.dblIntensity ) );
+        const double dblTotalRows( params.uintTotalRows ? params.uintTotalRows : size[1] );
+        const double dblWidth( size[0] );
+
+        RandomGenerator rngNoise( params.uint64NoiseSeed );
+
+        itk::ImageRegionIteratorWithIndex< TImage > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            const typename TImage::IndexType index( it.GetIndex() );
+
+            // Broad horizontal fan with a vertically peaked beam, as seen on IMBL
+            const double dblX( ( index[0] - 0.5 * dblWidth ) / dblWidth );
+            const double dblY( ( index[1] + params.uintRowOffset - 0.5 * dblTotalRows ) / dblTotalRows );
+            const double dblProfile( params.dblIntensity * ( 0.6 + 0.4 * std::exp( -8.0 * dblY * dblY ) ) * ( 1.0 - 0.3 * dblX * dblX ) );
+
+            const double dblTransmission( params.blnPhantom ? std::exp( -PhantomLineIntegral( dblX, params.dblAngle ) ) : 1.0 );
+
+            double dblValue( params.dblDarkLevel + dblProfile * dblTransmission * ( 1.0 + params.dblNoise * rngNoise.NextGaussian() ) );
+
+            if( params.dblZingerDensity > 0.0 && rngNoise.NextUniform() < params.dblZingerDensity )
+                dblValue = dblMax;
+
+            it.Set( static_cast< PixelType >( std::max( 0.0, std::min( dblValue, dblMax ) ) ) );
+        }
+
+        // Defects are a property of the detector, so their positions depend only on the defect seed
+        if( params.dblDefectDensity > 0.0 )
+        {
+            RandomGenerator rngDefect( params.uint64DefectSeed );
+            const itk::SizeValueType uintNumPixels( pImage->GetLargestPossibleRegion().GetNumberOfPixels() );
+            const itk::SizeValueType uintNumDefects( static_cast< itk::SizeValueType >( params.dblDefectDensity * uintNumPixels ) );
+
+            PixelType * pBuffer( pImage->GetBufferPointer() );
+            for( itk::SizeValueType i = 0; i < uintNumDefects; i++ )
+            {
+                const itk::SizeValueType uintOffset( static_cast< itk::SizeValueType >( rngDefect.NextUInt() % uintNumPixels ) );
+                pBuffer[uintOffset] = ( rngDefect.NextUInt() & 1 ) ? static_cast< PixelType >( dblMax ) : itk::NumericTraits< PixelType >::ZeroValue();
+            }
+        }
+
+        return pImage;
+    }
+
+    /** Wall clock in seconds */
+    inline double Now()
+    {
+        return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+    /** Peak resident set size of the process in bytes, 0 where unsupported */
+    inline double GetPeakRSSBytes()
+    {
+#if defined( _WIN32 )
+        return 0.0;
+#else
+        struct rusage usage;
+        if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+            return 0.0;
+#if defined( __APPLE__ )
+        return static_cast< double >( usage.ru_maxrss );
+#else
+        return static_cast< double >( usage.ru_maxrss ) * 1024.0;
+#endif
+#endif
+    }
+
+    /** Times an update of the passed filter, forcing re-execution each repeat.
+     * The minimum wall time over all repeats is returned. */
+    template< typename TFilter >
+    double TimeUpdate( TFilter * pFilter, unsigned int uintRepeats )
+    {
+        double dblBest( std::numeric_limits< double >::max() );
+
+        for( unsigned int i = 0; i < std::max( 1u, uintRepeats ); i++ )
+        {
+            pFilter->Modified();
+            const double dblStart( Now() );
+            pFilter->Update();
+            dblBest = std::min( dblBest, Now() - dblStart );
+        }
+
+        return dblBest;
+    }
+
+    /** Parses comma separated unsigned values, e.g. "1,2,4,8" */
+    inline std::vector< unsigned int > ParseList( const std::string & str )
+    {
+        std::vector< unsigned int > vecValues;
+        std::stringstream ss( str );
+        std::string strItem;
+
+        while( std::getline( ss, strItem, ',' ) )
+        {
+            if( !strItem.empty() )
+                vecValues.push_back( static_cast< unsigned int >( std::atoi( strItem.c_str() ) ) );
+        }
+
+        return vecValues;
+    }
+
+    /** Default thread counts: powers of two up to the ITK global default */
+    inline std::vector< unsigned int > DefaultThreadCounts()
+    {
+        std::vector< unsigned int > vecThreads;
+        const unsigned int uintMaxThreads( std::max( 1u, static_cast< unsigned int >( itk::MultiThreader::GetGlobalDefaultNumberOfThreads() ) ) );
+
+        for( unsigned int n = 1; n < uintMaxThreads; n *= 2 )
+            vecThreads.push_back( n );
+        vecThreads.push_back( uintMaxThreads );
+
+        return vecThreads;
+    }
+
+    /** FNV-1a checksum of an image quantised to the passed resolution. The
+     * quantisation absorbs last-bit differences between math libraries. */
+    template< typename TImage >
+    std::uint64_t ComputeChecksum( const TImage * pImage, double dblResolution, std::uint64_t uint64Hash = 0xcbf29ce484222325ull )
+    {
+        const typename TImage::PixelType * pBuffer( pImage->GetBufferPointer() );
+        const itk::SizeValueType uintNumPixels( pImage->GetBufferedRegion().GetNumberOfPixels() );
+
+        for( itk::SizeValueType i = 0; i < uintNumPixels; i++ )
+        {
+            const std::int64_t int64Value( static_cast< std::int64_t >( std::floor( static_cast< double >( pBuffer[i] ) / dblResolution + 0.5 ) ) );
+            const unsigned char * pBytes( reinterpret_cast< const unsigned char * >( &int64Value ) );
+
+            for( unsigned int j = 0; j < sizeof( int64Value ); j++ )
+            {
+                uint64Hash ^= pBytes[j];
+                uint64Hash *= 0x100000001b3ull;
+            }
+        }
+
+        return uint64Hash;
+    }
+
+    inline std::string ChecksumToString( std::uint64_t uint64Hash )
+    {
+        std::stringstream ss;
+        ss << std::hex << std::setw( 16 ) << std::setfill( '0' ) << uint64Hash;
+        return ss.str();
+    }
+
+    /** Minimal escaping for JSON string values */
+    inline std::string JSONString( const std::string & str )
+    {
+        std::string strOut( "\"" );
+        for( std::string::const_iterator it = str.begin(); it != str.end(); ++it )
+        {
+            if( *it == '"' || *it == '\\' )
+                strOut += '\\';
+            strOut += *it;
+        }
+        return strOut + "\"";
+    }
+
+    /** A single benchmark measurement */
+    struct Result
+    {
+        std::string     strFilter;
+        std::string     strParameters;
+        unsigned int    uintThreads;
+        double          dblSeconds;
+        double          dblPixels;
+        double          dblSingleThreadSeconds;
+        double          dblPeakRSSBytes;
+
+        void WriteJSON( std::ostream & os ) const
+        {
+            const double dblEfficiency( dblSeconds > 0.0 ? dblSingleThreadSeconds / ( uintThreads * dblSeconds ) : 0.0 );
+
+            os << "{\"filter\": " << JSONString( strFilter )
+               << ", \"parameters\": " << JSONString( strParameters )
+               << ", \"threads\": " << uintThreads
+               << std::setprecision( 9 )
+               << ", \"seconds\": " << dblSeconds
+               << ", \"pixels\": " << dblPixels
+               << ", \"pixels_per_second\": " << ( dblSeconds > 0.0 ? dblPixels / dblSeconds : 0.0 )
+               << ", \"scaling_efficiency\": " << dblEfficiency
+               << ", \"peak_rss_bytes\": " << dblPeakRSSBytes << "}";
+        }
+    };
+}
+
+#endif // itkCSIROTomoBenchmarkUtilities_h
@@ -0,0 +1,375 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkMaskedMedianImageFilter.h"
+#include "itkNegLogCheckedImageFilter.h"
+#include "itkParallelBeamFilteredBackProjectionImageFilter.h"
+#include "itkThresholdedMedianImageFilter.h"
+#include "itkThresholdedMedianMaskImageFilter.h"
+#include "itkVerticalStitchingImageFilter.h"
+
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMath.h"
+#include "itkPipelineMonitorImageFilter.h"
+#include "itkStreamingImageFilter.h"
+#include "itkTestingMacros.h"
+
+#include <cmath>
+#include <string>
+
+#define IMAGE_WIDTH 128
+#define IMAGE_HEIGHT 96
+#define STREAM_DIVISIONS 8u
+#define FILTER_RADIUS 2
+
+using ImageType = itk::Image< float, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+using VolumeType = itk::Image< float, 3 >;
+using ImageFileReaderType = itk::ImageFileReader< ImageType >;
+using ImageFileWriterType = itk::ImageFileWriter< ImageType >;
+using MaskImageFileReaderType = itk::ImageFileReader< MaskImageType >;
+using MaskImageFileWriterType = itk::ImageFileWriter< MaskImageType >;
+using PipelineMonitorType = itk::PipelineMonitorImageFilter< ImageType >;
+using MaskedMedianImageFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, MaskImageType >;
+using ThresholdedMedianImageFilterType = itk::ThresholdedMedianImageFilter< ImageType, ImageType >;
+using ThresholdedMedianMaskImageFilterType = itk::ThresholdedMedianMaskImageFilter< ImageType, MaskImageType >;
+using NegLogCheckedImageFilterType = itk::NegLogCheckedImageFilter< ImageType >;
+using VerticalStitchingImageFilterType = itk::VerticalStitchingImageFilter< ImageType, ImageType >;
+using FilteredBackProjectionFilterType = itk::ParallelBeamFilteredBackProjectionImageFilter< VolumeType, VolumeType >;
+
+namespace
+{
+    /** Smooth transmission-like image with scattered hot and dead pixels */
+    ImageType::Pointer CreateImage( double dblPhase )
+    {
+        ImageType::SizeType size;
+        size[0] = IMAGE_WIDTH;
+        size[1] = IMAGE_HEIGHT;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            const ImageType::IndexType index( it.GetIndex() );
+            double dblValue( 0.6 + 0.3 * std::sin( 0.11 * index[0] + dblPhase ) * std::cos( 0.07 * index[1] ) );
+
+            if( ( 7 * index[0] + 13 * index[1] ) % 37 == 0 )
+                dblValue = 5.0;
+            else if( ( 11 * index[0] + 3 * index[1] ) % 41 == 0 )
+                dblValue = 0.01;
+
+            it.Set( static_cast< float >( dblValue ) );
+        }
+
+        return pImage;
+    }
+
+    MaskImageType::Pointer CreateMask()
+    {
+        MaskImageType::SizeType size;
+        size[0] = IMAGE_WIDTH;
+        size[1] = IMAGE_HEIGHT;
+
+        MaskImageType::Pointer pMask( MaskImageType::New() );
+        pMask->SetRegions( size );
+        pMask->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< MaskImageType > it( pMask, pMask->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( ( 3 * it.GetIndex()[0] + 5 * it.GetIndex()[1] ) % 11 == 0 ? 1 : 0 );
+
+        return pMask;
+    }
+
+    template< typename TImage >
+    bool ImagesEqual( const TImage * pReference, const TImage * pImage )
+    {
+        if( pReference->GetLargestPossibleRegion() != pImage->GetLargestPossibleRegion() )
+        {
+            std::cerr << "Region " << pImage->GetLargestPossibleRegion() << " differs from " << pReference->GetLargestPossibleRegion() << std::endl;
+            return false;
+        }
+
+        itk::ImageRegionConstIteratorWithIndex< TImage > itReference( pReference, pReference->GetLargestPossibleRegion() );
+        for( itReference.GoToBegin(); !itReference.IsAtEnd(); ++itReference )
+        {
+            if( itReference.Get() != pImage->GetPixel( itReference.GetIndex() ) )
+            {
+                std::cerr << "Pixel " << itReference.GetIndex() << " is " << static_cast< double >( pImage->GetPixel( itReference.GetIndex() ) )
+                          << ", expected " << static_cast< double >( itReference.Get() ) << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /** Checks the reads of a streamed input: the expected number of updates,
+     * each reading at most a stream division plus the padding rows */
+    bool InputStreamed( const PipelineMonitorType * pMonitor, unsigned int uintExpectedUpdates, itk::SizeValueType uintMaximumRows )
+    {
+        if( pMonitor->GetNumberOfUpdates() != uintExpectedUpdates )
+        {
+            std::cerr << "Input updated " << pMonitor->GetNumberOfUpdates() << " times, expected " << uintExpectedUpdates << std::endl;
+            return false;
+        }
+
+        const PipelineMonitorType::RegionVectorType vecRegions( pMonitor->GetUpdatedBufferedRegions() );
+        for( size_t i = 0; i < vecRegions.size(); i++ )
+        {
+            if( vecRegions[i].GetSize( 1 ) > uintMaximumRows )
+            {
+                std::cerr << "Input read " << vecRegions[i].GetSize( 1 ) << " rows, expected at most " << uintMaximumRows << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /** Runs a filter created by createFilter over the whole image, then again
+     * through a StreamingImageFilter, comparing the results and the reads of
+     * the streamed input */
+    template< typename TFilter, typename TCreateFilter >
+    bool TestStreamingImageFilter( const std::string & strInputFile, TCreateFilter createFilter,
+                                   unsigned int uintExpectedUpdates, itk::SizeValueType uintMaximumRows )
+    {
+        typedef typename TFilter::OutputImageType OutputImageType;
+        typedef itk::StreamingImageFilter< OutputImageType, OutputImageType > StreamingImageFilterType;
+
+        ImageFileReaderType::Pointer pReferenceReader( ImageFileReaderType::New() );
+        pReferenceReader->SetFileName( strInputFile );
+
+        typename TFilter::Pointer pReferenceFilter( createFilter( pReferenceReader->GetOutput() ) );
+        pReferenceFilter->Update();
+
+        ImageFileReaderType::Pointer pReader( ImageFileReaderType::New() );
+        pReader->SetFileName( strInputFile );
+
+        PipelineMonitorType::Pointer pMonitor( PipelineMonitorType::New() );
+        pMonitor->SetInput( pReader->GetOutput() );
+
+        typename TFilter::Pointer pFilter( createFilter( pMonitor->GetOutput() ) );
+
+        typename StreamingImageFilterType::Pointer pStreamingImageFilter( StreamingImageFilterType::New() );
+        pStreamingImageFilter->SetInput( pFilter->GetOutput() );
+        pStreamingImageFilter->SetNumberOfStreamDivisions( STREAM_DIVISIONS );
+        pStreamingImageFilter->Update();
+
+        std::cout << pFilter->GetNameOfClass() << ": " << pMonitor->GetNumberOfUpdates() << " input updates" << std::endl;
+
+        return InputStreamed( pMonitor, uintExpectedUpdates, uintMaximumRows )
+            && ImagesEqual( pReferenceFilter->GetOutput(), pStreamingImageFilter->GetOutput() );
+    }
+}
+
+int itkCSIROTomoStreamingTest( int argc, char * argv[] )
+{
+    if( argc < 2 )
+    {
+        std::cerr << "Missing parameters." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Inputs are written uncompressed as MetaImage, which can be read in pieces
+    const std::string strOutputDirectory( argv[1] );
+    const std::string strImageFile( strOutputDirectory + "/streamingInput.mha" );
+    const std::string strImageFile2( strOutputDirectory + "/streamingInput2.mha" );
+    const std::string strMaskFile( strOutputDirectory + "/streamingMask.mha" );
+    const std::string strStreamedFile( strOutputDirectory + "/streamingMaskedMedian.mha" );
+
+    ImageFileWriterType::Pointer pImageFileWriter( ImageFileWriterType::New() );
+    pImageFileWriter->SetInput( CreateImage( 0.0 ) );
+    pImageFileWriter->SetFileName( strImageFile );
+    TRY_EXPECT_NO_EXCEPTION( pImageFileWriter->Update() );
+
+    pImageFileWriter->SetInput( CreateImage( 0.5 ) );
+    pImageFileWriter->SetFileName( strImageFile2 );
+    TRY_EXPECT_NO_EXCEPTION( pImageFileWriter->Update() );
+
+    MaskImageFileWriterType::Pointer pMaskImageFileWriter( MaskImageFileWriterType::New() );
+    pMaskImageFileWriter->SetInput( CreateMask() );
+    pMaskImageFileWriter->SetFileName( strMaskFile );
+    TRY_EXPECT_NO_EXCEPTION( pMaskImageFileWriter->Update() );
+
+    MaskImageFileReaderType::Pointer pMaskImageFileReader( MaskImageFileReaderType::New() );
+    pMaskImageFileReader->SetFileName( strMaskFile );
+
+    ThresholdedMedianImageFilterType::RadiusType radiusFilter;
+    radiusFilter.Fill( FILTER_RADIUS );
+
+    // Each piece of the neighborhood filters reads its rows plus the radius either side
+    const itk::SizeValueType uintPieceRows( IMAGE_HEIGHT / STREAM_DIVISIONS );
+    const itk::SizeValueType uintPaddedPieceRows( uintPieceRows + 2 * FILTER_RADIUS );
+
+    auto createMaskedMedian = [&]( ImageType * pInput ) -> MaskedMedianImageFilterType::Pointer
+    {
+        MaskedMedianImageFilterType::Pointer pFilter( MaskedMedianImageFilterType::New() );
+        pFilter->SetInput( pInput );
+        pFilter->SetMaskImage( pMaskImageFileReader->GetOutput() );
+        pFilter->SetRadius( radiusFilter );
+        return pFilter;
+    };
+
+    auto createThresholdedMedian = [&]( ImageType * pInput ) -> ThresholdedMedianImageFilterType::Pointer
+    {
+        ThresholdedMedianImageFilterType::Pointer pFilter( ThresholdedMedianImageFilterType::New() );
+        pFilter->SetInput( pInput );
+        pFilter->SetThresholdLower( 0.5 );
+        pFilter->SetThresholdUpper( 1.5 );
+        pFilter->SetRadius( radiusFilter );
+        return pFilter;
+    };
+
+    auto createThresholdedMedianMask = [&]( ImageType * pInput ) -> ThresholdedMedianMaskImageFilterType::Pointer
+    {
+        ThresholdedMedianMaskImageFilterType::Pointer pFilter( ThresholdedMedianMaskImageFilterType::New() );
+        pFilter->SetInput( pInput );
+        pFilter->SetThresholdLower( 0.5 );
+        pFilter->SetThresholdUpper( 1.5 );
+        pFilter->SetRadius( radiusFilter );
+        return pFilter;
+    };
+
+    auto createNegLog = [&]( ImageType * pInput ) -> NegLogCheckedImageFilterType::Pointer
+    {
+        NegLogCheckedImageFilterType::Pointer pFilter( NegLogCheckedImageFilterType::New() );
+        pFilter->SetInput( pInput );
+        return pFilter;
+    };
+
+    ImageFileReaderType::Pointer pImageFileReader2( ImageFileReaderType::New() );
+    pImageFileReader2->SetFileName( strImageFile2 );
+
+    auto createStitching = [&]( ImageType * pInput ) -> VerticalStitchingImageFilterType::Pointer
+    {
+        VerticalStitchingImageFilterType::Pointer pFilter( VerticalStitchingImageFilterType::New() );
+        pFilter->SetInput( 0, pInput );
+        pFilter->SetInput( 1, pImageFileReader2->GetOutput() );
+        pFilter->SetVerticalShift( IMAGE_HEIGHT - IMAGE_HEIGHT / 4 );
+        return pFilter;
+    };
+
+    TEST_EXPECT_TRUE( TestStreamingImageFilter< MaskedMedianImageFilterType >( strImageFile, createMaskedMedian, STREAM_DIVISIONS, uintPaddedPieceRows ) );
+    TEST_EXPECT_TRUE( TestStreamingImageFilter< ThresholdedMedianImageFilterType >( strImageFile, createThresholdedMedian, STREAM_DIVISIONS, uintPaddedPieceRows ) );
+    TEST_EXPECT_TRUE( TestStreamingImageFilter< ThresholdedMedianMaskImageFilterType >( strImageFile, createThresholdedMedianMask, STREAM_DIVISIONS, uintPaddedPieceRows ) );
+    TEST_EXPECT_TRUE( TestStreamingImageFilter< NegLogCheckedImageFilterType >( strImageFile, createNegLog, STREAM_DIVISIONS, uintPieceRows ) );
+
+    // Computing the weights, the stitched image is produced whole from a
+    // single read of its inputs
+    TEST_EXPECT_TRUE( TestStreamingImageFilter< VerticalStitchingImageFilterType >( strImageFile, createStitching, 1u, IMAGE_HEIGHT ) );
+
+    // Given the weights, it is stitched a band of rows at a time, the first
+    // input read for the pieces overlapping its rows only, its last row
+    // buffered already for the pieces below them
+    ImageFileReaderType::Pointer pWeightingReader( ImageFileReaderType::New() );
+    pWeightingReader->SetFileName( strImageFile );
+
+    VerticalStitchingImageFilterType::Pointer pWeightingFilter( createStitching( pWeightingReader->GetOutput() ) );
+    TRY_EXPECT_NO_EXCEPTION( pWeightingFilter->Update() );
+
+    auto createStitchingWeighted = [&]( ImageType * pInput ) -> VerticalStitchingImageFilterType::Pointer
+    {
+        VerticalStitchingImageFilterType::Pointer pFilter( createStitching( pInput ) );
+        pFilter->ComputeWeightingOff();
+        pFilter->SetWeightingAlpha( pWeightingFilter->GetWeightingAlpha() );
+        pFilter->SetWeightingBeta( pWeightingFilter->GetWeightingBeta() );
+        return pFilter;
+    };
+
+    const itk::SizeValueType uintStitchedRows( 2 * IMAGE_HEIGHT - IMAGE_HEIGHT / 4 );
+    const itk::SizeValueType uintStitchedPieceRows( ( uintStitchedRows + STREAM_DIVISIONS - 1 ) / STREAM_DIVISIONS );
+    const unsigned int uintStitchedUpdates( static_cast< unsigned int >( ( IMAGE_HEIGHT + uintStitchedPieceRows - 1 ) / uintStitchedPieceRows ) );
+    TEST_EXPECT_TRUE( TestStreamingImageFilter< VerticalStitchingImageFilterType >( strImageFile, createStitchingWeighted, uintStitchedUpdates, uintStitchedPieceRows ) );
+
+    // Streamed writing through ImageFileWriter
+    {
+        ImageFileReaderType::Pointer pReferenceReader( ImageFileReaderType::New() );
+        pReferenceReader->SetFileName( strImageFile );
+
+        MaskedMedianImageFilterType::Pointer pReferenceFilter( createMaskedMedian( pReferenceReader->GetOutput() ) );
+        TRY_EXPECT_NO_EXCEPTION( pReferenceFilter->Update() );
+
+        ImageFileReaderType::Pointer pReader( ImageFileReaderType::New() );
+        pReader->SetFileName( strImageFile );
+
+        PipelineMonitorType::Pointer pMonitor( PipelineMonitorType::New() );
+        pMonitor->SetInput( pReader->GetOutput() );
+
+        MaskedMedianImageFilterType::Pointer pFilter( createMaskedMedian( pMonitor->GetOutput() ) );
+
+        ImageFileWriterType::Pointer pStreamingWriter( ImageFileWriterType::New() );
+        pStreamingWriter->SetInput( pFilter->GetOutput() );
+        pStreamingWriter->SetFileName( strStreamedFile );
+        pStreamingWriter->SetNumberOfStreamDivisions( STREAM_DIVISIONS );
+        TRY_EXPECT_NO_EXCEPTION( pStreamingWriter->Update() );
+
+        TEST_EXPECT_TRUE( InputStreamed( pMonitor, STREAM_DIVISIONS, uintPaddedPieceRows ) );
+
+        ImageFileReaderType::Pointer pStreamedReader( ImageFileReaderType::New() );
+        pStreamedReader->SetFileName( strStreamedFile );
+        TRY_EXPECT_NO_EXCEPTION( pStreamedReader->Update() );
+
+        TEST_EXPECT_TRUE( ImagesEqual( pReferenceFilter->GetOutput(), pStreamedReader->GetOutput() ) );
+    }
+
+    // Back-projection streamed over slices, one detector row per piece
+    {
+        VolumeType::SizeType size;
+        size[0] = 48;
+        size[1] = STREAM_DIVISIONS;
+        size[2] = 30;
+
+        VolumeType::Pointer pProjections( VolumeType::New() );
+        pProjections->SetRegions( size );
+        pProjections->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< VolumeType > it( pProjections, pProjections->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            const double dblT( it.GetIndex()[0] - 23.5 - 6.0 * std::cos( itk::Math::pi * it.GetIndex()[2] / size[2] ) );
+            it.Set( static_cast< float >( std::fabs( dblT ) < 10.0 ? ( it.GetIndex()[1] + 1.0 ) * std::sqrt( 100.0 - dblT * dblT ) : 0.0 ) );
+        }
+
+        FilteredBackProjectionFilterType::Pointer pReferenceFilter( FilteredBackProjectionFilterType::New() );
+        pReferenceFilter->SetInput( pProjections );
+        TRY_EXPECT_NO_EXCEPTION( pReferenceFilter->Update() );
+
+        FilteredBackProjectionFilterType::Pointer pFilter( FilteredBackProjectionFilterType::New() );
+        pFilter->SetInput( pProjections );
+
+        using VolumeStreamingImageFilterType = itk::StreamingImageFilter< VolumeType, VolumeType >;
+        VolumeStreamingImageFilterType::Pointer pStreamingImageFilter( VolumeStreamingImageFilterType::New() );
+        pStreamingImageFilter->SetInput( pFilter->GetOutput() );
+        pStreamingImageFilter->SetNumberOfStreamDivisions( STREAM_DIVISIONS );
+        TRY_EXPECT_NO_EXCEPTION( pStreamingImageFilter->Update() );
+
+        TEST_EXPECT_TRUE( ImagesEqual( pReferenceFilter->GetOutput(), pStreamingImageFilter->GetOutput() ) );
+    }
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
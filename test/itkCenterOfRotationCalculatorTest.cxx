@@ -0,0 +1,214 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkCenterOfRotationCalculator.h"
+
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMath.h"
+#include "itkTestingMacros.h"
+
+#include <cmath>
+
+#define DETECTOR_WIDTH 128
+#define DETECTOR_ROWS 4
+#define OFFSET_TOLERANCE 0.1
+
+using ImageType = itk::Image< float, 2 >;
+using CenterOfRotationCalculatorType = itk::CenterOfRotationCalculator< ImageType >;
+
+namespace
+{
+    double DiskProjection( double dblT, double dblRadius )
+    {
+        return std::fabs( dblT ) < dblRadius ? 2.0 * std::sqrt( dblRadius * dblRadius - dblT * dblT ) : 0.0;
+    }
+
+    /** Line integral through an asymmetric phantom of three disks, at detector
+     * column u for a rotation axis dblAxisOffset columns right of the detector centre */
+    double PhantomProjection( double dblU, double dblAngle, double dblAxisOffset )
+    {
+        const double dblT( dblU - 0.5 * ( DETECTOR_WIDTH - 1 ) - dblAxisOffset );
+
+        return DiskProjection( dblT, 30.0 )
+             + DiskProjection( dblT - 14.0 * std::cos( dblAngle ) - 6.0 * std::sin( dblAngle ), 5.0 )
+             + 0.5 * DiskProjection( dblT + 20.0 * std::cos( dblAngle ), 3.0 );
+    }
+
+    ImageType::Pointer CreateProjection( double dblAngle, double dblAxisOffset )
+    {
+        ImageType::SizeType size;
+        size[0] = DETECTOR_WIDTH;
+        size[1] = DETECTOR_ROWS;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( static_cast< float >( ( it.GetIndex()[1] + 1.0 ) * PhantomProjection( it.GetIndex()[0], dblAngle, dblAxisOffset ) ) );
+
+        return pImage;
+    }
+
+    ImageType::Pointer CreateSinogram( unsigned int uintNumProjections, double dblAngleStep, double dblAxisOffset )
+    {
+        ImageType::SizeType size;
+        size[0] = DETECTOR_WIDTH;
+        size[1] = uintNumProjections;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( static_cast< float >( PhantomProjection( it.GetIndex()[0], it.GetIndex()[1] * dblAngleStep, dblAxisOffset ) ) );
+
+        return pImage;
+    }
+
+    bool IsClose( double dblValue, double dblExpected, double dblTolerance )
+    {
+        if( std::fabs( dblValue - dblExpected ) <= dblTolerance )
+            return true;
+
+        std::cerr << "Expected " << dblExpected << " +/- " << dblTolerance << ", got " << dblValue << std::endl;
+        return false;
+    }
+}
+
+int itkCenterOfRotationCalculatorTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    CenterOfRotationCalculatorType::Pointer pCalculator( CenterOfRotationCalculatorType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pCalculator, CenterOfRotationCalculator, Object );
+
+    // Neither a projection pair nor a sinogram
+    TRY_EXPECT_EXCEPTION( pCalculator->Compute() );
+
+    pCalculator->SetSubpixelSteps( 8 );
+    TEST_SET_GET_VALUE( 8u, pCalculator->GetSubpixelSteps() );
+
+    pCalculator->SetNumberOfThreads( 3 );
+    TEST_SET_GET_VALUE( 3u, pCalculator->GetNumberOfThreads() );
+
+    const double arrOffsets[] = { 0.0, 3.3, -6.8, 11.25, -14.6 };
+
+    for( unsigned int i = 0; i < sizeof( arrOffsets ) / sizeof( arrOffsets[0] ); i++ )
+    {
+        const double dblOffset( arrOffsets[i] );
+
+        // 0/180 degree projection pair, whole detector then trimmed off-centre
+        pCalculator->SetProjection( CreateProjection( 0.4, dblOffset ) );
+        pCalculator->SetOpposingProjection( CreateProjection( 0.4 + itk::Math::pi, dblOffset ) );
+
+        ImageType::PointType pointTrimMin;
+        pointTrimMin.Fill( 0.0 );
+        pCalculator->SetTrimPointMin( pointTrimMin );
+        pCalculator->SetTrimPointMax( pointTrimMin );
+
+        TRY_EXPECT_NO_EXCEPTION( pCalculator->Compute() );
+        TEST_EXPECT_TRUE( IsClose( pCalculator->GetCenterOfRotationOffset(), dblOffset, OFFSET_TOLERANCE ) );
+        TEST_EXPECT_TRUE( IsClose( pCalculator->GetCoarseOffset(), dblOffset, 1.0 ) );
+
+        ImageType::PointType pointTrimMax;
+        pointTrimMin[0] = 10.0;
+        pointTrimMax[0] = 118.0;
+        pointTrimMax[1] = DETECTOR_ROWS;
+        pCalculator->SetTrimPointMin( pointTrimMin );
+        pCalculator->SetTrimPointMax( pointTrimMax );
+
+        TRY_EXPECT_NO_EXCEPTION( pCalculator->Compute() );
+        TEST_EXPECT_TRUE( IsClose( pCalculator->GetCenterOfRotationOffset(), dblOffset, OFFSET_TOLERANCE ) );
+
+        // 360 degree sinogram, every row has an opposing row
+        pCalculator->SetProjection( ITK_NULLPTR );
+        pCalculator->SetOpposingProjection( ITK_NULLPTR );
+        pCalculator->SetSinogram( CreateSinogram( 60, 2.0 * itk::Math::pi / 60, dblOffset ) );
+        pCalculator->SetAngleStep( 2.0 * itk::Math::pi / 60 );
+        pCalculator->SetTrimPointMin( pointTrimMin );
+        pCalculator->SetTrimPointMax( pointTrimMin );
+
+        TRY_EXPECT_NO_EXCEPTION( pCalculator->Compute() );
+        TEST_EXPECT_TRUE( IsClose( pCalculator->GetCenterOfRotationOffset(), dblOffset, OFFSET_TOLERANCE ) );
+
+        // 180 degree sinogram including the final projection, first and last rows
+        pCalculator->SetSinogram( CreateSinogram( 91, itk::Math::pi / 90, dblOffset ) );
+        pCalculator->SetAngleStep( itk::Math::pi / 90 );
+
+        TRY_EXPECT_NO_EXCEPTION( pCalculator->Compute() );
+        TEST_EXPECT_TRUE( IsClose( pCalculator->GetCenterOfRotationOffset(), dblOffset, OFFSET_TOLERANCE ) );
+
+        // Without an angle step the last row opposes the first
+        const double dblExplicitStep( pCalculator->GetCenterOfRotationOffset() );
+        pCalculator->SetAngleStep( 0.0 );
+
+        TRY_EXPECT_NO_EXCEPTION( pCalculator->Compute() );
+        TEST_EXPECT_TRUE( IsClose( pCalculator->GetCenterOfRotationOffset(), dblExplicitStep, 1.0e-9 ) );
+
+        pCalculator->SetSinogram( ITK_NULLPTR );
+    }
+
+    // A single row has no opposing row without an angle step
+    pCalculator->SetSinogram( CreateSinogram( 1, 0.0, 0.0 ) );
+    TRY_EXPECT_EXCEPTION( pCalculator->Compute() );
+    pCalculator->SetSinogram( ITK_NULLPTR );
+
+    // Trim points must bound a region of the projections, the exclusive
+    // max bound at most one pixel past them
+    pCalculator->SetProjection( CreateProjection( 0.4, 3.3 ) );
+    pCalculator->SetOpposingProjection( CreateProjection( 0.4 + itk::Math::pi, 3.3 ) );
+
+    ImageType::PointType pointTrimMin;
+    ImageType::PointType pointTrimMax;
+    pointTrimMin[0] = 10.0;
+    pointTrimMin[1] = 0.0;
+    pointTrimMax[0] = DETECTOR_WIDTH;
+    pointTrimMax[1] = DETECTOR_ROWS;
+    pCalculator->SetTrimPointMin( pointTrimMin );
+    pCalculator->SetTrimPointMax( pointTrimMax );
+    TRY_EXPECT_NO_EXCEPTION( pCalculator->Compute() );
+    TEST_EXPECT_TRUE( IsClose( pCalculator->GetCenterOfRotationOffset(), 3.3, OFFSET_TOLERANCE ) );
+
+    pointTrimMax[0] = DETECTOR_WIDTH + 1;
+    pCalculator->SetTrimPointMax( pointTrimMax );
+    TRY_EXPECT_EXCEPTION( pCalculator->Compute() );
+
+    pointTrimMax[0] = DETECTOR_WIDTH;
+    pointTrimMin[0] = -5.0;
+    pCalculator->SetTrimPointMax( pointTrimMax );
+    pCalculator->SetTrimPointMin( pointTrimMin );
+    TRY_EXPECT_EXCEPTION( pCalculator->Compute() );
+
+    pointTrimMin[0] = DETECTOR_WIDTH / 2;
+    pointTrimMax[0] = DETECTOR_WIDTH / 4;
+    pCalculator->SetTrimPointMin( pointTrimMin );
+    pCalculator->SetTrimPointMax( pointTrimMax );
+    TRY_EXPECT_EXCEPTION( pCalculator->Compute() );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
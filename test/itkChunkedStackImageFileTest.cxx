@@ -0,0 +1,198 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkChunkedStackImageFileWriter.h"
+#include "itkChunkedStackImageFileReader.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+
+#include "itksys/SystemTools.hxx"
+
+#include <cmath>
+#include <fstream>
+
+#define STACK_WIDTH 40
+#define STACK_HEIGHT 37
+#define STACK_PROJECTIONS 21
+#define CHUNK_ROWS 8
+#define CHUNK_PROJECTIONS 4
+
+using ImageType = itk::Image< float, 3 >;
+using WriterType = itk::ChunkedStackImageFileWriter< ImageType >;
+using ReaderType = itk::ChunkedStackImageFileReader< ImageType >;
+
+namespace
+{
+    /** Checks the buffered region of the read image against the written one */
+    bool CheckRegion( const ImageType * pWritten, const ImageType * pRead, const ImageType::RegionType & region )
+    {
+        if( pRead->GetBufferedRegion() != region )
+        {
+            std::cerr << "Read " << pRead->GetBufferedRegion() << " rather than " << region << std::endl;
+            return false;
+        }
+
+        itk::ImageRegionConstIteratorWithIndex< ImageType > it( pRead, region );
+        for( ; !it.IsAtEnd(); ++it )
+        {
+            if( it.Get() != pWritten->GetPixel( it.GetIndex() ) )
+            {
+                std::cerr << "Read " << it.Get() << " at " << it.GetIndex() << ", written " << pWritten->GetPixel( it.GetIndex() ) << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int itkChunkedStackImageFileTest( int argc, char * argv[] )
+{
+    if( argc < 2 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << " outputFile";
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string strFileName( argv[1] );
+
+    WriterType::Pointer pWriter( WriterType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pWriter, ChunkedStackImageFileWriter, ProcessObject );
+
+    ReaderType::Pointer pReader( ReaderType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pReader, ChunkedStackImageFileReader, ImageSource );
+
+    // A smooth stack, sizes not multiples of the chunks
+    ImageType::SizeType size;
+    size[0] = STACK_WIDTH;
+    size[1] = STACK_HEIGHT;
+    size[2] = STACK_PROJECTIONS;
+
+    ImageType::SpacingType spacing;
+    spacing[0] = 0.5;
+    spacing[1] = 0.25;
+    spacing[2] = 1.0;
+
+    ImageType::PointType origin;
+    origin[0] = -10.0;
+    origin[1] = 3.0;
+    origin[2] = 0.125;
+
+    ImageType::Pointer pStack( ImageType::New() );
+    pStack->SetRegions( size );
+    pStack->SetSpacing( spacing );
+    pStack->SetOrigin( origin );
+    pStack->Allocate();
+
+    itk::ImageRegionIteratorWithIndex< ImageType > it( pStack, pStack->GetLargestPossibleRegion() );
+    for( ; !it.IsAtEnd(); ++it )
+    {
+        const ImageType::IndexType index( it.GetIndex() );
+        it.Set( static_cast< float >( 2.0 + std::sin( 0.1 * index[0] + 0.3 * index[2] ) * std::cos( 0.05 * index[1] ) ) );
+    }
+
+    ImageType::SizeType sizeChunk;
+    sizeChunk[0] = 0;
+    sizeChunk[1] = CHUNK_ROWS;
+    sizeChunk[2] = CHUNK_PROJECTIONS;
+
+    pWriter->SetInput( pStack );
+    pWriter->SetFileName( strFileName );
+    TEST_SET_GET_VALUE( strFileName, std::string( pWriter->GetFileName() ) );
+    pWriter->SetChunkSize( sizeChunk );
+    TEST_SET_GET_VALUE( sizeChunk, pWriter->GetChunkSize() );
+    pWriter->SetCompressionLevel( 6 );
+    TEST_SET_GET_VALUE( 6, pWriter->GetCompressionLevel() );
+    pWriter->SetNumberOfChunksPerThread( 1 );
+    TEST_SET_GET_VALUE( 1u, pWriter->GetNumberOfChunksPerThread() );
+
+    TRY_EXPECT_NO_EXCEPTION( pWriter->Update() );
+
+    const itk::SizeValueType uintChunksPerProjection( ( STACK_HEIGHT + CHUNK_ROWS - 1 ) / CHUNK_ROWS );
+    const itk::SizeValueType uintChunksPerRow( ( STACK_PROJECTIONS + CHUNK_PROJECTIONS - 1 ) / CHUNK_PROJECTIONS );
+    const itk::SizeValueType uintNumChunks( uintChunksPerProjection * uintChunksPerRow );
+    TEST_EXPECT_EQUAL( pWriter->GetHeader().GetNumberOfChunks(), uintNumChunks );
+
+    // Smooth data compresses
+    const unsigned long uintFileSize( itksys::SystemTools::FileLength( strFileName ) );
+    std::cout << "File of " << uintFileSize << " bytes for " << pStack->GetLargestPossibleRegion().GetNumberOfPixels() * sizeof( float )
+              << " bytes of pixels" << std::endl;
+    TEST_EXPECT_TRUE( uintFileSize < pStack->GetLargestPossibleRegion().GetNumberOfPixels() * sizeof( float ) );
+
+    // The whole stack, with its geometry
+    pReader->SetFileName( strFileName );
+    TEST_SET_GET_VALUE( strFileName, std::string( pReader->GetFileName() ) );
+    TRY_EXPECT_NO_EXCEPTION( pReader->Update() );
+    TEST_EXPECT_TRUE( pReader->GetOutput()->GetLargestPossibleRegion() == pStack->GetLargestPossibleRegion() );
+    TEST_EXPECT_TRUE( pReader->GetOutput()->GetSpacing() == spacing );
+    TEST_EXPECT_TRUE( pReader->GetOutput()->GetOrigin() == origin );
+    TEST_EXPECT_TRUE( pReader->GetOutput()->GetDirection() == pStack->GetDirection() );
+    TEST_EXPECT_TRUE( CheckRegion( pStack, pReader->GetOutput(), pStack->GetLargestPossibleRegion() ) );
+    TEST_EXPECT_EQUAL( pReader->GetNumberOfChunksRead(), uintNumChunks );
+
+    // A single projection, reading one chunk of projections. The reader is
+    // modified, as the region lies within the one already buffered
+    ImageType::RegionType regionProjection( pStack->GetLargestPossibleRegion() );
+    regionProjection.SetIndex( 2, CHUNK_PROJECTIONS + 1 );
+    regionProjection.SetSize( 2, 1 );
+
+    pReader->GetOutput()->SetRequestedRegion( regionProjection );
+    pReader->Modified();
+    TRY_EXPECT_NO_EXCEPTION( pReader->Update() );
+    TEST_EXPECT_TRUE( CheckRegion( pStack, pReader->GetOutput(), regionProjection ) );
+    TEST_EXPECT_EQUAL( pReader->GetNumberOfChunksRead(), uintChunksPerProjection );
+
+    // A sinogram slab, a few rows straddling two chunks of rows
+    ImageType::RegionType regionSinograms( pStack->GetLargestPossibleRegion() );
+    regionSinograms.SetIndex( 1, CHUNK_ROWS - 1 );
+    regionSinograms.SetSize( 1, 2 );
+
+    pReader->GetOutput()->SetRequestedRegion( regionSinograms );
+    TRY_EXPECT_NO_EXCEPTION( pReader->Update() );
+    TEST_EXPECT_TRUE( CheckRegion( pStack, pReader->GetOutput(), regionSinograms ) );
+    TEST_EXPECT_EQUAL( pReader->GetNumberOfChunksRead(), 2 * uintChunksPerRow );
+
+    // Pixel types of another size are refused
+    using ShortImageType = itk::Image< short, 3 >;
+    using ShortReaderType = itk::ChunkedStackImageFileReader< ShortImageType >;
+    ShortReaderType::Pointer pShortReader( ShortReaderType::New() );
+    pShortReader->SetFileName( strFileName );
+    TRY_EXPECT_EXCEPTION( pShortReader->Update() );
+
+    // As are files of other formats and truncated files
+    const std::string strBadFileName( strFileName + ".bad" );
+    {
+        std::ofstream ofs( strBadFileName.c_str(), std::ios::binary );
+        ofs << "CSIROTomoChunkedStack1\nDimension 3\nPixelType float\nPixelSize 4\n";
+    }
+
+    ReaderType::Pointer pBadReader( ReaderType::New() );
+    pBadReader->SetFileName( strBadFileName );
+    TRY_EXPECT_EXCEPTION( pBadReader->Update() );
+
+    pBadReader->SetFileName( strFileName + ".missing" );
+    TRY_EXPECT_EXCEPTION( pBadReader->Update() );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,243 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkDefectMapRepairImageFilter.h"
+#include "itkDetectorDefectMap.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkPackedBitMaskImage.h"
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#define FRAME_WIDTH 70
+#define FRAME_HEIGHT 24
+
+using ImageType = itk::Image< float, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+using PackedMaskImageType = itk::PackedBitMaskImage< 2 >;
+using DetectorDefectMapType = itk::DetectorDefectMap< 2 >;
+using DefectMapRepairImageFilterType = itk::DefectMapRepairImageFilter< ImageType >;
+
+namespace
+{
+    ImageType::Pointer CreateFrame()
+    {
+        ImageType::SizeType size;
+        size[0] = FRAME_WIDTH;
+        size[1] = FRAME_HEIGHT;
+
+        ImageType::Pointer pFrame( ImageType::New() );
+        pFrame->SetRegions( size );
+        pFrame->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pFrame, pFrame->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( static_cast< float >( 100.0 + 10.0 * std::sin( 0.3 * it.GetIndex()[0] ) + 0.5 * it.GetIndex()[1] ) );
+
+        return pFrame;
+    }
+
+    /** Median of the neighbours within radius 1 that are on the frame and
+     * not defects, the upper middle value of an even count */
+    float ReferenceRepair( const ImageType * pFrame, const MaskImageType * pMask, const ImageType::IndexType & index )
+    {
+        std::vector< float > vecValues;
+        for( int dy = -1; dy <= 1; dy++ )
+        {
+            for( int dx = -1; dx <= 1; dx++ )
+            {
+                ImageType::IndexType indexNeighbor( index );
+                indexNeighbor[0] += dx;
+                indexNeighbor[1] += dy;
+
+                if( pFrame->GetLargestPossibleRegion().IsInside( indexNeighbor ) && !pMask->GetPixel( indexNeighbor ) )
+                    vecValues.push_back( pFrame->GetPixel( indexNeighbor ) );
+            }
+        }
+
+        if( vecValues.empty() )
+            return pFrame->GetPixel( index );
+
+        std::nth_element( vecValues.begin(), vecValues.begin() + vecValues.size() / 2, vecValues.end() );
+        return vecValues[vecValues.size() / 2];
+    }
+
+    bool CheckRepair( const ImageType * pFrame, const MaskImageType * pMask, const ImageType * pRepaired )
+    {
+        itk::ImageRegionConstIteratorWithIndex< ImageType > it( pRepaired, pRepaired->GetLargestPossibleRegion() );
+        for( ; !it.IsAtEnd(); ++it )
+        {
+            const float fltExpected( pMask->GetPixel( it.GetIndex() ) ? ReferenceRepair( pFrame, pMask, it.GetIndex() ) : pFrame->GetPixel( it.GetIndex() ) );
+
+            if( it.Get() != fltExpected )
+            {
+                std::cerr << "Pixel " << it.GetIndex() << " is " << it.Get() << ", expected " << fltExpected << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int itkDefectMapRepairImageFilterTest( int argc, char * argv[] )
+{
+    if( argc < 2 )
+    {
+        std::cerr << "Missing parameters." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " defectMapFile" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ImageType::Pointer pFrame( CreateFrame() );
+    const ImageType::RegionType region( pFrame->GetLargestPossibleRegion() );
+
+    // Isolated defects, a cluster, a corner, a column and a defect wholly
+    // surrounded by others, across the words of the packed mask
+    MaskImageType::Pointer pMask( MaskImageType::New() );
+    pMask->SetRegions( region );
+    pMask->Allocate( true );
+
+    PackedMaskImageType::Pointer pPackedMask( PackedMaskImageType::New() );
+    pPackedMask->SetRegions( region );
+    pPackedMask->Allocate( true );
+
+    const int arrDefects[][2] = { { 5, 5 }, { 63, 2 }, { 64, 2 }, { 64, 3 }, { 0, 0 }, { 69, 23 },
+                                  { 20, 10 }, { 21, 10 }, { 22, 10 }, { 20, 11 }, { 21, 11 }, { 22, 11 }, { 20, 12 }, { 21, 12 }, { 22, 12 } };
+    for( size_t i = 0; i < sizeof( arrDefects ) / sizeof( arrDefects[0] ); i++ )
+    {
+        ImageType::IndexType index;
+        index[0] = arrDefects[i][0];
+        index[1] = arrDefects[i][1];
+        pMask->SetPixel( index, 1 );
+        pPackedMask->SetPixel( index, true );
+    }
+    for( int y = 0; y < FRAME_HEIGHT; y++ )
+    {
+        ImageType::IndexType index;
+        index[0] = 40;
+        index[1] = y;
+        pMask->SetPixel( index, 1 );
+        pPackedMask->SetPixel( index, true );
+    }
+
+    const itk::SizeValueType uintNumDefects( sizeof( arrDefects ) / sizeof( arrDefects[0] ) + FRAME_HEIGHT );
+
+    DetectorDefectMapType::Pointer pMap( DetectorDefectMapType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pMap, DetectorDefectMap, Object );
+
+    pMap->Initialize( region );
+    DetectorDefectMapType::RadiusType radius;
+    radius.Fill( 1 );
+    pMap->SetRadius( radius );
+    TEST_SET_GET_VALUE( radius, pMap->GetRadius() );
+
+    // Masks of either kind give the same defects, added twice they are merged
+    pMap->AddDefects( pPackedMask.GetPointer() );
+    pMap->AddDefects( pMask.GetPointer() );
+    pMap->Update();
+    TEST_EXPECT_EQUAL( pMap->GetNumberOfDefects(), uintNumDefects );
+
+    for( itk::SizeValueType i = 0; i < pMap->GetNumberOfDefects(); i++ )
+    {
+        TEST_EXPECT_TRUE( pMask->GetPixel( pMap->GetDefectIndex( i ) ) != 0 );
+        if( i > 0 )
+            TEST_EXPECT_TRUE( pMap->GetDefectOffsets()[i - 1] < pMap->GetDefectOffsets()[i] );
+    }
+
+    // The corner stencil holds the three pixels on the frame, the centre of
+    // the cluster none
+    ImageType::IndexType indexCorner;
+    indexCorner.Fill( 0 );
+    TEST_EXPECT_EQUAL( pMap->GetDefectIndex( 0 ), indexCorner );
+    TEST_EXPECT_EQUAL( pMap->GetStencilSize( 0 ), 3u );
+
+    for( itk::SizeValueType i = 0; i < pMap->GetNumberOfDefects(); i++ )
+    {
+        if( pMap->GetDefectIndex( i )[0] == 21 && pMap->GetDefectIndex( i )[1] == 11 )
+            TEST_EXPECT_EQUAL( pMap->GetStencilSize( i ), 0u );
+    }
+
+    ImageType::IndexType indexOutside;
+    indexOutside[0] = FRAME_WIDTH;
+    indexOutside[1] = 0;
+    TRY_EXPECT_EXCEPTION( pMap->AddDefect( indexOutside ) );
+
+    // Saved and read back with the same stencils
+    const std::string strFileName( argv[1] );
+    TRY_EXPECT_NO_EXCEPTION( pMap->Write( strFileName ) );
+
+    DetectorDefectMapType::Pointer pReadMap( DetectorDefectMapType::New() );
+    TRY_EXPECT_NO_EXCEPTION( pReadMap->Read( strFileName ) );
+    TEST_EXPECT_EQUAL( pReadMap->GetRegion(), region );
+    TEST_EXPECT_EQUAL( pReadMap->GetRadius(), radius );
+    TEST_EXPECT_TRUE( pReadMap->GetDefectOffsets() == pMap->GetDefectOffsets() );
+    for( itk::SizeValueType i = 0; i < pMap->GetNumberOfDefects(); i++ )
+    {
+        TEST_EXPECT_EQUAL( pReadMap->GetStencilSize( i ), pMap->GetStencilSize( i ) );
+        TEST_EXPECT_TRUE( std::equal( pMap->GetStencil( i ), pMap->GetStencil( i ) + pMap->GetStencilSize( i ), pReadMap->GetStencil( i ) ) );
+    }
+
+    TRY_EXPECT_EXCEPTION( pReadMap->Read( strFileName + ".missing" ) );
+
+    // Repaired into a new output, the defects by the median of their
+    // stencils and the other pixels copied
+    DefectMapRepairImageFilterType::Pointer pFilter( DefectMapRepairImageFilterType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pFilter, DefectMapRepairImageFilter, InPlaceImageFilter );
+
+    pFilter->SetInput( pFrame );
+    TRY_EXPECT_EXCEPTION( pFilter->Update() );
+
+    pFilter->SetDefectMap( pReadMap );
+    pFilter->InPlaceOff();
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+    TEST_EXPECT_TRUE( CheckRepair( pFrame, pMask, pFilter->GetOutput() ) );
+#ifdef ITKCSIROTomo_USE_INSTRUMENTATION
+    // One median per defect with a stencil
+    TEST_EXPECT_EQUAL( pFilter->GetInstrumentation()->GetMediansComputed(), uintNumDefects - 1 );
+#endif
+
+    // In place, the frame itself repaired
+    ImageType::Pointer pInPlaceFrame( CreateFrame() );
+
+    DefectMapRepairImageFilterType::Pointer pInPlaceFilter( DefectMapRepairImageFilterType::New() );
+    pInPlaceFilter->SetInput( pInPlaceFrame );
+    pInPlaceFilter->SetDefectMap( pMap );
+    pInPlaceFilter->SetNumberOfThreads( 3 );
+    TRY_EXPECT_NO_EXCEPTION( pInPlaceFilter->Update() );
+    TEST_EXPECT_TRUE( CheckRepair( pFrame, pMask, pInPlaceFilter->GetOutput() ) );
+
+    // A frame of another size is an error
+    ImageType::RegionType regionSmall( region );
+    regionSmall.SetSize( 0, FRAME_WIDTH - 1 );
+    ImageType::Pointer pSmallFrame( ImageType::New() );
+    pSmallFrame->SetRegions( regionSmall );
+    pSmallFrame->Allocate( true );
+
+    pFilter->SetInput( pSmallFrame );
+    TRY_EXPECT_EXCEPTION( pFilter->Update() );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
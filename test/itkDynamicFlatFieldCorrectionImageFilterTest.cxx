@@ -0,0 +1,286 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkDynamicFlatFieldCorrectionImageFilter.h"
+#include "itkEigenFlatCalculator.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkStreamingImageFilter.h"
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define FLAT_WIDTH 48
+#define FLAT_HEIGHT 30
+#define NUM_FLATS 20
+#define FIT_COLUMNS 8
+#define STACK_FRAMES 3
+
+using ImageType = itk::Image< float, 2 >;
+using StackType = itk::Image< float, 3 >;
+using EigenFlatCalculatorType = itk::EigenFlatCalculator< ImageType >;
+using DynamicFlatFieldCorrectionImageFilterType = itk::DynamicFlatFieldCorrectionImageFilter< ImageType >;
+using StackFlatFieldCorrectionImageFilterType = itk::DynamicFlatFieldCorrectionImageFilter< StackType >;
+using StreamingImageFilterType = itk::StreamingImageFilter< ImageType, ImageType >;
+
+namespace
+{
+    /** Mean flat field and its two drift modes, a tilt across the detector and
+     * a ripple down it */
+    double FlatValue( const ImageType::IndexType & index, double dblTilt, double dblRipple )
+    {
+        const double dblX( static_cast< double >( index[0] ) / FLAT_WIDTH - 0.5 );
+        const double dblY( static_cast< double >( index[1] ) / FLAT_HEIGHT );
+
+        return 100.0 + 10.0 * std::sin( 3.0 * dblX ) * std::cos( 2.0 * dblY ) + dblTilt * 8.0 * dblX + dblRipple * 3.0 * std::cos( 9.0 * dblY );
+    }
+
+    /** Transmission of a sample clear of the first FIT_COLUMNS columns */
+    double Transmission( const ImageType::IndexType & index )
+    {
+        return index[0] >= FIT_COLUMNS + 4 && index[0] < FLAT_WIDTH - 4 ? 0.5 + 0.01 * index[1] : 1.0;
+    }
+
+    ImageType::Pointer CreateImage( double dblTilt, double dblRipple, bool blnSample )
+    {
+        ImageType::SizeType size;
+        size[0] = FLAT_WIDTH;
+        size[1] = FLAT_HEIGHT;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( static_cast< float >( FlatValue( it.GetIndex(), dblTilt, dblRipple ) * ( blnSample ? Transmission( it.GetIndex() ) : 1.0 ) ) );
+
+        return pImage;
+    }
+
+    double Dot( const ImageType * pImage, const ImageType * pOtherImage )
+    {
+        itk::ImageRegionConstIterator< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        itk::ImageRegionConstIterator< ImageType > itOther( pOtherImage, pOtherImage->GetLargestPossibleRegion() );
+
+        double dblSum( 0.0 );
+        for( ; !it.IsAtEnd(); ++it, ++itOther )
+            dblSum += static_cast< double >( it.Get() ) * itOther.Get();
+
+        return dblSum;
+    }
+
+    /** Stack of frames along the third axis, as an (N, Y, X) array is viewed */
+    StackType::Pointer CreateStack( const std::vector< ImageType::Pointer > & vecFrames )
+    {
+        StackType::SizeType size;
+        size[0] = FLAT_WIDTH;
+        size[1] = FLAT_HEIGHT;
+        size[2] = vecFrames.size();
+
+        StackType::Pointer pStack( StackType::New() );
+        pStack->SetRegions( size );
+        pStack->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< StackType > it( pStack, pStack->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            ImageType::IndexType index;
+            index[0] = it.GetIndex()[0];
+            index[1] = it.GetIndex()[1];
+            it.Set( vecFrames[it.GetIndex()[2]]->GetPixel( index ) );
+        }
+
+        return pStack;
+    }
+
+    /** Largest deviation of a corrected projection from the sample transmission */
+    double MaximumError( const ImageType * pCorrected )
+    {
+        double dblError( 0.0 );
+
+        itk::ImageRegionConstIteratorWithIndex< ImageType > it( pCorrected, pCorrected->GetLargestPossibleRegion() );
+        for( ; !it.IsAtEnd(); ++it )
+            dblError = std::max( dblError, std::fabs( it.Get() - Transmission( it.GetIndex() ) ) );
+
+        return dblError;
+    }
+}
+
+int itkDynamicFlatFieldCorrectionImageFilterTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Flat series drifting along both modes about the mean flat
+    std::vector< ImageType::Pointer > vecFlats;
+    for( unsigned int n = 0; n < NUM_FLATS; n++ )
+        vecFlats.push_back( CreateImage( std::sin( 0.9 * n ), std::cos( 0.4 * n ) - 0.3 * std::sin( 2.1 * n ), false ) );
+
+    ImageType::Pointer pMeanFlat( CreateImage( 0.0, 0.0, false ) );
+    {
+        itk::ImageRegionIterator< ImageType > it( pMeanFlat, pMeanFlat->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            double dblSum( 0.0 );
+            for( unsigned int n = 0; n < NUM_FLATS; n++ )
+                dblSum += vecFlats[n]->GetPixel( it.GetIndex() );
+            it.Set( static_cast< float >( dblSum / NUM_FLATS ) );
+        }
+    }
+
+    EigenFlatCalculatorType::Pointer pCalculator( EigenFlatCalculatorType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pCalculator, EigenFlatCalculator, Object );
+
+    TRY_EXPECT_EXCEPTION( pCalculator->AddFlat( vecFlats[0] ) );
+
+    pCalculator->SetNumberOfEigenFlats( 4 );
+    TEST_SET_GET_VALUE( 4u, pCalculator->GetNumberOfEigenFlats() );
+    pCalculator->SetMeanFlat( pMeanFlat );
+
+    for( unsigned int n = 0; n < NUM_FLATS; n++ )
+        TRY_EXPECT_NO_EXCEPTION( pCalculator->AddFlat( vecFlats[n] ) );
+
+    TEST_EXPECT_EQUAL( pCalculator->GetNumberOfFlats(), static_cast< itk::SizeValueType >( NUM_FLATS ) );
+    TEST_EXPECT_TRUE( pCalculator->GetNumberOfComputedEigenFlats() >= 2 );
+    TRY_EXPECT_EXCEPTION( pCalculator->GetEigenFlat( pCalculator->GetNumberOfComputedEigenFlats() ) );
+
+    // Two modes hold the variance of the series, the remainder is rounding
+    const EigenFlatCalculatorType::SingularValuesType & vecSingularValues( pCalculator->GetSingularValues() );
+    TEST_EXPECT_TRUE( vecSingularValues[1] > 0.05 * vecSingularValues[0] );
+    for( size_t k = 2; k < vecSingularValues.size(); k++ )
+        TEST_EXPECT_TRUE( vecSingularValues[k] < 1.0e-3 * vecSingularValues[0] );
+
+    ImageType::Pointer pEigenFlat0( pCalculator->GetEigenFlat( 0 ) );
+    ImageType::Pointer pEigenFlat1( pCalculator->GetEigenFlat( 1 ) );
+    TEST_EXPECT_TRUE( std::fabs( Dot( pEigenFlat0, pEigenFlat1 ) ) < 1.0e-4 * std::sqrt( Dot( pEigenFlat0, pEigenFlat0 ) * Dot( pEigenFlat1, pEigenFlat1 ) ) );
+
+    // A projection of a flat field off the series, the sample clear of the
+    // first columns
+    ImageType::Pointer pProjection( CreateImage( 0.7, -0.8, true ) );
+
+    ImageType::RegionType regionFit( pProjection->GetLargestPossibleRegion() );
+    regionFit.SetSize( 0, FIT_COLUMNS );
+
+    DynamicFlatFieldCorrectionImageFilterType::Pointer pFilter( DynamicFlatFieldCorrectionImageFilterType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pFilter, DynamicFlatFieldCorrectionImageFilter, ImageToImageFilter );
+
+    pFilter->SetInput( pProjection );
+    pFilter->SetMeanFlat( pMeanFlat );
+
+    // Divided by the mean flat alone the drift remains
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+    const double dblStaticError( MaximumError( pFilter->GetOutput() ) );
+    TEST_EXPECT_TRUE( dblStaticError > 1.0e-2 );
+
+    pFilter->SetFitRegion( regionFit );
+    TEST_SET_GET_VALUE( regionFit, pFilter->GetFitRegion() );
+    pFilter->SetEigenFlat( 0, pEigenFlat0 );
+    pFilter->SetEigenFlat( 1, pEigenFlat1 );
+    TEST_EXPECT_EQUAL( pFilter->GetNumberOfEigenFlats(), 2u );
+
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+    TEST_EXPECT_EQUAL( pFilter->GetWeights().size(), static_cast< size_t >( 2 ) );
+
+    const double dblDynamicError( MaximumError( pFilter->GetOutput() ) );
+    std::cout << "Maximum error, mean flat " << dblStaticError << ", eigenflats " << dblDynamicError << std::endl;
+    TEST_EXPECT_TRUE( dblDynamicError < 1.0e-3 );
+
+    // Streamed, every piece fitted over the same region alike
+    DynamicFlatFieldCorrectionImageFilterType::Pointer pStreamedFilter( DynamicFlatFieldCorrectionImageFilterType::New() );
+    pStreamedFilter->SetInput( pProjection );
+    pStreamedFilter->SetMeanFlat( pMeanFlat );
+    pStreamedFilter->SetEigenFlat( 0, pEigenFlat0 );
+    pStreamedFilter->SetEigenFlat( 1, pEigenFlat1 );
+    pStreamedFilter->SetFitRegion( regionFit );
+
+    StreamingImageFilterType::Pointer pStreamer( StreamingImageFilterType::New() );
+    pStreamer->SetInput( pStreamedFilter->GetOutput() );
+    pStreamer->SetNumberOfStreamDivisions( 5 );
+    TRY_EXPECT_NO_EXCEPTION( pStreamer->Update() );
+
+    itk::ImageRegionConstIterator< ImageType > it( pFilter->GetOutput(), pFilter->GetOutput()->GetLargestPossibleRegion() );
+    itk::ImageRegionConstIterator< ImageType > itStreamed( pStreamer->GetOutput(), pStreamer->GetOutput()->GetLargestPossibleRegion() );
+    for( ; !it.IsAtEnd(); ++it, ++itStreamed )
+    {
+        if( std::fabs( it.Get() - itStreamed.Get() ) > 1.0e-5f )
+        {
+            std::cerr << "Streamed pixel " << it.GetIndex() << " is " << itStreamed.Get() << ", expected " << it.Get() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // A stack of projections off the series corrected in one update, each
+    // frame fitted with its own weights as if corrected alone
+    std::vector< ImageType::Pointer > vecProjections;
+    std::vector< ImageType::Pointer > vecCorrected;
+    for( unsigned int n = 0; n < STACK_FRAMES; n++ )
+    {
+        vecProjections.push_back( CreateImage( 0.9 - 0.6 * n, 0.5 * n - 0.4, true ) );
+
+        pFilter->SetInput( vecProjections[n] );
+        TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+        vecCorrected.push_back( pFilter->GetOutput() );
+        vecCorrected.back()->DisconnectPipeline();
+    }
+
+    std::vector< ImageType::Pointer > vecMeanFlat( 1, pMeanFlat );
+    std::vector< ImageType::Pointer > vecEigenFlat0( 1, pEigenFlat0 );
+    std::vector< ImageType::Pointer > vecEigenFlat1( 1, pEigenFlat1 );
+
+    StackType::RegionType regionStackFit;
+    regionStackFit.SetSize( 0, FIT_COLUMNS );
+    regionStackFit.SetSize( 1, FLAT_HEIGHT );
+    regionStackFit.SetSize( 2, 1 );
+
+    StackFlatFieldCorrectionImageFilterType::Pointer pStackFilter( StackFlatFieldCorrectionImageFilterType::New() );
+    pStackFilter->SetInput( CreateStack( vecProjections ) );
+    pStackFilter->SetMeanFlat( CreateStack( vecMeanFlat ) );
+    pStackFilter->SetEigenFlat( 0, CreateStack( vecEigenFlat0 ) );
+    pStackFilter->SetEigenFlat( 1, CreateStack( vecEigenFlat1 ) );
+    pStackFilter->SetFitRegion( regionStackFit );
+    TRY_EXPECT_NO_EXCEPTION( pStackFilter->Update() );
+    TEST_EXPECT_EQUAL( pStackFilter->GetWeights().size(), static_cast< size_t >( 2 * STACK_FRAMES ) );
+
+    itk::ImageRegionConstIteratorWithIndex< StackType > itStack( pStackFilter->GetOutput(), pStackFilter->GetOutput()->GetLargestPossibleRegion() );
+    for( ; !itStack.IsAtEnd(); ++itStack )
+    {
+        ImageType::IndexType index;
+        index[0] = itStack.GetIndex()[0];
+        index[1] = itStack.GetIndex()[1];
+
+        if( std::fabs( itStack.Get() - vecCorrected[itStack.GetIndex()[2]]->GetPixel( index ) ) > 1.0e-5f )
+        {
+            std::cerr << "Stack pixel " << itStack.GetIndex() << " is " << itStack.Get() << ", expected " << vecCorrected[itStack.GetIndex()[2]]->GetPixel( index ) << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
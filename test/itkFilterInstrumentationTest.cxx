@@ -0,0 +1,117 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkCSIROTomoInstrumentation.h"
+#include "itkMaskedMedianImageFilter.h"
+#include "itkThresholdedMedianMaskImageFilter.h"
+
+#include "itkCommand.h"
+#include "itkTestingMacros.h"
+
+using ImageType = itk::Image< float, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+using ThresholdedMedianMaskImageFilterType = itk::ThresholdedMedianMaskImageFilter< ImageType, MaskImageType >;
+using MaskedMedianImageFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, MaskImageType >;
+
+namespace
+{
+    class ShowInstrumentation : public itk::Command
+    {
+    public:
+        itkNewMacro( ShowInstrumentation )
+
+        unsigned int m_NumberOfEvents = 0;
+
+        void Execute( itk::Object* caller, const itk::EventObject& event ) override
+        {
+            Execute( dynamic_cast< const itk::Object* >( caller ), event );
+        }
+
+        void Execute( const itk::Object* caller, const itk::EventObject& event ) override
+        {
+            if ( !itk::InstrumentationEvent().CheckEvent( &event ) )
+                return;
+
+            const auto* pFilter( dynamic_cast< const MaskedMedianImageFilterType* >( caller ) );
+
+            if ( !pFilter )
+                return;
+
+            m_NumberOfEvents++;
+            pFilter->GetInstrumentation()->Print( std::cout );
+        }
+    };
+}
+
+int itkFilterInstrumentationTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Create a small noisy input with a few outliers to avoid test data dependencies
+    ImageType::SizeType size;
+    size.Fill( 32 );
+    ImageType::Pointer pImage( ImageType::New() );
+    pImage->SetRegions( size );
+    pImage->Allocate();
+
+    float * pBuffer( pImage->GetBufferPointer() );
+    for( itk::SizeValueType i = 0; i < pImage->GetLargestPossibleRegion().GetNumberOfPixels(); i++ )
+        pBuffer[i] = ( i % 97 == 0 ) ? 100.0f : 1.0f + 0.01f * static_cast< float >( i % 7 );
+
+    ThresholdedMedianMaskImageFilterType::Pointer pMaskFilter( ThresholdedMedianMaskImageFilterType::New() );
+    pMaskFilter->SetInput( pImage );
+    pMaskFilter->SetThresholdLower( 0.5 );
+    pMaskFilter->SetThresholdUpper( 1.5 );
+
+    MaskedMedianImageFilterType::Pointer pMaskedMedianImageFilter( MaskedMedianImageFilterType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pMaskedMedianImageFilter->GetModifiableInstrumentation(), FilterInstrumentation, Object );
+
+    ShowInstrumentation::Pointer pShowInstrumentation( ShowInstrumentation::New() );
+    pMaskedMedianImageFilter->AddObserver( itk::InstrumentationEvent(), pShowInstrumentation );
+    pMaskedMedianImageFilter->SetInput( pImage );
+    pMaskedMedianImageFilter->SetMaskImage( pMaskFilter->GetOutput() );
+
+    TRY_EXPECT_NO_EXCEPTION( pMaskedMedianImageFilter->Update() );
+
+    const itk::FilterInstrumentation * pInstrumentation( pMaskedMedianImageFilter->GetInstrumentation() );
+    const itk::FilterInstrumentation * pMaskInstrumentation( pMaskFilter->GetInstrumentation() );
+
+#ifdef ITKCSIROTomo_USE_INSTRUMENTATION
+    TEST_EXPECT_EQUAL( pShowInstrumentation->m_NumberOfEvents, 1u );
+    TEST_EXPECT_EQUAL( pInstrumentation->GetPixelsProcessed(), size[0] * size[1] );
+    TEST_EXPECT_EQUAL( pInstrumentation->GetMediansComputed(), size[0] * size[1] );
+    TEST_EXPECT_TRUE( pInstrumentation->GetPhaseSeconds( itk::FilterInstrumentation::MedianSelection ) > 0.0 );
+    TEST_EXPECT_TRUE( pInstrumentation->GetPhaseSeconds( itk::FilterInstrumentation::NeighborhoodGather ) > 0.0 );
+    TEST_EXPECT_EQUAL( pMaskInstrumentation->GetMediansComputed(), size[0] * size[1] );
+    TEST_EXPECT_TRUE( pMaskInstrumentation->GetBytesAllocated() >= size[0] * size[1] * sizeof( float ) );
+#else
+    // Without instrumentation nothing is recorded and no events are invoked
+    TEST_EXPECT_EQUAL( pShowInstrumentation->m_NumberOfEvents, 0u );
+    TEST_EXPECT_EQUAL( pInstrumentation->GetPixelsProcessed(), 0u );
+    TEST_EXPECT_EQUAL( pMaskInstrumentation->GetMediansComputed(), 0u );
+#endif
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkHDF5ProjectionStackSource.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+
+#include <vector>
+
+#define PROJECTION_WIDTH 24
+#define PROJECTION_HEIGHT 10
+#define NUM_PROJECTIONS 10
+#define CHUNK_DEPTH 3
+
+using ImageType = itk::Image< float, 2 >;
+using SourceType = itk::HDF5ProjectionStackSource< ImageType >;
+
+namespace
+{
+    unsigned short Count( itk::SizeValueType uintProjection, itk::IndexValueType x, itk::IndexValueType y )
+    {
+        return static_cast< unsigned short >( 1000 * uintProjection + y * PROJECTION_WIDTH + x );
+    }
+
+    /** Writes 16 bit counts as /entry/data/data, chunked by CHUNK_DEPTH
+     * projections and half the rows when blnChunked, and a two dimensional
+     * /entry/flat */
+    bool WriteFile( const std::string & strFileName, bool blnChunked )
+    {
+        std::vector< unsigned short > vecCounts;
+        for( itk::SizeValueType p = 0; p < NUM_PROJECTIONS; p++ )
+        {
+            for( itk::IndexValueType y = 0; y < PROJECTION_HEIGHT; y++ )
+            {
+                for( itk::IndexValueType x = 0; x < PROJECTION_WIDTH; x++ )
+                    vecCounts.push_back( Count( p, x, y ) );
+            }
+        }
+
+        const hid_t file( H5Fcreate( strFileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT ) );
+        if( file < 0 )
+            return false;
+
+        const hid_t plistLinks( H5Pcreate( H5P_LINK_CREATE ) );
+        H5Pset_create_intermediate_group( plistLinks, 1 );
+
+        const hsize_t arrDims[3] = { NUM_PROJECTIONS, PROJECTION_HEIGHT, PROJECTION_WIDTH };
+        const hsize_t arrChunkDims[3] = { CHUNK_DEPTH, PROJECTION_HEIGHT / 2, PROJECTION_WIDTH };
+
+        const hid_t plistCreate( H5Pcreate( H5P_DATASET_CREATE ) );
+        if( blnChunked )
+        {
+            H5Pset_chunk( plistCreate, 3, arrChunkDims );
+            H5Pset_deflate( plistCreate, 1 );
+        }
+
+        const hid_t space( H5Screate_simple( 3, arrDims, ITK_NULLPTR ) );
+        const hid_t dataset( H5Dcreate2( file, "/entry/data/data", H5T_STD_U16LE, space, plistLinks, plistCreate, H5P_DEFAULT ) );
+        const herr_t status( H5Dwrite( dataset, H5T_NATIVE_USHORT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &vecCounts[0] ) );
+        H5Dclose( dataset );
+        H5Sclose( space );
+
+        const hid_t spaceFlat( H5Screate_simple( 2, arrDims + 1, ITK_NULLPTR ) );
+        const hid_t datasetFlat( H5Dcreate2( file, "/entry/flat", H5T_STD_U16LE, spaceFlat, plistLinks, H5P_DEFAULT, H5P_DEFAULT ) );
+        H5Dclose( datasetFlat );
+        H5Sclose( spaceFlat );
+
+        H5Pclose( plistCreate );
+        H5Pclose( plistLinks );
+        H5Fclose( file );
+
+        return dataset >= 0 && status >= 0;
+    }
+
+    bool CheckProjection( const ImageType * pProjection, itk::SizeValueType uintProjection )
+    {
+        itk::ImageRegionConstIteratorWithIndex< ImageType > it( pProjection, pProjection->GetLargestPossibleRegion() );
+        for( ; !it.IsAtEnd(); ++it )
+        {
+            const float fltExpected( Count( uintProjection, it.GetIndex()[0], it.GetIndex()[1] ) );
+            if( it.Get() != fltExpected )
+            {
+                std::cerr << "Projection " << uintProjection << " is " << it.Get() << " at " << it.GetIndex() << ", expected " << fltExpected << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /** Reads every projection in order */
+    bool ReadAll( SourceType * pSource )
+    {
+        for( itk::SizeValueType p = 0; p < pSource->GetNumberOfProjections(); p++ )
+        {
+            if( !CheckProjection( pSource->GetProjection( p ), p ) )
+                return false;
+        }
+
+        return true;
+    }
+}
+
+int itkHDF5ProjectionStackSourceTest( int argc, char * argv[] )
+{
+    if( argc < 2 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << " outputFile";
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string strFileName( argv[1] );
+    const std::string strContiguousFileName( strFileName + ".contiguous.h5" );
+    TEST_EXPECT_TRUE( WriteFile( strFileName, true ) );
+    TEST_EXPECT_TRUE( WriteFile( strContiguousFileName, false ) );
+
+    SourceType::Pointer pSource( SourceType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pSource, HDF5ProjectionStackSource, Object );
+
+    pSource->SetFileName( strFileName );
+    TEST_SET_GET_VALUE( strFileName, std::string( pSource->GetFileName() ) );
+    TEST_SET_GET_VALUE( std::string( "/entry/data/data" ), std::string( pSource->GetDatasetName() ) );
+    pSource->SetNumberOfCachedSlabs( 3 );
+    TEST_SET_GET_VALUE( 3u, pSource->GetNumberOfCachedSlabs() );
+    TEST_SET_GET_BOOLEAN( pSource, ReadAhead, true );
+
+    // Read ahead, every chunk of projections read once whichever thread reads it
+    TRY_EXPECT_NO_EXCEPTION( pSource->Open() );
+    TEST_EXPECT_TRUE( pSource->IsOpen() );
+    TEST_EXPECT_EQUAL( pSource->GetNumberOfProjections(), NUM_PROJECTIONS );
+    TEST_EXPECT_EQUAL( pSource->GetProjectionSize()[0], PROJECTION_WIDTH );
+    TEST_EXPECT_EQUAL( pSource->GetProjectionSize()[1], PROJECTION_HEIGHT );
+    TEST_EXPECT_EQUAL( pSource->GetSlabDepth(), CHUNK_DEPTH );
+
+    const itk::SizeValueType uintNumSlabs( ( NUM_PROJECTIONS + CHUNK_DEPTH - 1 ) / CHUNK_DEPTH );
+    TEST_EXPECT_TRUE( ReadAll( pSource ) );
+    TEST_EXPECT_EQUAL( pSource->GetNumberOfSlabsRead(), uintNumSlabs );
+    pSource->Close();
+    TEST_EXPECT_TRUE( !pSource->IsOpen() );
+
+    // Without, the projections of a slab after the first found in the cache
+    pSource->ReadAheadOff();
+    TRY_EXPECT_NO_EXCEPTION( pSource->Open() );
+    TEST_EXPECT_TRUE( ReadAll( pSource ) );
+    TEST_EXPECT_EQUAL( pSource->GetNumberOfSlabsRead(), uintNumSlabs );
+    TEST_EXPECT_EQUAL( pSource->GetNumberOfCacheHits(), NUM_PROJECTIONS - uintNumSlabs );
+
+    // The first slab was replaced by the last three
+    TEST_EXPECT_TRUE( CheckProjection( pSource->GetProjection( 1 ), 1 ) );
+    TEST_EXPECT_EQUAL( pSource->GetNumberOfSlabsRead(), uintNumSlabs + 1 );
+    TEST_EXPECT_TRUE( CheckProjection( pSource->GetProjection( NUM_PROJECTIONS - 1 ), NUM_PROJECTIONS - 1 ) );
+    TEST_EXPECT_EQUAL( pSource->GetNumberOfSlabsRead(), uintNumSlabs + 1 );
+
+    TRY_EXPECT_EXCEPTION( pSource->GetProjection( NUM_PROJECTIONS ) );
+
+    // A contiguous dataset is read a projection at a time
+    pSource->SetFileName( strContiguousFileName );
+    pSource->ReadAheadOn();
+    TRY_EXPECT_NO_EXCEPTION( pSource->Open() );
+    TEST_EXPECT_EQUAL( pSource->GetSlabDepth(), 1u );
+    TEST_EXPECT_TRUE( ReadAll( pSource ) );
+    TEST_EXPECT_EQUAL( pSource->GetNumberOfSlabsRead(), NUM_PROJECTIONS );
+
+    // Datasets that are missing or not stacks, and missing files
+    pSource->SetDatasetName( "/entry/flat" );
+    TRY_EXPECT_EXCEPTION( pSource->Open() );
+    TEST_EXPECT_TRUE( !pSource->IsOpen() );
+
+    pSource->SetDatasetName( "/entry/missing" );
+    TRY_EXPECT_EXCEPTION( pSource->Open() );
+
+    pSource->SetDatasetName( "/entry/data/data" );
+    pSource->SetFileName( strFileName + ".missing" );
+    TRY_EXPECT_EXCEPTION( pSource->Open() );
+    TRY_EXPECT_EXCEPTION( pSource->GetProjection( 0 ) );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
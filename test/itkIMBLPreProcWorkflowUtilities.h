@@ -0,0 +1,591 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkIMBLPreProcWorkflowUtilities_h
+#define itkIMBLPreProcWorkflowUtilities_h
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageSeriesReader.h"
+#include "itkIMBLSeriesIndex.h"
+#include "itkMath.h"
+#include "itkProcessingCache.h"
+
+#include "itkCSIROTomoBenchmarkUtilities.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Settings, frame sources and report of IMBLPreProcWorkflowTest, kept apart
+// from the preprocessing chain it runs and times.
+namespace IMBLPreProcWorkflow
+{
+    using ImageType = itk::Image< float, 2 >;
+    using VolumeType = itk::Image< float, 3 >;
+
+    using ImageReader = itk::ImageFileReader< ImageType >;
+    using ImageSeriesReader = itk::ImageSeriesReader< VolumeType >;
+    using IMBLSeriesIndex = itk::IMBLSeriesIndex;
+    using FileNamesContainer = ImageSeriesReader::FileNamesContainer;
+    using CacheKey = itk::ProcessingCache::Key;
+
+    /** Parameters of a run, as set by ParseArguments() */
+    struct WorkflowSettings
+    {
+        WorkflowSettings()
+            : uintNumStacks( 4 )
+            , uintWidth( 256 )
+            , uintHeight( 200 )
+            , uintNumDarks( 10 )
+            , uintNumFlats( 10 )
+            , uintNumProjections( 32 )
+            , uintRadius( 3 )
+            , uintBinning( 1 )
+            , uintNumEigenFlats( 0 )
+            , uintNumShards( 1 )
+            , dblSpacing( 0.1 )
+            , dblVerticalShift( 0.0 )
+            , dblTrimTop( 0.2 )
+            , dblTrimBottom( 1.1 )
+            , dblDefectDensity( 0.0005 )
+            , dblZingerDensity( 0.0002 )
+            , dblCenterOfRotationOffset( 0.5 )
+            , dblMemoryBudget( 0.0 )
+            , dblFrameInterval( 0.02 )
+            , dblTargetLatency( 0.1 )
+            , dblLiveTimeout( 5.0 )
+            , blnReconstruct( false )
+            , blnDefectMap( false )
+            , blnHugePages( false )
+        {
+        }
+
+        unsigned int    uintNumStacks;
+        unsigned int    uintWidth;
+        unsigned int    uintHeight;
+        unsigned int    uintNumDarks;
+        unsigned int    uintNumFlats;
+        unsigned int    uintNumProjections;
+        unsigned int    uintRadius;         // median radius at full resolution
+        unsigned int    uintBinning;        // preview binning of every frame, 1 = full resolution
+        unsigned int    uintNumEigenFlats;  // per stack, 0 = conventional flat field correction
+        unsigned int    uintNumShards;      // worker processes preprocessing the projections, 1 = this process
+        double          dblSpacing;
+        double          dblVerticalShift;   // physical, 0 = three quarters of the frame height
+        double          dblTrimTop;         // physical
+        double          dblTrimBottom;      // physical
+        double          dblDefectDensity;
+        double          dblZingerDensity;
+        double          dblCenterOfRotationOffset;  // detector columns, the synthetic phantom rotates about W / 2
+        double          dblMemoryBudget;    // MB the stages are planned to, 0 = unlimited
+        double          dblFrameInterval;   // seconds between synthetic frames written live
+        double          dblTargetLatency;   // seconds from writing to output of a live frame
+        double          dblLiveTimeout;     // seconds without a frame that end a live run
+        bool            blnReconstruct;
+        bool            blnDefectMap;       // repair the defects found once in the flat instead of masking every projection
+        bool            blnHugePages;       // back the buffer pool with huge pages
+        std::string     strInputDir;        // read IMBL TIFF series instead of synthesising
+        std::string     strGolden;          // expected checksum of the projections
+        std::string     strBaseline;        // checked in report holding the expected checksum
+        std::string     strOutputFile;
+        std::string     strCacheDir;        // reuse results of unchanged stages stored here
+        std::string     strLiveDir;         // correct frames as they are written here instead
+        std::vector< std::string > vecExpectStreamed;  // stages the memory plan must stream
+    };
+
+    /** The checksum reported by an earlier run in its JSON, empty if the file
+     * cannot be read or has none */
+    inline std::string ReadReportChecksum( const std::string & strFile )
+    {
+        std::ifstream ifs( strFile.c_str() );
+        const std::string strReport( ( std::istreambuf_iterator< char >( ifs ) ), std::istreambuf_iterator< char >() );
+
+        const std::string strField( "\"checksum\": \"" );
+        const std::string::size_type uintStart( strReport.rfind( strField ) );
+        if( uintStart == std::string::npos )
+            return std::string();
+
+        const std::string::size_type uintEnd( strReport.find( '"', uintStart + strField.size() ) );
+        if( uintEnd == std::string::npos )
+            return std::string();
+
+        return strReport.substr( uintStart + strField.size(), uintEnd - uintStart - strField.size() );
+    }
+
+    inline const char * Usage()
+    {
+        return "[--size width height] [--stacks n] [--darks n] [--flats n] [--projections n]"
+               " [--radius r] [--bin factor] [--eigenflats n] [--shards n] [--spacing mm] [--shift mm] [--defects density] [--zingers density]"
+               " [--reconstruct] [--cor columns] [--defect-map] [--huge-pages] [--memory-budget MB] [--expect-streamed stage] [--input-dir dir] [--cache dir]"
+               " [--live dir] [--frame-interval s] [--target-latency s] [--live-timeout s] [--golden checksum] [--golden-from report.json] [--baseline report.json]"
+               " [--output stages.json]";
+    }
+
+    /** Reads the settings from the arguments of the test, printing the usage
+     * and returning false on any it does not know. Besides the sizes and
+     * densities of the synthetic acquisition:
+     *   --golden <checksum>        fail unless the projections hash to the checksum
+     *   --golden-from <json>       fail unless they hash to the checksum of an earlier run
+     *   --baseline <json>          fail unless they hash to the checksum recorded in
+     *                              the baseline, skipped while it records none
+     *   --input-dir <dir>          read an IMBL acquisition rather than synthesise one
+     *   --reconstruct              back-project the preprocessed projections in memory
+     *   --bin <factor>             preview the chain on frames binned by the factor
+     *   --eigenflats <n>           correct each projection by n eigenflats per stack
+     *   --defect-map               repair the defects found once in the flat
+     *   --shards <n>               preprocess the projections in n worker processes
+     *   --memory-budget <MB>       run the stages in place or streamed to fit the budget
+     *   --expect-streamed <stage>  fail unless the budget streams the stage
+     *   --cache <dir>              skip the stages whose inputs are unchanged since a run
+     *   --live <dir>               correct each frame as a detector writes it there */
+    inline bool ParseArguments( int argc, char * argv[], WorkflowSettings & settings )
+    {
+        for( int i = 1; i < argc; i++ )
+        {
+            const std::string strArg( argv[i] );
+            const bool blnHasValue( i + 1 < argc );
+
+            if( strArg == "--size" && i + 2 < argc )
+            {
+                settings.uintWidth = std::atoi( argv[++i] );
+                settings.uintHeight = std::atoi( argv[++i] );
+            }
+            else if( strArg == "--stacks" && blnHasValue )
+                settings.uintNumStacks = std::atoi( argv[++i] );
+            else if( strArg == "--darks" && blnHasValue )
+                settings.uintNumDarks = std::atoi( argv[++i] );
+            else if( strArg == "--flats" && blnHasValue )
+                settings.uintNumFlats = std::atoi( argv[++i] );
+            else if( strArg == "--projections" && blnHasValue )
+                settings.uintNumProjections = std::atoi( argv[++i] );
+            else if( strArg == "--radius" && blnHasValue )
+                settings.uintRadius = std::atoi( argv[++i] );
+            else if( strArg == "--eigenflats" && blnHasValue )
+                settings.uintNumEigenFlats = std::atoi( argv[++i] );
+            else if( strArg == "--shards" && blnHasValue )
+                settings.uintNumShards = std::max( std::atoi( argv[++i] ), 1 );
+            else if( strArg == "--bin" && blnHasValue )
+                settings.uintBinning = std::max( std::atoi( argv[++i] ), 1 );
+            else if( strArg == "--spacing" && blnHasValue )
+                settings.dblSpacing = std::atof( argv[++i] );
+            else if( strArg == "--shift" && blnHasValue )
+                settings.dblVerticalShift = std::atof( argv[++i] );
+            else if( strArg == "--defects" && blnHasValue )
+                settings.dblDefectDensity = std::atof( argv[++i] );
+            else if( strArg == "--zingers" && blnHasValue )
+                settings.dblZingerDensity = std::atof( argv[++i] );
+            else if( strArg == "--cor" && blnHasValue )
+                settings.dblCenterOfRotationOffset = std::atof( argv[++i] );
+            else if( strArg == "--memory-budget" && blnHasValue )
+                settings.dblMemoryBudget = std::max( std::atof( argv[++i] ), 0.0 );
+            else if( strArg == "--expect-streamed" && blnHasValue )
+                settings.vecExpectStreamed.push_back( argv[++i] );
+            else if( strArg == "--reconstruct" )
+                settings.blnReconstruct = true;
+            else if( strArg == "--defect-map" )
+                settings.blnDefectMap = true;
+            else if( strArg == "--huge-pages" )
+                settings.blnHugePages = true;
+            else if( strArg == "--input-dir" && blnHasValue )
+                settings.strInputDir = argv[++i];
+            else if( strArg == "--golden" && blnHasValue )
+                settings.strGolden = argv[++i];
+            else if( strArg == "--golden-from" && blnHasValue )
+            {
+                // Another configuration of the same projections, whose output
+                // must not differ from that of the reported run
+                settings.strGolden = ReadReportChecksum( argv[++i] );
+                if( settings.strGolden.empty() )
+                {
+                    std::cerr << "No checksum reported in " << argv[i] << std::endl;
+                    return false;
+                }
+            }
+            else if( strArg == "--baseline" && blnHasValue )
+            {
+                settings.strBaseline = argv[++i];
+                settings.strGolden = ReadReportChecksum( settings.strBaseline );
+            }
+            else if( strArg == "--output" && blnHasValue )
+                settings.strOutputFile = argv[++i];
+            else if( strArg == "--cache" && blnHasValue )
+                settings.strCacheDir = argv[++i];
+            else if( strArg == "--live" && blnHasValue )
+                settings.strLiveDir = argv[++i];
+            else if( strArg == "--frame-interval" && blnHasValue )
+                settings.dblFrameInterval = std::max( std::atof( argv[++i] ), 0.0 );
+            else if( strArg == "--target-latency" && blnHasValue )
+                settings.dblTargetLatency = std::max( std::atof( argv[++i] ), 0.0 );
+            else if( strArg == "--live-timeout" && blnHasValue )
+                settings.dblLiveTimeout = std::max( std::atof( argv[++i] ), 0.0 );
+            else
+            {
+                std::cerr << "Usage: " << argv[0] << " " << Usage() << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /** Source of dark, flat and projection frames for the workflow */
+    class WorkflowSource
+    {
+    public:
+        virtual ~WorkflowSource() {}
+
+        virtual VolumeType::Pointer GetDarks() = 0;
+        virtual VolumeType::Pointer GetFlats( unsigned int uintStack ) = 0;
+        virtual ImageType::SizeType GetFrameSize() = 0;
+        virtual unsigned int GetNumberOfProjections() = 0;
+        virtual ImageType::Pointer GetProjection( unsigned int uintStack, unsigned int uintProjection ) = 0;
+
+        /** Describe the content of the frames to a cache key without reading them */
+        virtual void AddDarksToKey( CacheKey & key ) = 0;
+        virtual void AddFlatsToKey( CacheKey & key, unsigned int uintStack ) = 0;
+        virtual void AddProjectionToKey( CacheKey & key, unsigned int uintStack, unsigned int uintProjection ) = 0;
+    };
+
+    /** Synthesises IMBL-like frames: a vertically peaked beam, a two cylinder
+     * phantom, static dead/hot pixels shared by every frame and random zingers
+     * in the projections. */
+    class SyntheticWorkflowSource : public WorkflowSource
+    {
+    public:
+        explicit SyntheticWorkflowSource( const WorkflowSettings & settings )
+            : m_Settings( settings )
+        {
+            m_Size[0] = settings.uintWidth;
+            m_Size[1] = settings.uintHeight;
+            m_ShiftPixels = static_cast< unsigned int >( settings.dblVerticalShift / settings.dblSpacing + 0.5 );
+        }
+
+        VolumeType::Pointer GetDarks() override
+        {
+            CSIROTomoBenchmark::FrameParameters params( CreateParameters( 0 ) );
+            params.dblIntensity = 0.0;
+            params.dblDarkLevel = 100.0;
+
+            return CreateSeries( params, m_Settings.uintNumDarks, 1000 );
+        }
+
+        VolumeType::Pointer GetFlats( unsigned int uintStack ) override
+        {
+            return CreateSeries( CreateParameters( uintStack ), m_Settings.uintNumFlats, 2000 + 100 * uintStack );
+        }
+
+        ImageType::SizeType GetFrameSize() override
+        {
+            return m_Size;
+        }
+
+        unsigned int GetNumberOfProjections() override
+        {
+            return m_Settings.uintNumProjections;
+        }
+
+        ImageType::Pointer GetProjection( unsigned int uintStack, unsigned int uintProjection ) override
+        {
+            CSIROTomoBenchmark::FrameParameters params( CreateParameters( uintStack ) );
+            params.blnPhantom = true;
+            params.dblAngle = itk::Math::pi * uintProjection / m_Settings.uintNumProjections;
+            params.dblZingerDensity = m_Settings.dblZingerDensity;
+            params.uint64NoiseSeed = 100000 + 1000 * uintStack + uintProjection;
+
+            return CSIROTomoBenchmark::CreateDetectorFrame< ImageType >( m_Size, params, m_Settings.dblSpacing );
+        }
+
+        // Synthetic frames are described by the parameters they are generated from
+        void AddDarksToKey( CacheKey & key ) override
+        {
+            AddParametersToKey( key, 0 );
+            key.Add( "darks", m_Settings.uintNumDarks );
+        }
+
+        void AddFlatsToKey( CacheKey & key, unsigned int uintStack ) override
+        {
+            AddParametersToKey( key, uintStack );
+            key.Add( "flats", m_Settings.uintNumFlats );
+        }
+
+        void AddProjectionToKey( CacheKey & key, unsigned int uintStack, unsigned int uintProjection ) override
+        {
+            AddParametersToKey( key, uintStack );
+            key.Add( "projection", uintProjection );
+            key.Add( "projections", m_Settings.uintNumProjections );
+            key.Add( "zinger_density", m_Settings.dblZingerDensity );
+        }
+
+    private:
+        void AddParametersToKey( CacheKey & key, unsigned int uintStack ) const
+        {
+            key.Add( "synthetic_size", m_Size );
+            key.Add( "synthetic_spacing", m_Settings.dblSpacing );
+            key.Add( "synthetic_stack", uintStack );
+            key.Add( "synthetic_stacks", m_Settings.uintNumStacks );
+            key.Add( "synthetic_shift", m_ShiftPixels );
+            key.Add( "defect_density", m_Settings.dblDefectDensity );
+        }
+
+        CSIROTomoBenchmark::FrameParameters CreateParameters( unsigned int uintStack ) const
+        {
+            CSIROTomoBenchmark::FrameParameters params;
+            params.dblDarkLevel = 100.0;
+            params.dblDefectDensity = m_Settings.dblDefectDensity;
+            params.uintRowOffset = uintStack * m_ShiftPixels;
+            params.uintTotalRows = ( m_Settings.uintNumStacks - 1 ) * m_ShiftPixels + m_Settings.uintHeight;
+
+            return params;
+        }
+
+        VolumeType::Pointer CreateSeries( CSIROTomoBenchmark::FrameParameters params, unsigned int uintFrames, std::uint64_t uint64Seed ) const
+        {
+            VolumeType::SizeType sizeVolume;
+            sizeVolume[0] = m_Size[0];
+            sizeVolume[1] = m_Size[1];
+            sizeVolume[2] = uintFrames;
+
+            VolumeType::SpacingType spacing;
+            spacing.Fill( m_Settings.dblSpacing );
+
+            VolumeType::Pointer pVolume( VolumeType::New() );
+            pVolume->SetRegions( sizeVolume );
+            pVolume->SetSpacing( spacing );
+            pVolume->Allocate();
+
+            const itk::SizeValueType uintFramePixels( m_Size[0] * m_Size[1] );
+
+            for( unsigned int i = 0; i < uintFrames; i++ )
+            {
+                params.uint64NoiseSeed = uint64Seed + i;
+                ImageType::Pointer pFrame( CSIROTomoBenchmark::CreateDetectorFrame< ImageType >( m_Size, params, m_Settings.dblSpacing ) );
+                std::copy( pFrame->GetBufferPointer(), pFrame->GetBufferPointer() + uintFramePixels, pVolume->GetBufferPointer() + i * uintFramePixels );
+            }
+
+            return pVolume;
+        }
+
+        const WorkflowSettings &    m_Settings;
+        ImageType::SizeType         m_Size;
+        unsigned int                m_ShiftPixels;
+    };
+
+    inline VolumeType::Pointer ReadImageSeries( const FileNamesContainer& vecFileNames )
+    {
+        ImageSeriesReader::Pointer pSeriesReader( ImageSeriesReader::New() );
+        pSeriesReader->SetFileNames( vecFileNames );
+        pSeriesReader->Update();
+        return pSeriesReader->GetOutput();
+    }
+
+    /** Reads an IMBL acquisition (DF/BG/SAMPLE TIFF series) from a directory */
+    class FileWorkflowSource : public WorkflowSource
+    {
+    public:
+        explicit FileWorkflowSource( const WorkflowSettings & settings )
+            : m_Settings( settings )
+            , m_Index( IMBLSeriesIndex::New() )
+        {
+            m_Index->SetDirectory( settings.strInputDir );
+            m_Index->Update();
+
+            for( unsigned int i = 0; i < settings.uintNumStacks; i++ )
+                m_vecProjectionFiles.push_back( m_Index->GetFileNames( IMBLSeriesIndex::Projection, i ) );
+        }
+
+        VolumeType::Pointer GetDarks() override
+        {
+            return ReadImageSeries( m_Index->GetFileNames( IMBLSeriesIndex::Dark, 0 ) );
+        }
+
+        VolumeType::Pointer GetFlats( unsigned int uintStack ) override
+        {
+            return ReadImageSeries( m_Index->GetFileNames( IMBLSeriesIndex::Flat, uintStack ) );
+        }
+
+        // Read from the header of the first dark
+        ImageType::SizeType GetFrameSize() override
+        {
+            ImageReader::Pointer pReader( ImageReader::New() );
+            pReader->SetFileName( m_Index->GetFileNames( IMBLSeriesIndex::Dark, 0 ).front() );
+            pReader->UpdateOutputInformation();
+            return pReader->GetOutput()->GetLargestPossibleRegion().GetSize();
+        }
+
+        unsigned int GetNumberOfProjections() override
+        {
+            size_t uintNum( m_vecProjectionFiles.empty() ? 0 : m_vecProjectionFiles[0].size() );
+            for( size_t i = 1; i < m_vecProjectionFiles.size(); i++ )
+                uintNum = std::min( uintNum, m_vecProjectionFiles[i].size() );
+
+            return static_cast< unsigned int >( std::min( uintNum, static_cast< size_t >( m_Settings.uintNumProjections ) ) );
+        }
+
+        ImageType::Pointer GetProjection( unsigned int uintStack, unsigned int uintProjection ) override
+        {
+            ImageReader::Pointer pReader( ImageReader::New() );
+            pReader->SetFileName( m_vecProjectionFiles[uintStack][uintProjection] );
+            pReader->Update();
+            return pReader->GetOutput();
+        }
+
+        // Acquired frames are described by the content hashes of their files
+        void AddDarksToKey( CacheKey & key ) override
+        {
+            AddFilesToKey( key, m_Index->GetFileNames( IMBLSeriesIndex::Dark, 0 ) );
+        }
+
+        void AddFlatsToKey( CacheKey & key, unsigned int uintStack ) override
+        {
+            AddFilesToKey( key, m_Index->GetFileNames( IMBLSeriesIndex::Flat, uintStack ) );
+        }
+
+        void AddProjectionToKey( CacheKey & key, unsigned int uintStack, unsigned int uintProjection ) override
+        {
+            key.AddFile( "projection", m_vecProjectionFiles[uintStack][uintProjection] );
+        }
+
+    private:
+        static void AddFilesToKey( CacheKey & key, const FileNamesContainer & vecFileNames )
+        {
+            for( size_t i = 0; i < vecFileNames.size(); i++ )
+                key.AddFile( "file", vecFileNames[i] );
+        }
+
+        const WorkflowSettings &            m_Settings;
+        IMBLSeriesIndex::Pointer            m_Index;
+        std::vector< FileNamesContainer >   m_vecProjectionFiles;
+    };
+
+    /** Accumulated cost of one workflow stage */
+    struct StageStatistics
+    {
+        StageStatistics( const std::string & strStageName )
+            : strName( strStageName )
+            , dblSeconds( 0.0 )
+            , dblBytesAllocated( 0.0 )
+            , dblBytesMoved( 0.0 )
+            , uintCacheHits( 0 )
+        {
+        }
+
+        void WriteJSON( std::ostream & os ) const
+        {
+            os << "{\"stage\": " << CSIROTomoBenchmark::JSONString( strName )
+               << std::setprecision( 9 )
+               << ", \"seconds\": " << dblSeconds
+               << ", \"bytes_allocated\": " << dblBytesAllocated
+               << ", \"bytes_moved\": " << dblBytesMoved
+               << ", \"bandwidth_bytes_per_second\": " << ( dblSeconds > 0.0 ? dblBytesMoved / dblSeconds : 0.0 )
+               << ", \"cache_hits\": " << uintCacheHits << "}";
+        }
+
+        std::string     strName;
+        double          dblSeconds;
+        double          dblBytesAllocated;  // output buffers created by the stage
+        double          dblBytesMoved;      // bytes read plus bytes written
+        unsigned int    uintCacheHits;      // runs skipped as their results were cached
+    };
+
+    /** JSON report of a run, written to the output file of the settings, or
+     * to the standard output without one */
+    class WorkflowReport
+    {
+    public:
+        explicit WorkflowReport( const std::string & strFile )
+            : m_ToFile( !strFile.empty() )
+        {
+            if( m_ToFile )
+                m_File.open( strFile.c_str() );
+        }
+
+        bool IsOpen() const
+        {
+            return !m_ToFile || m_File.is_open();
+        }
+
+        std::ostream & GetStream()
+        {
+            return m_ToFile ? static_cast< std::ostream & >( m_File ) : std::cout;
+        }
+
+        /** Writes the stages as a "stages" field, adding their time and
+         * traffic to the totals */
+        void WriteStages( const std::vector< StageStatistics > & vecStages, double & dblTotalSeconds, double & dblTotalBytesMoved )
+        {
+            std::ostream & os( GetStream() );
+            os << ", \"stages\": [" << std::endl;
+
+            for( std::vector< StageStatistics >::const_iterator it = vecStages.begin(); it != vecStages.end(); ++it )
+            {
+                dblTotalSeconds += it->dblSeconds;
+                dblTotalBytesMoved += it->dblBytesMoved;
+
+                os << "  ";
+                it->WriteJSON( os );
+                os << ( it + 1 != vecStages.end() ? "," : "" ) << std::endl;
+            }
+
+            os << "]";
+        }
+
+        /** Ends the report with the checksum of the projections */
+        void WriteChecksum( const std::string & strChecksum )
+        {
+            GetStream() << ", \"checksum\": " << CSIROTomoBenchmark::JSONString( strChecksum ) << "}" << std::endl;
+        }
+
+    private:
+        bool            m_ToFile;
+        std::ofstream   m_File;
+    };
+
+    /** Exit code of a run whose baseline records no checksum, reported by
+     * CTest as skipped rather than passed */
+    const int SkippedExitCode( 77 );
+
+    /** Prints the checksum, returning the exit code of the test: a failure
+     * unless it matches the golden checksum of the settings if there is one,
+     * or SkippedExitCode if the baseline asked for records none yet */
+    inline int CheckGolden( const WorkflowSettings & settings, const std::string & strChecksum )
+    {
+        std::cout << "Output checksum: " << strChecksum << std::endl;
+
+        if( !settings.strGolden.empty() && settings.strGolden != strChecksum )
+        {
+            std::cerr << "Checksum mismatch, expected " << settings.strGolden << " got " << strChecksum << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if( settings.strGolden.empty() && !settings.strBaseline.empty() )
+        {
+            std::cerr << "No checksum recorded in " << settings.strBaseline << ", record " << strChecksum << " from a reference build" << std::endl;
+            return SkippedExitCode;
+        }
+
+        return EXIT_SUCCESS;
+    }
+}
+
+#endif // itkIMBLPreProcWorkflowUtilities_h
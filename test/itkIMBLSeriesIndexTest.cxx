@@ -0,0 +1,156 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkIMBLSeriesIndex.h"
+
+#include "itkImageFileWriter.h"
+#include "itkTestingMacros.h"
+
+#include "itksys/SystemTools.hxx"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#define FRAME_WIDTH 12
+#define FRAME_HEIGHT 8
+
+using ImageType = itk::Image< unsigned short, 2 >;
+using ImageWriter = itk::ImageFileWriter< ImageType >;
+using IMBLSeriesIndexType = itk::IMBLSeriesIndex;
+
+namespace
+{
+    void WriteFrame( const std::string & strFileName, unsigned int uintWidth )
+    {
+        ImageType::SizeType size;
+        size[0] = uintWidth;
+        size[1] = FRAME_HEIGHT;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+        pImage->FillBuffer( 1000 );
+
+        ImageWriter::Pointer pWriter( ImageWriter::New() );
+        pWriter->SetInput( pImage );
+        pWriter->SetFileName( strFileName );
+        pWriter->Update();
+    }
+
+    std::string FrameName( const std::string & strDirectory, const char * szPrefix, unsigned int uintStack, const char * szTag, unsigned int uintFrame )
+    {
+        std::ostringstream ss;
+        ss << strDirectory << "/" << szPrefix << "_Y" << uintStack << "_" << szTag << "_" << uintFrame << ".tif";
+        return ss.str();
+    }
+}
+
+int itkIMBLSeriesIndexTest( int argc, char * argv[] )
+{
+    if( argc < 2 )
+    {
+        std::cerr << "Missing parameters." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " acquisitionDirectory" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string strDirectory( argv[1] );
+    itksys::SystemTools::RemoveADirectory( strDirectory );
+    itksys::SystemTools::MakeDirectory( strDirectory );
+
+    // Two stacks of darks, flats and projections, frame numbers unpadded so
+    // that lexical and numeric order differ
+    for( unsigned int uintStack = 0; uintStack < 2; uintStack++ )
+    {
+        for( unsigned int uintFrame = 8; uintFrame <= 11; uintFrame++ )
+        {
+            WriteFrame( FrameName( strDirectory, "DF", uintStack, "AFTER", uintFrame ), FRAME_WIDTH );
+            WriteFrame( FrameName( strDirectory, "BG", uintStack, "BEFORE", uintFrame ), FRAME_WIDTH );
+        }
+
+        for( unsigned int uintFrame = 1; uintFrame <= 12; uintFrame++ )
+            WriteFrame( FrameName( strDirectory, "SAMPLE", uintStack, "TOMO", uintFrame ), FRAME_WIDTH );
+    }
+
+    // Files of the acquisition that are not frames
+    WriteFrame( FrameName( strDirectory, "SAMPLE", 0, "ALIGN", 1 ), FRAME_WIDTH + 4 );
+    std::ofstream( ( strDirectory + "/acquisition.log" ).c_str() ) << "log";
+
+    IMBLSeriesIndexType::Pointer pIndex( IMBLSeriesIndexType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pIndex, IMBLSeriesIndex, Object );
+
+    TRY_EXPECT_EXCEPTION( pIndex->Update() );
+
+    pIndex->SetDirectory( strDirectory );
+    TEST_SET_GET_VALUE( strDirectory, std::string( pIndex->GetDirectory() ) );
+    pIndex->SetNumberOfThreads( 3 );
+    TEST_SET_GET_VALUE( 3u, pIndex->GetNumberOfThreads() );
+
+    TRY_EXPECT_NO_EXCEPTION( pIndex->Update() );
+    TEST_EXPECT_TRUE( !pIndex->GetLoadedFromIndexFile() );
+    TEST_EXPECT_TRUE( itksys::SystemTools::FileExists( pIndex->GetActualIndexFileName().c_str(), true ) );
+
+    TEST_EXPECT_EQUAL( pIndex->GetNumberOfFrames(), 40u );
+    TEST_EXPECT_EQUAL( pIndex->GetNumberOfStacks( IMBLSeriesIndexType::Dark ), 2u );
+    TEST_EXPECT_EQUAL( pIndex->GetNumberOfStacks( IMBLSeriesIndexType::Projection ), 2u );
+    TEST_EXPECT_EQUAL( pIndex->GetFrameSize()[0], static_cast< itk::SizeValueType >( FRAME_WIDTH ) );
+    TEST_EXPECT_EQUAL( pIndex->GetFrameSize()[1], static_cast< itk::SizeValueType >( FRAME_HEIGHT ) );
+
+    // Series in numeric frame order
+    IMBLSeriesIndexType::FileNamesContainer vecFlats( pIndex->GetFileNames( IMBLSeriesIndexType::Flat, 1 ) );
+    TEST_EXPECT_EQUAL( vecFlats.size(), static_cast< size_t >( 4 ) );
+    TEST_EXPECT_EQUAL( vecFlats[0], FrameName( strDirectory, "BG", 1, "BEFORE", 8 ) );
+    TEST_EXPECT_EQUAL( vecFlats[3], FrameName( strDirectory, "BG", 1, "BEFORE", 11 ) );
+
+    IMBLSeriesIndexType::FileNamesContainer vecProjections( pIndex->GetFileNames( IMBLSeriesIndexType::Projection, 0 ) );
+    TEST_EXPECT_EQUAL( vecProjections.size(), static_cast< size_t >( 12 ) );
+    TEST_EXPECT_EQUAL( vecProjections[1], FrameName( strDirectory, "SAMPLE", 0, "TOMO", 2 ) );
+    TEST_EXPECT_EQUAL( vecProjections[11], FrameName( strDirectory, "SAMPLE", 0, "TOMO", 12 ) );
+    TEST_EXPECT_TRUE( pIndex->GetFileNames( IMBLSeriesIndexType::Dark, 2 ).empty() );
+
+    // A re-run takes the index from the sidecar file
+    IMBLSeriesIndexType::Pointer pRerunIndex( IMBLSeriesIndexType::New() );
+    pRerunIndex->SetDirectory( strDirectory );
+    TRY_EXPECT_NO_EXCEPTION( pRerunIndex->Update() );
+    TEST_EXPECT_TRUE( pRerunIndex->GetLoadedFromIndexFile() );
+    TEST_EXPECT_EQUAL( pRerunIndex->GetNumberOfFrames(), pIndex->GetNumberOfFrames() );
+    TEST_EXPECT_EQUAL( pRerunIndex->GetFrameSize(), pIndex->GetFrameSize() );
+    TEST_EXPECT_TRUE( pRerunIndex->GetFileNames( IMBLSeriesIndexType::Flat, 1 ) == vecFlats );
+
+    // A frame added since invalidates the sidecar file, and a frame of another
+    // size is an error
+    WriteFrame( FrameName( strDirectory, "SAMPLE", 1, "TOMO", 13 ), FRAME_WIDTH );
+    TRY_EXPECT_NO_EXCEPTION( pRerunIndex->Update() );
+    TEST_EXPECT_TRUE( !pRerunIndex->GetLoadedFromIndexFile() );
+    TEST_EXPECT_EQUAL( pRerunIndex->GetFileNames( IMBLSeriesIndexType::Projection, 1 ).size(), static_cast< size_t >( 13 ) );
+
+    WriteFrame( FrameName( strDirectory, "DF", 0, "AFTER", 12 ), FRAME_WIDTH + 4 );
+    TRY_EXPECT_EXCEPTION( pRerunIndex->Update() );
+
+    // A sidecar file elsewhere, for an acquisition directory that is read only
+    itksys::SystemTools::RemoveFile( FrameName( strDirectory, "DF", 0, "AFTER", 12 ) );
+    pRerunIndex->SetIndexFileName( strDirectory + "_index" );
+    TRY_EXPECT_NO_EXCEPTION( pRerunIndex->Update() );
+    TEST_EXPECT_TRUE( !pRerunIndex->GetLoadedFromIndexFile() );
+    TEST_EXPECT_TRUE( itksys::SystemTools::FileExists( ( strDirectory + "_index" ).c_str(), true ) );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkImageBufferPool.h"
+#include "itkNegLogCheckedImageFilter.h"
+#include "itkThresholdedMedianMaskImageFilter.h"
+#include "itkVerticalStitchingImageFilter.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+
+#include <cmath>
+
+#define IMAGE_WIDTH 64
+#define IMAGE_HEIGHT 48
+#define NUMBER_OF_FRAMES 4
+
+using ImageType = itk::Image< float, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+using VectorImageType = itk::VectorImage< float, 2 >;
+using NegLogCheckedImageFilterType = itk::NegLogCheckedImageFilter< ImageType >;
+using ThresholdedMedianMaskImageFilterType = itk::ThresholdedMedianMaskImageFilter< ImageType, MaskImageType >;
+using VerticalStitchingImageFilterType = itk::VerticalStitchingImageFilter< ImageType, ImageType >;
+
+namespace
+{
+    ImageType::Pointer CreateFrame( unsigned int uintFrame, double dblPhase )
+    {
+        ImageType::SizeType size;
+        size[0] = IMAGE_WIDTH;
+        size[1] = IMAGE_HEIGHT;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            const ImageType::IndexType index( it.GetIndex() );
+            const bool blnOutlier( ( 5 * index[0] + 7 * index[1] + uintFrame ) % 43 == 0 );
+
+            it.Set( blnOutlier ? 4.0f : static_cast< float >( 0.6 + 0.3 * std::sin( 0.1 * index[0] + dblPhase + uintFrame ) ) );
+        }
+
+        return pImage;
+    }
+
+    template< typename TImage >
+    bool ImagesEqual( const TImage * pReference, const TImage * pImage )
+    {
+        itk::ImageRegionConstIterator< TImage > itReference( pReference, pReference->GetLargestPossibleRegion() );
+        itk::ImageRegionConstIterator< TImage > it( pImage, pImage->GetLargestPossibleRegion() );
+
+        if( pReference->GetLargestPossibleRegion() != pImage->GetLargestPossibleRegion() )
+            return false;
+
+        for( ; !itReference.IsAtEnd(); ++itReference, ++it )
+        {
+            if( itReference.Get() != it.Get() )
+                return false;
+        }
+
+        return true;
+    }
+
+    /** Runs the per-frame filters over the frames, with and without the pool,
+     * comparing the results. Returns the number of allocations made by the
+     * pool for the frames after the first. The stitching filter computes its
+     * weights every frame, drawing them from the pool. */
+    bool RunFrames( itk::ImageBufferPool * pPool, itk::SizeValueType & uintSteadyStateAllocations )
+    {
+        ThresholdedMedianMaskImageFilterType::RadiusType radius;
+        radius.Fill( 2 );
+
+        VerticalStitchingImageFilterType::Pointer pStitchingFilter( VerticalStitchingImageFilterType::New() );
+        pStitchingFilter->SetVerticalShift( IMAGE_HEIGHT - IMAGE_HEIGHT / 4 );
+        pStitchingFilter->ComputeWeightingOn();
+        pStitchingFilter->SetBufferPool( pPool );
+
+        VerticalStitchingImageFilterType::Pointer pReferenceStitchingFilter( VerticalStitchingImageFilterType::New() );
+        pReferenceStitchingFilter->SetVerticalShift( IMAGE_HEIGHT - IMAGE_HEIGHT / 4 );
+
+        itk::SizeValueType uintFirstFrameAllocations( 0 );
+
+        for( unsigned int uintFrame = 0; uintFrame < NUMBER_OF_FRAMES; uintFrame++ )
+        {
+            ImageType::Pointer pFrameUpper( CreateFrame( uintFrame, 0.0 ) );
+            ImageType::Pointer pFrameLower( CreateFrame( uintFrame, 0.7 ) );
+
+            pStitchingFilter->SetInput( 0, pFrameUpper );
+            pStitchingFilter->SetInput( 1, pFrameLower );
+            pStitchingFilter->Update();
+
+            ThresholdedMedianMaskImageFilterType::Pointer pMaskFilter( ThresholdedMedianMaskImageFilterType::New() );
+            pMaskFilter->SetInput( pStitchingFilter->GetOutput() );
+            pMaskFilter->SetRadius( radius );
+            pMaskFilter->SetThresholdLower( 0.5 );
+            pMaskFilter->SetThresholdUpper( 1.5 );
+            pMaskFilter->SetBufferPool( pPool );
+            pMaskFilter->Update();
+
+            NegLogCheckedImageFilterType::Pointer pNegLogFilter( NegLogCheckedImageFilterType::New() );
+            pNegLogFilter->SetInput( pStitchingFilter->GetOutput() );
+            pNegLogFilter->SetBufferPool( pPool );
+            pNegLogFilter->Update();
+
+            // The same chain without the pool
+            pReferenceStitchingFilter->SetInput( 0, pFrameUpper );
+            pReferenceStitchingFilter->SetInput( 1, pFrameLower );
+
+            ThresholdedMedianMaskImageFilterType::Pointer pReferenceMaskFilter( ThresholdedMedianMaskImageFilterType::New() );
+            pReferenceMaskFilter->SetInput( pReferenceStitchingFilter->GetOutput() );
+            pReferenceMaskFilter->SetRadius( radius );
+            pReferenceMaskFilter->SetThresholdLower( 0.5 );
+            pReferenceMaskFilter->SetThresholdUpper( 1.5 );
+            pReferenceMaskFilter->Update();
+
+            NegLogCheckedImageFilterType::Pointer pReferenceNegLogFilter( NegLogCheckedImageFilterType::New() );
+            pReferenceNegLogFilter->SetInput( pReferenceStitchingFilter->GetOutput() );
+            pReferenceNegLogFilter->Update();
+
+            if( !ImagesEqual( pReferenceStitchingFilter->GetOutput(), pStitchingFilter->GetOutput() )
+                || !ImagesEqual( pReferenceMaskFilter->GetOutput(), pMaskFilter->GetOutput() )
+                || !ImagesEqual( pReferenceNegLogFilter->GetOutput(), pNegLogFilter->GetOutput() ) )
+            {
+                std::cerr << "Pooled result of frame " << uintFrame << " differs" << std::endl;
+                return false;
+            }
+
+            typedef itk::PooledImageContainer< itk::SizeValueType, float > PooledContainerType;
+            if( !dynamic_cast< const PooledContainerType * >( pStitchingFilter->GetWeightingAlpha()->GetPixelContainer() )
+                || !dynamic_cast< const PooledContainerType * >( pStitchingFilter->GetWeightingBeta()->GetPixelContainer() ) )
+            {
+                std::cerr << "Weights of frame " << uintFrame << " not drawn from the pool" << std::endl;
+                return false;
+            }
+
+            if( uintFrame == 0 )
+                uintFirstFrameAllocations = pPool->GetNumberOfAllocations();
+        }
+
+        uintSteadyStateAllocations = pPool->GetNumberOfAllocations() - uintFirstFrameAllocations;
+
+        return true;
+    }
+}
+
+int itkImageBufferPoolTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    itk::ImageBufferPool::Pointer pPool( itk::ImageBufferPool::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pPool, ImageBufferPool, Object );
+
+    pPool->SetUseHugePages( false );
+    TEST_SET_GET_VALUE( false, pPool->GetUseHugePages() );
+    TEST_SET_GET_VALUE( 0u, pPool->GetMaximumCachedBytes() );
+
+    // Released buffers are reused for requests of the same size only
+    void * p( pPool->Acquire( 1000 ) );
+    pPool->Release( p );
+    TEST_EXPECT_EQUAL( pPool->GetCachedBytes(), 1000u );
+
+    TEST_EXPECT_EQUAL( pPool->Acquire( 1000 ), p );
+    void * pOther( pPool->Acquire( 2000 ) );
+    TEST_EXPECT_EQUAL( pPool->GetNumberOfAllocations(), 2u );
+    TEST_EXPECT_EQUAL( pPool->GetNumberOfReuses(), 1u );
+
+    pPool->Release( p );
+    pPool->Release( pOther );
+    TEST_EXPECT_EQUAL( pPool->GetAllocatedBytes(), 3000u );
+
+    int intNotPooled( 0 );
+    TRY_EXPECT_EXCEPTION( pPool->Release( &intNotPooled ) );
+
+    pPool->Clear();
+    TEST_EXPECT_EQUAL( pPool->GetCachedBytes(), 0u );
+    TEST_EXPECT_EQUAL( pPool->GetAllocatedBytes(), 0u );
+
+    // Buffers beyond the cache limit are freed on release
+    pPool->SetMaximumCachedBytes( 1500 );
+    p = pPool->Acquire( 1000 );
+    pOther = pPool->Acquire( 1000 );
+    pPool->Release( p );
+    pPool->Release( pOther );
+    TEST_EXPECT_EQUAL( pPool->GetCachedBytes(), 1000u );
+    pPool->SetMaximumCachedBytes( 0 );
+    pPool->Clear();
+
+    // Images return their buffers when released, vector images included
+    {
+        VectorImageType::SizeType size;
+        size.Fill( 16 );
+
+        VectorImageType::Pointer pVectorImage( VectorImageType::New() );
+        pVectorImage->SetRegions( size );
+        pVectorImage->SetNumberOfComponentsPerPixel( 3 );
+        pPool->AllocateImage( pVectorImage.GetPointer(), true );
+
+        TEST_EXPECT_EQUAL( pPool->GetAllocatedBytes(), static_cast< itk::SizeValueType >( 16 * 16 * 3 * sizeof( float ) ) );
+        VectorImageType::IndexType index;
+        index.Fill( 5 );
+        TEST_EXPECT_EQUAL( pVectorImage->GetPixel( index )[2], 0.0f );
+    }
+    TEST_EXPECT_EQUAL( pPool->GetCachedBytes(), pPool->GetAllocatedBytes() );
+    pPool->Clear();
+
+    // Huge page backed buffers of 4 MB, mapped from transparent huge pages
+    // if none are reserved
+    pPool->UseHugePagesOn();
+    {
+        ImageType::SizeType size;
+        size.Fill( 1024 );
+
+        ImageType::Pointer pLargeImage( ImageType::New() );
+        pLargeImage->SetRegions( size );
+        pPool->AllocateImage( pLargeImage.GetPointer() );
+        pLargeImage->FillBuffer( 1.0f );
+
+        ImageType::IndexType index;
+        index.Fill( 1000 );
+        TEST_EXPECT_EQUAL( pLargeImage->GetPixel( index ), 1.0f );
+    }
+    pPool->UseHugePagesOff();
+    pPool->Clear();
+
+    // After the first frame the per-frame filters allocate nothing, and the
+    // results are those of unpooled filters
+    itk::SizeValueType uintSteadyStateAllocations( 0 );
+    TEST_EXPECT_TRUE( RunFrames( pPool, uintSteadyStateAllocations ) );
+    TEST_EXPECT_EQUAL( uintSteadyStateAllocations, 0u );
+    TEST_EXPECT_TRUE( pPool->GetNumberOfReuses() > 0 );
+
+    std::cout << "Pool after " << NUMBER_OF_FRAMES << " frames:" << std::endl;
+    pPool->Print( std::cout );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
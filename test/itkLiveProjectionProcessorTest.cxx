@@ -0,0 +1,247 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkLiveProjectionProcessor.h"
+
+#include "itkImageFileWriter.h"
+#include "itkTestingMacros.h"
+
+#include "itksys/SystemTools.hxx"
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FRAME_WIDTH 32
+#define FRAME_HEIGHT 16
+#define DARK_COUNT 100
+#define FLAT_RANGE 1000
+#define DEFECT_X 5
+#define DEFECT_Y 5
+
+using ImageType = itk::Image< float, 2 >;
+using CountImageType = itk::Image< unsigned short, 2 >;
+using CountWriter = itk::ImageFileWriter< CountImageType >;
+using ProcessorType = itk::LiveProjectionProcessor< ImageType >;
+using DefectMapType = ProcessorType::DefectMapType;
+
+namespace
+{
+    ImageType::Pointer CreateImage( float fltValue )
+    {
+        ImageType::SizeType size;
+        size[0] = FRAME_WIDTH;
+        size[1] = FRAME_HEIGHT;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+        pImage->FillBuffer( fltValue );
+
+        return pImage;
+    }
+
+    /** Writes a frame of transmission exp( -0.5 ) with a hot pixel at the
+     * defect, under a temporary name renamed when complete as a detector would */
+    void WriteFrame( const std::string & strDirectory, const std::string & strName, unsigned int uintWidth = FRAME_WIDTH )
+    {
+        CountImageType::SizeType size;
+        size[0] = uintWidth;
+        size[1] = FRAME_HEIGHT;
+
+        CountImageType::Pointer pImage( CountImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+        pImage->FillBuffer( static_cast< unsigned short >( DARK_COUNT + std::floor( FLAT_RANGE * std::exp( -0.5 ) + 0.5 ) ) );
+
+        CountImageType::IndexType indexDefect;
+        indexDefect[0] = DEFECT_X;
+        indexDefect[1] = DEFECT_Y;
+        pImage->SetPixel( indexDefect, 60000 );
+
+        CountWriter::Pointer pWriter( CountWriter::New() );
+        pWriter->SetInput( pImage );
+        pWriter->SetFileName( strDirectory + "/tmp_" + strName );
+        pWriter->Update();
+
+        itksys::SystemTools::RenameFile( ( strDirectory + "/tmp_" + strName ).c_str(), ( strDirectory + "/" + strName ).c_str() );
+    }
+
+    std::string FrameName( unsigned int uintStack, unsigned int uintFrame )
+    {
+        std::ostringstream ss;
+        ss << "SAMPLE_Y" << uintStack << "_TOMO_" << uintFrame << ".tif";
+        return ss.str();
+    }
+}
+
+int itkLiveProjectionProcessorTest( int argc, char * argv[] )
+{
+    if( argc < 2 )
+    {
+        std::cerr << "Missing parameters." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " acquisitionDirectory" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string strDirectory( argv[1] );
+    itksys::SystemTools::RemoveADirectory( strDirectory );
+    itksys::SystemTools::MakeDirectory( strDirectory );
+
+    ProcessorType::Pointer pProcessor( ProcessorType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pProcessor, LiveProjectionProcessor, Object );
+
+    // Nothing to correct with
+    pProcessor->SetDirectory( strDirectory );
+    TEST_SET_GET_VALUE( strDirectory, std::string( pProcessor->GetDirectory() ) );
+    TRY_EXPECT_EXCEPTION( pProcessor->Start() );
+
+    // Two stacks sharing the dark, the defect of stack 0 in its map
+    ImageType::Pointer pDark( CreateImage( DARK_COUNT ) );
+    ImageType::Pointer pFlat( CreateImage( DARK_COUNT + FLAT_RANGE ) );
+
+    DefectMapType::RadiusType radius;
+    radius.Fill( 1 );
+
+    DefectMapType::IndexType indexDefect;
+    indexDefect[0] = DEFECT_X;
+    indexDefect[1] = DEFECT_Y;
+
+    DefectMapType::Pointer pDefectMap( DefectMapType::New() );
+    pDefectMap->Initialize( pDark->GetLargestPossibleRegion() );
+    pDefectMap->SetRadius( radius );
+    pDefectMap->AddDefect( indexDefect );
+    pDefectMap->Update();
+
+    pProcessor->SetDark( 0, pDark );
+    pProcessor->SetFlat( 0, pFlat );
+    pProcessor->SetFlat( 1, pFlat );
+    pProcessor->SetDefectMap( 0, pDefectMap );
+    TEST_EXPECT_EQUAL( pProcessor->GetNumberOfStacks(), 2u );
+
+    pProcessor->SetTargetLatency( 0.0 );
+    TEST_SET_GET_VALUE( 0.0, pProcessor->GetTargetLatency() );
+    pProcessor->SetPreviewShrinkFactor( 2 );
+    TEST_SET_GET_VALUE( 2u, pProcessor->GetPreviewShrinkFactor() );
+    TEST_SET_GET_BOOLEAN( pProcessor, UseNotification, true );
+
+    std::vector< ProcessorType::Frame > vecFrames;
+    std::vector< float > vecDefectValues;
+    pProcessor->SetFrameCallback( [&]( const ProcessorType::Frame & frame, const ImageType * pProjection )
+    {
+        vecFrames.push_back( frame );
+        vecDefectValues.push_back( pProjection->GetPixel( indexDefect ) );
+    } );
+
+    // Frames written before the start, and files of other series
+    WriteFrame( strDirectory, FrameName( 1, 1 ) );
+    WriteFrame( strDirectory, FrameName( 0, 1 ) );
+    WriteFrame( strDirectory, "SAMPLE_Y0_ALIGN_1.tif" );
+    WriteFrame( strDirectory, "DF_Y0_DARK_1.tif" );
+
+    TRY_EXPECT_NO_EXCEPTION( pProcessor->Start() );
+    std::cout << "Notified: " << pProcessor->GetNotified() << std::endl;
+
+    // No frame allocates once started
+    const itk::SizeValueType uintAllocations( pProcessor->GetBufferPool()->GetNumberOfAllocations() );
+
+    TEST_EXPECT_EQUAL( pProcessor->ProcessPending(), 2u );
+    TEST_EXPECT_EQUAL( vecFrames.size(), 2u );
+    TEST_EXPECT_EQUAL( vecFrames[0].Stack, 0u );
+    TEST_EXPECT_EQUAL( vecFrames[1].Stack, 1u );
+    TEST_EXPECT_EQUAL( vecFrames[0].Number, 1u );
+    TEST_EXPECT_EQUAL( vecFrames[0].FileName, strDirectory + "/" + FrameName( 0, 1 ) );
+
+    // -log of the corrected transmission, the defect repaired in stack 0 only
+    const double dblExpected( -std::log( std::floor( FLAT_RANGE * std::exp( -0.5 ) + 0.5 ) / FLAT_RANGE ) );
+    const ImageType * pProjection( pProcessor->GetProjection( 0 ) );
+    TEST_EXPECT_TRUE( pProjection != ITK_NULLPTR );
+    TEST_EXPECT_TRUE( std::abs( pProjection->GetBufferPointer()[0] - dblExpected ) < 1.0e-5 );
+    TEST_EXPECT_TRUE( std::abs( vecDefectValues[0] - dblExpected ) < 1.0e-5 );
+    TEST_EXPECT_TRUE( std::abs( vecDefectValues[1] - dblExpected ) > 0.1 );
+
+    TEST_EXPECT_EQUAL( pProcessor->GetPreview( 1 )->GetLargestPossibleRegion().GetSize( 0 ), FRAME_WIDTH / 2u );
+
+    ProcessorType::Statistics statistics( pProcessor->GetStatistics() );
+    TEST_EXPECT_EQUAL( statistics.FramesDetected, 2u );
+    TEST_EXPECT_EQUAL( statistics.FramesProcessed, 2u );
+    TEST_EXPECT_EQUAL( statistics.Backlog, 0u );
+    TEST_EXPECT_EQUAL( statistics.MaximumBacklog, 2u );
+    TEST_EXPECT_EQUAL( statistics.FramesOverTarget, 2u );
+    TEST_EXPECT_TRUE( statistics.MaximumLatency >= statistics.LastLatency );
+    TEST_EXPECT_TRUE( statistics.MeanProcessingSeconds > 0.0 );
+
+    // Frames written while running, picked up as written when notified and
+    // once unchanged between two listings otherwise
+    WriteFrame( strDirectory, FrameName( 0, 2 ) );
+    if( !pProcessor->GetNotified() )
+        TEST_EXPECT_EQUAL( pProcessor->ProcessPending(), 0u );
+    TEST_EXPECT_EQUAL( pProcessor->ProcessPending(), 1u );
+    TEST_EXPECT_EQUAL( pProcessor->ProcessPending(), 0u );
+
+    std::thread threadDetector( [&]()
+    {
+        for( unsigned int i = 3; i < 6; i++ )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+            WriteFrame( strDirectory, FrameName( 1, i ) );
+        }
+    } );
+
+    const itk::SizeValueType uintRun( pProcessor->Run( 3, 5.0 ) );
+    threadDetector.join();
+    TEST_EXPECT_EQUAL( uintRun, 3u );
+    TEST_EXPECT_EQUAL( pProcessor->GetBufferPool()->GetNumberOfAllocations(), uintAllocations );
+
+    // Idle until the timeout
+    TEST_EXPECT_EQUAL( pProcessor->Run( 0, 0.05 ), 0u );
+
+    // Frames of the wrong size or of a stack without a flat fail and are skipped
+    WriteFrame( strDirectory, FrameName( 0, 6 ), FRAME_WIDTH + 1 );
+    WriteFrame( strDirectory, FrameName( 2, 6 ) );
+    pProcessor->ProcessPending();
+    pProcessor->ProcessPending();
+    statistics = pProcessor->GetStatistics();
+    TEST_EXPECT_EQUAL( statistics.FramesFailed, 2u );
+    TEST_EXPECT_EQUAL( statistics.FramesProcessed, 6u );
+    TEST_EXPECT_TRUE( !std::string( pProcessor->GetLastError() ).empty() );
+    std::cout << "Last error: " << pProcessor->GetLastError() << std::endl;
+
+    // Polled, the frames present at the start are processed again
+    pProcessor->Stop();
+    pProcessor->UseNotificationOff();
+    vecFrames.clear();
+    TRY_EXPECT_NO_EXCEPTION( pProcessor->Start() );
+    TEST_EXPECT_TRUE( !pProcessor->GetNotified() );
+    pProcessor->ProcessPending();
+    TEST_EXPECT_EQUAL( pProcessor->GetStatistics().FramesProcessed, 6u );
+
+    WriteFrame( strDirectory, FrameName( 0, 7 ) );
+    TEST_EXPECT_EQUAL( pProcessor->ProcessPending(), 0u );
+    TEST_EXPECT_EQUAL( pProcessor->ProcessPending(), 1u );
+
+    std::cout << "Mean latency " << pProcessor->GetStatistics().MeanLatency << " s, "
+              << pProcessor->GetStatistics().ProcessedPerSecond << " frames/s" << std::endl;
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -20,6 +20,7 @@
 #include "itkCommand.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
 #include "itkTestingMacros.h"
 
 using ImageType = itk::Image< float, 2 >;
@@ -30,6 +31,9 @@ using MaskImageFileReaderType = itk::ImageFileReader< MaskImageType >;
 using MaskedMedianImageFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, MaskImageType >;
 
 #define FILTER_RADIUS 2
+#define PROGRESS_UPDATES 10u
+#define CLUSTER_SIZE 3
+#define MINIMUM_VALID_SAMPLES 3u
 
 namespace
 {
@@ -85,6 +89,9 @@ int itkMaskedMedianImageFilterTest( int argc, char * argv[] )
     pMaskedMedianImageFilter->SetRadius( radiusFilter );
     TEST_SET_GET_VALUE( radiusFilter, pMaskedMedianImageFilter->GetRadius() );
 
+    pMaskedMedianImageFilter->SetNumberOfProgressUpdates( PROGRESS_UPDATES );
+    TEST_SET_GET_VALUE( PROGRESS_UPDATES, pMaskedMedianImageFilter->GetNumberOfProgressUpdates() );
+
     ShowProgress::Pointer pShowProgress( ShowProgress::New() );
     pMaskedMedianImageFilter->AddObserver( itk::ProgressEvent(), pShowProgress );
     pMaskedMedianImageFilter->SetInput( pImageFileReader->GetOutput() );
@@ -98,6 +105,78 @@ int itkMaskedMedianImageFilterTest( int argc, char * argv[] )
 
     TRY_EXPECT_NO_EXCEPTION( pImageFileWriter->Update() );
 
+    // A cluster of defects on a flat background, which outvotes the background
+    // at radius 1 unless the masked pixels are excluded
+    ImageType::SizeType sizeCluster;
+    sizeCluster.Fill( 16 );
+
+    ImageType::Pointer pClusterImage( ImageType::New() );
+    pClusterImage->SetRegions( sizeCluster );
+    pClusterImage->Allocate();
+    pClusterImage->FillBuffer( 10.0f );
+
+    MaskImageType::Pointer pClusterMask( MaskImageType::New() );
+    pClusterMask->SetRegions( sizeCluster );
+    pClusterMask->Allocate( true );
+
+    ImageType::IndexType indexCenter;
+    indexCenter.Fill( 7 );
+
+    for( int y = -CLUSTER_SIZE / 2; y <= CLUSTER_SIZE / 2; y++ )
+    {
+        for( int x = -CLUSTER_SIZE / 2; x <= CLUSTER_SIZE / 2; x++ )
+        {
+            ImageType::IndexType index( indexCenter );
+            index[0] += x;
+            index[1] += y;
+            pClusterImage->SetPixel( index, 1000.0f );
+            pClusterMask->SetPixel( index, 1 );
+        }
+    }
+
+    // A defect in the corner, only three good neighbours on the image
+    ImageType::IndexType indexCorner;
+    indexCorner.Fill( 0 );
+    pClusterImage->SetPixel( indexCorner, 1000.0f );
+    pClusterMask->SetPixel( indexCorner, 1 );
+
+    MaskedMedianImageFilterType::RadiusType radiusSmall;
+    radiusSmall.Fill( 1 );
+
+    MaskedMedianImageFilterType::Pointer pClusterFilter( MaskedMedianImageFilterType::New() );
+    pClusterFilter->SetInput( pClusterImage );
+    pClusterFilter->SetMaskImage( pClusterMask );
+    pClusterFilter->SetRadius( radiusSmall );
+    TEST_SET_GET_BOOLEAN( pClusterFilter, ExcludeMaskedPixels, false );
+    pClusterFilter->ExcludeMaskedPixelsOff();
+
+    TRY_EXPECT_NO_EXCEPTION( pClusterFilter->Update() );
+    TEST_EXPECT_EQUAL( pClusterFilter->GetOutput()->GetPixel( indexCenter ), 1000.0f );
+
+    // The centre of the cluster has no good pixel within radius 1, so the
+    // neighborhood grows to radius 2
+    pClusterFilter->ExcludeMaskedPixelsOn();
+    pClusterFilter->SetMinimumValidSamples( MINIMUM_VALID_SAMPLES );
+    TEST_SET_GET_VALUE( MINIMUM_VALID_SAMPLES, pClusterFilter->GetMinimumValidSamples() );
+
+    TRY_EXPECT_NO_EXCEPTION( pClusterFilter->Update() );
+    TEST_EXPECT_EQUAL( pClusterFilter->GetOutput()->GetPixel( indexCenter ), 10.0f );
+    TEST_EXPECT_EQUAL( pClusterFilter->GetOutput()->GetPixel( indexCorner ), 10.0f );
+
+    itk::ImageRegionConstIterator< ImageType > itCluster( pClusterFilter->GetOutput(), pClusterFilter->GetOutput()->GetLargestPossibleRegion() );
+    for( ; !itCluster.IsAtEnd(); ++itCluster )
+        TEST_EXPECT_EQUAL( itCluster.Get(), 10.0f );
+
+    // Not grown beyond the radius of the filter, the centre is left unchanged
+    pClusterFilter->SetMaximumRadius( radiusSmall );
+    TEST_SET_GET_VALUE( radiusSmall, pClusterFilter->GetMaximumRadius() );
+
+    TRY_EXPECT_NO_EXCEPTION( pClusterFilter->Update() );
+    TEST_EXPECT_EQUAL( pClusterFilter->GetOutput()->GetPixel( indexCenter ), 1000.0f );
+
+    indexCenter[0] += 1;
+    TEST_EXPECT_EQUAL( pClusterFilter->GetOutput()->GetPixel( indexCenter ), 10.0f );
+
     std::cout << "Test finished." << std::endl;
 
     return EXIT_SUCCESS;
@@ -0,0 +1,171 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkMemoryBudgetPlanner.h"
+
+#include "itkImage.h"
+#include "itkTestingMacros.h"
+
+#include <sstream>
+
+#define IMAGE_SIZE 100
+#define MEDIAN_RADIUS 2
+#define RESIDENT_BYTES 10000.0
+
+using ImageType = itk::Image< float, 2 >;
+using MaskImageType = itk::PackedBitMaskImage< 2 >;
+using PlannerType = itk::MemoryBudgetPlanner;
+using ComputeType = itk::ComputePixelTraits< float >::ComputeType;
+
+int itkMemoryBudgetPlannerTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    PlannerType::Pointer pPlanner( PlannerType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pPlanner, MemoryBudgetPlanner, Object );
+
+    ImageType::SizeType size;
+    size.Fill( IMAGE_SIZE );
+
+    const double dblImageBytes( IMAGE_SIZE * IMAGE_SIZE * sizeof( float ) );
+    TEST_EXPECT_EQUAL( PlannerType::ImageBytes< ImageType >( size ), dblImageBytes );
+
+    // Masks by their words, two of 64 bits per row of 100 pixels
+    TEST_EXPECT_EQUAL( PlannerType::ImageBytes< MaskImageType >( size ), 2.0 * IMAGE_SIZE * sizeof( MaskImageType::WordType ) );
+
+    // Three inputs of 50 rows shifted by 40 rows stitched into 130 rows,
+    // overlapping by 10 rows
+    ImageType::SizeType sizeInput;
+    sizeInput[0] = IMAGE_SIZE;
+    sizeInput[1] = 50;
+
+    ImageType::SizeType sizeStitched;
+    sizeStitched[0] = IMAGE_SIZE;
+    sizeStitched[1] = 130;
+
+    const PlannerType::Step stepStitch( PlannerType::EstimateVerticalStitching< ImageType >( sizeInput, 3, sizeStitched, 40, true ) );
+    TEST_EXPECT_EQUAL( stepStitch.Rows, 130u );
+    TEST_EXPECT_EQUAL( stepStitch.InputBytes, 3.0 * IMAGE_SIZE * 50 * sizeof( float ) );
+    TEST_EXPECT_EQUAL( stepStitch.OutputBytes, 1.0 * IMAGE_SIZE * 130 * sizeof( float ) );
+    TEST_EXPECT_EQUAL( stepStitch.IntermediateBytes, 3.0 * IMAGE_SIZE * 50 * sizeof( float ) );
+    TEST_EXPECT_EQUAL( stepStitch.HeldBytes, 2.0 * 2 * IMAGE_SIZE * 10 * sizeof( ComputeType ) );
+    TEST_EXPECT_TRUE( !stepStitch.Streamable );
+
+    // Given the weights, the stitching streams and holds none
+    const PlannerType::Step stepStitchWeighted( PlannerType::EstimateVerticalStitching< ImageType >( sizeInput, 3, sizeStitched, 40, false ) );
+    TEST_EXPECT_EQUAL( stepStitchWeighted.HeldBytes, 0.0 );
+    TEST_EXPECT_TRUE( stepStitchWeighted.Streamable );
+
+    ImageType::SizeType radius;
+    radius.Fill( MEDIAN_RADIUS );
+
+    PlannerType::StepsType vecRepair;
+    vecRepair.push_back( PlannerType::EstimateThresholdedMedianMask< ImageType, MaskImageType >( size, radius ) );
+    vecRepair.push_back( PlannerType::EstimateNegLog< ImageType >( size ) );
+    TEST_EXPECT_EQUAL( vecRepair[0].OverlapRows, static_cast< itk::SizeValueType >( MEDIAN_RADIUS ) );
+
+    // Undivided, the input, median image, mask and output of the chain
+    const double dblMaskBytes( PlannerType::ImageBytes< MaskImageType >( size ) );
+    TEST_EXPECT_EQUAL( PlannerType::ComputeStageBytes( vecRepair, 1, false ), 3.0 * dblImageBytes + dblMaskBytes );
+
+    // Streamed, the input and assembled output whole and the rest by piece
+    TEST_EXPECT_EQUAL( PlannerType::ComputeStageBytes( vecRepair, 4, false ), 2.0 * dblImageBytes + 0.25 * ( 2.0 * dblImageBytes + dblMaskBytes ) );
+
+    pPlanner->AddResident( "flat", RESIDENT_BYTES );
+    TEST_EXPECT_EQUAL( pPlanner->GetResidentBytes(), RESIDENT_BYTES );
+
+    TEST_EXPECT_EQUAL( pPlanner->AddStage( "normalise", PlannerType::EstimatePixelwise< ImageType >( "DivideImageFilter", sizeStitched, true ) ), 0u );
+    TEST_EXPECT_EQUAL( pPlanner->AddStage( "repair", vecRepair ), 1u );
+    TEST_EXPECT_EQUAL( pPlanner->AddStage( "stitch", stepStitch ), 2u );
+    TEST_EXPECT_EQUAL( pPlanner->GetNumberOfStages(), 3u );
+    TRY_EXPECT_EXCEPTION( pPlanner->GetStage( "missing" ) );
+    TRY_EXPECT_EXCEPTION( pPlanner->GetStage( 3 ) );
+
+    // Without a budget every stage runs undivided
+    TEST_SET_GET_VALUE( 0.0, pPlanner->GetBudgetBytes() );
+    pPlanner->Plan();
+    for( unsigned int i = 0; i < pPlanner->GetNumberOfStages(); i++ )
+    {
+        TEST_EXPECT_EQUAL( pPlanner->GetStage( i ).Divisions, 1u );
+        TEST_EXPECT_TRUE( !pPlanner->GetStage( i ).InPlace );
+        TEST_EXPECT_EQUAL( pPlanner->GetStage( i ).PeakBytes, pPlanner->GetStage( i ).UnplannedPeakBytes );
+    }
+    TEST_EXPECT_TRUE( pPlanner->GetWithinBudget() );
+    TEST_EXPECT_EQUAL( pPlanner->GetPeakBytes(), pPlanner->GetStage( "stitch" ).UnplannedPeakBytes );
+
+    // Running in place fits the division, streaming the repair chain
+    const double dblStitchedBytes( PlannerType::ImageBytes< ImageType >( sizeStitched ) );
+    const double dblBudget( RESIDENT_BYTES + 2.5 * dblImageBytes );
+    pPlanner->SetBudgetBytes( dblBudget );
+    TEST_SET_GET_VALUE( dblBudget, pPlanner->GetBudgetBytes() );
+    pPlanner->Plan();
+
+    const PlannerType::Stage & stageNormalise( pPlanner->GetStage( "normalise" ) );
+    TEST_EXPECT_TRUE( stageNormalise.InPlace );
+    TEST_EXPECT_EQUAL( stageNormalise.Divisions, 1u );
+    TEST_EXPECT_TRUE( stageNormalise.UnplannedPeakBytes > dblBudget );
+    TEST_EXPECT_EQUAL( stageNormalise.PeakBytes, RESIDENT_BYTES + dblStitchedBytes );
+    TEST_EXPECT_TRUE( stageNormalise.WithinBudget );
+
+    // The fewest divisions that fit, 100 rows in 5 pieces of 20 rows
+    const PlannerType::Stage & stageRepair( pPlanner->GetStage( "repair" ) );
+    TEST_EXPECT_TRUE( !stageRepair.InPlace );
+    TEST_EXPECT_EQUAL( stageRepair.Divisions, 5u );
+    TEST_EXPECT_TRUE( stageRepair.WithinBudget );
+    TEST_EXPECT_TRUE( stageRepair.PeakBytes <= dblBudget );
+    TEST_EXPECT_TRUE( RESIDENT_BYTES + PlannerType::ComputeStageBytes( vecRepair, stageRepair.Divisions - 1, false ) > dblBudget );
+
+    // The stitching neither streams nor runs in place
+    const PlannerType::Stage & stageStitch( pPlanner->GetStage( "stitch" ) );
+    TEST_EXPECT_EQUAL( stageStitch.Divisions, 1u );
+    TEST_EXPECT_TRUE( !stageStitch.WithinBudget );
+    TEST_EXPECT_TRUE( !pPlanner->GetWithinBudget() );
+
+    std::ostringstream ossReport;
+    pPlanner->Report( ossReport );
+    std::cout << ossReport.str();
+    TEST_EXPECT_TRUE( ossReport.str().find( "repair" ) != std::string::npos );
+    TEST_EXPECT_TRUE( ossReport.str().find( "5 divisions" ) != std::string::npos );
+    TEST_EXPECT_TRUE( ossReport.str().find( "over budget" ) != std::string::npos );
+
+    std::ostringstream ossJSON;
+    pPlanner->WriteJSON( ossJSON );
+    TEST_EXPECT_TRUE( ossJSON.str().find( "\"stage\": \"normalise\", \"divisions\": 1, \"in_place\": true" ) != std::string::npos );
+    TEST_EXPECT_TRUE( ossJSON.str().find( "\"within_budget\": false" ) != std::string::npos );
+
+    // A budget below the resident images is met by nothing, each stage
+    // planned to its smallest peak
+    pPlanner->SetBudgetBytes( RESIDENT_BYTES / 2 );
+    pPlanner->Plan();
+    TEST_EXPECT_TRUE( !pPlanner->GetStage( "normalise" ).WithinBudget );
+    TEST_EXPECT_TRUE( pPlanner->GetStage( "normalise" ).InPlace );
+    TEST_EXPECT_TRUE( pPlanner->GetStage( "repair" ).PeakBytes < pPlanner->GetStage( "repair" ).UnplannedPeakBytes );
+
+    pPlanner->Clear();
+    TEST_EXPECT_EQUAL( pPlanner->GetNumberOfStages(), 0u );
+    TEST_EXPECT_EQUAL( pPlanner->GetResidentBytes(), 0.0 );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkNUMAPlacement.h"
+#include "itkDynamicFlatFieldCorrectionImageFilter.h"
+#include "itkMaskedMedianImageFilter.h"
+#include "itkVerticalStitchingImageFilter.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#define IMAGE_WIDTH 40
+#define IMAGE_HEIGHT 32
+#define NUM_STACKS 3
+#define VERTICAL_SHIFT 24
+#define NUM_THREADS 4
+
+using ImageType = itk::Image< float, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+using PlacementType = itk::NUMAPlacement;
+using StitchingFilterType = itk::VerticalStitchingImageFilter< ImageType, ImageType >;
+using FlatFieldFilterType = itk::DynamicFlatFieldCorrectionImageFilter< ImageType >;
+using MaskedMedianFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, MaskImageType >;
+
+namespace
+{
+    template< typename TImage >
+    typename TImage::Pointer CreateImage( double dblPhase )
+    {
+        typename TImage::SizeType size;
+        size[0] = IMAGE_WIDTH;
+        size[1] = IMAGE_HEIGHT;
+
+        typename TImage::Pointer pImage( TImage::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< TImage > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( ; !it.IsAtEnd(); ++it )
+            it.Set( static_cast< typename TImage::PixelType >( 100.0 + 20.0 * std::sin( 0.3 * it.GetIndex()[0] + dblPhase ) * std::cos( 0.2 * it.GetIndex()[1] ) ) );
+
+        return pImage;
+    }
+
+    /** Whether two images hold the same pixels, bit for bit */
+    bool Identical( const ImageType * pImage, const ImageType * pOtherImage )
+    {
+        if( pImage->GetBufferedRegion() != pOtherImage->GetBufferedRegion() )
+            return false;
+
+        itk::ImageRegionConstIterator< ImageType > it( pImage, pImage->GetBufferedRegion() );
+        itk::ImageRegionConstIterator< ImageType > itOther( pOtherImage, pOtherImage->GetBufferedRegion() );
+        for( ; !it.IsAtEnd(); ++it, ++itOther )
+        {
+            if( it.Get() != itOther.Get() )
+                return false;
+        }
+
+        return true;
+    }
+
+    /** Runs a filter without and then with a placement, returning whether the
+     * outputs are identical */
+    template< typename TFilter >
+    bool PlacedOutputIdentical( TFilter * pFilter, PlacementType * pPlacement )
+    {
+        pFilter->SetNumberOfThreads( NUM_THREADS );
+        pFilter->SetNUMAPlacement( ITK_NULLPTR );
+        pFilter->Update();
+
+        ImageType::Pointer pExpected( pFilter->GetOutput() );
+        pExpected->DisconnectPipeline();
+
+        pFilter->SetNUMAPlacement( pPlacement );
+        pFilter->Modified();
+        pFilter->Update();
+
+        return Identical( pExpected, pFilter->GetOutput() );
+    }
+
+    /** The CPUs this process may run on split into two nodes, so that two
+     * nodes are placed on whatever the machine */
+    PlacementType::NodeCPUsType SimulatedNodes()
+    {
+        const PlacementType::NodeCPUsType vecDetected( PlacementType::DetectNodeCPUs() );
+
+        std::vector< int > vecCPUs;
+        for( size_t i = 0; i < vecDetected.size(); i++ )
+            vecCPUs.insert( vecCPUs.end(), vecDetected[i].begin(), vecDetected[i].end() );
+
+        PlacementType::NodeCPUsType vecNodes( 2 );
+        for( size_t i = 0; i < vecCPUs.size(); i++ )
+            vecNodes[2 * i < vecCPUs.size() ? 0 : 1].push_back( vecCPUs[i] );
+
+        // A single CPU is shared by both
+        if( vecNodes[1].empty() )
+            vecNodes[1] = vecNodes[0];
+
+        return vecNodes;
+    }
+}
+
+int itkNUMAPlacementTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    PlacementType::Pointer pPlacement( PlacementType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pPlacement, NUMAPlacement, Object );
+
+    TEST_SET_GET_BOOLEAN( pPlacement, PinThreads, true );
+    TEST_EXPECT_TRUE( pPlacement->GetNumberOfNodes() >= 1 );
+    std::cout << "Detected " << pPlacement->GetNumberOfNodes() << " nodes" << std::endl;
+
+    // CPU lists as written by the kernel
+    const std::vector< int > vecCPUs( PlacementType::ParseCPUList( "0-3,8,10-11\n" ) );
+    TEST_EXPECT_EQUAL( vecCPUs.size(), 7u );
+    TEST_EXPECT_EQUAL( vecCPUs[3], 3 );
+    TEST_EXPECT_EQUAL( vecCPUs[4], 8 );
+    TEST_EXPECT_EQUAL( vecCPUs[6], 11 );
+    TEST_EXPECT_TRUE( PlacementType::ParseCPUList( "" ).empty() );
+
+    // Threads are grouped by node in order
+    pPlacement->SetNodeCPUs( SimulatedNodes() );
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfNodes(), 2u );
+    TEST_EXPECT_EQUAL( pPlacement->GetNodeOfThread( 0, NUM_THREADS ), 0u );
+    TEST_EXPECT_EQUAL( pPlacement->GetNodeOfThread( 1, NUM_THREADS ), 0u );
+    TEST_EXPECT_EQUAL( pPlacement->GetNodeOfThread( 2, NUM_THREADS ), 1u );
+    TEST_EXPECT_EQUAL( pPlacement->GetNodeOfThread( 3, NUM_THREADS ), 1u );
+    TEST_EXPECT_EQUAL( pPlacement->GetNodeOfThread( 0, 1 ), 0u );
+
+    // Every row is visited once, by the thread splitting it as a filter would
+    ImageType::RegionType region;
+    region.SetSize( 0, IMAGE_WIDTH );
+    region.SetSize( 1, IMAGE_HEIGHT );
+    region.SetIndex( 1, 5 );
+
+    std::vector< std::atomic< int > > vecVisits( IMAGE_HEIGHT );
+    for( size_t i = 0; i < vecVisits.size(); i++ )
+        vecVisits[i] = 0;
+
+    std::atomic< itk::SizeValueType > uintPixels( 0 );
+    pPlacement->ForEachThreadRegion( region, NUM_THREADS, [&]( const ImageType::RegionType & regionThread, itk::ThreadIdType )
+    {
+        for( itk::IndexValueType y = regionThread.GetIndex( 1 ); y < regionThread.GetUpperIndex()[1] + 1; y++ )
+            vecVisits[y - region.GetIndex( 1 )]++;
+        uintPixels += regionThread.GetNumberOfPixels();
+    } );
+
+    TEST_EXPECT_EQUAL( uintPixels.load(), region.GetNumberOfPixels() );
+    for( size_t i = 0; i < vecVisits.size(); i++ )
+        TEST_EXPECT_EQUAL( vecVisits[i].load(), 1 );
+
+    // A copy per node, holding the pixels of the image
+    ImageType::Pointer pFlat( CreateImage< ImageType >( 0.0 ) );
+    TEST_EXPECT_TRUE( pPlacement->GetReplica( pFlat.GetPointer(), 1 ) == pFlat.GetPointer() );
+
+    pPlacement->Replicate( pFlat.GetPointer() );
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfReplicatedImages(), 1u );
+
+    const ImageType * pReplica0( pPlacement->GetReplica( pFlat.GetPointer(), 0 ) );
+    const ImageType * pReplica1( pPlacement->GetReplica( pFlat.GetPointer(), 1 ) );
+    TEST_EXPECT_TRUE( pReplica0 != pFlat.GetPointer() && pReplica1 != pFlat.GetPointer() && pReplica0 != pReplica1 );
+    TEST_EXPECT_TRUE( Identical( pFlat, pReplica0 ) && Identical( pFlat, pReplica1 ) );
+
+    // Copied again once modified, not before
+    pPlacement->Replicate( pFlat.GetPointer() );
+    TEST_EXPECT_TRUE( pPlacement->GetReplica( pFlat.GetPointer(), 1 ) == pReplica1 );
+
+    pFlat->GetBufferPointer()[0] = 7.0f;
+    pFlat->Modified();
+    TEST_EXPECT_TRUE( pPlacement->GetReplica( pFlat.GetPointer(), 1 ) == pFlat.GetPointer() );
+    pPlacement->Replicate( pFlat.GetPointer() );
+    TEST_EXPECT_EQUAL( pPlacement->GetReplica( pFlat.GetPointer(), 1 )->GetBufferPointer()[0], 7.0f );
+
+    pPlacement->ReleaseReplica( pFlat );
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfReplicatedImages(), 0u );
+
+    // Vector images, as the stitching weights are
+    using VectorImageType = itk::VectorImage< float, 2 >;
+    VectorImageType::Pointer pVectorImage( VectorImageType::New() );
+    pVectorImage->SetRegions( region );
+    pVectorImage->SetNumberOfComponentsPerPixel( 2 );
+    pVectorImage->Allocate();
+    pVectorImage->GetBufferPointer()[2 * region.GetNumberOfPixels() - 1] = 3.0f;
+
+    pPlacement->Replicate( pVectorImage.GetPointer() );
+    const VectorImageType * pVectorReplica( pPlacement->GetReplica( pVectorImage.GetPointer(), 1 ) );
+    TEST_EXPECT_EQUAL( pVectorReplica->GetNumberOfComponentsPerPixel(), 2u );
+    TEST_EXPECT_EQUAL( pVectorReplica->GetBufferPointer()[2 * region.GetNumberOfPixels() - 1], 3.0f );
+
+    // A single node places nothing
+    pPlacement->SetNodeCPUs( PlacementType::NodeCPUsType() );
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfNodes(), 1u );
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfReplicatedImages(), 0u );
+    pPlacement->Replicate( pFlat.GetPointer() );
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfReplicatedImages(), 0u );
+
+    // Placed filters produce the outputs they produce unplaced
+    pPlacement->SetNodeCPUs( SimulatedNodes() );
+
+    StitchingFilterType::Pointer pStitching( StitchingFilterType::New() );
+    pStitching->SetVerticalShift( VERTICAL_SHIFT );
+    for( unsigned int i = 0; i < NUM_STACKS; i++ )
+        pStitching->SetInput( i, CreateImage< ImageType >( 0.5 * i ) );
+    TEST_EXPECT_TRUE( PlacedOutputIdentical( pStitching.GetPointer(), pPlacement.GetPointer() ) );
+    TEST_EXPECT_EQUAL( pStitching->GetOutput()->GetLargestPossibleRegion().GetSize( 1 ), static_cast< itk::SizeValueType >( VERTICAL_SHIFT * ( NUM_STACKS - 1 ) + IMAGE_HEIGHT ) );
+
+    // The weights of the last update replicated, those of earlier ones released
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfReplicatedImages(), 2u );
+    pStitching->Modified();
+    pStitching->Update();
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfReplicatedImages(), 2u );
+
+    // A single input is only trimmed
+    StitchingFilterType::Pointer pTrimming( StitchingFilterType::New() );
+    pTrimming->SetInput( CreateImage< ImageType >( 0.0 ) );
+    TEST_EXPECT_TRUE( PlacedOutputIdentical( pTrimming.GetPointer(), pPlacement.GetPointer() ) );
+
+    pPlacement->ReleaseReplicas();
+
+    FlatFieldFilterType::Pointer pFlatField( FlatFieldFilterType::New() );
+    pFlatField->SetInput( CreateImage< ImageType >( 0.2 ) );
+    pFlatField->SetMeanFlat( CreateImage< ImageType >( 0.0 ) );
+    pFlatField->SetEigenFlat( 0, CreateImage< ImageType >( 1.0 ) );
+    TEST_EXPECT_TRUE( PlacedOutputIdentical( pFlatField.GetPointer(), pPlacement.GetPointer() ) );
+    TEST_EXPECT_EQUAL( pPlacement->GetNumberOfReplicatedImages(), 2u );
+
+    MaskImageType::Pointer pMask( CreateImage< MaskImageType >( 0.0 ) );
+    MaskedMedianFilterType::Pointer pMaskedMedian( MaskedMedianFilterType::New() );
+    pMaskedMedian->SetInput( CreateImage< ImageType >( 0.7 ) );
+    pMaskedMedian->SetMaskImage( pMask );
+    TEST_EXPECT_TRUE( PlacedOutputIdentical( pMaskedMedian.GetPointer(), pPlacement.GetPointer() ) );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
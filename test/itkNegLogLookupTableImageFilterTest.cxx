@@ -0,0 +1,153 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkNegLogLookupTableImageFilter.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+#include "itkMath.h"
+
+#include <cmath>
+#include <vector>
+
+#define IMAGE_WIDTH 64
+#define IMAGE_HEIGHT 4
+#define FLAT_VALUE 20000.0
+#define PROGRESS_UPDATES 10u
+
+using CountImageType = itk::Image< unsigned short, 2 >;
+using ImageType = itk::Image< float, 2 >;
+using NegLogLookupTableImageFilterType = itk::NegLogLookupTableImageFilter< CountImageType, ImageType >;
+
+namespace
+{
+    /** Checks the output against -log( c / f ) through the polynomial,
+     * computed directly per pixel */
+    bool CheckOutput( const CountImageType * pCounts, const ImageType * pOutput, const std::vector< double > & vecRowFlats,
+                      const std::vector< double > & vecCoefficients )
+    {
+        itk::ImageRegionConstIteratorWithIndex< CountImageType > it( pCounts, pCounts->GetLargestPossibleRegion() );
+        for( ; !it.IsAtEnd(); ++it )
+        {
+            double dblExpected( 0.0 );
+            if( it.Get() > 0 )
+            {
+                const double dblFlat( FLAT_VALUE * ( vecRowFlats.empty() ? 1.0 : vecRowFlats[it.GetIndex()[1]] ) );
+                const double dblAttenuation( -std::log( it.Get() / dblFlat ) );
+
+                dblExpected = vecCoefficients.empty() ? dblAttenuation : 0.0;
+                for( size_t i = vecCoefficients.size(); i-- > 0; )
+                    dblExpected = dblExpected * dblAttenuation + vecCoefficients[i];
+            }
+
+            const float fltOutput( pOutput->GetPixel( it.GetIndex() ) );
+            if( std::abs( fltOutput - dblExpected ) > 1.0e-5 * ( 1.0 + std::abs( dblExpected ) ) )
+            {
+                std::cerr << "Count " << it.Get() << " at " << it.GetIndex() << " gave " << fltOutput << ", expected " << dblExpected << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int itkNegLogLookupTableImageFilterTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    NegLogLookupTableImageFilterType::Pointer pFilter( NegLogLookupTableImageFilterType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pFilter, NegLogLookupTableImageFilter, ImageToImageFilter );
+
+    // Counts over the whole 16 bit range, including zero and the maximum
+    CountImageType::SizeType size;
+    size[0] = IMAGE_WIDTH;
+    size[1] = IMAGE_HEIGHT;
+
+    CountImageType::Pointer pCounts( CountImageType::New() );
+    pCounts->SetRegions( size );
+    pCounts->Allocate();
+
+    itk::ImageRegionIteratorWithIndex< CountImageType > it( pCounts, pCounts->GetLargestPossibleRegion() );
+    for( ; !it.IsAtEnd(); ++it )
+        it.Set( static_cast< unsigned short >( ( it.GetIndex()[0] * 1031 + it.GetIndex()[1] * 16411 ) % 65536 ) );
+
+    CountImageType::IndexType index;
+    index.Fill( 0 );
+    pCounts->SetPixel( index, 0 );
+    index[0] = 1;
+    pCounts->SetPixel( index, 65535 );
+    index[0] = 2;
+    pCounts->SetPixel( index, static_cast< unsigned short >( FLAT_VALUE ) );
+
+    pFilter->SetInput( pCounts );
+    pFilter->SetFlatValue( FLAT_VALUE );
+    TEST_SET_GET_VALUE( FLAT_VALUE, pFilter->GetFlatValue() );
+    pFilter->SetNumberOfProgressUpdates( PROGRESS_UPDATES );
+    TEST_SET_GET_VALUE( PROGRESS_UPDATES, pFilter->GetNumberOfProgressUpdates() );
+
+    // Scalar flat, the count equal to the flat giving zero attenuation
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+    TEST_EXPECT_EQUAL( pFilter->GetTable().size(), 65536u );
+    TEST_EXPECT_TRUE( CheckOutput( pCounts, pFilter->GetOutput(), std::vector< double >(), std::vector< double >() ) );
+    TEST_EXPECT_TRUE( itk::Math::FloatAlmostEqual( pFilter->GetOutput()->GetPixel( index ), 0.0f ) );
+
+    // Folded with a linearisation polynomial
+    std::vector< double > vecCoefficients;
+    vecCoefficients.push_back( 0.01 );
+    vecCoefficients.push_back( 1.0 );
+    vecCoefficients.push_back( 0.05 );
+    pFilter->SetLinearisationCoefficients( vecCoefficients );
+    TEST_EXPECT_TRUE( pFilter->GetLinearisationCoefficients() == vecCoefficients );
+
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+    TEST_EXPECT_TRUE( CheckOutput( pCounts, pFilter->GetOutput(), std::vector< double >(), vecCoefficients ) );
+
+    // Per-row flats, with and without the polynomial
+    std::vector< double > vecRowFlats;
+    for( unsigned int y = 0; y < IMAGE_HEIGHT; y++ )
+        vecRowFlats.push_back( 0.5 + 0.25 * y );
+    pFilter->SetRowFlatValues( vecRowFlats );
+    TEST_EXPECT_TRUE( pFilter->GetRowFlatValues() == vecRowFlats );
+
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+    TEST_EXPECT_TRUE( CheckOutput( pCounts, pFilter->GetOutput(), vecRowFlats, vecCoefficients ) );
+
+    pFilter->SetLinearisationCoefficients( std::vector< double >() );
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+    TEST_EXPECT_TRUE( CheckOutput( pCounts, pFilter->GetOutput(), vecRowFlats, std::vector< double >() ) );
+
+    // Invalid flats
+    vecRowFlats.pop_back();
+    pFilter->SetRowFlatValues( vecRowFlats );
+    TRY_EXPECT_EXCEPTION( pFilter->Update() );
+
+    pFilter->SetRowFlatValues( std::vector< double >() );
+    pFilter->SetFlatValue( 0.0 );
+    TRY_EXPECT_EXCEPTION( pFilter->Update() );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
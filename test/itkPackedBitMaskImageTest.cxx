@@ -0,0 +1,230 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkPackedBitMaskImage.h"
+#include "itkImageBufferPool.h"
+#include "itkMaskedMedianImageFilter.h"
+#include "itkThresholdedMedianMaskImageFilter.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+
+#include <cmath>
+
+// Rows spanning two full words and a partial one
+#define IMAGE_WIDTH 150
+#define IMAGE_HEIGHT 40
+#define FILTER_RADIUS 2
+
+using ImageType = itk::Image< float, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+using PackedMaskImageType = itk::PackedBitMaskImage< 2 >;
+using ThresholdedMedianMaskImageFilterType = itk::ThresholdedMedianMaskImageFilter< ImageType, MaskImageType >;
+using PackedThresholdedMedianMaskImageFilterType = itk::ThresholdedMedianMaskImageFilter< ImageType, PackedMaskImageType >;
+using MaskedMedianImageFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, MaskImageType >;
+using PackedMaskedMedianImageFilterType = itk::MaskedMedianImageFilter< ImageType, ImageType, PackedMaskImageType >;
+
+namespace
+{
+    ImageType::Pointer CreateImage()
+    {
+        ImageType::SizeType size;
+        size[0] = IMAGE_WIDTH;
+        size[1] = IMAGE_HEIGHT;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        // Sparse outliers on a smooth background, clustered in a few columns
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            const ImageType::IndexType index( it.GetIndex() );
+            const bool blnOutlier( ( 3 * index[0] + 11 * index[1] ) % 97 == 0 || ( index[0] > 60 && index[0] < 66 && index[1] % 7 == 0 ) );
+
+            it.Set( blnOutlier ? 5.0f : static_cast< float >( 0.8 + 0.1 * std::cos( 0.05 * index[0] + 0.2 * index[1] ) ) );
+        }
+
+        return pImage;
+    }
+
+    MaskImageType::Pointer CreateMask( itk::SizeValueType uintPeriod )
+    {
+        MaskImageType::SizeType size;
+        size[0] = IMAGE_WIDTH;
+        size[1] = IMAGE_HEIGHT;
+
+        MaskImageType::Pointer pMask( MaskImageType::New() );
+        pMask->SetRegions( size );
+        pMask->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< MaskImageType > it( pMask, pMask->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( ( it.GetIndex()[0] * 13 + it.GetIndex()[1] * 5 ) % uintPeriod == 0 ? 1 : 0 );
+
+        return pMask;
+    }
+
+    template< typename TImage >
+    bool ImagesEqual( const TImage * pReference, const TImage * pImage )
+    {
+        if( pReference->GetBufferedRegion() != pImage->GetBufferedRegion() )
+            return false;
+
+        itk::ImageRegionConstIterator< TImage > itReference( pReference, pReference->GetBufferedRegion() );
+        itk::ImageRegionConstIterator< TImage > it( pImage, pImage->GetBufferedRegion() );
+
+        for( ; !itReference.IsAtEnd(); ++itReference, ++it )
+        {
+            if( itReference.Get() != it.Get() )
+                return false;
+        }
+
+        return true;
+    }
+
+    /** Checks that both scanline iterators find the same set pixels in every
+     * row of a mask, starting anywhere within the row */
+    bool ScanlinesAgree( const MaskImageType * pMask, const PackedMaskImageType * pPackedMask )
+    {
+        MaskImageType::IndexType index;
+        index.Fill( 0 );
+
+        for( index[1] = 0; index[1] < IMAGE_HEIGHT; index[1]++ )
+        {
+            for( index[0] = 0; index[0] < IMAGE_WIDTH; index[0] += 29 )
+            {
+                const itk::SizeValueType uintLength( IMAGE_WIDTH - index[0] );
+                const itk::MaskScanlineConstIterator< MaskImageType > it( pMask, index, uintLength );
+                const itk::MaskScanlineConstIterator< PackedMaskImageType > itPacked( pPackedMask, index, uintLength );
+
+                for( itk::SizeValueType x = 0; x <= uintLength; x++ )
+                {
+                    if( it.FindNextSet( x ) != itPacked.FindNextSet( x ) || ( x < uintLength && it.Get( x ) != itPacked.Get( x ) ) )
+                    {
+                        std::cerr << "Scanline at " << index << " differs at " << x << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+}
+
+int itkPackedBitMaskImageTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    PackedMaskImageType::Pointer pPackedMask( PackedMaskImageType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pPackedMask, PackedBitMaskImage, ImageBase );
+
+    // Rows are padded to whole words, so a little more than an eighth of a
+    // byte mask here
+    MaskImageType::Pointer pMask( CreateMask( 7 ) );
+    pPackedMask->Pack( pMask.GetPointer() );
+
+    TEST_EXPECT_EQUAL( pPackedMask->GetWordsPerRow(), 3u );
+    TEST_EXPECT_EQUAL( pPackedMask->GetPixelContainer()->Size(), static_cast< itk::SizeValueType >( 3 * IMAGE_HEIGHT ) );
+    TEST_EXPECT_TRUE( pPackedMask->GetPixelContainer()->Size() * sizeof( PackedMaskImageType::WordType ) * 6 < pMask->GetBufferedRegion().GetNumberOfPixels() );
+
+    MaskImageType::Pointer pUnpackedMask( MaskImageType::New() );
+    pPackedMask->Unpack( pUnpackedMask.GetPointer() );
+    TEST_EXPECT_TRUE( ImagesEqual( pMask.GetPointer(), pUnpackedMask.GetPointer() ) );
+
+    PackedMaskImageType::IndexType index;
+    index[0] = 130;
+    index[1] = 17;
+    pPackedMask->SetPixel( index, true );
+    TEST_EXPECT_TRUE( pPackedMask->GetPixel( index ) );
+    pPackedMask->SetPixel( index, false );
+    TEST_EXPECT_TRUE( !pPackedMask->GetPixel( index ) );
+    pPackedMask->SetPixel( index, pMask->GetPixel( index ) != 0 );
+
+    // Word-at-a-time search finds what the pixel-wise search finds, for dense,
+    // sparse and empty masks
+    TEST_EXPECT_TRUE( ScanlinesAgree( pMask.GetPointer(), pPackedMask.GetPointer() ) );
+
+    MaskImageType::Pointer pSparseMask( CreateMask( 211 ) );
+    PackedMaskImageType::Pointer pPackedSparseMask( PackedMaskImageType::New() );
+    pPackedSparseMask->Pack( pSparseMask.GetPointer() );
+    TEST_EXPECT_TRUE( ScanlinesAgree( pSparseMask.GetPointer(), pPackedSparseMask.GetPointer() ) );
+
+    pSparseMask->FillBuffer( 0 );
+    pPackedSparseMask->FillBuffer( false );
+    TEST_EXPECT_TRUE( ScanlinesAgree( pSparseMask.GetPointer(), pPackedSparseMask.GetPointer() ) );
+
+    // The mask filter produces the same mask packed as in bytes
+    ImageType::Pointer pImage( CreateImage() );
+
+    ThresholdedMedianMaskImageFilterType::RadiusType radius;
+    radius.Fill( FILTER_RADIUS );
+
+    ThresholdedMedianMaskImageFilterType::Pointer pMaskFilter( ThresholdedMedianMaskImageFilterType::New() );
+    pMaskFilter->SetInput( pImage );
+    pMaskFilter->SetRadius( radius );
+    pMaskFilter->SetThresholdLower( 0.5 );
+    pMaskFilter->SetThresholdUpper( 1.5 );
+    TRY_EXPECT_NO_EXCEPTION( pMaskFilter->Update() );
+
+    itk::ImageBufferPool::Pointer pPool( itk::ImageBufferPool::New() );
+
+    PackedThresholdedMedianMaskImageFilterType::Pointer pPackedMaskFilter( PackedThresholdedMedianMaskImageFilterType::New() );
+    pPackedMaskFilter->SetInput( pImage );
+    pPackedMaskFilter->SetRadius( radius );
+    pPackedMaskFilter->SetThresholdLower( 0.5 );
+    pPackedMaskFilter->SetThresholdUpper( 1.5 );
+    pPackedMaskFilter->SetBufferPool( pPool );
+    TRY_EXPECT_NO_EXCEPTION( pPackedMaskFilter->Update() );
+
+    pPackedMaskFilter->GetOutput()->Unpack( pUnpackedMask.GetPointer() );
+    TEST_EXPECT_TRUE( ImagesEqual( pMaskFilter->GetOutput(), pUnpackedMask.GetPointer() ) );
+
+    // The masked median gives the same result with either mask
+    MaskedMedianImageFilterType::Pointer pMaskedMedianFilter( MaskedMedianImageFilterType::New() );
+    pMaskedMedianFilter->SetInput( pImage );
+    pMaskedMedianFilter->SetMaskImage( pMaskFilter->GetOutput() );
+    pMaskedMedianFilter->SetRadius( radius );
+    TRY_EXPECT_NO_EXCEPTION( pMaskedMedianFilter->Update() );
+
+    PackedMaskedMedianImageFilterType::Pointer pPackedMaskedMedianFilter( PackedMaskedMedianImageFilterType::New() );
+    pPackedMaskedMedianFilter->SetInput( pImage );
+    pPackedMaskedMedianFilter->SetMaskImage( pPackedMaskFilter->GetOutput() );
+    pPackedMaskedMedianFilter->SetRadius( radius );
+    TRY_EXPECT_NO_EXCEPTION( pPackedMaskedMedianFilter->Update() );
+
+    TEST_EXPECT_TRUE( ImagesEqual( pMaskedMedianFilter->GetOutput(), pPackedMaskedMedianFilter->GetOutput() ) );
+
+    // Unmasked pixels pass through unchanged
+    index[0] = 1;
+    index[1] = 1;
+    if( !pPackedMaskFilter->GetOutput()->GetPixel( index ) )
+        TEST_EXPECT_EQUAL( pPackedMaskedMedianFilter->GetOutput()->GetPixel( index ), pImage->GetPixel( index ) );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkProcessingCache.h"
+
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+#include "itkVectorImage.h"
+
+#include "itksys/SystemTools.hxx"
+
+#include <fstream>
+#include <string>
+
+using ImageType = itk::Image< float, 2 >;
+using VectorImageType = itk::VectorImage< double, 2 >;
+using ProcessingCacheType = itk::ProcessingCache;
+using CacheKey = ProcessingCacheType::Key;
+
+namespace
+{
+    ImageType::Pointer CreateImage( float fltScale )
+    {
+        ImageType::SizeType size;
+        size[0] = 16;
+        size[1] = 12;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< ImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+            it.Set( fltScale * static_cast< float >( it.GetIndex()[0] + 100 * it.GetIndex()[1] ) );
+
+        return pImage;
+    }
+
+    void WriteFile( const std::string & strFileName, const std::string & strContent )
+    {
+        std::ofstream ofs( strFileName.c_str(), std::ios::binary );
+        ofs << strContent;
+    }
+
+    /** Key of a stage that depends on a file and an upstream key */
+    CacheKey CreateKey( const std::string & strFileName, const CacheKey & keyUpstream, double dblThreshold )
+    {
+        CacheKey key( "stage" );
+        key.AddFile( "input", strFileName );
+        key.AddKey( "upstream", keyUpstream );
+        key.Add( "threshold", dblThreshold );
+        return key;
+    }
+}
+
+int itkProcessingCacheTest( int argc, char * argv[] )
+{
+    if( argc < 2 )
+    {
+        std::cerr << "Missing parameters." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " cacheDirectory" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string strDirectory( argv[1] );
+    itksys::SystemTools::RemoveADirectory( strDirectory );
+
+    ProcessingCacheType::Pointer pCache( ProcessingCacheType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pCache, ProcessingCache, Object );
+
+    // Without a directory nothing is stored and everything misses
+    CacheKey keyUpstream( "upstream" );
+    keyUpstream.Add( "radius", 3 );
+
+    pCache->Store( keyUpstream, CreateImage( 1.0f ).GetPointer() );
+    TEST_EXPECT_TRUE( pCache->Load< ImageType >( keyUpstream ).IsNull() );
+    TEST_EXPECT_EQUAL( pCache->GetMisses(), 1u );
+
+    pCache->SetDirectory( strDirectory );
+    TEST_SET_GET_VALUE( strDirectory, std::string( pCache->GetDirectory() ) );
+
+    const std::string strInputFile( strDirectory + "_input.raw" );
+    WriteFile( strInputFile, "first acquisition" );
+
+    // Keys are determined by their description only
+    const CacheKey key( CreateKey( strInputFile, keyUpstream, 0.5 ) );
+    TEST_EXPECT_EQUAL( key.GetDigest(), CreateKey( strInputFile, keyUpstream, 0.5 ).GetDigest() );
+    TEST_EXPECT_EQUAL( key.GetDigest().size(), 32u );
+    TEST_EXPECT_TRUE( key.GetDigest() != CreateKey( strInputFile, keyUpstream, 0.5 + 1.0e-12 ).GetDigest() );
+
+    CacheKey keyUpstreamChanged( "upstream" );
+    keyUpstreamChanged.Add( "radius", 2 );
+    TEST_EXPECT_TRUE( key.GetDigest() != CreateKey( strInputFile, keyUpstreamChanged, 0.5 ).GetDigest() );
+
+    CacheKey keyOtherStage( "other" );
+    TEST_EXPECT_TRUE( CacheKey( "stage" ).GetDigest() != keyOtherStage.GetDigest() );
+
+    // Image hashes cover pixels and geometry
+    ImageType::Pointer pImage( CreateImage( 1.0f ) );
+    TEST_EXPECT_EQUAL( ProcessingCacheType::HashImage( pImage.GetPointer() ), ProcessingCacheType::HashImage( CreateImage( 1.0f ).GetPointer() ) );
+    TEST_EXPECT_TRUE( ProcessingCacheType::HashImage( pImage.GetPointer() ) != ProcessingCacheType::HashImage( CreateImage( 2.0f ).GetPointer() ) );
+
+    ImageType::Pointer pImageSpacing( CreateImage( 1.0f ) );
+    ImageType::SpacingType spacing;
+    spacing.Fill( 0.5 );
+    pImageSpacing->SetSpacing( spacing );
+    TEST_EXPECT_TRUE( ProcessingCacheType::HashImage( pImage.GetPointer() ) != ProcessingCacheType::HashImage( pImageSpacing.GetPointer() ) );
+
+    ImageType::Pointer pImageIndex( CreateImage( 1.0f ) );
+    ImageType::IndexType indexShifted;
+    indexShifted.Fill( 1 );
+    ImageType::RegionType regionShifted( pImageIndex->GetLargestPossibleRegion() );
+    regionShifted.SetIndex( indexShifted );
+    pImageIndex->SetRegions( regionShifted );
+    TEST_EXPECT_TRUE( ProcessingCacheType::HashImage( pImage.GetPointer() ) != ProcessingCacheType::HashImage( pImageIndex.GetPointer() ) );
+
+    // Keys of separately allocated images of the same pixels match
+    ImageType::Pointer pImageCopy( CreateImage( 1.0f ) );
+    TEST_EXPECT_TRUE( pImageCopy->GetBufferPointer() != pImage->GetBufferPointer() );
+
+    CacheKey keyImage( "image" );
+    keyImage.AddImage( "input", pImage.GetPointer() );
+    CacheKey keyImageCopy( "image" );
+    keyImageCopy.AddImage( "input", pImageCopy.GetPointer() );
+    TEST_EXPECT_EQUAL( keyImage.GetDigest(), keyImageCopy.GetDigest() );
+
+    // Miss, store, then hit with the stored pixels
+    TEST_EXPECT_TRUE( pCache->Load< ImageType >( key ).IsNull() );
+    TRY_EXPECT_NO_EXCEPTION( pCache->Store( key, pImage.GetPointer() ) );
+    TEST_EXPECT_TRUE( itksys::SystemTools::FileExists( pCache->GetFileName( key ).c_str(), true ) );
+
+    ImageType::Pointer pLoaded( pCache->Load< ImageType >( key ) );
+    TEST_EXPECT_TRUE( pLoaded.IsNotNull() );
+    TEST_EXPECT_EQUAL( ProcessingCacheType::HashImage( pLoaded.GetPointer() ), ProcessingCacheType::HashImage( pImage.GetPointer() ) );
+    TEST_EXPECT_EQUAL( pCache->GetHits(), 1u );
+    TEST_EXPECT_EQUAL( pCache->GetMisses(), 2u );
+
+    // Several results of one stage are stored under suffixes
+    VectorImageType::Pointer pVectorImage( VectorImageType::New() );
+    pVectorImage->SetRegions( pImage->GetLargestPossibleRegion() );
+    pVectorImage->SetNumberOfComponentsPerPixel( 3 );
+    pVectorImage->Allocate();
+    for( itk::SizeValueType i = 0; i < pVectorImage->GetPixelContainer()->Size(); i++ )
+        pVectorImage->GetBufferPointer()[i] = 0.25 * i;
+
+    TEST_EXPECT_TRUE( pCache->Load< VectorImageType >( key, "_weights" ).IsNull() );
+    TRY_EXPECT_NO_EXCEPTION( pCache->Store( key, pVectorImage.GetPointer(), "_weights" ) );
+
+    VectorImageType::Pointer pLoadedVector( pCache->Load< VectorImageType >( key, "_weights" ) );
+    TEST_EXPECT_TRUE( pLoadedVector.IsNotNull() );
+    TEST_EXPECT_EQUAL( ProcessingCacheType::HashImage( pLoadedVector.GetPointer() ), ProcessingCacheType::HashImage( pVectorImage.GetPointer() ) );
+
+    // Changing the content of an input file invalidates the stage
+    WriteFile( strInputFile, "re-acquired" );
+    const CacheKey keyReacquired( CreateKey( strInputFile, keyUpstream, 0.5 ) );
+    TEST_EXPECT_TRUE( key.GetDigest() != keyReacquired.GetDigest() );
+    TEST_EXPECT_TRUE( pCache->Load< ImageType >( keyReacquired ).IsNull() );
+
+    // A corrupt entry is a miss, not an error
+    WriteFile( pCache->GetFileName( keyReacquired ), "not an image" );
+    TEST_EXPECT_TRUE( pCache->Load< ImageType >( keyReacquired ).IsNull() );
+
+    TRY_EXPECT_EXCEPTION( ProcessingCacheType::HashFile( strDirectory + "/missing.raw" ) );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkProjectionBatchCorrector.h"
+#include "itkDefectMapRepairImageFilter.h"
+#include "itkNegLogCheckedImageFilter.h"
+
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define FRAME_WIDTH 24
+#define FRAME_HEIGHT 16
+#define NUM_FRAMES 5
+#define DARK_COUNT 100
+
+using ImageType = itk::Image< float, 2 >;
+using CorrectorType = itk::ProjectionBatchCorrector< ImageType >;
+using DefectMapType = CorrectorType::DefectMapType;
+using RepairFilterType = itk::DefectMapRepairImageFilter< ImageType >;
+using NegLogFilterType = itk::NegLogCheckedImageFilter< ImageType >;
+
+namespace
+{
+    ImageType::Pointer CreateImage( unsigned int uintWidth )
+    {
+        ImageType::SizeType size;
+        size[0] = uintWidth;
+        size[1] = FRAME_HEIGHT;
+
+        ImageType::Pointer pImage( ImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+        pImage->FillBuffer( DARK_COUNT );
+
+        return pImage;
+    }
+
+    /** Raw counts of a frame, a hot pixel at the defect */
+    unsigned short RawCount( itk::SizeValueType f, itk::SizeValueType i, itk::SizeValueType uintDefect )
+    {
+        return i == uintDefect ? 60000 : static_cast< unsigned short >( DARK_COUNT + 200 + ( 37 * i + 101 * f ) % 700 );
+    }
+}
+
+int itkProjectionBatchCorrectorTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    CorrectorType::Pointer pCorrector( CorrectorType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pCorrector, ProjectionBatchCorrector, Object );
+
+    TRY_EXPECT_EXCEPTION( pCorrector->Update() );
+
+    // A flat varying over the frame, and a column the beam does not reach
+    ImageType::Pointer pDark( CreateImage( FRAME_WIDTH ) );
+    ImageType::Pointer pFlat( CreateImage( FRAME_WIDTH ) );
+    const itk::SizeValueType uintPixels( pDark->GetBufferedRegion().GetNumberOfPixels() );
+    for( itk::SizeValueType i = 0; i < uintPixels; i++ )
+        pFlat->GetBufferPointer()[i] = i % FRAME_WIDTH == 0 ? DARK_COUNT : DARK_COUNT + 900 + 5 * ( i % 13 );
+
+    DefectMapType::IndexType indexDefect;
+    indexDefect[0] = 6;
+    indexDefect[1] = 7;
+    const itk::SizeValueType uintDefect( indexDefect[1] * FRAME_WIDTH + indexDefect[0] );
+
+    DefectMapType::RadiusType radius;
+    radius.Fill( 1 );
+
+    DefectMapType::Pointer pDefectMap( DefectMapType::New() );
+    pDefectMap->Initialize( pDark->GetLargestPossibleRegion() );
+    pDefectMap->SetRadius( radius );
+    pDefectMap->AddDefect( indexDefect );
+    pDefectMap->Update();
+
+    pCorrector->SetDark( pDark );
+    pCorrector->SetFlat( CreateImage( FRAME_WIDTH + 1 ) );
+    TRY_EXPECT_EXCEPTION( pCorrector->Update() );
+
+    pCorrector->SetFlat( pFlat );
+    pCorrector->SetDefectMap( pDefectMap );
+    pCorrector->SetNumberOfThreads( 3 );
+    TEST_SET_GET_VALUE( 3u, pCorrector->GetNumberOfThreads() );
+
+    std::vector< unsigned short > vecRaw( NUM_FRAMES * uintPixels );
+    for( itk::SizeValueType f = 0; f < NUM_FRAMES; f++ )
+        for( itk::SizeValueType i = 0; i < uintPixels; i++ )
+            vecRaw[f * uintPixels + i] = RawCount( f, i, uintDefect );
+
+    std::vector< float > vecOutput( NUM_FRAMES * uintPixels );
+    TEST_EXPECT_TRUE( !pCorrector->IsUpdated() );
+    TRY_EXPECT_EXCEPTION( pCorrector->Process( &vecRaw[0], &vecOutput[0], NUM_FRAMES ) );
+
+    TRY_EXPECT_NO_EXCEPTION( pCorrector->Update() );
+    TEST_EXPECT_TRUE( pCorrector->IsUpdated() );
+    TEST_EXPECT_EQUAL( pCorrector->GetNumberOfPixelsPerFrame(), uintPixels );
+    TRY_EXPECT_NO_EXCEPTION( pCorrector->Process( &vecRaw[0], &vecOutput[0], NUM_FRAMES ) );
+
+    // Each frame as corrected by the filters of the per-frame chain
+    for( itk::SizeValueType f = 0; f < NUM_FRAMES; f++ )
+    {
+        ImageType::Pointer pCorrected( CreateImage( FRAME_WIDTH ) );
+        for( itk::SizeValueType i = 0; i < uintPixels; i++ )
+        {
+            const double dblRange( pFlat->GetBufferPointer()[i] - pDark->GetBufferPointer()[i] );
+            pCorrected->GetBufferPointer()[i] = dblRange > 0.0 ? static_cast< float >( ( vecRaw[f * uintPixels + i] - pDark->GetBufferPointer()[i] ) * ( 1.0f / static_cast< float >( dblRange ) ) ) : 0.0f;
+        }
+
+        RepairFilterType::Pointer pRepair( RepairFilterType::New() );
+        pRepair->SetInput( pCorrected );
+        pRepair->SetDefectMap( pDefectMap );
+
+        NegLogFilterType::Pointer pNegLog( NegLogFilterType::New() );
+        pNegLog->SetInput( pRepair->GetOutput() );
+        pNegLog->Update();
+
+        const float * pExpected( pNegLog->GetOutput()->GetBufferPointer() );
+        double dblMaximumError( 0.0 );
+        for( itk::SizeValueType i = 0; i < uintPixels; i++ )
+            dblMaximumError = std::max( dblMaximumError, std::abs( static_cast< double >( vecOutput[f * uintPixels + i] ) - pExpected[i] ) );
+
+        TEST_EXPECT_TRUE( dblMaximumError < 1.0e-5 );
+        TEST_EXPECT_TRUE( vecOutput[f * uintPixels + uintDefect] > 0.0f );
+        TEST_EXPECT_EQUAL( vecOutput[f * uintPixels], 0.0f );
+    }
+
+    // In place from float counts, on one thread, as in parallel
+    std::vector< float > vecInPlace( vecRaw.begin(), vecRaw.end() );
+    pCorrector->SetNumberOfThreads( 1 );
+    TEST_EXPECT_TRUE( !pCorrector->IsUpdated() );
+    pCorrector->Update();
+    TRY_EXPECT_NO_EXCEPTION( pCorrector->Process( &vecInPlace[0], &vecInPlace[0], NUM_FRAMES ) );
+    TEST_EXPECT_TRUE( std::equal( vecInPlace.begin(), vecInPlace.end(), vecOutput.begin() ) );
+
+    // A changed defect map needs the corrector updated
+    pDefectMap->Initialize( pDark->GetLargestPossibleRegion() );
+    pDefectMap->Update();
+    TEST_EXPECT_TRUE( !pCorrector->IsUpdated() );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,290 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkBFloat16.h"
+#include "itkFloat16.h"
+#include "itkMaskedMedianImageFilter.h"
+#include "itkNegLogCheckedImageFilter.h"
+#include "itkThresholdedMedianImageFilter.h"
+#include "itkThresholdedMedianMaskImageFilter.h"
+#include "itkVerticalStitchingImageFilter.h"
+
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using FloatImageType = itk::Image< float, 2 >;
+using HalfImageType = itk::Image< itk::Float16, 2 >;
+using BHalfImageType = itk::Image< itk::BFloat16, 2 >;
+using MaskImageType = itk::Image< unsigned char, 2 >;
+
+namespace
+{
+    /** A vertically peaked beam of dblIntensity, across a cylinder if
+     * blnPhantom, rippled by 1% in place of noise and with dead and hot
+     * pixels at 1% of the pixels if blnDefects. The rows are those from
+     * uintRowOffset of a beam of uintTotalRows, as frames of stacks. */
+    FloatImageType::Pointer CreateFrame( const FloatImageType::SizeType & size, double dblIntensity, bool blnPhantom, bool blnDefects,
+                                         unsigned int uintRowOffset, unsigned int uintTotalRows )
+    {
+        FloatImageType::Pointer pImage( FloatImageType::New() );
+        pImage->SetRegions( size );
+        pImage->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< FloatImageType > it( pImage, pImage->GetLargestPossibleRegion() );
+        for( ; !it.IsAtEnd(); ++it )
+        {
+            const FloatImageType::IndexType index( it.GetIndex() );
+            const itk::IndexValueType intRow( index[1] + uintRowOffset );
+
+            const double dblX( ( index[0] - 0.5 * size[0] ) / size[0] );
+            const double dblY( ( intRow - 0.5 * uintTotalRows ) / uintTotalRows );
+            const double dblProfile( ( 0.6 + 0.4 * std::exp( -8.0 * dblY * dblY ) ) * ( 1.0 - 0.3 * dblX * dblX ) );
+            const double dblPath( blnPhantom && std::fabs( dblX ) < 0.3 ? 4.0 * std::sqrt( 0.09 - dblX * dblX ) : 0.0 );
+            const double dblRipple( 1.0 + 0.01 * ( ( 37 * index[0] + 101 * intRow ) % 13 - 6 ) / 6.0 );
+
+            double dblValue( dblIntensity * dblProfile * std::exp( -dblPath ) * dblRipple );
+            if( blnDefects && ( 7 * index[0] + 13 * index[1] ) % 100 == 0 )
+                dblValue = index[0] % 2 ? 4.0 * dblIntensity : 0.0;
+
+            it.Set( static_cast< float >( dblValue ) );
+        }
+
+        return pImage;
+    }
+
+    template< typename TOutputImage, typename TInputImage >
+    typename TOutputImage::Pointer ConvertImage( const TInputImage * pInput )
+    {
+        typename TOutputImage::Pointer pOutput( TOutputImage::New() );
+        pOutput->CopyInformation( pInput );
+        pOutput->SetRegions( pInput->GetBufferedRegion() );
+        pOutput->Allocate();
+
+        const typename TInputImage::PixelType * pIn( pInput->GetBufferPointer() );
+        typename TOutputImage::PixelType * pOut( pOutput->GetBufferPointer() );
+
+        for( itk::SizeValueType i = 0; i < pInput->GetBufferedRegion().GetNumberOfPixels(); i++ )
+            pOut[i] = static_cast< typename TOutputImage::PixelType >( static_cast< float >( pIn[i] ) );
+
+        return pOutput;
+    }
+
+    /** Largest difference between a reduced precision result and the float
+     * reference, relative to the largest reference magnitude */
+    template< typename TImage >
+    double MaximumRelativeDifference( const FloatImageType * pReference, const TImage * pImage )
+    {
+        const float * pRef( pReference->GetBufferPointer() );
+        const typename TImage::PixelType * pValue( pImage->GetBufferPointer() );
+
+        double dblMaxDifference( 0.0 );
+        double dblMaxReference( 0.0 );
+
+        for( itk::SizeValueType i = 0; i < pReference->GetBufferedRegion().GetNumberOfPixels(); i++ )
+        {
+            dblMaxDifference = std::max( dblMaxDifference, std::fabs( static_cast< double >( pRef[i] ) - static_cast< double >( pValue[i] ) ) );
+            dblMaxReference = std::max( dblMaxReference, std::fabs( static_cast< double >( pRef[i] ) ) );
+        }
+
+        return dblMaxReference > 0.0 ? dblMaxDifference / dblMaxReference : dblMaxDifference;
+    }
+
+    /** Runs the module's filters on a storage type and checks them against float */
+    template< typename TImage >
+    int TestFilters( const FloatImageType * pFrame, const std::vector< FloatImageType::Pointer > & vecStacks, double dblTolerance )
+    {
+        using ThresholdedMedianFloatType = itk::ThresholdedMedianImageFilter< FloatImageType, FloatImageType >;
+        using ThresholdedMedianType = itk::ThresholdedMedianImageFilter< TImage, TImage >;
+        using MaskFloatType = itk::ThresholdedMedianMaskImageFilter< FloatImageType, MaskImageType >;
+        using MaskType = itk::ThresholdedMedianMaskImageFilter< TImage, MaskImageType >;
+        using MaskedMedianFloatType = itk::MaskedMedianImageFilter< FloatImageType, FloatImageType, MaskImageType >;
+        using MaskedMedianType = itk::MaskedMedianImageFilter< TImage, TImage, MaskImageType >;
+        using NegLogFloatType = itk::NegLogCheckedImageFilter< FloatImageType >;
+        using NegLogType = itk::NegLogCheckedImageFilter< TImage >;
+        using StitchingFloatType = itk::VerticalStitchingImageFilter< FloatImageType, FloatImageType >;
+        using StitchingType = itk::VerticalStitchingImageFilter< TImage, TImage >;
+
+        typename TImage::Pointer pFrameReduced( ConvertImage< TImage >( pFrame ) );
+
+        typename ThresholdedMedianFloatType::RadiusType radius;
+        radius.Fill( 2 );
+
+        // Thresholded median
+        typename ThresholdedMedianFloatType::Pointer pMedianFloat( ThresholdedMedianFloatType::New() );
+        pMedianFloat->SetInput( pFrame );
+        pMedianFloat->SetRadius( radius );
+        pMedianFloat->SetThresholdLower( 0.02 );
+        pMedianFloat->SetThresholdUpper( 3.0 );
+        TRY_EXPECT_NO_EXCEPTION( pMedianFloat->Update() );
+
+        typename ThresholdedMedianType::Pointer pMedian( ThresholdedMedianType::New() );
+        pMedian->SetInput( pFrameReduced );
+        pMedian->SetRadius( radius );
+        pMedian->SetThresholdLower( 0.02 );
+        pMedian->SetThresholdUpper( 3.0 );
+        TRY_EXPECT_NO_EXCEPTION( pMedian->Update() );
+        TEST_EXPECT_TRUE( MaximumRelativeDifference( pMedianFloat->GetOutput(), pMedian->GetOutput() ) < dblTolerance );
+
+        // Defect mask and masked median
+        typename MaskFloatType::Pointer pMaskFloat( MaskFloatType::New() );
+        pMaskFloat->SetInput( pFrame );
+        pMaskFloat->SetRadius( radius );
+        pMaskFloat->SetThresholdLower( 0.5 );
+        pMaskFloat->SetThresholdUpper( 1.5 );
+        TRY_EXPECT_NO_EXCEPTION( pMaskFloat->Update() );
+
+        typename MaskType::Pointer pMask( MaskType::New() );
+        pMask->SetInput( pFrameReduced );
+        pMask->SetRadius( radius );
+        pMask->SetThresholdLower( 0.5 );
+        pMask->SetThresholdUpper( 1.5 );
+        TRY_EXPECT_NO_EXCEPTION( pMask->Update() );
+
+        // Rounding may only move the few pixels lying on a threshold
+        const MaskImageType::PixelType * pMaskValues( pMask->GetOutput()->GetBufferPointer() );
+        const MaskImageType::PixelType * pMaskFloatValues( pMaskFloat->GetOutput()->GetBufferPointer() );
+        const itk::SizeValueType uintPixels( pFrame->GetBufferedRegion().GetNumberOfPixels() );
+        itk::SizeValueType uintMasked( 0 );
+        itk::SizeValueType uintMismatched( 0 );
+        for( itk::SizeValueType i = 0; i < uintPixels; i++ )
+        {
+            if( pMaskFloatValues[i] )
+                ++uintMasked;
+            if( ( pMaskValues[i] != 0 ) != ( pMaskFloatValues[i] != 0 ) )
+                ++uintMismatched;
+        }
+        TEST_EXPECT_TRUE( uintMasked > 0 );
+        TEST_EXPECT_TRUE( uintMismatched <= uintPixels / 1000 );
+
+        // The masked medians both take the mask of the storage type, so that
+        // only the median itself is compared
+        typename MaskedMedianFloatType::Pointer pMaskedMedianFloat( MaskedMedianFloatType::New() );
+        pMaskedMedianFloat->SetInput( pFrame );
+        pMaskedMedianFloat->SetMaskImage( pMask->GetOutput() );
+        pMaskedMedianFloat->SetRadius( radius );
+        TRY_EXPECT_NO_EXCEPTION( pMaskedMedianFloat->Update() );
+
+        typename MaskedMedianType::Pointer pMaskedMedian( MaskedMedianType::New() );
+        pMaskedMedian->SetInput( pFrameReduced );
+        pMaskedMedian->SetMaskImage( pMask->GetOutput() );
+        pMaskedMedian->SetRadius( radius );
+        TRY_EXPECT_NO_EXCEPTION( pMaskedMedian->Update() );
+        TEST_EXPECT_TRUE( MaximumRelativeDifference( pMaskedMedianFloat->GetOutput(), pMaskedMedian->GetOutput() ) < dblTolerance );
+
+        // NegLog
+        typename NegLogFloatType::Pointer pNegLogFloat( NegLogFloatType::New() );
+        pNegLogFloat->SetInput( pFrame );
+        TRY_EXPECT_NO_EXCEPTION( pNegLogFloat->Update() );
+
+        typename NegLogType::Pointer pNegLog( NegLogType::New() );
+        pNegLog->SetInput( pFrameReduced );
+        TRY_EXPECT_NO_EXCEPTION( pNegLog->Update() );
+        TEST_EXPECT_TRUE( MaximumRelativeDifference( pNegLogFloat->GetOutput(), pNegLog->GetOutput() ) < 4.0 * dblTolerance );
+
+        // Stitching, weights are computed and blended sums accumulated in
+        // float for both
+        const double dblShift( 3.0 * pFrame->GetLargestPossibleRegion().GetSize( 1 ) / 4.0 );
+
+        typename StitchingFloatType::Pointer pStitchingFloat( StitchingFloatType::New() );
+        typename StitchingType::Pointer pStitching( StitchingType::New() );
+        pStitchingFloat->SetVerticalShift( dblShift );
+        pStitching->SetVerticalShift( dblShift );
+
+        for( unsigned int i = 0; i < vecStacks.size(); i++ )
+        {
+            pStitchingFloat->SetInput( i, vecStacks[i] );
+            pStitching->SetInput( i, ConvertImage< TImage >( vecStacks[i].GetPointer() ) );
+        }
+
+        TRY_EXPECT_NO_EXCEPTION( pStitchingFloat->Update() );
+        TRY_EXPECT_NO_EXCEPTION( pStitching->Update() );
+        TEST_EXPECT_EQUAL( pStitchingFloat->GetOutput()->GetLargestPossibleRegion(), pStitching->GetOutput()->GetLargestPossibleRegion() );
+        TEST_EXPECT_TRUE( MaximumRelativeDifference( pStitchingFloat->GetOutput(), pStitching->GetOutput() ) < 2.0 * dblTolerance );
+
+        return EXIT_SUCCESS;
+    }
+}
+
+int itkReducedPrecisionPixelTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Conversions round to nearest even and keep special values
+    TEST_EXPECT_EQUAL( itk::Float16( 1.0f ).GetBits(), 0x3c00 );
+    TEST_EXPECT_EQUAL( itk::Float16( -2.0 ).GetBits(), 0xc000 );
+    TEST_EXPECT_EQUAL( itk::Float16( 65504.0f ).GetBits(), 0x7bff );
+    TEST_EXPECT_EQUAL( itk::Float16( 65520.0f ).GetBits(), 0x7c00 );
+    TEST_EXPECT_EQUAL( itk::Float16( std::ldexp( 1.0f, -24 ) ).GetBits(), 0x0001 );
+    TEST_EXPECT_EQUAL( itk::Float16( 1.0f + std::ldexp( 1.0f, -11 ) ).GetBits(), 0x3c00 );
+    TEST_EXPECT_EQUAL( itk::Float16( 1.0f + 3.0f * std::ldexp( 1.0f, -11 ) ).GetBits(), 0x3c02 );
+    TEST_EXPECT_TRUE( std::isnan( static_cast< float >( itk::Float16( std::numeric_limits< float >::quiet_NaN() ) ) ) );
+    TEST_EXPECT_EQUAL( static_cast< float >( itk::Float16( 0.333251953125f ) ), 0.333251953125f );
+
+    TEST_EXPECT_EQUAL( itk::BFloat16( 1.0f ).GetBits(), 0x3f80 );
+    TEST_EXPECT_EQUAL( itk::BFloat16( 1.0f + std::ldexp( 1.0f, -8 ) ).GetBits(), 0x3f80 );
+    TEST_EXPECT_EQUAL( itk::BFloat16( 1.0f + 3.0f * std::ldexp( 1.0f, -8 ) ).GetBits(), 0x3f82 );
+    TEST_EXPECT_EQUAL( static_cast< float >( itk::BFloat16( 1.0e30f ) ) > 0.99e30f, true );
+    TEST_EXPECT_TRUE( std::isnan( static_cast< float >( itk::BFloat16( std::numeric_limits< float >::quiet_NaN() ) ) ) );
+
+    // Every half precision value survives a round trip through float
+    for( unsigned int uintBits = 0; uintBits < 0x10000; uintBits++ )
+    {
+        const itk::Float16 value( itk::Float16::FromBits( static_cast< itk::Float16::StorageType >( uintBits ) ) );
+        const float flt( value );
+
+        if( !std::isnan( flt ) && itk::Float16( flt ).GetBits() != value.GetBits() )
+        {
+            std::cerr << "Round trip failed for 0x" << std::hex << uintBits << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Normalised transmission with defects, as produced by flat field correction
+    FloatImageType::SizeType size;
+    size[0] = 96;
+    size[1] = 64;
+
+    FloatImageType::Pointer pFrame( CreateFrame( size, 1.0, true, true, 0, size[1] ) );
+
+    std::vector< FloatImageType::Pointer > vecStacks;
+    const unsigned int uintShift( 3 * size[1] / 4 );
+    for( unsigned int i = 0; i < 3; i++ )
+        vecStacks.push_back( CreateFrame( size, 1000.0, false, false, i * uintShift, 2 * uintShift + size[1] ) );
+
+    // Tolerances are a few units in the last place of the storage type
+    std::cout << "Float16" << std::endl;
+    if( TestFilters< HalfImageType >( pFrame, vecStacks, 4.0 * std::ldexp( 1.0, -11 ) ) != EXIT_SUCCESS )
+        return EXIT_FAILURE;
+
+    std::cout << "BFloat16" << std::endl;
+    if( TestFilters< BHalfImageType >( pFrame, vecStacks, 4.0 * std::ldexp( 1.0, -8 ) ) != EXIT_SUCCESS )
+        return EXIT_FAILURE;
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
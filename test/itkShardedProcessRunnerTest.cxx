@@ -0,0 +1,230 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkShardedProcessRunner.h"
+#include "itkSharedMemoryImage.h"
+
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#define IMAGE_WIDTH 16
+#define NUM_ITEMS 10
+#define NUM_SHARDS 3
+#define FAILING_SHARD 1
+#define NUM_COMPONENTS 3u
+
+using ImageType = itk::Image< float, 2 >;
+using SharedImageType = itk::SharedMemoryImage< ImageType >;
+using VectorImageType = itk::VectorImage< float, 2 >;
+using SharedVectorImageType = itk::SharedMemoryImage< VectorImageType >;
+using RunnerType = itk::ShardedProcessRunner;
+
+int itkShardedProcessRunnerTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    RunnerType::Pointer pRunner( RunnerType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pRunner, ShardedProcessRunner, Object );
+
+    SharedImageType::Pointer pSharedInput( SharedImageType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pSharedInput, SharedMemoryImage, Object );
+
+    // Unique per process, as segments outlive a crashed test
+    std::ostringstream ossPrefix;
+    ossPrefix << "/CSIROTomoShardedProcessRunnerTest" << getpid();
+
+    // A row per item, the input read by the workers and the output written
+    ImageType::SizeType size;
+    size[0] = IMAGE_WIDTH;
+    size[1] = NUM_ITEMS;
+
+    ImageType::SpacingType spacing;
+    spacing[0] = 0.5;
+    spacing[1] = 2.0;
+
+    ImageType::Pointer pInput( ImageType::New() );
+    pInput->SetRegions( size );
+    pInput->SetSpacing( spacing );
+    pInput->Allocate();
+
+    itk::ImageRegionIteratorWithIndex< ImageType > it( pInput, pInput->GetLargestPossibleRegion() );
+    for( ; !it.IsAtEnd(); ++it )
+        it.Set( static_cast< float >( it.GetIndex()[1] * IMAGE_WIDTH + it.GetIndex()[0] ) );
+
+    pSharedInput->SetName( ossPrefix.str() + "_input" );
+    TEST_SET_GET_VALUE( ossPrefix.str() + "_input", std::string( pSharedInput->GetName() ) );
+    TRY_EXPECT_NO_EXCEPTION( pSharedInput->Create( pInput ) );
+    TEST_EXPECT_TRUE( pSharedInput->GetOwner() );
+
+    // An output with no buffer is created zeroed
+    ImageType::Pointer pOutputInformation( ImageType::New() );
+    pOutputInformation->SetRegions( size );
+
+    SharedImageType::Pointer pSharedOutput( SharedImageType::New() );
+    pSharedOutput->SetName( ossPrefix.str() + "_output" );
+    TRY_EXPECT_NO_EXCEPTION( pSharedOutput->Create( pOutputInformation ) );
+
+    // Mapped read only with the geometry of the input
+    ImageType::Pointer pMappedInput( pSharedInput->Map() );
+    TEST_EXPECT_TRUE( pMappedInput->GetBufferedRegion() == pInput->GetBufferedRegion() );
+    TEST_EXPECT_TRUE( pMappedInput->GetSpacing() == spacing );
+    TEST_EXPECT_TRUE( std::equal( pInput->GetBufferPointer(), pInput->GetBufferPointer() + size[0] * size[1], pMappedInput->GetBufferPointer() ) );
+
+    // Each worker doubles the rows of its shard into the shared output
+    pRunner->SetNumberOfShards( NUM_SHARDS );
+    TEST_SET_GET_VALUE( NUM_SHARDS, pRunner->GetNumberOfShards() );
+    pRunner->SetNumberOfItems( NUM_ITEMS );
+    TEST_SET_GET_VALUE( NUM_ITEMS, pRunner->GetNumberOfItems() );
+
+    bool blnFail( false );
+    RunnerType::ShardFunctionType function( [&]( itk::SizeValueType uintFirst, itk::SizeValueType uintCount, unsigned int uintShard )
+    {
+        if( blnFail && uintShard == FAILING_SHARD )
+            throw std::runtime_error( "shard failed" );
+
+        ImageType::Pointer pWorkerInput( pSharedInput->Map() );
+        ImageType::Pointer pWorkerOutput( pSharedOutput->Map( true ) );
+
+        for( itk::SizeValueType i = uintFirst * IMAGE_WIDTH; i < ( uintFirst + uintCount ) * IMAGE_WIDTH; i++ )
+            pWorkerOutput->GetBufferPointer()[i] = 2.0f * pWorkerInput->GetBufferPointer()[i];
+    } );
+
+    TRY_EXPECT_NO_EXCEPTION( pRunner->Run( function ) );
+
+    const RunnerType::ShardResultsType & results( pRunner->GetShardResults() );
+    TEST_EXPECT_EQUAL( results.size(), NUM_SHARDS );
+    TEST_EXPECT_EQUAL( results[0].First, 0 );
+    TEST_EXPECT_EQUAL( results[0].Count, 4 );
+    TEST_EXPECT_EQUAL( results[1].First, 4 );
+    TEST_EXPECT_EQUAL( results[2].Count, 3 );
+    for( size_t i = 0; i < results.size(); i++ )
+    {
+        std::cout << "Shard " << i << " of " << results[i].Count << " items in " << results[i].Seconds << " s" << std::endl;
+        TEST_EXPECT_TRUE( results[i].Completed );
+        TEST_EXPECT_TRUE( results[i].Seconds >= 0.0 );
+    }
+
+    ImageType::Pointer pOutput( pSharedOutput->Map() );
+    for( itk::SizeValueType i = 0; i < size[0] * size[1]; i++ )
+        TEST_EXPECT_EQUAL( pOutput->GetBufferPointer()[i], 2.0f * pInput->GetBufferPointer()[i] );
+
+    // A failing shard is reported, the others still complete
+    blnFail = true;
+    TRY_EXPECT_EXCEPTION( pRunner->Run( function ) );
+    TEST_EXPECT_TRUE( !pRunner->GetShardResults()[FAILING_SHARD].Completed );
+    TEST_EXPECT_EQUAL( pRunner->GetShardResults()[FAILING_SHARD].Error, std::string( "shard failed" ) );
+    TEST_EXPECT_TRUE( pRunner->GetShardResults()[0].Completed );
+
+    // More shards than items, and a single shard run in this process
+    pRunner->SetNumberOfItems( 2 );
+    blnFail = false;
+    TRY_EXPECT_NO_EXCEPTION( pRunner->Run( function ) );
+    TEST_EXPECT_EQUAL( pRunner->GetShardResults().size(), 2u );
+
+    pRunner->SetNumberOfShards( 1 );
+    TRY_EXPECT_NO_EXCEPTION( pRunner->Run( function ) );
+    TEST_EXPECT_EQUAL( pRunner->GetShardResults().size(), 1u );
+
+    // Segments of another pixel type, and removed segments, are refused
+    using DoubleImageType = itk::Image< double, 2 >;
+    itk::SharedMemoryImage< DoubleImageType >::Pointer pSharedDouble( itk::SharedMemoryImage< DoubleImageType >::New() );
+    pSharedDouble->SetName( pSharedInput->GetName() );
+    TRY_EXPECT_EXCEPTION( pSharedDouble->Map() );
+
+    pSharedInput->Remove();
+    TEST_EXPECT_TRUE( !pSharedInput->GetOwner() );
+    TRY_EXPECT_EXCEPTION( pSharedInput->Map() );
+
+    // Images mapped before removal stay valid
+    TEST_EXPECT_EQUAL( pMappedInput->GetBufferPointer()[IMAGE_WIDTH + 1], pInput->GetBufferPointer()[IMAGE_WIDTH + 1] );
+
+    // Mapped before the workers are forked, the segments can be removed at
+    // once, the workers writing through the mappings they inherit
+    ImageType::Pointer pInheritedOutput( pSharedOutput->Map( true ) );
+    pSharedOutput->Remove();
+    TRY_EXPECT_EXCEPTION( pSharedOutput->Map() );
+
+    pRunner->SetNumberOfShards( NUM_SHARDS );
+    pRunner->SetNumberOfItems( NUM_ITEMS );
+    TRY_EXPECT_NO_EXCEPTION( pRunner->Run( [&]( itk::SizeValueType uintFirst, itk::SizeValueType uintCount, unsigned int )
+    {
+        for( itk::SizeValueType i = uintFirst * IMAGE_WIDTH; i < ( uintFirst + uintCount ) * IMAGE_WIDTH; i++ )
+            pInheritedOutput->GetBufferPointer()[i] = 3.0f * pMappedInput->GetBufferPointer()[i];
+    } ) );
+
+    for( itk::SizeValueType i = 0; i < size[0] * size[1]; i++ )
+        TEST_EXPECT_EQUAL( pInheritedOutput->GetBufferPointer()[i], 3.0f * pInput->GetBufferPointer()[i] );
+
+    // Vector images share their components, as the stitching weights
+    VectorImageType::Pointer pVectorInput( VectorImageType::New() );
+    pVectorInput->SetRegions( size );
+    pVectorInput->SetSpacing( spacing );
+    pVectorInput->SetNumberOfComponentsPerPixel( NUM_COMPONENTS );
+    pVectorInput->Allocate();
+
+    const itk::SizeValueType uintElements( size[0] * size[1] * NUM_COMPONENTS );
+    for( itk::SizeValueType i = 0; i < uintElements; i++ )
+        pVectorInput->GetBufferPointer()[i] = static_cast< float >( i );
+
+    SharedVectorImageType::Pointer pSharedVector( SharedVectorImageType::New() );
+    pSharedVector->SetName( ossPrefix.str() + "_vector" );
+    TRY_EXPECT_NO_EXCEPTION( pSharedVector->Create( pVectorInput ) );
+
+    VectorImageType::Pointer pMappedVector( pSharedVector->Map() );
+    TEST_EXPECT_EQUAL( pMappedVector->GetNumberOfComponentsPerPixel(), NUM_COMPONENTS );
+    TEST_EXPECT_TRUE( pMappedVector->GetBufferedRegion() == pVectorInput->GetBufferedRegion() );
+    TEST_EXPECT_TRUE( pMappedVector->GetSpacing() == spacing );
+    TEST_EXPECT_EQUAL( pMappedVector->GetPixelContainer()->Size(), uintElements );
+    TEST_EXPECT_TRUE( std::equal( pVectorInput->GetBufferPointer(), pVectorInput->GetBufferPointer() + uintElements, pMappedVector->GetBufferPointer() ) );
+
+    VectorImageType::IndexType indexVector;
+    indexVector[0] = 3;
+    indexVector[1] = 5;
+    TEST_EXPECT_TRUE( pMappedVector->GetPixel( indexVector ) == pVectorInput->GetPixel( indexVector ) );
+
+    // A vector segment is not an image of single component pixels
+    SharedImageType::Pointer pSharedScalar( SharedImageType::New() );
+    pSharedScalar->SetName( pSharedVector->GetName() );
+    TRY_EXPECT_EXCEPTION( pSharedScalar->Map() );
+
+    // An output with no buffer is created zeroed with its components
+    VectorImageType::Pointer pVectorInformation( VectorImageType::New() );
+    pVectorInformation->SetRegions( size );
+    pVectorInformation->SetNumberOfComponentsPerPixel( NUM_COMPONENTS );
+
+    SharedVectorImageType::Pointer pSharedVectorOutput( SharedVectorImageType::New() );
+    pSharedVectorOutput->SetName( ossPrefix.str() + "_vector_output" );
+    TRY_EXPECT_NO_EXCEPTION( pSharedVectorOutput->Create( pVectorInformation ) );
+
+    VectorImageType::Pointer pMappedVectorOutput( pSharedVectorOutput->Map( true ) );
+    TEST_EXPECT_EQUAL( pMappedVectorOutput->GetNumberOfComponentsPerPixel(), NUM_COMPONENTS );
+    TEST_EXPECT_EQUAL( pMappedVectorOutput->GetBufferPointer()[uintElements - 1], 0.0f );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/*=========================================================================
+ *
+ *  Copyright
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTemporalZingerRemovalImageFilter.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkStreamingImageFilter.h"
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define STACK_WIDTH 37
+#define STACK_HEIGHT 6
+#define STACK_PROJECTIONS 50
+#define ZINGER_RADIUS 2
+
+using StackType = itk::Image< float, 3 >;
+using TemporalZingerRemovalImageFilterType = itk::TemporalZingerRemovalImageFilter< StackType >;
+using StreamingImageFilterType = itk::StreamingImageFilter< StackType, StackType >;
+
+namespace
+{
+    bool IsZinger( const StackType::IndexType & index )
+    {
+        return ( 7 * index[0] + 3 * index[1] + 11 * index[2] ) % 53 == 0;
+    }
+
+    /** Smoothly varying projections with isolated zingers */
+    StackType::Pointer CreateStack()
+    {
+        StackType::SizeType size;
+        size[0] = STACK_WIDTH;
+        size[1] = STACK_HEIGHT;
+        size[2] = STACK_PROJECTIONS;
+
+        StackType::Pointer pStack( StackType::New() );
+        pStack->SetRegions( size );
+        pStack->Allocate();
+
+        itk::ImageRegionIteratorWithIndex< StackType > it( pStack, pStack->GetLargestPossibleRegion() );
+        for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+            const StackType::IndexType index( it.GetIndex() );
+            const double dblValue( 1.0 + 0.2 * std::sin( 0.3 * index[0] + 0.1 * index[2] ) + 0.01 * index[1] );
+
+            it.Set( static_cast< float >( IsZinger( index ) ? 4.0 * dblValue : dblValue ) );
+        }
+
+        return pStack;
+    }
+
+    /** Pixel by pixel reference of the filter, the window clamped to the stack */
+    float ReferenceValue( const StackType * pStack, StackType::IndexType index, double dblThresholdLower, double dblThresholdUpper )
+    {
+        const float fltPixel( pStack->GetPixel( index ) );
+        const itk::IndexValueType intProjection( index[2] );
+
+        std::vector< float > vecWindow;
+        for( itk::IndexValueType p = intProjection - ZINGER_RADIUS; p <= intProjection + ZINGER_RADIUS; p++ )
+        {
+            index[2] = std::min( std::max( p, static_cast< itk::IndexValueType >( 0 ) ), static_cast< itk::IndexValueType >( STACK_PROJECTIONS - 1 ) );
+            vecWindow.push_back( pStack->GetPixel( index ) );
+        }
+
+        std::nth_element( vecWindow.begin(), vecWindow.begin() + ZINGER_RADIUS, vecWindow.end() );
+        const float fltMedian( vecWindow[ZINGER_RADIUS] );
+
+        return fltPixel < dblThresholdLower * fltMedian || fltPixel > dblThresholdUpper * fltMedian ? fltMedian : fltPixel;
+    }
+}
+
+int itkTemporalZingerRemovalImageFilterTest( int argc, char * argv[] )
+{
+    if( argc < 1 )
+    {
+        std::cerr << "Usage: " << argv[0];
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    StackType::Pointer pStack( CreateStack() );
+
+    TemporalZingerRemovalImageFilterType::Pointer pFilter( TemporalZingerRemovalImageFilterType::New() );
+    EXERCISE_BASIC_OBJECT_METHODS( pFilter, TemporalZingerRemovalImageFilter, ImageToImageFilter );
+
+    pFilter->SetRadius( ZINGER_RADIUS );
+    TEST_SET_GET_VALUE( static_cast< unsigned int >( ZINGER_RADIUS ), pFilter->GetRadius() );
+    pFilter->SetThresholdLower( 0.5 );
+    TEST_SET_GET_VALUE( 0.5, pFilter->GetThresholdLower() );
+    pFilter->SetThresholdUpper( 1.5 );
+    TEST_SET_GET_VALUE( 1.5, pFilter->GetThresholdUpper() );
+
+    pFilter->SetInput( pStack );
+    TRY_EXPECT_NO_EXCEPTION( pFilter->Update() );
+
+    // The same filter streamed a few projections at a time
+    TemporalZingerRemovalImageFilterType::Pointer pStreamedFilter( TemporalZingerRemovalImageFilterType::New() );
+    pStreamedFilter->SetRadius( ZINGER_RADIUS );
+    pStreamedFilter->SetThresholdLower( 0.5 );
+    pStreamedFilter->SetThresholdUpper( 1.5 );
+    pStreamedFilter->SetInput( pStack );
+
+    StreamingImageFilterType::Pointer pStreamer( StreamingImageFilterType::New() );
+    pStreamer->SetInput( pStreamedFilter->GetOutput() );
+    pStreamer->SetNumberOfStreamDivisions( 9 );
+    TRY_EXPECT_NO_EXCEPTION( pStreamer->Update() );
+
+    itk::ImageRegionConstIterator< StackType > it( pFilter->GetOutput(), pFilter->GetOutput()->GetLargestPossibleRegion() );
+    itk::ImageRegionConstIterator< StackType > itStreamed( pStreamer->GetOutput(), pStreamer->GetOutput()->GetLargestPossibleRegion() );
+
+    itk::SizeValueType uintZingers( 0 );
+    itk::SizeValueType uintReplaced( 0 );
+
+    for( ; !it.IsAtEnd(); ++it, ++itStreamed )
+    {
+        const StackType::IndexType index( it.GetIndex() );
+        const float fltReference( ReferenceValue( pStack, index, 0.5, 1.5 ) );
+
+        if( it.Get() != fltReference || itStreamed.Get() != fltReference )
+        {
+            std::cerr << "Pixel " << index << " is " << it.Get() << ", streamed " << itStreamed.Get() << ", expected " << fltReference << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if( IsZinger( index ) )
+            uintZingers++;
+        if( it.Get() != pStack->GetPixel( index ) )
+            uintReplaced++;
+    }
+
+    // Every zinger and nothing else is replaced
+    TEST_EXPECT_TRUE( uintZingers > 0 );
+    TEST_EXPECT_EQUAL( uintReplaced, uintZingers );
+
+    std::cout << "Test finished." << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -26,6 +26,7 @@
 #define THRESHOLD_LOWER 0.0
 #define THRESHOLD_UPPER 100.0
 #define FILTER_RADIUS 2
+#define PROGRESS_UPDATES 10u
 
 using ImageType = itk::Image< float, 2 >;
 using ThresholdedMedianImageFilterType = itk::ThresholdedMedianImageFilter< ImageType, ImageType >;
@@ -91,6 +92,9 @@ int itkThresholdedMedianImageFilterTest( int argc, char * argv[] )
     pThresholdedMedianImageFilter->SetRadius( radiusFilter );
     TEST_SET_GET_VALUE( radiusFilter, pThresholdedMedianImageFilter->GetRadius() );
 
+    pThresholdedMedianImageFilter->SetNumberOfProgressUpdates( PROGRESS_UPDATES );
+    TEST_SET_GET_VALUE( PROGRESS_UPDATES, pThresholdedMedianImageFilter->GetNumberOfProgressUpdates() );
+
     // Setup writer for output file
     ImageFileWriterType::Pointer pImageFileWriter( ImageFileWriterType::New() );
     pImageFileWriter->SetFileName( argv[2] );